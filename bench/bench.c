@@ -0,0 +1,542 @@
+#include <getopt.h>
+#include "../src/flashlight.c"
+
+/*
+  benchmarks indexing, lookups, scans and searches against a synthetic corpus,
+  and prints the results as json.
+
+  the corpus is generated from a seed, the same options always give the same bytes.
+*/
+
+#define BENCH_SWEEP_MAX 16
+
+static const char* bench_words[] = {
+  "error", "info", "warn", "debug", "request", "took", "user", "session",
+  "GET", "POST", "/api/v1/items", "timeout", "cache", "miss", "hit", "retry"
+};
+
+/** @struct BenchCorpus
+* @brief how to generate a corpus
+* @var BenchCorpus::path
+* where the corpus is written
+* @var BenchCorpus::size
+* the approximate size in bytes
+* @var BenchCorpus::line_min
+* the shortest line, without its newline
+* @var BenchCorpus::line_max
+* the longest line, without its newline
+* @var BenchCorpus::long_every
+* every nth line is a long one (0 for none)
+* @var BenchCorpus::long_len
+* the length of long lines
+* @var BenchCorpus::crlf
+* end lines with \r\n
+* @var BenchCorpus::trailing_newline
+* end the last line with a newline too
+* @var BenchCorpus::seed
+* seeds the generator
+* @var BenchCorpus::bytes
+* the bytes written
+* @var BenchCorpus::lines
+* the lines written
+*/
+typedef struct BenchCorpus
+{
+  char* path;
+  size_t size;
+  size_t line_min;
+  size_t line_max;
+  size_t long_every;
+  size_t long_len;
+  bool crlf;
+  bool trailing_newline;
+  uint64_t seed;
+  size_t bytes;
+  size_t lines;
+} bench_corpus;
+
+/** @struct BenchSweep
+* @brief the values a setting is benchmarked with
+* @var BenchSweep::values
+* the values, in order
+* @var BenchSweep::len
+* the number of values
+*/
+typedef struct BenchSweep
+{
+  size_t values[BENCH_SWEEP_MAX];
+  int len;
+} bench_sweep;
+
+// splitmix64, small and the same everywhere.
+static uint64_t bench_random(uint64_t* state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static int bench_corpus_write(bench_corpus* corpus)
+{
+  FILE* fp = fopen(corpus->path, "wb");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "cannot create %s\n", corpus->path);
+    return -1;
+  }
+
+  size_t max_len = corpus->line_max > corpus->long_len ? corpus->line_max : corpus->long_len;
+  char* line = malloc(max_len + 2);
+  if (line == NULL)
+  {
+    fclose(fp);
+    return -1;
+  }
+
+  const size_t words = sizeof(bench_words) / sizeof(bench_words[0]);
+  const char* newline = corpus->crlf ? "\r\n" : "\n";
+  const size_t newline_len = corpus->crlf ? 2 : 1;
+  uint64_t state = corpus->seed;
+  corpus->bytes = 0;
+  corpus->lines = 0;
+
+  while (corpus->bytes < corpus->size)
+  {
+    size_t len = corpus->line_min;
+    if (corpus->long_every > 0 && corpus->lines % corpus->long_every == corpus->long_every - 1)
+    {
+      len = corpus->long_len;
+    }
+    else if (corpus->line_max > corpus->line_min)
+    {
+      len += bench_random(&state) % (corpus->line_max - corpus->line_min + 1);
+    }
+
+    // words and numbers, so searches have something to find.
+    size_t n = (size_t) snprintf(line, max_len + 1, "%zu ", corpus->lines);
+    while (n < len)
+    {
+      uint64_t r = bench_random(&state);
+      const char* word = bench_words[r % words];
+      n += (size_t) snprintf(line + n, max_len + 1 - n, r & 0x100 ? "%s=%u " : "%s ", word, (unsigned int) (r >> 32) % 10000);
+    }
+    n = len < n ? len : n;
+
+    bool last = corpus->bytes + n + newline_len >= corpus->size;
+    if (fwrite(line, 1, n, fp) != n || ((!last || corpus->trailing_newline) && fwrite(newline, 1, newline_len, fp) != newline_len))
+    {
+      fprintf(stderr, "cannot write %s\n", corpus->path);
+      free(line);
+      fclose(fp);
+      return -1;
+    }
+
+    corpus->bytes += n + (!last || corpus->trailing_newline ? newline_len : 0);
+    corpus->lines++;
+  }
+
+  free(line);
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+// sizes take a K, M or G suffix.
+static size_t bench_size(const char* value)
+{
+  char* end;
+  double size = strtod(value, &end);
+  switch (*end)
+  {
+    case 'k': case 'K': size *= 1024.0; break;
+    case 'm': case 'M': size *= 1024.0 * 1024.0; break;
+    case 'g': case 'G': size *= 1024.0 * 1024.0 * 1024.0; break;
+  }
+  return size > 0 ? (size_t) size : 0;
+}
+
+// a comma separated list of sizes.
+static int bench_sweep_parse(bench_sweep* sweep, const char* value)
+{
+  char* copy = strdup(value);
+  if (copy == NULL)
+  {
+    return -1;
+  }
+
+  sweep->len = 0;
+  char* save;
+  for (char* item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+  {
+    if (sweep->len == BENCH_SWEEP_MAX || bench_size(item) == 0)
+    {
+      fprintf(stderr, "bad sweep value %s\n", item);
+      free(copy);
+      return -1;
+    }
+    sweep->values[sweep->len++] = bench_size(item);
+  }
+
+  free(copy);
+  return sweep->len > 0 ? 0 : -1;
+}
+
+static int bench_compare(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+static double bench_mb_per_sec(size_t bytes, uint64_t ns)
+{
+  return ns > 0 ? (double) bytes / (1024.0 * 1024.0) * 1e9 / (double) ns : 0.0;
+}
+
+static double bench_seconds(uint64_t ns)
+{
+  return (double) ns / 1e9;
+}
+
+/*
+  indexes the corpus once per combination, keeping the fastest of `repeat` runs.
+  the index of the last combination is kept for the other benchmarks.
+*/
+static f_index* bench_index(bench_corpus* corpus, char* lookup_dir, bench_sweep* threads, bench_sweep* concurrency, bench_sweep* buffer_size, size_t max_bytes, int repeat)
+{
+  f_index* kept = NULL;
+  bool first = true;
+
+  printf("  \"index\": [");
+  for (int t=0; t<threads->len; t++)
+  {
+    for (int c=0; c<concurrency->len; c++)
+    {
+      for (int b=0; b<buffer_size->len; b++)
+      {
+        f_stats best;
+        f_stats_init(&best);
+
+        for (int r=0; r<repeat; r++)
+        {
+          f_stats stats;
+          f_stats_init(&stats);
+
+          f_indexer config = {
+            .filename = corpus->path,
+            .lookup_dir = lookup_dir,
+            .threads = (int) threads->values[t],
+            .concurrency = (int) concurrency->values[c],
+            .buffer_size = buffer_size->values[b],
+            .max_bytes_per_iteration = max_bytes,
+            .stats = &stats
+          };
+
+          f_index* index = f_index_text_file(config);
+          if (index == NULL)
+          {
+            fprintf(stderr, "failed to index %s\n", corpus->path);
+            if (kept != NULL)
+            {
+              f_index_free(&kept);
+            }
+            return NULL;
+          }
+
+          if (r == 0 || stats.elapsed_ns < best.elapsed_ns)
+          {
+            memcpy(&best, &stats, sizeof(stats));
+          }
+
+          if (kept != NULL)
+          {
+            f_index_free(&kept);
+          }
+          kept = index;
+        }
+
+        printf("%s\n    {\"threads\": %zu, \"concurrency\": %zu, \"buffer_size\": %zu, \"seconds\": %.6f, \"mb_per_sec\": %.2f, \"lines_per_sec\": %.0f, "
+          "\"reads\": %llu, \"read_ns\": %llu, \"scan_ns\": %llu, \"merge_ns\": %llu, \"peak_rss\": %zu}",
+          first ? "" : ",", threads->values[t], concurrency->values[c], buffer_size->values[b], bench_seconds(best.elapsed_ns),
+          bench_mb_per_sec(corpus->bytes, best.elapsed_ns), best.lines_per_sec, atomic_load(&best.reads), atomic_load(&best.read_ns),
+          atomic_load(&best.scan_ns), atomic_load(&best.merge_ns), best.peak_rss);
+        first = false;
+      }
+    }
+  }
+  printf("\n  ],\n");
+
+  return kept;
+}
+
+// single lines at random, the latency of each one.
+static int bench_lookup(f_index* index, size_t samples, uint64_t seed)
+{
+  size_t lines = f_index_line_count(index);
+  uint64_t* latencies = malloc(sizeof(uint64_t) * samples);
+  if (latencies == NULL || lines == 0)
+  {
+    free(latencies);
+    return -1;
+  }
+
+  uint64_t state = seed;
+  for (size_t i=0; i<samples; i++)
+  {
+    char* data;
+    uint64_t started = f_stats_now();
+    if (f_index_lookup(&data, index, bench_random(&state) % lines, 1) != 0)
+    {
+      fprintf(stderr, "lookup failed\n");
+      free(latencies);
+      return -1;
+    }
+    latencies[i] = f_stats_now() - started;
+    free(data);
+  }
+
+  qsort(latencies, samples, sizeof(uint64_t), bench_compare);
+  printf("  \"lookup\": {\"samples\": %zu, \"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f},\n",
+    samples, latencies[samples * 50 / 100] / 1e3, latencies[samples * 90 / 100] / 1e3, latencies[samples * 99 / 100] / 1e3,
+    latencies[samples * 999 / 1000] / 1e3, latencies[samples - 1] / 1e3);
+
+  free(latencies);
+  return 0;
+}
+
+// every line front to back, `block` lines per read.
+static int bench_scan(f_index* index, size_t bytes, size_t block)
+{
+  size_t lines = f_index_line_count(index);
+  uint64_t started = f_stats_now();
+
+  for (size_t i=0; i<lines; i+=block)
+  {
+    f_index_lines out;
+    if (f_index_lookup_lines(&out, index, i, i + block > lines ? lines - i : block) != 0)
+    {
+      fprintf(stderr, "scan failed at line %zu\n", i);
+      return -1;
+    }
+    f_index_lines_free(&out);
+  }
+
+  uint64_t elapsed = f_stats_now() - started;
+  printf("  \"scan\": {\"block_lines\": %zu, \"seconds\": %.6f, \"mb_per_sec\": %.2f, \"lines_per_sec\": %.0f},\n",
+    block, bench_seconds(elapsed), bench_mb_per_sec(bytes, elapsed), elapsed > 0 ? lines * 1e9 / elapsed : 0.0);
+  return 0;
+}
+
+static int bench_search(f_index* index, size_t bytes, char* regex, bench_sweep* threads, bench_sweep* line_buffer, int repeat)
+{
+  bool first = true;
+
+  printf("  \"search\": [");
+  for (int t=0; t<threads->len; t++)
+  {
+    for (int b=0; b<line_buffer->len; b++)
+    {
+      f_stats best;
+      f_stats_init(&best);
+
+      for (int r=0; r<repeat; r++)
+      {
+        f_stats stats;
+        f_stats_init(&stats);
+
+        f_searcher searcher = {
+          .regex = regex,
+          .index = index,
+          .threads = (int) threads->values[t],
+          .line_buffer = (unsigned int) line_buffer->values[b],
+          .stats = &stats
+        };
+
+        size_t count;
+        if (f_index_search_count(searcher, &count) != 0)
+        {
+          fprintf(stderr, "search for %s failed\n", regex);
+          return -1;
+        }
+
+        if (r == 0 || stats.elapsed_ns < best.elapsed_ns)
+        {
+          memcpy(&best, &stats, sizeof(stats));
+        }
+      }
+
+      printf("%s\n    {\"threads\": %zu, \"line_buffer\": %zu, \"matches\": %llu, \"seconds\": %.6f, \"mb_per_sec\": %.2f, \"lines_per_sec\": %.0f, "
+        "\"read_ns\": %llu, \"match_ns\": %llu}",
+        first ? "" : ",", threads->values[t], line_buffer->values[b], atomic_load(&best.matches), bench_seconds(best.elapsed_ns),
+        bench_mb_per_sec(bytes, best.elapsed_ns), best.lines_per_sec, atomic_load(&best.read_ns), atomic_load(&best.match_ns));
+      first = false;
+    }
+  }
+  printf("\n  ]\n");
+
+  return 0;
+}
+
+static void bench_usage(const char* name)
+{
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  --corpus PATH          benchmark an existing file instead of generating one\n"
+    "  --out PATH             where to generate the corpus (bench.txt)\n"
+    "  --size N               corpus size, with a K, M or G suffix (64M)\n"
+    "  --line-min N           shortest line (20)\n"
+    "  --line-max N           longest line (200)\n"
+    "  --long-every N         every nth line is long (0 for none)\n"
+    "  --long-len N           length of long lines (1M)\n"
+    "  --crlf                 end lines with \\r\\n\n"
+    "  --no-trailing-newline  don't end the last line\n"
+    "  --seed N               generator seed (1)\n"
+    "  --keep                 keep the generated corpus\n"
+    "  --threads LIST         thread counts to sweep (1,2,4,8)\n"
+    "  --concurrency LIST     coroutines per thread to sweep (8)\n"
+    "  --buffer-size LIST     chunk sizes to sweep (1M)\n"
+    "  --max-bytes N          bytes indexed per iteration (1G)\n"
+    "  --line-buffer LIST     lines per search read to sweep (10000)\n"
+    "  --regex REGEX          search term (error=\\d+)\n"
+    "  --lookups N            random lookups (10000)\n"
+    "  --repeat N             runs per combination, the fastest is reported (3)\n",
+    name);
+}
+
+int main(int argc, char** argv)
+{
+  bench_corpus corpus = {
+    .path = "bench.txt",
+    .size = 64u << 20,
+    .line_min = 20,
+    .line_max = 200,
+    .long_every = 0,
+    .long_len = 1u << 20,
+    .crlf = false,
+    .trailing_newline = true,
+    .seed = 1
+  };
+
+  char* existing = NULL;
+  char* regex = "error=\\d+";
+  bool keep = false;
+  size_t max_bytes = 1u << 30;
+  size_t lookups = 10000;
+  int repeat = 3;
+  bench_sweep threads = { .values = { 1, 2, 4, 8 }, .len = 4 };
+  bench_sweep concurrency = { .values = { 8 }, .len = 1 };
+  bench_sweep buffer_size = { .values = { 1u << 20 }, .len = 1 };
+  bench_sweep line_buffer = { .values = { 10000 }, .len = 1 };
+
+  static struct option options[] = {
+    { "corpus", required_argument, NULL, 'c' },
+    { "out", required_argument, NULL, 'o' },
+    { "size", required_argument, NULL, 's' },
+    { "line-min", required_argument, NULL, 'l' },
+    { "line-max", required_argument, NULL, 'L' },
+    { "long-every", required_argument, NULL, 'e' },
+    { "long-len", required_argument, NULL, 'E' },
+    { "crlf", no_argument, NULL, 'r' },
+    { "no-trailing-newline", no_argument, NULL, 'n' },
+    { "seed", required_argument, NULL, 'S' },
+    { "keep", no_argument, NULL, 'k' },
+    { "threads", required_argument, NULL, 't' },
+    { "concurrency", required_argument, NULL, 'C' },
+    { "buffer-size", required_argument, NULL, 'b' },
+    { "max-bytes", required_argument, NULL, 'm' },
+    { "line-buffer", required_argument, NULL, 'B' },
+    { "regex", required_argument, NULL, 'x' },
+    { "lookups", required_argument, NULL, 'u' },
+    { "repeat", required_argument, NULL, 'R' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int opt;
+  int rc = 0;
+  while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 'c': existing = optarg; break;
+      case 'o': corpus.path = optarg; break;
+      case 's': corpus.size = bench_size(optarg); break;
+      case 'l': corpus.line_min = bench_size(optarg); break;
+      case 'L': corpus.line_max = bench_size(optarg); break;
+      case 'e': corpus.long_every = bench_size(optarg); break;
+      case 'E': corpus.long_len = bench_size(optarg); break;
+      case 'r': corpus.crlf = true; break;
+      case 'n': corpus.trailing_newline = false; break;
+      case 'S': corpus.seed = strtoull(optarg, NULL, 10); break;
+      case 'k': keep = true; break;
+      case 't': rc |= bench_sweep_parse(&threads, optarg); break;
+      case 'C': rc |= bench_sweep_parse(&concurrency, optarg); break;
+      case 'b': rc |= bench_sweep_parse(&buffer_size, optarg); break;
+      case 'm': max_bytes = bench_size(optarg); break;
+      case 'B': rc |= bench_sweep_parse(&line_buffer, optarg); break;
+      case 'x': regex = optarg; break;
+      case 'u': lookups = bench_size(optarg); break;
+      case 'R': repeat = atoi(optarg); break;
+      default:
+        bench_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (rc != 0 || corpus.size == 0 || corpus.line_max < corpus.line_min || max_bytes == 0 || lookups == 0 || repeat < 1)
+  {
+    bench_usage(argv[0]);
+    return 1;
+  }
+
+  f_logger_set_level(F_LOG_ERROR);
+
+  uint64_t started = f_stats_now();
+  if (existing != NULL)
+  {
+    struct stat st;
+    if (stat(existing, &st) != 0)
+    {
+      fprintf(stderr, "cannot stat %s\n", existing);
+      return 1;
+    }
+    corpus.path = existing;
+    corpus.bytes = (size_t) st.st_size;
+    keep = true;
+  }
+  else if (bench_corpus_write(&corpus) != 0)
+  {
+    return 1;
+  }
+
+  printf("{\n  \"corpus\": {\"path\": \"%s\", \"generated\": %s, \"bytes\": %zu, \"seconds\": %.6f",
+    corpus.path, existing == NULL ? "true" : "false", corpus.bytes, bench_seconds(f_stats_now() - started));
+  if (existing == NULL)
+  {
+    printf(", \"lines\": %zu, \"line_min\": %zu, \"line_max\": %zu, \"long_every\": %zu, \"long_len\": %zu, \"crlf\": %s, \"trailing_newline\": %s, \"seed\": %llu",
+      corpus.lines, corpus.line_min, corpus.line_max, corpus.long_every, corpus.long_len, corpus.crlf ? "true" : "false",
+      corpus.trailing_newline ? "true" : "false", (unsigned long long) corpus.seed);
+  }
+  printf("},\n");
+
+  f_index* index = bench_index(&corpus, ".flashlight", &threads, &concurrency, &buffer_size, max_bytes, repeat);
+  if (index == NULL)
+  {
+    rc = 1;
+  }
+  else
+  {
+    if (bench_lookup(index, lookups, corpus.seed) != 0 || bench_scan(index, corpus.bytes, line_buffer.values[0]) != 0
+      || bench_search(index, corpus.bytes, regex, &threads, &line_buffer, repeat) != 0)
+    {
+      rc = 1;
+    }
+    f_index_free(&index);
+  }
+  printf("}\n");
+
+  if (!keep)
+  {
+    remove(corpus.path);
+  }
+  return rc;
+}
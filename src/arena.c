@@ -0,0 +1,93 @@
+#ifndef FLASHLIGHT_ARENA
+#define FLASHLIGHT_ARENA
+#include "arena.h"
+
+int f_arena_init(f_arena** out, size_t block_size)
+{
+  f_arena* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    return -1;
+  }
+
+  init->first = NULL;
+  init->current = NULL;
+  init->block_size = block_size > 0 ? block_size : F_ARENA_BLOCK;
+  init->allocated = 0;
+
+  *out = init;
+  return 0;
+}
+
+void* f_arena_alloc(f_arena* arena, size_t size)
+{
+  const size_t align = _Alignof(max_align_t);
+  size = (size + align - 1) & ~(align - 1);
+
+  f_arena_block* block = arena->current;
+  while (block != NULL && block->size - block->used < size)
+  {
+    // blocks kept from a previous round are reused before new ones are made.
+    if (block->next == NULL)
+    {
+      break;
+    }
+    block = block->next;
+    arena->current = block;
+  }
+
+  if (block == NULL || block->size - block->used < size)
+  {
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    f_arena_block* grown = malloc(sizeof(*grown) + block_size);
+    if (grown == NULL)
+    {
+      f_log(F_LOG_ERROR, "cannot grow arena by %zu bytes", block_size);
+      return NULL;
+    }
+
+    grown->size = block_size;
+    grown->used = 0;
+    grown->next = NULL;
+    if (block == NULL)
+    {
+      arena->first = grown;
+    }
+    else
+    {
+      block->next = grown;
+    }
+    arena->current = grown;
+    arena->allocated += block_size;
+    block = grown;
+  }
+
+  void* ptr = (uint8_t*) block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+void f_arena_reset(f_arena* arena)
+{
+  for (f_arena_block* block=arena->first; block != NULL; block=block->next)
+  {
+    block->used = 0;
+  }
+  arena->current = arena->first;
+}
+
+void f_arena_free(f_arena** arenaref)
+{
+  f_arena* arena = *arenaref;
+  f_arena_block* block = arena->first;
+  while (block != NULL)
+  {
+    f_arena_block* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+  *arenaref = NULL;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FLASHLIGHT_ARENA_H
+#define FLASHLIGHT_ARENA_H
+
+/** @file arena.h
+* @brief A bump allocator for the short lived objects of one thread
+*
+* Objects are carved out of large blocks and never freed one by one,
+* the whole arena is reset at once when they are no longer needed.
+* Blocks are kept across resets, so an arena stops calling malloc once it saw its largest round.
+* An arena isn't thread safe, coroutines of the same thread can share one.
+*/
+
+// the default size of a block.
+#define F_ARENA_BLOCK (1 << 20)
+
+/** @struct FArenaBlock
+* @brief a block objects are carved from
+* @var FArenaBlock::next
+* the next block
+* @var FArenaBlock::size
+* the number of usable bytes
+* @var FArenaBlock::used
+* the number of bytes handed out
+* @var FArenaBlock::data
+* the bytes
+*/
+typedef struct FArenaBlock
+{
+  struct FArenaBlock* next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+} f_arena_block;
+
+/** @struct FArena
+* @brief blocks and the one being carved from
+* @var FArena::first
+* the first block
+* @var FArena::current
+* the block objects are carved from
+* @var FArena::block_size
+* the size of new blocks
+* @var FArena::allocated
+* the bytes held by every block
+*/
+typedef struct FArena
+{
+  f_arena_block* first;
+  f_arena_block* current;
+  size_t block_size;
+  size_t allocated;
+} f_arena;
+
+/**
+  Creates an empty arena, blocks are allocated on first use
+  @param out the arena
+  @param block_size the size of a block (0 for F_ARENA_BLOCK)
+  @return non zero for error
+*/
+int f_arena_init(f_arena** out, size_t block_size);
+
+/**
+  Hands out memory aligned for any type, valid until the next reset
+  @param arena the arena
+  @param size the number of bytes
+  @return the memory, NULL for error
+*/
+void* f_arena_alloc(f_arena* arena, size_t size);
+
+/**
+  Takes back everything handed out at once, the blocks are kept for reuse
+  @param arena the arena
+*/
+void f_arena_reset(f_arena* arena);
+
+/**
+  Frees an arena and every block
+  @param arena the arena to free
+*/
+void f_arena_free(f_arena** arena);
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef FLASHLIGHT_BITMAP
+#define FLASHLIGHT_BITMAP
+#include "bitmap.h"
+
+int f_bitmap_init(f_bitmap** out)
+{
+  f_bitmap* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    return -1;
+  }
+
+  init->containers = NULL;
+  init->len = 0;
+  init->cap = 0;
+  init->cardinality = 0;
+
+  *out = init;
+  return 0;
+}
+
+/*
+  binary search for the container with `key`.
+  returns true if found, otherwise `idx` is where it belongs.
+*/
+static bool f_bitmap_find(f_bitmap* bitmap, size_t key, size_t* idx)
+{
+  // ascending adds land on the last container.
+  if (bitmap->len > 0 && bitmap->containers[bitmap->len - 1].key <= key)
+  {
+    bool found = bitmap->containers[bitmap->len - 1].key == key;
+    *idx = found ? bitmap->len - 1 : bitmap->len;
+    return found;
+  }
+
+  size_t lo = 0;
+  size_t hi = bitmap->len;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (bitmap->containers[mid].key < key)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  *idx = lo;
+  return lo < bitmap->len && bitmap->containers[lo].key == key;
+}
+
+static f_bitmap_container* f_bitmap_container_get(f_bitmap* bitmap, size_t key)
+{
+  size_t idx;
+  if (f_bitmap_find(bitmap, key, &idx))
+  {
+    return &bitmap->containers[idx];
+  }
+
+  if (bitmap->len == bitmap->cap)
+  {
+    size_t cap = bitmap->cap == 0 ? 4 : bitmap->cap * 2;
+    f_bitmap_container* containers = realloc(bitmap->containers, sizeof(f_bitmap_container) * cap);
+    if (containers == NULL)
+    {
+      return NULL;
+    }
+
+    bitmap->containers = containers;
+    bitmap->cap = cap;
+  }
+
+  memmove(&bitmap->containers[idx + 1], &bitmap->containers[idx], sizeof(f_bitmap_container) * (bitmap->len - idx));
+  bitmap->len++;
+
+  f_bitmap_container* container = &bitmap->containers[idx];
+  container->key = key;
+  container->cardinality = 0;
+  container->cap = 0;
+  container->array = NULL;
+  container->bits = NULL;
+  return container;
+}
+
+static int f_bitmap_container_to_bits(f_bitmap_container* container)
+{
+  uint64_t* bits = calloc(F_BITMAP_WORDS, sizeof(uint64_t));
+  if (bits == NULL)
+  {
+    return -1;
+  }
+
+  for (unsigned int i=0; i<container->cardinality; i++)
+  {
+    uint16_t low = container->array[i];
+    bits[low >> 6] |= (uint64_t) 1 << (low & 63);
+  }
+
+  free(container->array);
+  container->array = NULL;
+  container->cap = 0;
+  container->bits = bits;
+  return 0;
+}
+
+/*
+  returns 1 if `low` was added, 0 if it was already set.
+*/
+static int f_bitmap_container_add(f_bitmap_container* container, uint16_t low)
+{
+  if (container->bits != NULL)
+  {
+    uint64_t mask = (uint64_t) 1 << (low & 63);
+    if (container->bits[low >> 6] & mask)
+    {
+      return 0;
+    }
+
+    container->bits[low >> 6] |= mask;
+    container->cardinality++;
+    return 1;
+  }
+
+  unsigned int pos = container->cardinality;
+  if (pos > 0 && container->array[pos - 1] >= low)
+  {
+    unsigned int lo = 0;
+    unsigned int hi = container->cardinality;
+    while (lo < hi)
+    {
+      unsigned int mid = (lo + hi) / 2;
+      if (container->array[mid] < low)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+
+    if (container->array[lo] == low)
+    {
+      return 0;
+    }
+    pos = lo;
+  }
+
+  if (container->cardinality == F_BITMAP_ARRAY_MAX)
+  {
+    if (f_bitmap_container_to_bits(container) == -1)
+    {
+      return -1;
+    }
+    return f_bitmap_container_add(container, low);
+  }
+
+  if (container->cardinality == container->cap)
+  {
+    unsigned int cap = container->cap == 0 ? 16 : container->cap * 2;
+    if (cap > F_BITMAP_ARRAY_MAX)
+    {
+      cap = F_BITMAP_ARRAY_MAX;
+    }
+
+    uint16_t* array = realloc(container->array, sizeof(uint16_t) * cap);
+    if (array == NULL)
+    {
+      return -1;
+    }
+
+    container->array = array;
+    container->cap = cap;
+  }
+
+  memmove(&container->array[pos + 1], &container->array[pos], sizeof(uint16_t) * (container->cardinality - pos));
+  container->array[pos] = low;
+  container->cardinality++;
+  return 1;
+}
+
+int f_bitmap_add(f_bitmap* bitmap, size_t line)
+{
+  f_bitmap_container* container = f_bitmap_container_get(bitmap, line >> 16);
+  if (container == NULL)
+  {
+    return -1;
+  }
+
+  int rc = f_bitmap_container_add(container, (uint16_t) (line & 0xFFFF));
+  if (rc == -1)
+  {
+    return -1;
+  }
+
+  bitmap->cardinality += rc;
+  return 0;
+}
+
+bool f_bitmap_contains(f_bitmap* bitmap, size_t line)
+{
+  size_t idx;
+  if (!f_bitmap_find(bitmap, line >> 16, &idx))
+  {
+    return false;
+  }
+
+  f_bitmap_container* container = &bitmap->containers[idx];
+  uint16_t low = (uint16_t) (line & 0xFFFF);
+
+  if (container->bits != NULL)
+  {
+    return (container->bits[low >> 6] >> (low & 63)) & 1;
+  }
+
+  for (unsigned int i=0; i<container->cardinality; i++)
+  {
+    if (container->array[i] >= low)
+    {
+      return container->array[i] == low;
+    }
+  }
+  return false;
+}
+
+/*
+  counts the low bits in [lo, hi) of a single container.
+*/
+static size_t f_bitmap_container_count(f_bitmap_container* container, uint32_t lo, uint32_t hi)
+{
+  if (lo == 0 && hi == 0x10000)
+  {
+    return container->cardinality;
+  }
+
+  size_t count = 0;
+  if (container->bits != NULL)
+  {
+    for (uint32_t i=lo; i<hi; i++)
+    {
+      if ((i & 63) == 0 && i + 64 <= hi)
+      {
+        count += __builtin_popcountll(container->bits[i >> 6]);
+        i += 63;
+        continue;
+      }
+
+      count += (container->bits[i >> 6] >> (i & 63)) & 1;
+    }
+    return count;
+  }
+
+  for (unsigned int i=0; i<container->cardinality; i++)
+  {
+    if (container->array[i] >= hi)
+    {
+      break;
+    }
+
+    if (container->array[i] >= lo)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t f_bitmap_count_range(f_bitmap* bitmap, size_t start, size_t end)
+{
+  if (start >= end)
+  {
+    return 0;
+  }
+
+  size_t count = 0;
+  size_t idx;
+  f_bitmap_find(bitmap, start >> 16, &idx);
+
+  for (; idx<bitmap->len; idx++)
+  {
+    f_bitmap_container* container = &bitmap->containers[idx];
+    size_t base = container->key << 16;
+    if (base >= end)
+    {
+      break;
+    }
+
+    uint32_t lo = start > base ? (uint32_t) (start - base) : 0;
+    uint32_t hi = end - base >= 0x10000 ? 0x10000 : (uint32_t) (end - base);
+    count += f_bitmap_container_count(container, lo, hi);
+  }
+
+  return count;
+}
+
+bool f_bitmap_next(f_bitmap* bitmap, size_t from, size_t* out)
+{
+  size_t idx;
+  f_bitmap_find(bitmap, from >> 16, &idx);
+
+  for (; idx<bitmap->len; idx++)
+  {
+    f_bitmap_container* container = &bitmap->containers[idx];
+    size_t base = container->key << 16;
+    uint32_t lo = from > base ? (uint32_t) (from - base) : 0;
+
+    if (container->bits != NULL)
+    {
+      for (uint32_t i=lo; i<0x10000; i++)
+      {
+        uint64_t word = container->bits[i >> 6] >> (i & 63);
+        if (word == 0)
+        {
+          // skip to the next word.
+          i |= 63;
+          continue;
+        }
+
+        *out = base + i + __builtin_ctzll(word);
+        return true;
+      }
+      continue;
+    }
+
+    for (unsigned int i=0; i<container->cardinality; i++)
+    {
+      if (container->array[i] >= lo)
+      {
+        *out = base + container->array[i];
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+int f_bitmap_merge(f_bitmap* bitmap, f_bitmap* other)
+{
+  for (size_t c=0; c<other->len; c++)
+  {
+    f_bitmap_container* from = &other->containers[c];
+    f_bitmap_container* to = f_bitmap_container_get(bitmap, from->key);
+    if (to == NULL)
+    {
+      return -1;
+    }
+
+    if (from->bits != NULL)
+    {
+      if (to->bits == NULL && f_bitmap_container_to_bits(to) == -1)
+      {
+        return -1;
+      }
+
+      unsigned int cardinality = 0;
+      for (int w=0; w<F_BITMAP_WORDS; w++)
+      {
+        to->bits[w] |= from->bits[w];
+        cardinality += __builtin_popcountll(to->bits[w]);
+      }
+
+      bitmap->cardinality += cardinality - to->cardinality;
+      to->cardinality = cardinality;
+      continue;
+    }
+
+    for (unsigned int i=0; i<from->cardinality; i++)
+    {
+      int rc = f_bitmap_container_add(to, from->array[i]);
+      if (rc == -1)
+      {
+        return -1;
+      }
+      bitmap->cardinality += rc;
+    }
+  }
+
+  return 0;
+}
+
+void f_bitmap_free(f_bitmap** bitmap)
+{
+  f_bitmap* b = *bitmap;
+  for (size_t i=0; i<b->len; i++)
+  {
+    free(b->containers[i].array);
+    free(b->containers[i].bits);
+  }
+
+  free(b->containers);
+  free(b);
+  *bitmap = NULL;
+}
+
+#endif
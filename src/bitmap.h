@@ -0,0 +1,115 @@
+#ifndef FLASHLIGHT_BITMAP_H
+#define FLASHLIGHT_BITMAP_H
+
+/** @file bitmap.h
+* @brief A compressed set of line numbers
+*
+* Line numbers are split into a high key and a low 16 bits, roaring style.
+* Each key owns a container that stores the low bits as a sorted array
+* while it is sparse, and as a 65536 bit bitset once it is dense.
+*/
+
+#define F_BITMAP_ARRAY_MAX 4096
+#define F_BITMAP_WORDS 1024
+
+/** @struct FBitmapContainer
+* @brief the line numbers that share the same high bits
+* @var FBitmapContainer::key
+* the high bits (line number >> 16)
+* @var FBitmapContainer::cardinality
+* the number of line numbers in this container
+* @var FBitmapContainer::cap
+* the capacity of the array (unused for a bitset)
+* @var FBitmapContainer::array
+* sorted low bits (NULL once the container is a bitset)
+* @var FBitmapContainer::bits
+* a bitset of low bits (NULL while the container is an array)
+*/
+typedef struct FBitmapContainer
+{
+  size_t key;
+  unsigned int cardinality;
+  unsigned int cap;
+  uint16_t* array;
+  uint64_t* bits;
+} f_bitmap_container;
+
+/** @struct FBitmap
+* @brief a set of line numbers
+* @var FBitmap::containers
+* containers sorted by key
+* @var FBitmap::len
+* the number of containers
+* @var FBitmap::cap
+* the capacity of the containers array
+* @var FBitmap::cardinality
+* the number of line numbers in the set
+*/
+typedef struct FBitmap
+{
+  f_bitmap_container* containers;
+  size_t len;
+  size_t cap;
+  size_t cardinality;
+} f_bitmap;
+
+/**
+  Initializes an empty bitmap
+  @param out the bitmap to init
+  @return non zero for error
+*/
+int f_bitmap_init(f_bitmap** out);
+
+/**
+  Adds a line number to the bitmap
+
+  Adding in ascending order is the fast path.
+  @param bitmap the bitmap
+  @param line the line number to add
+  @return non zero for error
+*/
+int f_bitmap_add(f_bitmap* bitmap, size_t line);
+
+/**
+  Checks if a line number is in the bitmap
+  @param bitmap the bitmap
+  @param line the line number to check
+  @return true if the line number is set
+*/
+bool f_bitmap_contains(f_bitmap* bitmap, size_t line);
+
+/**
+  Counts the line numbers in [start, end)
+
+  Useful for building a histogram without walking every line.
+  @param bitmap the bitmap
+  @param start the first line number to count
+  @param end the line number to stop at
+  @return the number of line numbers in the range
+*/
+size_t f_bitmap_count_range(f_bitmap* bitmap, size_t start, size_t end);
+
+/**
+  Finds the first line number that is greater or equal to `from`
+  @param bitmap the bitmap
+  @param from the line number to start from
+  @param out the line number found
+  @return true if a line number was found
+*/
+bool f_bitmap_next(f_bitmap* bitmap, size_t from, size_t* out);
+
+/**
+  Adds every line number of `other` to `bitmap`
+  @param bitmap the bitmap to merge into
+  @param other the bitmap to merge
+  @return non zero for error
+*/
+int f_bitmap_merge(f_bitmap* bitmap, f_bitmap* other);
+
+/**
+  Free a bitmap
+  @param bitmap the bitmap to free
+*/
+void f_bitmap_free(f_bitmap** bitmap);
+
+#endif
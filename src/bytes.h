@@ -8,6 +8,9 @@
 * This allows for indexing parts of a file to later be recombined into a single FNode
 */
 
+// set on the offsets of non atomic bytes written to a lookup file, until they are resolved.
+#define F_BYTES_TAG ((size_t) 1 << (sizeof(size_t) * 8 - 1))
+
 /** @struct FBytes
 * @brief representation of the start of a file unit to index
 * @var FBytes::atomic 
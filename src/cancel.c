@@ -0,0 +1,115 @@
+#ifndef FLASHLIGHT_CANCEL
+#define FLASHLIGHT_CANCEL
+#include <time.h>
+#include "cancel.h"
+
+int f_cancel_init(f_cancel** out)
+{
+  f_cancel* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    return -1;
+  }
+
+  atomic_init(&init->cancelled, false);
+  *out = init;
+  return 0;
+}
+
+void f_cancel_request(f_cancel* cancel)
+{
+  atomic_store(&cancel->cancelled, true);
+}
+
+bool f_cancel_requested(f_cancel* cancel)
+{
+  return atomic_load(&cancel->cancelled);
+}
+
+void f_cancel_reset(f_cancel* cancel)
+{
+  atomic_store(&cancel->cancelled, false);
+}
+
+void f_cancel_free(f_cancel** cancel)
+{
+  free(*cancel);
+  *cancel = NULL;
+}
+
+static long long f_cancel_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void f_cancel_state_init(f_cancel_state* state, f_cancel* cancel, unsigned long timeout_ms)
+{
+  state->cancel = cancel;
+  state->deadline = timeout_ms == 0 ? 0 : f_cancel_now() + (long long) timeout_ms * 1000000ll;
+  atomic_init(&state->reason, F_CANCEL_NONE);
+}
+
+/*
+  keeps the first reason, so a deadline
+  isn't reported as a failure of another thread.
+*/
+static enum F_CANCEL_REASON f_cancel_state_set(f_cancel_state* state, enum F_CANCEL_REASON reason)
+{
+  int expected = F_CANCEL_NONE;
+  if (atomic_compare_exchange_strong(&state->reason, &expected, reason))
+  {
+    return reason;
+  }
+
+  return (enum F_CANCEL_REASON) expected;
+}
+
+enum F_CANCEL_REASON f_cancel_state_poll(f_cancel_state* state)
+{
+  enum F_CANCEL_REASON reason = atomic_load(&state->reason);
+  if (reason != F_CANCEL_NONE)
+  {
+    return reason;
+  }
+
+  if (state->cancel != NULL && atomic_load(&state->cancel->cancelled))
+  {
+    f_log(F_LOG_INFO, "operation cancelled");
+    return f_cancel_state_set(state, F_CANCEL_REQUESTED);
+  }
+
+  if (state->deadline != 0 && f_cancel_now() >= state->deadline)
+  {
+    f_log(F_LOG_INFO, "operation deadline passed");
+    return f_cancel_state_set(state, F_CANCEL_DEADLINE);
+  }
+
+  return F_CANCEL_NONE;
+}
+
+void f_cancel_state_fail(f_cancel_state* state)
+{
+  f_cancel_state_set(state, F_CANCEL_FAILED);
+}
+
+void f_cancel_state_errno(f_cancel_state* state)
+{
+  switch (atomic_load(&state->reason))
+  {
+    case F_CANCEL_REQUESTED: {
+      errno = ECANCELED;
+      break;
+    }
+    case F_CANCEL_DEADLINE: {
+      errno = ETIMEDOUT;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef FLASHLIGHT_CANCEL_H
+#define FLASHLIGHT_CANCEL_H
+
+/** @file cancel.h
+* @brief Cooperative cancellation for searches and indexing
+*
+* Threads check for cancellation between buffers,
+* so a cancelled operation stops within one buffer per thread.
+*/
+
+/**
+* @brief the return code of a cancelled search
+*/
+#define F_CANCELLED -3
+
+/**
+* @brief why an operation stopped early
+*/
+enum F_CANCEL_REASON
+{
+  F_CANCEL_NONE = 0, /**< still running */
+  F_CANCEL_REQUESTED, /**< the token was cancelled */
+  F_CANCEL_DEADLINE, /**< the deadline passed */
+  F_CANCEL_FAILED /**< another thread of the operation failed */
+};
+
+/** @struct FCancel
+* @brief a cancellation token owned by the caller
+*
+* The same token can be shared between several operations,
+* cancelling it stops all of them.
+* @var FCancel::cancelled
+* true once cancellation was requested
+*/
+typedef struct FCancel
+{
+  atomic_bool cancelled;
+} f_cancel;
+
+/** @struct FCancelState
+* @brief the cancellation state of a single operation
+* @var FCancelState::cancel
+* the caller's token (NULL if unused)
+* @var FCancelState::deadline
+* the monotonic deadline in nanoseconds (0 if unused)
+* @var FCancelState::reason
+* why the operation stopped, sticky once set
+*/
+typedef struct FCancelState
+{
+  f_cancel* cancel;
+  long long deadline;
+  atomic_int reason;
+} f_cancel_state;
+
+/**
+  Initializes a new cancellation token
+  @param out the token to init
+  @return non zero for error
+*/
+int f_cancel_init(f_cancel** out);
+
+/**
+  Requests cancellation of every operation using the token
+  @param cancel the token
+*/
+void f_cancel_request(f_cancel* cancel);
+
+/**
+  Checks if cancellation was requested
+  @param cancel the token
+  @return true if cancelled
+*/
+bool f_cancel_requested(f_cancel* cancel);
+
+/**
+  Clears the token so it can be reused
+  @param cancel the token
+*/
+void f_cancel_reset(f_cancel* cancel);
+
+/**
+  Free a cancellation token
+  @param cancel the token to free
+*/
+void f_cancel_free(f_cancel** cancel);
+
+/**
+  Starts tracking cancellation for an operation
+  @param state the state to init
+  @param cancel the caller's token (NULL if unused)
+  @param timeout_ms milliseconds from now until the deadline (0 for no deadline)
+*/
+void f_cancel_state_init(f_cancel_state* state, f_cancel* cancel, unsigned long timeout_ms);
+
+/**
+  Checks the token and the deadline
+  @param state the operation's state
+  @return F_CANCEL_NONE if the operation should keep going
+*/
+enum F_CANCEL_REASON f_cancel_state_poll(f_cancel_state* state);
+
+/**
+  Stops the operation because one of its threads failed
+  @param state the operation's state
+*/
+void f_cancel_state_fail(f_cancel_state* state);
+
+/**
+  Sets errno for a stopped operation
+  
+  ECANCELED if the token was cancelled, ETIMEDOUT if the deadline passed.
+  @param state the operation's state
+*/
+void f_cancel_state_errno(f_cancel_state* state);
+
+#endif
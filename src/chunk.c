@@ -14,6 +14,7 @@ int f_chunk_new(f_chunk** out, unsigned long int current, f_bytes_node* firstref
   init->first = firstref;
   init->last = lastref;
   init->line_count = 0;
+  init->pooled = false;
   if (firstref != NULL)
   {
     init->empty = false;
@@ -41,7 +42,10 @@ void f_chunk_free(f_chunk** chunk)
 */
 void f_chunk_free_all(f_chunk* chunk)
 {
-  f_bytes_node_free(&chunk->first);
+  if (!chunk->pooled)
+  {
+    f_bytes_node_free(&chunk->first);
+  }
   f_chunk_free(&chunk);
 }
 
@@ -88,6 +92,7 @@ int f_chunk_array_reverse_reduce(f_chunk** out, int idx, f_chunk** chunks, size_
     if (current == NULL)
     {
       current = chunks[i]->first;
+      result->first = chunks[i]->first;
 
       if (head)
       {
@@ -109,6 +114,7 @@ int f_chunk_array_reverse_reduce(f_chunk** out, int idx, f_chunk** chunks, size_
   }
 
   result->empty = empty;
+  result->pooled = len > 0 && chunks[0]->pooled;
   result->current = idx;
   *out = result;
   return 0;
@@ -16,6 +16,8 @@
 * true if the chunk doesn't have an FBytesNode
 * @var FChunk::line_count
 * the count of offsets used in this chunk
+* @var FChunk::pooled
+* true if its FBytesNode are in an arena, and are freed when the arena is reset
 */
 typedef struct FChunk
 {
@@ -24,6 +26,7 @@ typedef struct FChunk
   f_bytes_node* last;
   bool empty;
   unsigned int line_count;
+  bool pooled;
 } f_chunk;
 
 /**
@@ -42,7 +45,7 @@ int f_chunk_new(f_chunk** out, unsigned long int current, f_bytes_node* firstref
 void f_chunk_free(f_chunk** chunk);
 
 /**
-  Free a chunk and the FBytesNode in it.
+  Free a chunk and the FBytesNode in it, unless they are pooled.
   @param chunk the chunk to free
 */
 void f_chunk_free_all(f_chunk* chunk);
@@ -0,0 +1,1121 @@
+#ifndef FLASHLIGHT_COMPRESS
+#define FLASHLIGHT_COMPRESS
+
+#include "compress.h"
+#include <string.h>
+#include <limits.h>
+#include <zlib.h>
+#include <zstd.h>
+
+enum F_COMPRESSION f_compressed_detect(int fd)
+{
+  uint8_t magic[4];
+  if (pread(fd, magic, sizeof(magic), 0) != (ssize_t) sizeof(magic))
+  {
+    return F_COMPRESSION_NONE;
+  }
+
+  if (magic[0] == 0x1f && magic[1] == 0x8b)
+  {
+    return F_COMPRESSION_GZIP;
+  }
+
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+  {
+    return F_COMPRESSION_ZSTD;
+  }
+
+  return F_COMPRESSION_NONE;
+}
+
+/*
+  adds a checkpoint, `ring` is the window being decompressed into with `left` bytes not written yet.
+*/
+static int f_compressed_point(f_compressed* compressed, size_t out, size_t in, int bits, const uint8_t* ring, size_t left)
+{
+  // a member or frame that decompressed to nothing starts where the next one does.
+  if (ring == NULL && compressed->len > 0)
+  {
+    f_compress_point* last = &compressed->points[compressed->len - 1];
+    if (last->out == out && last->window == NULL)
+    {
+      last->in = in;
+      return 0;
+    }
+  }
+
+  if (compressed->len == compressed->cap)
+  {
+    size_t cap = compressed->cap == 0 ? 64 : compressed->cap * 2;
+    f_compress_point* points = realloc(compressed->points, sizeof(f_compress_point) * cap);
+    if (points == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant grow compression checkpoints");
+      return -1;
+    }
+    compressed->points = points;
+    compressed->cap = cap;
+  }
+
+  f_compress_point* point = &compressed->points[compressed->len];
+  point->out = out;
+  point->in = in;
+  point->bits = bits;
+  point->window = NULL;
+
+  if (ring != NULL)
+  {
+    point->window = malloc(sizeof(uint8_t) * F_COMPRESS_WINDOW);
+    if (point->window == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant allocate compression window");
+      return -1;
+    }
+
+    // the ring wraps at the next byte to write, the oldest bytes come first.
+    if (left > 0)
+    {
+      memcpy(point->window, ring + F_COMPRESS_WINDOW - left, left);
+    }
+    if (left < F_COMPRESS_WINDOW)
+    {
+      memcpy(point->window + left, ring, F_COMPRESS_WINDOW - left);
+    }
+  }
+
+  compressed->len++;
+  return 0;
+}
+
+static int f_compressed_build_gzip(f_compressed* compressed, size_t span, f_compressed_cb on_data, void* payload)
+{
+  uint8_t* input = malloc(sizeof(uint8_t) * F_COMPRESS_READ);
+  uint8_t* ring = calloc(F_COMPRESS_WINDOW, sizeof(uint8_t));
+  if (input == NULL || ring == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate gzip buffers");
+    free(input);
+    free(ring);
+    return -1;
+  }
+
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  // 47 reads a gzip or zlib header.
+  if (inflateInit2(&strm, 47) != Z_OK)
+  {
+    f_log(F_LOG_ERROR, "cant init inflate");
+    free(input);
+    free(ring);
+    return -1;
+  }
+
+  int rc = f_compressed_point(compressed, 0, 0, 0, NULL, 0);
+  int ret = Z_OK;
+  size_t read_at = 0;
+  size_t total_in = 0;
+  size_t total_out = 0;
+  size_t last = 0;
+  strm.avail_out = 0;
+
+  while (rc == 0)
+  {
+    ssize_t bytes_read = pread(compressed->fd, input, F_COMPRESS_READ, (off_t) read_at);
+    if (bytes_read < 0)
+    {
+      perror("cant read gzip target");
+      rc = -1;
+      break;
+    }
+
+    if (bytes_read == 0)
+    {
+      if (ret != Z_STREAM_END)
+      {
+        f_log(F_LOG_ERROR, "gzip target is truncated");
+        rc = -1;
+      }
+      break;
+    }
+
+    read_at += (size_t) bytes_read;
+    strm.next_in = input;
+    strm.avail_in = (uInt) bytes_read;
+
+    while (rc == 0 && strm.avail_in != 0)
+    {
+      // another member follows the one that ended.
+      if (ret == Z_STREAM_END)
+      {
+        inflateReset(&strm);
+        rc = f_compressed_point(compressed, total_out, total_in, 0, NULL, 0);
+        last = total_out;
+      }
+
+      if (strm.avail_out == 0)
+      {
+        strm.next_out = ring;
+        strm.avail_out = F_COMPRESS_WINDOW;
+      }
+
+      uint8_t* produced = strm.next_out;
+      total_in += strm.avail_in;
+      total_out += strm.avail_out;
+      ret = inflate(&strm, Z_BLOCK);
+      total_in -= strm.avail_in;
+      total_out -= strm.avail_out;
+
+      if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+      {
+        f_log(F_LOG_ERROR, "gzip target is corrupt at %zu", total_in);
+        rc = -1;
+        break;
+      }
+
+      size_t produced_len = (size_t) (strm.next_out - produced);
+      if (produced_len > 0 && on_data != NULL)
+      {
+        rc = on_data(payload, produced, produced_len, total_out - produced_len, NULL);
+        if (rc != 0)
+        {
+          break;
+        }
+      }
+
+      // the end of a deflate block that isn't the last one can be resumed from.
+      if (ret != Z_STREAM_END && (strm.data_type & 128) && !(strm.data_type & 64) && total_out - last > span)
+      {
+        rc = f_compressed_point(compressed, total_out, total_in, strm.data_type & 7, ring, strm.avail_out);
+        last = total_out;
+      }
+    }
+  }
+
+  inflateEnd(&strm);
+  free(input);
+  free(ring);
+  compressed->size = total_out;
+  return rc;
+}
+
+static int f_compressed_build_zstd(f_compressed* compressed, f_compressed_cb on_data, void* payload)
+{
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  size_t input_size = ZSTD_DStreamInSize();
+  size_t output_size = ZSTD_DStreamOutSize();
+  uint8_t* input = malloc(sizeof(uint8_t) * input_size);
+  uint8_t* output = malloc(sizeof(uint8_t) * output_size);
+  if (dctx == NULL || input == NULL || output == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate zstd buffers");
+    ZSTD_freeDCtx(dctx);
+    free(input);
+    free(output);
+    return -1;
+  }
+
+  int rc = 0;
+  size_t ret = 0;
+  size_t read_at = 0;
+  size_t total_out = 0;
+  bool frame_start = true;
+
+  while (rc == 0)
+  {
+    ssize_t bytes_read = pread(compressed->fd, input, input_size, (off_t) read_at);
+    if (bytes_read < 0)
+    {
+      perror("cant read zstd target");
+      rc = -1;
+      break;
+    }
+
+    if (bytes_read == 0)
+    {
+      if (ret != 0)
+      {
+        f_log(F_LOG_ERROR, "zstd target is truncated");
+        rc = -1;
+      }
+      break;
+    }
+
+    ZSTD_inBuffer in = { input, (size_t) bytes_read, 0 };
+    bool pending = false;
+    while (rc == 0 && (in.pos < in.size || pending))
+    {
+      if (frame_start && in.pos < in.size)
+      {
+        rc = f_compressed_point(compressed, total_out, read_at + in.pos, 0, NULL, 0);
+        frame_start = false;
+      }
+
+      ZSTD_outBuffer out = { output, output_size, 0 };
+      ret = ZSTD_decompressStream(dctx, &out, &in);
+      if (ZSTD_isError(ret))
+      {
+        f_log(F_LOG_ERROR, "zstd target is corrupt: %s", ZSTD_getErrorName(ret));
+        rc = -1;
+        break;
+      }
+
+      if (out.pos > 0 && on_data != NULL)
+      {
+        rc = on_data(payload, output, out.pos, total_out, NULL);
+      }
+      total_out += out.pos;
+
+      // a full output can leave bytes in the context.
+      pending = out.pos == out.size;
+      frame_start = ret == 0;
+    }
+
+    read_at += (size_t) bytes_read;
+  }
+
+  ZSTD_freeDCtx(dctx);
+  free(input);
+  free(output);
+  compressed->size = total_out;
+
+  if (rc == 0 && compressed->len == 1 && total_out > F_COMPRESS_CACHE_MAX)
+  {
+    f_log(F_LOG_WARN, "zstd target is a single frame, every read decompresses it from the start");
+  }
+  return rc;
+}
+
+static int f_compressed_build_stream(f_compressed* compressed, size_t span, f_compressed_cb on_data, void* payload)
+{
+  switch (compressed->kind)
+  {
+    case F_COMPRESSION_GZIP:
+      return f_compressed_build_gzip(compressed, span == 0 ? F_COMPRESS_DEFAULT_SPAN : span, on_data, payload);
+    case F_COMPRESSION_ZSTD:
+      return f_compressed_build_zstd(compressed, on_data, payload);
+    default:
+      f_log(F_LOG_ERROR, "target isn't compressed");
+      return -1;
+  }
+}
+
+/*
+  the size of the zstd frame at `offset`, from its block headers, without decompressing it.
+*/
+static int f_compressed_zstd_frame(int fd, size_t file_size, size_t offset, size_t* len)
+{
+  // a frame header is at most 18 bytes.
+  uint8_t header[18];
+  ssize_t bytes_read = pread(fd, header, sizeof(header), (off_t) offset);
+  if (bytes_read < 8)
+  {
+    return -1;
+  }
+
+  uint32_t magic = (uint32_t) header[0] | (uint32_t) header[1] << 8 | (uint32_t) header[2] << 16 | (uint32_t) header[3] << 24;
+  if ((magic & 0xfffffff0u) == 0x184d2a50u)
+  {
+    // skippable frames hold their size after the magic.
+    *len = 8 + ((size_t) header[4] | (size_t) header[5] << 8 | (size_t) header[6] << 16 | (size_t) header[7] << 24);
+    return offset + *len <= file_size ? 0 : -1;
+  }
+
+  if (magic != 0xfd2fb528u)
+  {
+    return -1;
+  }
+
+  static const size_t dict_sizes[] = { 0, 1, 2, 4 };
+  static const size_t content_sizes[] = { 0, 2, 4, 8 };
+  uint8_t descriptor = header[4];
+  bool single_segment = (descriptor >> 5) & 1;
+  bool checksum = (descriptor >> 2) & 1;
+  size_t content_size = (descriptor >> 6) == 0 && single_segment ? 1 : content_sizes[descriptor >> 6];
+  size_t pos = offset + 5 + (single_segment ? 0 : 1) + dict_sizes[descriptor & 3] + content_size;
+
+  bool last = false;
+  while (!last)
+  {
+    uint8_t block[3];
+    if (pread(fd, block, sizeof(block), (off_t) pos) != (ssize_t) sizeof(block))
+    {
+      return -1;
+    }
+
+    uint32_t block_header = (uint32_t) block[0] | (uint32_t) block[1] << 8 | (uint32_t) block[2] << 16;
+    uint32_t type = (block_header >> 1) & 3;
+    last = block_header & 1;
+    if (type == 3)
+    {
+      return -1;
+    }
+
+    // an rle block holds a single byte.
+    pos += sizeof(block) + (type == 1 ? 1 : block_header >> 3);
+  }
+
+  pos += checksum ? 4 : 0;
+  if (pos > file_size)
+  {
+    return -1;
+  }
+
+  *len = pos - offset;
+  return 0;
+}
+
+/*
+  the size of the bgzf member at `offset`, from the block size in its extra field.
+*/
+static int f_compressed_bgzf_member(int fd, size_t offset, size_t* len)
+{
+  uint8_t header[12 + 256];
+  ssize_t bytes_read = pread(fd, header, sizeof(header), (off_t) offset);
+  if (bytes_read < 12 || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 4))
+  {
+    return -1;
+  }
+
+  size_t extra_len = (size_t) header[10] | (size_t) header[11] << 8;
+  if (12 + extra_len > (size_t) bytes_read)
+  {
+    return -1;
+  }
+
+  const uint8_t* extra = header + 12;
+  for (size_t i=0; i + 4 <= extra_len;)
+  {
+    size_t field_len = (size_t) extra[i + 2] | (size_t) extra[i + 3] << 8;
+    if (extra[i] == 'B' && extra[i + 1] == 'C' && field_len == 2 && i + 6 <= extra_len)
+    {
+      *len = ((size_t) extra[i + 4] | (size_t) extra[i + 5] << 8) + 1;
+      return 0;
+    }
+    i += 4 + field_len;
+  }
+
+  return -1;
+}
+
+/*
+  finds the frames of a target that can be decompressed on their own.
+  0 if there are less than two, or they can't be found without decompressing the target.
+*/
+static size_t f_compressed_frames(f_compressed* compressed, f_compress_frame** out)
+{
+  struct stat st;
+  if (fstat(compressed->fd, &st) == -1)
+  {
+    return 0;
+  }
+
+  size_t file_size = (size_t) st.st_size;
+  f_compress_frame* frames = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+  size_t offset = 0;
+  while (offset < file_size)
+  {
+    size_t frame_len;
+    int rc = compressed->kind == F_COMPRESSION_ZSTD
+      ? f_compressed_zstd_frame(compressed->fd, file_size, offset, &frame_len)
+      : f_compressed_bgzf_member(compressed->fd, offset, &frame_len);
+    if (rc != 0 || frame_len > F_COMPRESS_FRAME_MAX)
+    {
+      f_log(F_LOG_DEBUG, "target can't be split at %zu, decompressing a single stream", offset);
+      free(frames);
+      return 0;
+    }
+
+    if (len == cap)
+    {
+      cap = cap == 0 ? 64 : cap * 2;
+      f_compress_frame* grown = realloc(frames, sizeof(f_compress_frame) * cap);
+      if (grown == NULL)
+      {
+        free(frames);
+        return 0;
+      }
+      frames = grown;
+    }
+
+    frames[len].in = offset;
+    frames[len].len = frame_len;
+    frames[len].data = NULL;
+    frames[len].out_len = 0;
+    frames[len].result = NULL;
+    frames[len].done = false;
+    len++;
+    offset += frame_len;
+  }
+
+  if (len < 2)
+  {
+    free(frames);
+    return 0;
+  }
+
+  *out = frames;
+  return len;
+}
+
+static int f_compressed_grow(uint8_t** data, size_t* cap)
+{
+  uint8_t* grown = realloc(*data, sizeof(uint8_t) * *cap * 2);
+  if (grown == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant grow decompressed frame");
+    return -1;
+  }
+
+  *data = grown;
+  *cap *= 2;
+  return 0;
+}
+
+/*
+  decompresses a whole frame into memory.
+*/
+static int f_compressed_frame_decode(f_compressed* compressed, f_compress_frame* frame)
+{
+  uint8_t* input = malloc(sizeof(uint8_t) * (frame->len > 0 ? frame->len : 1));
+  size_t cap = frame->len * 4 + 64;
+  uint8_t* data = malloc(sizeof(uint8_t) * cap);
+  if (input == NULL || data == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate frame buffers");
+    free(input);
+    free(data);
+    return -1;
+  }
+
+  if (pread(compressed->fd, input, frame->len, (off_t) frame->in) != (ssize_t) frame->len)
+  {
+    perror("cant read compressed frame");
+    free(input);
+    free(data);
+    return -1;
+  }
+
+  int rc = 0;
+  size_t size = 0;
+  if (compressed->kind == F_COMPRESSION_ZSTD)
+  {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in = { input, frame->len, 0 };
+    bool pending = false;
+    while (dctx != NULL && rc == 0 && (in.pos < in.size || pending))
+    {
+      if (size == cap && f_compressed_grow(&data, &cap) != 0)
+      {
+        rc = -1;
+        break;
+      }
+
+      ZSTD_outBuffer out = { data + size, cap - size, 0 };
+      size_t ret = ZSTD_decompressStream(dctx, &out, &in);
+      if (ZSTD_isError(ret))
+      {
+        f_log(F_LOG_ERROR, "zstd frame at %zu is corrupt: %s", frame->in, ZSTD_getErrorName(ret));
+        rc = -1;
+        break;
+      }
+
+      size += out.pos;
+      pending = out.pos == out.size;
+    }
+    rc = dctx == NULL ? -1 : rc;
+    ZSTD_freeDCtx(dctx);
+  }
+  else
+  {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    rc = inflateInit2(&strm, 31) == Z_OK ? 0 : -1;
+    strm.next_in = input;
+    strm.avail_in = (uInt) frame->len;
+    while (rc == 0)
+    {
+      if (size == cap && f_compressed_grow(&data, &cap) != 0)
+      {
+        rc = -1;
+        break;
+      }
+
+      size_t room = cap - size;
+      strm.next_out = data + size;
+      strm.avail_out = (uInt) (room > UINT_MAX ? UINT_MAX : room);
+      uInt before = strm.avail_out;
+      int ret = inflate(&strm, Z_NO_FLUSH);
+      size += before - strm.avail_out;
+      if (ret == Z_STREAM_END)
+      {
+        break;
+      }
+
+      if ((ret != Z_OK && ret != Z_BUF_ERROR) || (ret == Z_BUF_ERROR && strm.avail_in == 0))
+      {
+        f_log(F_LOG_ERROR, "gzip member at %zu is corrupt", frame->in);
+        rc = -1;
+      }
+    }
+    inflateEnd(&strm);
+  }
+
+  free(input);
+  if (rc != 0)
+  {
+    free(data);
+    return -1;
+  }
+
+  frame->data = data;
+  frame->out_len = size;
+  return 0;
+}
+
+static void* f_compressed_worker(void* payload)
+{
+  f_compress_pipeline* pipeline = payload;
+
+  pthread_mutex_lock(&pipeline->lock);
+  while (true)
+  {
+    // stay within the window, so frames in flight are bounded.
+    while (!pipeline->stop && pipeline->next < pipeline->len && pipeline->next >= pipeline->consumed + pipeline->window)
+    {
+      pthread_cond_wait(&pipeline->ready, &pipeline->lock);
+    }
+
+    if (pipeline->stop || pipeline->next >= pipeline->len)
+    {
+      break;
+    }
+
+    f_compress_frame* frame = &pipeline->frames[pipeline->next++];
+    pthread_mutex_unlock(&pipeline->lock);
+
+    int rc = f_compressed_frame_decode(pipeline->compressed, frame);
+    if (rc == 0 && pipeline->on_frame != NULL && pipeline->on_frame(pipeline->payload, frame->data, frame->out_len, &frame->result) != 0)
+    {
+      free(frame->data);
+      frame->data = NULL;
+      rc = -1;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    if (rc != 0)
+    {
+      pipeline->stop = true;
+      pipeline->failed = true;
+    }
+    frame->done = true;
+    pthread_cond_broadcast(&pipeline->ready);
+  }
+  pthread_mutex_unlock(&pipeline->lock);
+
+  return NULL;
+}
+
+/*
+  decompresses frames on a pool of threads that hand them to on_frame, while the calling thread hands them to on_data in order.
+*/
+static int f_compressed_build_parallel(f_compressed* compressed, f_compress_frame* frames, size_t len, int threads, f_compressed_frame_cb on_frame, f_compressed_cb on_data, void* payload)
+{
+  threads = (size_t) threads > len ? (int) len : threads;
+
+  f_compress_pipeline pipeline = {
+    .compressed = compressed,
+    .frames = frames,
+    .len = len,
+    .next = 0,
+    .consumed = 0,
+    .window = (size_t) threads * F_COMPRESS_AHEAD,
+    .stop = false,
+    .failed = false,
+    .on_frame = on_frame,
+    .payload = payload
+  };
+
+  pthread_t* thread_ids = malloc(sizeof(pthread_t) * threads);
+  if (thread_ids == NULL || pthread_mutex_init(&pipeline.lock, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init decompression threads");
+    free(thread_ids);
+    return -1;
+  }
+
+  if (pthread_cond_init(&pipeline.ready, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init condition");
+    pthread_mutex_destroy(&pipeline.lock);
+    free(thread_ids);
+    return -1;
+  }
+
+  int spawned = 0;
+  for (int i=0; i<threads; i++)
+  {
+    if (pthread_create(&thread_ids[i], NULL, f_compressed_worker, &pipeline) != 0)
+    {
+      f_log(F_LOG_ERROR, "Couldn't create thread %d", i);
+      break;
+    }
+    spawned++;
+  }
+
+  f_log(F_LOG_DEBUG, "decompressing %zu frames on %d threads", len, spawned);
+
+  int rc = spawned > 0 ? 0 : -1;
+  size_t total_out = 0;
+  for (size_t i=0; i<len && rc == 0; i++)
+  {
+    pthread_mutex_lock(&pipeline.lock);
+    while (!frames[i].done && !pipeline.failed)
+    {
+      pthread_cond_wait(&pipeline.ready, &pipeline.lock);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+
+    if (frames[i].data == NULL)
+    {
+      rc = -1;
+      break;
+    }
+
+    rc = f_compressed_point(compressed, total_out, frames[i].in, 0, NULL, 0);
+    if (rc == 0 && frames[i].out_len > 0 && on_data != NULL)
+    {
+      rc = on_data(payload, frames[i].data, frames[i].out_len, total_out, frames[i].result);
+    }
+    total_out += frames[i].out_len;
+    free(frames[i].data);
+    free(frames[i].result);
+    frames[i].data = NULL;
+    frames[i].result = NULL;
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.consumed++;
+    pthread_cond_broadcast(&pipeline.ready);
+    pthread_mutex_unlock(&pipeline.lock);
+  }
+
+  pthread_mutex_lock(&pipeline.lock);
+  pipeline.stop = true;
+  pthread_cond_broadcast(&pipeline.ready);
+  pthread_mutex_unlock(&pipeline.lock);
+
+  for (int i=0; i<spawned; i++)
+  {
+    pthread_join(thread_ids[i], NULL);
+  }
+
+  // frames decompressed ahead of a failure.
+  for (size_t i=0; i<len; i++)
+  {
+    free(frames[i].data);
+    free(frames[i].result);
+  }
+
+  pthread_cond_destroy(&pipeline.ready);
+  pthread_mutex_destroy(&pipeline.lock);
+  free(thread_ids);
+  compressed->size = total_out;
+  return rc;
+}
+
+int f_compressed_build(f_compressed** out, int fd, enum F_COMPRESSION kind, size_t span, int threads, f_compressed_frame_cb on_frame, f_compressed_cb on_data, void* payload)
+{
+  f_compressed* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    return -1;
+  }
+
+  init->kind = kind;
+  init->fd = fd;
+  init->size = 0;
+  init->points = NULL;
+  init->len = 0;
+  init->cap = 0;
+  init->clock = 0;
+  memset(init->cache, 0, sizeof(init->cache));
+
+  if (pthread_mutex_init(&init->lock, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init mutex");
+    free(init);
+    return -1;
+  }
+
+  // split targets are decompressed in parallel, the others in a single stream.
+  int rc;
+  f_compress_frame* frames = NULL;
+  size_t frames_len = threads > 1 ? f_compressed_frames(init, &frames) : 0;
+  if (frames_len > 0)
+  {
+    rc = f_compressed_build_parallel(init, frames, frames_len, threads, on_frame, on_data, payload);
+    free(frames);
+  }
+  else
+  {
+    rc = f_compressed_build_stream(init, span, on_data, payload);
+  }
+
+  if (rc != 0)
+  {
+    f_compressed_free(&init);
+    return rc;
+  }
+
+  f_log(F_LOG_DEBUG, "%zu compression checkpoints for %zu bytes", init->len, init->size);
+  *out = init;
+  return 0;
+}
+
+/*
+  decompresses `len` bytes at `offset`, starting from a gzip checkpoint.
+*/
+static int f_compressed_decode_gzip(f_compressed* compressed, f_compress_point* point, size_t skip, uint8_t* out, size_t len, size_t* written)
+{
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+
+  // a window point resumes raw deflate data, a member start reads the header.
+  bool raw = point->window != NULL;
+  if (inflateInit2(&strm, raw ? -15 : 47) != Z_OK)
+  {
+    f_log(F_LOG_ERROR, "cant init inflate");
+    return -1;
+  }
+
+  size_t read_at = point->in;
+  if (raw)
+  {
+    if (point->bits > 0)
+    {
+      uint8_t byte;
+      if (pread(compressed->fd, &byte, 1, (off_t) (point->in - 1)) != 1)
+      {
+        perror("cant read gzip target");
+        inflateEnd(&strm);
+        return -1;
+      }
+      inflatePrime(&strm, point->bits, byte >> (8 - point->bits));
+    }
+    inflateSetDictionary(&strm, point->window, F_COMPRESS_WINDOW);
+  }
+
+  uint8_t* input = malloc(sizeof(uint8_t) * F_COMPRESS_READ);
+  uint8_t* discard = malloc(sizeof(uint8_t) * F_COMPRESS_WINDOW);
+  if (input == NULL || discard == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate gzip buffers");
+    inflateEnd(&strm);
+    free(input);
+    free(discard);
+    return -1;
+  }
+
+  int rc = 0;
+  *written = 0;
+  while (*written < len)
+  {
+    if (strm.avail_in == 0)
+    {
+      ssize_t bytes_read = pread(compressed->fd, input, F_COMPRESS_READ, (off_t) read_at);
+      if (bytes_read < 0)
+      {
+        perror("cant read gzip target");
+        rc = -1;
+        break;
+      }
+      if (bytes_read == 0)
+      {
+        break;
+      }
+      read_at += (size_t) bytes_read;
+      strm.next_in = input;
+      strm.avail_in = (uInt) bytes_read;
+    }
+
+    size_t want = skip > 0 ? skip : len - *written;
+    strm.next_out = skip > 0 ? discard : out + *written;
+    strm.avail_out = (uInt) (want > F_COMPRESS_WINDOW ? F_COMPRESS_WINDOW : want);
+    uInt before = strm.avail_out;
+
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+    {
+      f_log(F_LOG_ERROR, "gzip target is corrupt near %zu", point->in);
+      rc = -1;
+      break;
+    }
+
+    size_t produced = before - strm.avail_out;
+    if (skip > 0)
+    {
+      skip -= produced;
+    }
+    else
+    {
+      *written += produced;
+    }
+
+    if (ret == Z_STREAM_END && raw)
+    {
+      // the member trailer follows the raw deflate data, then the next member's header.
+      read_at = read_at - strm.avail_in + 8;
+      strm.avail_in = 0;
+      inflateEnd(&strm);
+      memset(&strm, 0, sizeof(strm));
+      if (inflateInit2(&strm, 47) != Z_OK)
+      {
+        f_log(F_LOG_ERROR, "cant init inflate");
+        free(input);
+        free(discard);
+        return -1;
+      }
+      raw = false;
+    }
+    else if (ret == Z_STREAM_END)
+    {
+      inflateReset(&strm);
+    }
+  }
+
+  inflateEnd(&strm);
+  free(input);
+  free(discard);
+  return rc;
+}
+
+/*
+  decompresses `len` bytes at `offset`, starting from a zstd frame.
+*/
+static int f_compressed_decode_zstd(f_compressed* compressed, f_compress_point* point, size_t skip, uint8_t* out, size_t len, size_t* written)
+{
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  size_t input_size = ZSTD_DStreamInSize();
+  uint8_t* input = malloc(sizeof(uint8_t) * input_size);
+  uint8_t* discard = malloc(sizeof(uint8_t) * F_COMPRESS_WINDOW);
+  if (dctx == NULL || input == NULL || discard == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate zstd buffers");
+    ZSTD_freeDCtx(dctx);
+    free(input);
+    free(discard);
+    return -1;
+  }
+
+  int rc = 0;
+  size_t read_at = point->in;
+  bool pending = false;
+  ZSTD_inBuffer in = { input, 0, 0 };
+  *written = 0;
+  while (*written < len)
+  {
+    if (in.pos == in.size && !pending)
+    {
+      ssize_t bytes_read = pread(compressed->fd, input, input_size, (off_t) read_at);
+      if (bytes_read < 0)
+      {
+        perror("cant read zstd target");
+        rc = -1;
+        break;
+      }
+      if (bytes_read == 0)
+      {
+        break;
+      }
+      read_at += (size_t) bytes_read;
+      in.size = (size_t) bytes_read;
+      in.pos = 0;
+    }
+
+    size_t want = skip > 0 ? (skip > F_COMPRESS_WINDOW ? F_COMPRESS_WINDOW : skip) : len - *written;
+    ZSTD_outBuffer o = { skip > 0 ? discard : out + *written, want, 0 };
+    size_t ret = ZSTD_decompressStream(dctx, &o, &in);
+    if (ZSTD_isError(ret))
+    {
+      f_log(F_LOG_ERROR, "zstd target is corrupt: %s", ZSTD_getErrorName(ret));
+      rc = -1;
+      break;
+    }
+
+    if (skip > 0)
+    {
+      skip -= o.pos;
+    }
+    else
+    {
+      *written += o.pos;
+    }
+    pending = o.pos == o.size;
+  }
+
+  ZSTD_freeDCtx(dctx);
+  free(input);
+  free(discard);
+  return rc;
+}
+
+static int f_compressed_decode(f_compressed* compressed, size_t point, size_t offset, uint8_t* out, size_t len)
+{
+  f_compress_point* from = &compressed->points[point];
+  size_t written = 0;
+  int rc = compressed->kind == F_COMPRESSION_GZIP
+    ? f_compressed_decode_gzip(compressed, from, offset - from->out, out, len, &written)
+    : f_compressed_decode_zstd(compressed, from, offset - from->out, out, len, &written);
+
+  if (rc == 0 && written != len)
+  {
+    f_log(F_LOG_ERROR, "compressed target ended at %zu, expected %zu bytes", offset + written, len);
+    return -1;
+  }
+  return rc;
+}
+
+/*
+  the last checkpoint at or before an offset.
+*/
+static size_t f_compressed_find(f_compressed* compressed, size_t offset)
+{
+  size_t low = 0;
+  size_t high = compressed->len;
+  while (high - low > 1)
+  {
+    size_t mid = low + (high - low) / 2;
+    if (compressed->points[mid].out <= offset)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/*
+  copies part of a span, decompressing the whole span into the cache if it isn't there.
+*/
+static int f_compressed_cached(f_compressed* compressed, size_t point, size_t span_len, size_t offset, uint8_t* out, size_t len)
+{
+  size_t at = offset - compressed->points[point].out;
+
+  pthread_mutex_lock(&compressed->lock);
+  for (int i=0; i<F_COMPRESS_CACHE; i++)
+  {
+    f_compress_span* span = &compressed->cache[i];
+    if (span->data != NULL && span->point == point)
+    {
+      memcpy(out, span->data + at, len);
+      span->used = ++compressed->clock;
+      pthread_mutex_unlock(&compressed->lock);
+      return 0;
+    }
+  }
+  pthread_mutex_unlock(&compressed->lock);
+
+  // decompressed outside the lock, so reads of other spans don't wait.
+  uint8_t* data = malloc(sizeof(uint8_t) * span_len);
+  if (data == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate compressed span");
+    return -1;
+  }
+
+  if (f_compressed_decode(compressed, point, compressed->points[point].out, data, span_len) != 0)
+  {
+    free(data);
+    return -1;
+  }
+  memcpy(out, data + at, len);
+
+  pthread_mutex_lock(&compressed->lock);
+  f_compress_span* oldest = &compressed->cache[0];
+  for (int i=0; i<F_COMPRESS_CACHE; i++)
+  {
+    f_compress_span* span = &compressed->cache[i];
+    if (span->data != NULL && span->point == point)
+    {
+      // another reader got here first.
+      oldest = NULL;
+      break;
+    }
+    if (span->data == NULL || span->used < oldest->used)
+    {
+      oldest = span;
+    }
+  }
+
+  if (oldest == NULL)
+  {
+    free(data);
+  }
+  else
+  {
+    free(oldest->data);
+    oldest->point = point;
+    oldest->data = data;
+    oldest->len = span_len;
+    oldest->used = ++compressed->clock;
+  }
+  pthread_mutex_unlock(&compressed->lock);
+  return 0;
+}
+
+ssize_t f_compressed_read(f_compressed* compressed, void* buffer, size_t len, size_t offset)
+{
+  if (offset >= compressed->size)
+  {
+    return 0;
+  }
+
+  len = offset + len > compressed->size ? compressed->size - offset : len;
+  size_t done = 0;
+  while (done < len)
+  {
+    size_t at = offset + done;
+    size_t point = f_compressed_find(compressed, at);
+    size_t span_end = point + 1 < compressed->len ? compressed->points[point + 1].out : compressed->size;
+    size_t span_len = span_end - compressed->points[point].out;
+    size_t n = len - done > span_end - at ? span_end - at : len - done;
+
+    int rc = span_len > F_COMPRESS_CACHE_MAX
+      ? f_compressed_decode(compressed, point, at, (uint8_t*) buffer + done, n)
+      : f_compressed_cached(compressed, point, span_len, at, (uint8_t*) buffer + done, n);
+    if (rc != 0)
+    {
+      return -1;
+    }
+
+    done += n;
+  }
+
+  return (ssize_t) done;
+}
+
+void f_compressed_free(f_compressed** compressedref)
+{
+  f_compressed* compressed = *compressedref;
+
+  for (size_t i=0; i<compressed->len; i++)
+  {
+    free(compressed->points[i].window);
+  }
+  free(compressed->points);
+
+  for (int i=0; i<F_COMPRESS_CACHE; i++)
+  {
+    free(compressed->cache[i].data);
+  }
+
+  pthread_mutex_destroy(&compressed->lock);
+  free(compressed);
+  *compressedref = NULL;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef FLASHLIGHT_COMPRESS_H
+#define FLASHLIGHT_COMPRESS_H
+
+/** @file compress.h
+* @brief Random access into gzip and zstd targets
+*
+* A compressed target is decompressed once while it is indexed, and checkpoints
+* are kept along the way: the start of every zstd frame or gzip member, and a
+* snapshot of the gzip window every `span` bytes. Offsets are in uncompressed
+* coordinates, a read only decompresses from the checkpoint before it.
+* Spans that were decompressed recently are kept in a small cache.
+*
+* zstd targets with several frames and bgzip targets are split without decompressing them,
+* and their frames are decompressed in parallel, ahead of the bytes being consumed in order.
+* A frame can also be looked at on the thread that decompressed it, before its offset is known.
+*/
+
+// the size of a deflate window.
+#define F_COMPRESS_WINDOW 32768
+// compressed bytes read at a time.
+#define F_COMPRESS_READ 65536
+// uncompressed bytes between gzip checkpoints, when none is given.
+#define F_COMPRESS_DEFAULT_SPAN (1u << 20)
+// decompressed spans kept around.
+#define F_COMPRESS_CACHE 8
+// spans bigger than this, e.g. a zstd target with a single frame, are decompressed on every read instead of cached.
+#define F_COMPRESS_CACHE_MAX (16u << 20)
+// frames bigger than this are decompressed in a single stream, it bounds the memory of the frames in flight.
+#define F_COMPRESS_FRAME_MAX (8u << 20)
+// frames decompressed ahead of the one being consumed, per thread.
+#define F_COMPRESS_AHEAD 2
+
+/**
+* @brief the compression of a target
+*/
+enum F_COMPRESSION
+{
+  F_COMPRESSION_NONE = 0, /**< raw bytes */
+  F_COMPRESSION_AUTO, /**< detected from the magic bytes at the start of the target */
+  F_COMPRESSION_GZIP, /**< gzip, one or more members */
+  F_COMPRESSION_ZSTD /**< zstd, one or more frames */
+};
+
+/** @struct FCompressPoint
+* @brief a place decompression can start from
+* @var FCompressPoint::out
+* the uncompressed offset
+* @var FCompressPoint::in
+* the compressed offset
+* @var FCompressPoint::bits
+* the bits of the byte before `in` that are still to be decompressed (gzip only)
+* @var FCompressPoint::window
+* the last F_COMPRESS_WINDOW uncompressed bytes before the point, NULL at the start of a gzip member or zstd frame
+*/
+typedef struct FCompressPoint
+{
+  size_t out;
+  size_t in;
+  int bits;
+  uint8_t* window;
+} f_compress_point;
+
+/** @struct FCompressSpan
+* @brief a decompressed span between two points
+* @var FCompressSpan::point
+* the point the span starts at
+* @var FCompressSpan::data
+* the bytes of the span (NULL if the slot is empty)
+* @var FCompressSpan::len
+* the number of bytes
+* @var FCompressSpan::used
+* when the span was last read, to find the oldest one
+*/
+typedef struct FCompressSpan
+{
+  size_t point;
+  uint8_t* data;
+  size_t len;
+  uint64_t used;
+} f_compress_span;
+
+/** @struct FCompressed
+* @brief the checkpoints of a compressed target
+* @var FCompressed::kind
+* the compression
+* @var FCompressed::fd
+* the file descriptor of the compressed target
+* @var FCompressed::size
+* the uncompressed size
+* @var FCompressed::points
+* the checkpoints, by offset
+* @var FCompressed::len
+* the number of checkpoints
+* @var FCompressed::cap
+* the capacity of the checkpoints array
+* @var FCompressed::lock
+* serializes the cache
+* @var FCompressed::cache
+* the spans decompressed recently
+* @var FCompressed::clock
+* counts cache reads
+*/
+typedef struct FCompressed
+{
+  enum F_COMPRESSION kind;
+  int fd;
+  size_t size;
+  f_compress_point* points;
+  size_t len;
+  size_t cap;
+  pthread_mutex_t lock;
+  f_compress_span cache[F_COMPRESS_CACHE];
+  uint64_t clock;
+} f_compressed;
+
+/** @struct FCompressFrame
+* @brief a gzip member or zstd frame that is decompressed on its own
+* @var FCompressFrame::in
+* the compressed offset
+* @var FCompressFrame::len
+* the compressed size
+* @var FCompressFrame::data
+* the decompressed bytes (NULL until done, or if it failed)
+* @var FCompressFrame::out_len
+* the decompressed size
+* @var FCompressFrame::result
+* what on_frame found in the bytes, allocated with malloc (NULL if unused)
+* @var FCompressFrame::done
+* true once a thread finished with the frame
+*/
+typedef struct FCompressFrame
+{
+  size_t in;
+  size_t len;
+  uint8_t* data;
+  size_t out_len;
+  void* result;
+  bool done;
+} f_compress_frame;
+
+/**
+  Called on a decompression thread with the bytes of a whole frame, in any order
+  @param payload the payload given to f_compressed_build
+  @param data the decompressed bytes of the frame
+  @param len the number of bytes
+  @param result what was found in the bytes, allocated with malloc, handed to on_data and freed after it
+  @return non zero for error
+*/
+typedef int (*f_compressed_frame_cb)(void* payload, const uint8_t* data, size_t len, void** result);
+
+/** @struct FCompressPipeline
+* @brief frames decompressed by a pool of threads, consumed in order
+* @var FCompressPipeline::compressed
+* the target
+* @var FCompressPipeline::frames
+* the frames, by offset
+* @var FCompressPipeline::len
+* the number of frames
+* @var FCompressPipeline::next
+* the next frame a thread picks up
+* @var FCompressPipeline::consumed
+* the number of frames consumed, threads stay within `window` of it
+* @var FCompressPipeline::window
+* the frames that can be in flight
+* @var FCompressPipeline::stop
+* true once the threads should exit
+* @var FCompressPipeline::failed
+* true if a frame couldn't be decompressed
+* @var FCompressPipeline::lock
+* serializes the fields above
+* @var FCompressPipeline::ready
+* signaled when a frame is done or consumed
+* @var FCompressPipeline::on_frame
+* called on the threads with every decompressed frame (NULL if unused)
+* @var FCompressPipeline::payload
+* passed to on_frame
+*/
+typedef struct FCompressPipeline
+{
+  f_compressed* compressed;
+  f_compress_frame* frames;
+  size_t len;
+  size_t next;
+  size_t consumed;
+  size_t window;
+  bool stop;
+  bool failed;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  f_compressed_frame_cb on_frame;
+  void* payload;
+} f_compress_pipeline;
+
+/**
+  Called with the bytes of a target as it is decompressed, in order
+  @param payload the payload given to f_compressed_build
+  @param data the decompressed bytes
+  @param len the number of bytes
+  @param offset the uncompressed offset of the bytes
+  @param result what on_frame found in the bytes (NULL if they weren't decompressed as a frame)
+  @return non zero to stop
+*/
+typedef int (*f_compressed_cb)(void* payload, const uint8_t* data, size_t len, size_t offset, void* result);
+
+/**
+  Detects the compression of a target from its magic bytes
+  @param fd the file descriptor of the target
+  @return F_COMPRESSION_GZIP, F_COMPRESSION_ZSTD or F_COMPRESSION_NONE
+*/
+enum F_COMPRESSION f_compressed_detect(int fd);
+
+/**
+  Decompresses a target once and keeps checkpoints to read it from
+
+  Frames that can be found without decompressing them are decompressed on `threads` threads,
+  and handed to on_frame there. on_data is still called in order, on the calling thread.
+  @param out the checkpoints
+  @param fd the file descriptor of the target, not owned
+  @param kind F_COMPRESSION_GZIP or F_COMPRESSION_ZSTD
+  @param span the uncompressed bytes between gzip checkpoints (0 for the default)
+  @param threads the threads to decompress frames on (1 for a single stream)
+  @param on_frame called on the threads with every frame (NULL if unused)
+  @param on_data called with the decompressed bytes (NULL if unused)
+  @param payload passed to on_frame and on_data
+  @return non zero for error, or what on_data returned if it stopped
+*/
+int f_compressed_build(f_compressed** out, int fd, enum F_COMPRESSION kind, size_t span, int threads, f_compressed_frame_cb on_frame, f_compressed_cb on_data, void* payload);
+
+/**
+  Reads the uncompressed bytes of a target, like pread
+  @param compressed the checkpoints
+  @param buffer where to copy the bytes
+  @param len the number of bytes to read
+  @param offset the uncompressed offset to read from
+  @return the number of bytes read, less at the end of the target, -1 for error
+*/
+ssize_t f_compressed_read(f_compressed* compressed, void* buffer, size_t len, size_t offset);
+
+/**
+  Frees the checkpoints of a target
+  @param compressed the checkpoints to free
+*/
+void f_compressed_free(f_compressed** compressed);
+
+#endif
@@ -0,0 +1,531 @@
+#ifndef FLASHLIGHT_FIELD
+#define FLASHLIGHT_FIELD
+
+#include "field.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+  the first pass, only the quote state of the range start is unknown.
+  rows start where a line starts outside quotes, so both states are counted at once:
+  a range that starts inside quotes is outside them wherever one that starts outside is inside.
+*/
+void* f_field_thread_count(void* payload)
+{
+  f_field_thread* config = payload;
+  f_field_index* fields = config->fields;
+  bool quoted = false;
+
+  for (size_t start=config->from; start<config->to; start+=F_FIELD_READ_LINES)
+  {
+    if (config->cancel != NULL && f_cancel_state_poll(config->cancel) != F_CANCEL_NONE)
+    {
+      config->rc = F_CANCELLED;
+      return NULL;
+    }
+
+    size_t count = start + F_FIELD_READ_LINES > config->to ? config->to - start : F_FIELD_READ_LINES;
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, config->index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "field lookup failed to start: %zu buffer: %zu", start, count);
+      config->rc = -1;
+      return NULL;
+    }
+
+    for (size_t k=0; k<lookup.count; k++)
+    {
+      char* line;
+      size_t line_len;
+      f_index_lines_get(&lookup, k, &line, &line_len);
+
+      config->starts[quoted]++;
+      config->tail[quoted] = 0;
+      for (size_t i=0; i<line_len; i++)
+      {
+        if (line[i] == fields->quote)
+        {
+          quoted = !quoted;
+        }
+        else if (line[i] == fields->delimiter)
+        {
+          config->tail[quoted]++;
+        }
+      }
+    }
+
+    f_index_lines_free(&lookup);
+  }
+
+  config->flips = quoted;
+  return NULL;
+}
+
+/*
+  the second pass, writes the spans of every line and the rows that start in the range.
+*/
+void* f_field_thread_spans(void* payload)
+{
+  f_field_thread* config = payload;
+  f_field_index* fields = config->fields;
+  size_t columns = fields->columns;
+  bool quoted = config->quoted;
+  size_t column = config->column;
+  size_t row = config->row;
+
+  f_field_span* spans = malloc(sizeof(f_field_span) * columns * F_FIELD_READ_LINES);
+  uint64_t* rows = malloc(sizeof(uint64_t) * F_FIELD_READ_LINES);
+  if (spans == NULL || rows == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate field spans");
+    free(spans);
+    free(rows);
+    config->rc = -1;
+    return NULL;
+  }
+
+  for (size_t start=config->from; start<config->to; start+=F_FIELD_READ_LINES)
+  {
+    if (config->cancel != NULL && f_cancel_state_poll(config->cancel) != F_CANCEL_NONE)
+    {
+      config->rc = F_CANCELLED;
+      break;
+    }
+
+    size_t count = start + F_FIELD_READ_LINES > config->to ? config->to - start : F_FIELD_READ_LINES;
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, config->index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "field lookup failed to start: %zu buffer: %zu", start, count);
+      config->rc = -1;
+      break;
+    }
+
+    memset(spans, 0xff, sizeof(f_field_span) * columns * count);
+    size_t row_count = 0;
+    for (size_t k=0; k<lookup.count; k++)
+    {
+      char* line;
+      size_t line_len;
+      f_index_lines_get(&lookup, k, &line, &line_len);
+
+      f_field_span* span = spans + k * columns;
+      if (!quoted)
+      {
+        rows[row_count++] = start + k;
+        column = 0;
+      }
+
+      size_t piece = 0;
+      for (size_t i=0; i<line_len; i++)
+      {
+        if (line[i] == fields->quote)
+        {
+          quoted = !quoted;
+        }
+        else if (!quoted && line[i] == fields->delimiter && column + 1 < columns)
+        {
+          span[column].start = (uint32_t) piece;
+          span[column].end = (uint32_t) i;
+          column++;
+          piece = i + 1;
+        }
+      }
+
+      size_t line_end = !quoted && line_len > 0 && line[line_len - 1] == '\r' ? line_len - 1 : line_len;
+      span[column].start = (uint32_t) piece;
+      span[column].end = (uint32_t) line_end;
+    }
+    f_index_lines_free(&lookup);
+
+    off_t offset = (off_t) (sizeof(f_field_header) + start * columns * sizeof(f_field_span));
+    size_t len = count * columns * sizeof(f_field_span);
+    off_t row_offset = (off_t) (sizeof(f_field_header) + fields->lines * columns * sizeof(f_field_span) + row * sizeof(uint64_t));
+    size_t row_len = row_count * sizeof(uint64_t);
+    if (pwrite(fields->fd, spans, len, offset) != (ssize_t) len || pwrite(fields->fd, rows, row_len, row_offset) != (ssize_t) row_len)
+    {
+      perror("cant write field spans");
+      config->rc = -1;
+      break;
+    }
+    row += row_count;
+  }
+
+  free(spans);
+  free(rows);
+  return NULL;
+}
+
+/*
+  counts the fields of the first row.
+*/
+static int f_field_columns(size_t* out, f_index* index, char delimiter, char quote, size_t lines)
+{
+  size_t columns = 1;
+  bool quoted = false;
+
+  for (size_t start=0; start<lines; start+=F_FIELD_READ_LINES)
+  {
+    size_t count = start + F_FIELD_READ_LINES > lines ? lines - start : F_FIELD_READ_LINES;
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "field lookup failed to start: %zu buffer: %zu", start, count);
+      return -1;
+    }
+
+    for (size_t k=0; k<lookup.count; k++)
+    {
+      char* line;
+      size_t line_len;
+      f_index_lines_get(&lookup, k, &line, &line_len);
+
+      for (size_t i=0; i<line_len; i++)
+      {
+        if (line[i] == quote)
+        {
+          quoted = !quoted;
+        }
+        else if (!quoted && line[i] == delimiter)
+        {
+          columns++;
+        }
+      }
+
+      if (!quoted)
+      {
+        f_index_lines_free(&lookup);
+        *out = columns;
+        return 0;
+      }
+    }
+
+    f_index_lines_free(&lookup);
+  }
+
+  *out = columns;
+  return 0;
+}
+
+/*
+  runs one pass of the threads over their ranges.
+*/
+static int f_field_pass(f_field_thread* fthreads, int threads, void* (*pass)(void*))
+{
+  pthread_t* thread_ids = malloc(sizeof(pthread_t) * threads);
+  if (thread_ids == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate field threads");
+    return -1;
+  }
+
+  int spawned = 0;
+  int rc = 0;
+  for (int i=0; i<threads; i++)
+  {
+    if (pthread_create(&thread_ids[i], NULL, pass, &fthreads[i]) != 0)
+    {
+      f_log(F_LOG_ERROR, "Couldn't create field thread %d", i);
+      rc = -1;
+      break;
+    }
+    spawned++;
+  }
+
+  for (int i=0; i<spawned; i++)
+  {
+    pthread_join(thread_ids[i], NULL);
+    if (rc == 0 && fthreads[i].rc != 0)
+    {
+      rc = fthreads[i].rc;
+    }
+  }
+
+  free(thread_ids);
+  return rc;
+}
+
+int f_field_index_build(f_field_index** out, f_index* index, char* path, char delimiter, char quote, size_t columns, int threads, f_cancel_state* cancel)
+{
+  size_t lines = f_index_line_count(index);
+  quote = quote == '\0' ? '"' : quote;
+
+  if (columns == 0 && f_field_columns(&columns, index, delimiter, quote, lines) != 0)
+  {
+    free(path);
+    return -1;
+  }
+
+  f_field_index* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    free(path);
+    return -1;
+  }
+
+  init->path = path;
+  init->map = NULL;
+  init->map_len = 0;
+  init->delimiter = delimiter;
+  init->quote = quote;
+  init->columns = columns;
+  init->lines = lines;
+  init->rows = 0;
+  init->spans = NULL;
+  init->row_lines = NULL;
+
+  init->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (init->fd == -1)
+  {
+    perror("cant open field index");
+    free(path);
+    free(init);
+    return -1;
+  }
+
+  if (threads > lines)
+  {
+    threads = lines > 0 ? (int) lines : 1;
+  }
+
+  f_field_thread* fthreads = calloc(threads, sizeof(f_field_thread));
+  if (fthreads == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate field threads");
+    f_field_index_free(&init);
+    return -1;
+  }
+
+  size_t lines_per_thread = (lines + threads - 1) / threads;
+  for (int i=0; i<threads; i++)
+  {
+    size_t from = i * lines_per_thread;
+    size_t to = from + lines_per_thread;
+    fthreads[i].fields = init;
+    fthreads[i].index = index;
+    fthreads[i].from = from > lines ? lines : from;
+    fthreads[i].to = to > lines ? lines : to;
+    fthreads[i].cancel = cancel;
+  }
+
+  int rc = f_field_pass(fthreads, threads, f_field_thread_count);
+  if (rc != 0)
+  {
+    free(fthreads);
+    f_field_index_free(&init);
+    return rc;
+  }
+
+  // the quote state, column and row at the start of each range follow from the ranges before it.
+  bool quoted = false;
+  size_t column = 0;
+  for (int i=0; i<threads; i++)
+  {
+    f_field_thread* t = &fthreads[i];
+    t->quoted = quoted;
+    t->column = column < columns ? column : columns - 1;
+    t->row = init->rows;
+
+    init->rows += t->starts[quoted];
+    column = t->starts[quoted] > 0 ? t->tail[quoted] : column + t->tail[quoted];
+    quoted = quoted != t->flips;
+  }
+
+  size_t rows_offset = sizeof(f_field_header) + lines * columns * sizeof(f_field_span);
+  init->map_len = rows_offset + init->rows * sizeof(uint64_t);
+
+  f_field_header header = {
+    .magic = F_FIELD_MAGIC,
+    .version = F_FIELD_VERSION,
+    .delimiter = (uint32_t) (unsigned char) delimiter,
+    .quote = (uint32_t) (unsigned char) quote,
+    .columns = columns,
+    .lines = lines,
+    .rows = init->rows,
+    .rows_offset = rows_offset
+  };
+
+  if (ftruncate(init->fd, (off_t) init->map_len) != 0 || pwrite(init->fd, &header, sizeof(header), 0) != sizeof(header))
+  {
+    perror("cant write field index");
+    free(fthreads);
+    f_field_index_free(&init);
+    return -1;
+  }
+
+  rc = f_field_pass(fthreads, threads, f_field_thread_spans);
+  free(fthreads);
+  if (rc != 0)
+  {
+    f_field_index_free(&init);
+    return rc;
+  }
+
+  init->map = mmap(NULL, init->map_len, PROT_READ, MAP_SHARED, init->fd, 0);
+  if (init->map == MAP_FAILED)
+  {
+    perror("cant map field index");
+    init->map = NULL;
+    f_field_index_free(&init);
+    return -1;
+  }
+
+  init->spans = (f_field_span*) ((char*) init->map + sizeof(f_field_header));
+  init->row_lines = (uint64_t*) ((char*) init->map + rows_offset);
+  *out = init;
+  return 0;
+}
+
+bool f_field_index_span(f_field_index* fields, size_t line, size_t column, size_t* offset, size_t* len)
+{
+  if (line >= fields->lines || column == 0 || column > fields->columns)
+  {
+    return false;
+  }
+
+  f_field_span span = fields->spans[line * fields->columns + column - 1];
+  if (span.start == F_FIELD_NONE)
+  {
+    return false;
+  }
+
+  *offset = span.start;
+  *len = span.end - span.start;
+  return true;
+}
+
+/*
+  removes the quotes around a value and unescapes doubled quotes, in place.
+  returns the new length.
+*/
+static size_t f_field_unquote(char* value, size_t len, char quote)
+{
+  if (len == 0 || value[0] != quote)
+  {
+    return len;
+  }
+
+  size_t w = 0;
+  for (size_t r=1; r<len; r++)
+  {
+    if (value[r] == quote)
+    {
+      if (r + 1 < len && value[r + 1] == quote)
+      {
+        value[w++] = quote;
+        r++;
+      }
+      continue;
+    }
+    value[w++] = value[r];
+  }
+
+  return w;
+}
+
+int f_index_lookup_column(char** out, f_index* index, size_t start, size_t count, size_t column)
+{
+  f_field_index* fields = index->fields;
+  if (fields == NULL)
+  {
+    return -2;
+  }
+
+  if (column == 0 || column > fields->columns)
+  {
+    f_log(F_LOG_ERROR, "column %zu is out of range", column);
+    return -1;
+  }
+
+  if (start >= fields->rows)
+  {
+    f_log(F_LOG_WARN, "start %zu is greater than max %zu", start, fields->rows);
+    *out = NULL;
+    return 0;
+  }
+
+  count = start + count > fields->rows ? fields->rows - start : count;
+  size_t first_line = fields->row_lines[start];
+  size_t end_line = start + count < fields->rows ? fields->row_lines[start + count] : fields->lines;
+
+  f_index_lines lookup;
+  if (f_index_lookup_lines(&lookup, index, first_line, end_line - first_line) != 0 || lookup.data == NULL)
+  {
+    f_log(F_LOG_ERROR, "column lookup failed to start: %zu buffer: %zu", first_line, end_line - first_line);
+    return -1;
+  }
+
+  // values are never longer than the lines they are on.
+  char* values = malloc(sizeof(char) * (lookup.offsets[lookup.count] + 1));
+  if (values == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate column values");
+    f_index_lines_free(&lookup);
+    return -1;
+  }
+
+  size_t len = 0;
+  size_t row = start;
+  size_t value = 0;
+  bool pieces = false;
+  for (size_t line_number=first_line; line_number<end_line; line_number++)
+  {
+    char* line;
+    size_t line_len;
+    f_index_lines_get(&lookup, line_number - first_line, &line, &line_len);
+
+    size_t next_row = row + 1 < fields->rows ? fields->row_lines[row + 1] : fields->lines;
+    if (line_number == next_row)
+    {
+      len = value + f_field_unquote(values + value, len - value, fields->quote);
+      values[len++] = '\n';
+      value = len;
+      pieces = false;
+      row++;
+    }
+
+    size_t offset, piece_len;
+    if (!f_field_index_span(fields, line_number, column, &offset, &piece_len) || offset + piece_len > line_len)
+    {
+      continue;
+    }
+
+    // a quoted value that spans lines keeps its newlines.
+    if (pieces)
+    {
+      values[len++] = '\n';
+    }
+    memcpy(values + len, line + offset, piece_len);
+    len += piece_len;
+    pieces = true;
+  }
+
+  len = value + f_field_unquote(values + value, len - value, fields->quote);
+  values[len] = '\0';
+
+  f_index_lines_free(&lookup);
+  *out = values;
+  return 0;
+}
+
+void f_field_index_free(f_field_index** fieldsref)
+{
+  f_field_index* fields = *fieldsref;
+
+  if (fields->map != NULL)
+  {
+    munmap(fields->map, fields->map_len);
+  }
+
+  close(fields->fd);
+  if (remove(fields->path) != 0)
+  {
+    f_log(F_LOG_WARN, "Cannot free field index path");
+  }
+
+  free(fields->path);
+  free(fields);
+  *fieldsref = NULL;
+}
+
+#endif
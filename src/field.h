@@ -0,0 +1,198 @@
+#ifndef FLASHLIGHT_FIELD_H
+#define FLASHLIGHT_FIELD_H
+
+/** @file field.h
+* @brief Field offsets of a delimited file (CSV, TSV)
+*
+* Every line gets a span per column, relative to the line start, so a column
+* can be read or searched without parsing lines again. A quoted field can hold
+* newlines, so rows are numbered separately from lines and a row can span lines.
+* The index is a sidecar file next to the lookup, mapped read only:
+* a header, the spans of every line, then the first line of every row.
+*/
+
+#define F_FIELD_MAGIC 0x44464c46u
+#define F_FIELD_VERSION 1u
+// lines a thread reads at a time.
+#define F_FIELD_READ_LINES 4096
+// the span of a column that isn't on a line.
+#define F_FIELD_NONE UINT32_MAX
+
+/** @struct FFieldHeader
+* @brief the header of a field index file
+* @var FFieldHeader::magic
+* F_FIELD_MAGIC
+* @var FFieldHeader::version
+* F_FIELD_VERSION
+* @var FFieldHeader::delimiter
+* the byte between fields
+* @var FFieldHeader::quote
+* the byte fields are quoted with
+* @var FFieldHeader::columns
+* the number of columns with spans
+* @var FFieldHeader::lines
+* the number of lines
+* @var FFieldHeader::rows
+* the number of rows
+* @var FFieldHeader::rows_offset
+* where the first line of every row is stored
+*/
+typedef struct FFieldHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t delimiter;
+  uint32_t quote;
+  uint64_t columns;
+  uint64_t lines;
+  uint64_t rows;
+  uint64_t rows_offset;
+} f_field_header;
+
+/** @struct FFieldSpan
+* @brief the part of a column that is on a line
+* @var FFieldSpan::start
+* the offset from the start of the line
+* @var FFieldSpan::end
+* the offset the column ends at
+*
+* Both are F_FIELD_NONE if the column isn't on the line.
+*/
+typedef struct FFieldSpan
+{
+  uint32_t start;
+  uint32_t end;
+} f_field_span;
+
+/** @struct FFieldIndex
+* @brief a field index, mapped from the file next to the lookup
+* @var FFieldIndex::path
+* the location of the field index
+* @var FFieldIndex::fd
+* the file descriptor of the field index
+* @var FFieldIndex::map
+* the mapped file
+* @var FFieldIndex::map_len
+* the size of the mapped file
+* @var FFieldIndex::delimiter
+* the byte between fields
+* @var FFieldIndex::quote
+* the byte fields are quoted with
+* @var FFieldIndex::columns
+* the number of columns with spans, fields past it are part of the last column
+* @var FFieldIndex::lines
+* the number of lines
+* @var FFieldIndex::rows
+* the number of rows
+* @var FFieldIndex::spans
+* `columns` spans for every line
+* @var FFieldIndex::row_lines
+* the first line of every row, 0 based
+*/
+typedef struct FFieldIndex
+{
+  char* path;
+  int fd;
+  void* map;
+  size_t map_len;
+  char delimiter;
+  char quote;
+  size_t columns;
+  size_t lines;
+  size_t rows;
+  f_field_span* spans;
+  uint64_t* row_lines;
+} f_field_index;
+
+/** @struct FFieldThread
+* @brief the lines one thread scans
+*
+* The first pass finds out how the range would be split for both quote states it could start in,
+* the second writes the spans once the state at the start of every range is known.
+* @var FFieldThread::fields
+* the field index being built
+* @var FFieldThread::index
+* the index to read lines from
+* @var FFieldThread::from
+* the first line
+* @var FFieldThread::to
+* the line to stop at
+* @var FFieldThread::flips
+* true if the range has an odd number of quotes
+* @var FFieldThread::starts
+* the rows that start in the range, for a range that starts outside or inside quotes
+* @var FFieldThread::tail
+* the column at the end of the range, counted from its last row start, or from the range start if it has none
+* @var FFieldThread::quoted
+* true if the range starts inside quotes
+* @var FFieldThread::column
+* the column at the start of the range
+* @var FFieldThread::row
+* the first row that starts in the range
+* @var FFieldThread::cancel
+* the cancellation state of the indexing
+* @var FFieldThread::rc
+* non zero if scanning failed
+*/
+typedef struct FFieldThread
+{
+  f_field_index* fields;
+  f_index* index;
+  size_t from;
+  size_t to;
+  bool flips;
+  size_t starts[2];
+  size_t tail[2];
+  bool quoted;
+  size_t column;
+  size_t row;
+  f_cancel_state* cancel;
+  int rc;
+} f_field_thread;
+
+/**
+  Builds a field index for every line of an index
+
+  @param out the field index
+  @param index the index to read lines from
+  @param path the file to write, owned by the field index (freed on error)
+  @param delimiter the byte between fields
+  @param quote the byte fields are quoted with (0 for '"')
+  @param columns the number of columns to keep spans for (0 for the number of fields in the first row)
+  @param threads how many threads to scan with
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_field_index_build(f_field_index** out, f_index* index, char* path, char delimiter, char quote, size_t columns, int threads, f_cancel_state* cancel);
+
+/**
+  Finds the part of a column that is on a line
+  @param fields the field index
+  @param line the line, 0 based
+  @param column the column, 1 based
+  @param offset the offset of the column from the start of the line
+  @param len the length of the column on the line
+  @return false if the column isn't on the line
+*/
+bool f_field_index_span(f_field_index* fields, size_t line, size_t column, size_t* offset, size_t* len);
+
+/**
+  Fetches one column of a range of rows
+
+  Quotes are removed from the values. A value can hold a newline if it was quoted.
+  @param out the values, newline separated and zero terminated
+  @param index an index built with a field delimiter
+  @param start the first row, 0 based
+  @param count the number of rows to fetch
+  @param column the column, 1 based
+  @return non zero for error, -2 if the index has no field index
+*/
+int f_index_lookup_column(char** out, f_index* index, size_t start, size_t count, size_t column);
+
+/**
+  Unmaps and deletes a field index
+  @param fields the field index to free
+*/
+void f_field_index_free(f_field_index** fields);
+
+#endif
@@ -508,6 +508,7 @@ CWK_PUBLIC enum cwk_path_style cwk_path_get_style(void);
 #endif
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -518,6 +519,9 @@ CWK_PUBLIC enum cwk_path_style cwk_path_get_style(void);
 #include <sys/types.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #endif
 #ifndef FLASHLIGHT_LOG_H
@@ -529,6 +533,13 @@ CWK_PUBLIC enum cwk_path_style cwk_path_get_style(void);
 #define ANSI_COLOR_CYAN    "\x1b[36m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
+// the longest message, longer ones are cut off.
+#define F_LOG_MESSAGE 500
+// records each thread can queue while logging asynchronously, when none is given.
+#define F_LOG_RING 1024
+// how long the async logger sleeps when every ring is empty.
+#define F_LOG_DRAIN_NS 1000000
+
 enum F_LOG_LEVEL
 {
   F_LOG_ERROR = 1 << 0,
@@ -547,15 +558,687 @@ typedef struct FLogMessage
 
 typedef void (*f_logger_cb)(f_log_message message, volatile void* payload);
 static volatile f_logger_cb f_log_cb = NULL;
-static volatile enum F_LOG_LEVEL f_log_level = F_LOG_ERROR;
+static atomic_int f_log_level = F_LOG_ERROR;
 static volatile void* f_log_payload = NULL;
 
+// the levels compiled in, release builds drop debug and fine messages. define it to override.
+#ifndef F_LOG_COMPILED
+#ifdef NDEBUG
+#define F_LOG_COMPILED (F_LOG_ERROR | F_LOG_WARN | F_LOG_INFO)
+#else
+#define F_LOG_COMPILED (F_LOG_ERROR | F_LOG_WARN | F_LOG_INFO | F_LOG_DEBUG | F_LOG_FINE)
+#endif
+#endif
+
+// true if a message of `level` would be logged, to skip work that only feeds a message.
+#define F_LOG_ENABLED(level) (((level) & F_LOG_COMPILED) && ((level) & atomic_load_explicit(&f_log_level, memory_order_relaxed)))
+
+/*
+  the level is checked before the arguments are evaluated or anything is formatted,
+  and levels that aren't compiled in are removed.
+*/
+#define f_log(level, ...) do { if (F_LOG_ENABLED(level)) f_log_write(level, __VA_ARGS__); } while (0)
+
+/** @struct FLogRecord
+* @brief a message queued by the async logger, formatted by the thread that logged it
+* @var FLogRecord::level
+* the level of the message
+* @var FLogRecord::time
+* when it was logged
+* @var FLogRecord::message
+* the message
+*/
+typedef struct FLogRecord
+{
+  enum F_LOG_LEVEL level;
+  time_t time;
+  char message[F_LOG_MESSAGE];
+} f_log_record;
+
+/** @struct FLogRing
+* @brief the queue of one thread, written by that thread only and read by the drain thread only
+* @var FLogRing::head
+* the records written
+* @var FLogRing::tail
+* the records read
+* @var FLogRing::cap
+* the number of slots
+* @var FLogRing::records
+* the slots
+* @var FLogRing::owned
+* true while a thread writes to the ring, a ring whose thread exited is reused by the next one
+* @var FLogRing::next
+* the next ring of the logger
+*/
+typedef struct FLogRing
+{
+  atomic_size_t head;
+  atomic_size_t tail;
+  size_t cap;
+  f_log_record* records;
+  atomic_bool owned;
+  struct FLogRing* next;
+} f_log_ring;
+
 void f_logger_set_level(enum F_LOG_LEVEL level);
 void f_logger_set_cb(f_logger_cb cb, volatile void* payload);
 f_logger_cb f_logger_get_cb();
 enum F_LOG_LEVEL f_logger_get_level();
 volatile void* f_logger_get_payload();
-void f_log(enum F_LOG_LEVEL level, char* fmt, ...);
+void f_log_write(enum F_LOG_LEVEL level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+  Queues messages instead of writing them on the thread that logs them
+
+  Every thread formats into its own lock free ring, and a background thread hands
+  the messages to the callback (or stderr), so the callback only ever runs on that thread.
+  A message is dropped when its thread's ring is full.
+  @param capacity the records each thread can queue (0 for F_LOG_RING)
+  @return non zero for error, or if it is already started
+*/
+int f_logger_async_start(size_t capacity);
+
+/**
+  Delivers every queued message and goes back to logging on the calling thread
+*/
+void f_logger_async_stop();
+
+/**
+  The number of messages dropped because a ring was full, since the async logger started
+*/
+size_t f_logger_async_dropped();
+
+#endif
+#ifndef FLASHLIGHT_ARENA_H
+#define FLASHLIGHT_ARENA_H
+
+/** @file arena.h
+* @brief A bump allocator for the short lived objects of one thread
+*
+* Objects are carved out of large blocks and never freed one by one,
+* the whole arena is reset at once when they are no longer needed.
+* Blocks are kept across resets, so an arena stops calling malloc once it saw its largest round.
+* An arena isn't thread safe, coroutines of the same thread can share one.
+*/
+
+// the default size of a block.
+#define F_ARENA_BLOCK (1 << 20)
+
+/** @struct FArenaBlock
+* @brief a block objects are carved from
+* @var FArenaBlock::next
+* the next block
+* @var FArenaBlock::size
+* the number of usable bytes
+* @var FArenaBlock::used
+* the number of bytes handed out
+* @var FArenaBlock::data
+* the bytes
+*/
+typedef struct FArenaBlock
+{
+  struct FArenaBlock* next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+} f_arena_block;
+
+/** @struct FArena
+* @brief blocks and the one being carved from
+* @var FArena::first
+* the first block
+* @var FArena::current
+* the block objects are carved from
+* @var FArena::block_size
+* the size of new blocks
+* @var FArena::allocated
+* the bytes held by every block
+*/
+typedef struct FArena
+{
+  f_arena_block* first;
+  f_arena_block* current;
+  size_t block_size;
+  size_t allocated;
+} f_arena;
+
+/**
+  Creates an empty arena, blocks are allocated on first use
+  @param out the arena
+  @param block_size the size of a block (0 for F_ARENA_BLOCK)
+  @return non zero for error
+*/
+int f_arena_init(f_arena** out, size_t block_size);
+
+/**
+  Hands out memory aligned for any type, valid until the next reset
+  @param arena the arena
+  @param size the number of bytes
+  @return the memory, NULL for error
+*/
+void* f_arena_alloc(f_arena* arena, size_t size);
+
+/**
+  Takes back everything handed out at once, the blocks are kept for reuse
+  @param arena the arena
+*/
+void f_arena_reset(f_arena* arena);
+
+/**
+  Frees an arena and every block
+  @param arena the arena to free
+*/
+void f_arena_free(f_arena** arena);
+
+#endif
+#ifndef FLASHLIGHT_CANCEL_H
+#define FLASHLIGHT_CANCEL_H
+
+/** @file cancel.h
+* @brief Cooperative cancellation for searches and indexing
+*
+* Threads check for cancellation between buffers,
+* so a cancelled operation stops within one buffer per thread.
+*/
+
+/**
+* @brief the return code of a cancelled search
+*/
+#define F_CANCELLED -3
+
+/**
+* @brief why an operation stopped early
+*/
+enum F_CANCEL_REASON
+{
+  F_CANCEL_NONE = 0, /**< still running */
+  F_CANCEL_REQUESTED, /**< the token was cancelled */
+  F_CANCEL_DEADLINE, /**< the deadline passed */
+  F_CANCEL_FAILED /**< another thread of the operation failed */
+};
+
+/** @struct FCancel
+* @brief a cancellation token owned by the caller
+*
+* The same token can be shared between several operations,
+* cancelling it stops all of them.
+* @var FCancel::cancelled
+* true once cancellation was requested
+*/
+typedef struct FCancel
+{
+  atomic_bool cancelled;
+} f_cancel;
+
+/** @struct FCancelState
+* @brief the cancellation state of a single operation
+* @var FCancelState::cancel
+* the caller's token (NULL if unused)
+* @var FCancelState::deadline
+* the monotonic deadline in nanoseconds (0 if unused)
+* @var FCancelState::reason
+* why the operation stopped, sticky once set
+*/
+typedef struct FCancelState
+{
+  f_cancel* cancel;
+  long long deadline;
+  atomic_int reason;
+} f_cancel_state;
+
+/**
+  Initializes a new cancellation token
+  @param out the token to init
+  @return non zero for error
+*/
+int f_cancel_init(f_cancel** out);
+
+/**
+  Requests cancellation of every operation using the token
+  @param cancel the token
+*/
+void f_cancel_request(f_cancel* cancel);
+
+/**
+  Checks if cancellation was requested
+  @param cancel the token
+  @return true if cancelled
+*/
+bool f_cancel_requested(f_cancel* cancel);
+
+/**
+  Clears the token so it can be reused
+  @param cancel the token
+*/
+void f_cancel_reset(f_cancel* cancel);
+
+/**
+  Free a cancellation token
+  @param cancel the token to free
+*/
+void f_cancel_free(f_cancel** cancel);
+
+/**
+  Starts tracking cancellation for an operation
+  @param state the state to init
+  @param cancel the caller's token (NULL if unused)
+  @param timeout_ms milliseconds from now until the deadline (0 for no deadline)
+*/
+void f_cancel_state_init(f_cancel_state* state, f_cancel* cancel, unsigned long timeout_ms);
+
+/**
+  Checks the token and the deadline
+  @param state the operation's state
+  @return F_CANCEL_NONE if the operation should keep going
+*/
+enum F_CANCEL_REASON f_cancel_state_poll(f_cancel_state* state);
+
+/**
+  Stops the operation because one of its threads failed
+  @param state the operation's state
+*/
+void f_cancel_state_fail(f_cancel_state* state);
+
+/**
+  Sets errno for a stopped operation
+  
+  ECANCELED if the token was cancelled, ETIMEDOUT if the deadline passed.
+  @param state the operation's state
+*/
+void f_cancel_state_errno(f_cancel_state* state);
+
+#endif
+#ifndef FLASHLIGHT_STATS_H
+#define FLASHLIGHT_STATS_H
+
+/** @file stats.h
+* @brief Counters and stage timings of an indexing run or a search
+*
+* The caller owns the stats and passes them on the `f_indexer` or `f_searcher`,
+* threads add to them as they go. Nothing is measured when no stats are given.
+* Times are in nanoseconds, and summed over every thread.
+*/
+
+// read latency buckets, bucket i counts reads that took under 2^i microseconds, the last one the slower ones.
+#define F_STATS_BUCKETS 20
+// threads timed on their own, threads past these share the last slots.
+#define F_STATS_THREADS 64
+
+/**
+* @brief the stage a time or count is added to
+*/
+enum F_STATS_STAGE
+{
+  F_STATS_SCAN = 0, /**< finding record ends in the bytes read */
+  F_STATS_MERGE, /**< reducing chunks and writing the lookup */
+  F_STATS_MATCH, /**< running the regex */
+  F_STATS_LINES, /**< lines indexed or searched */
+  F_STATS_MATCHES /**< lines that matched */
+};
+
+/** @struct FStats
+* @brief where the time of an indexing run or a search went
+* @var FStats::bytes_read
+* the bytes read from the target
+* @var FStats::reads
+* the reads of the target
+* @var FStats::read_ns
+* the time spent reading
+* @var FStats::read_latency
+* the reads by latency, see F_STATS_BUCKETS
+* @var FStats::scan_ns
+* the time spent finding record ends
+* @var FStats::merge_ns
+* the time spent reducing chunks and writing the lookup
+* @var FStats::match_ns
+* the time spent in pcre2
+* @var FStats::lines
+* the lines indexed or searched
+* @var FStats::matches
+* the lines that matched
+* @var FStats::busy_ns
+* the time each thread spent reading, scanning or matching
+* @var FStats::idle_ns
+* the time each thread spent waiting, or in between
+* @var FStats::threads
+* the number of threads used
+* @var FStats::elapsed_ns
+* the wall time of the whole operation
+* @var FStats::lines_per_sec
+* lines over elapsed time
+* @var FStats::peak_rss
+* the peak resident memory of the process in bytes, when the operation finished
+*/
+typedef struct FStats
+{
+  atomic_ullong bytes_read;
+  atomic_ullong reads;
+  atomic_ullong read_ns;
+  atomic_ullong read_latency[F_STATS_BUCKETS];
+  atomic_ullong scan_ns;
+  atomic_ullong merge_ns;
+  atomic_ullong match_ns;
+  atomic_ullong lines;
+  atomic_ullong matches;
+  atomic_ullong busy_ns[F_STATS_THREADS];
+  atomic_ullong idle_ns[F_STATS_THREADS];
+  int threads;
+  uint64_t elapsed_ns;
+  double lines_per_sec;
+  size_t peak_rss;
+} f_stats;
+
+/**
+  Resets stats to zero
+  @param stats the stats
+*/
+void f_stats_init(f_stats* stats);
+
+/**
+  A monotonic clock
+  @return nanoseconds
+*/
+uint64_t f_stats_now();
+
+/**
+  Counts a read of the target
+  @param stats the stats (NULL if unused)
+  @param bytes the bytes read
+  @param started when the read started, from f_stats_now
+*/
+void f_stats_read(f_stats* stats, size_t bytes, uint64_t started);
+
+/**
+  Adds to the time or count of a stage
+  @param stats the stats (NULL if unused)
+  @param stage the stage
+  @param value nanoseconds, or a count
+*/
+void f_stats_add(f_stats* stats, enum F_STATS_STAGE stage, uint64_t value);
+
+/**
+  Adds the time since `started` to a stage
+  @param stats the stats (NULL if unused)
+  @param stage the stage
+  @param started from f_stats_now
+  @return the nanoseconds added
+*/
+uint64_t f_stats_since(f_stats* stats, enum F_STATS_STAGE stage, uint64_t started);
+
+/**
+  Records how a thread spent its time once it is done
+  @param stats the stats (NULL if unused)
+  @param thread the thread index
+  @param started when the thread started, from f_stats_now
+  @param busy the nanoseconds it spent working
+*/
+void f_stats_thread(f_stats* stats, int thread, uint64_t started, uint64_t busy);
+
+/**
+  Fills in the totals once the operation is done
+  @param stats the stats (NULL if unused)
+  @param started when the operation started, from f_stats_now
+  @param threads the number of threads used
+*/
+void f_stats_finish(f_stats* stats, uint64_t started, int threads);
+
+#endif
+#ifndef FLASHLIGHT_NUMA_H
+#define FLASHLIGHT_NUMA_H
+
+/** @file numa.h
+* @brief The NUMA nodes of the host, to keep threads and their memory on one node
+*
+* Nodes and their cpus are read from sysfs, a host without them is a single node with every online cpu.
+* A thread bound to a node only runs on its cpus and prefers its memory, so the read buffers and offsets
+* it allocates and touches first stay local. Memory is placed with set_mempolicy, without libnuma.
+*/
+
+// the nodes a preferred memory policy can name.
+#define F_NUMA_MAX_NODES 64
+
+/** @struct FNumaNode
+* @brief a node and its cpus
+* @var FNumaNode::id
+* the node number
+* @var FNumaNode::cpus
+* the cpus of the node
+* @var FNumaNode::len
+* the number of cpus
+*/
+typedef struct FNumaNode
+{
+  int id;
+  int* cpus;
+  int len;
+} f_numa_node;
+
+/** @struct FNuma
+* @brief the nodes of the host
+* @var FNuma::nodes
+* the nodes with cpus, by id
+* @var FNuma::len
+* the number of nodes
+*/
+typedef struct FNuma
+{
+  f_numa_node* nodes;
+  int len;
+} f_numa;
+
+/**
+  Finds the nodes of the host
+  @param out the nodes
+  @return non zero for error
+*/
+int f_numa_init(f_numa** out);
+
+/**
+  Spreads threads over the nodes in contiguous blocks, so neighbouring threads share a node
+  @param numa the nodes
+  @param index the thread
+  @param count the number of threads
+  @return the position of the node in `numa->nodes`
+*/
+int f_numa_node_of(f_numa* numa, int index, int count);
+
+/**
+  Runs the calling thread on the cpus of a node and prefers its memory
+  @param numa the nodes
+  @param node the position of the node in `numa->nodes`
+  @return non zero if the thread couldn't be bound
+*/
+int f_numa_bind(f_numa* numa, int node);
+
+/**
+  Frees the nodes
+  @param numa the nodes to free
+*/
+void f_numa_free(f_numa** numa);
+
+#endif
+#ifndef FLASHLIGHT_RUNTIME_H
+#define FLASHLIGHT_RUNTIME_H
+
+/** @file runtime.h
+* @brief A pool of threads shared by indexing and searching
+*
+* A runtime is created once and given to any number of `f_indexer` and `f_searcher` configs,
+* their threads then become tasks queued on the runtime's workers instead of fresh pthreads.
+* The runtime caps how many tasks run at once across every operation using it.
+* Without a runtime, every task gets a thread of its own, as before.
+*
+* Tasks of an operation never wait on tasks that weren't started yet, so operations finish
+* with fewer workers than they ask threads for. A task must not wait on the runtime it runs on,
+* and an ordered search from `f_index_search_start` holds its workers while nobody takes its batches.
+*/
+
+/**
+* @brief where the workers of a runtime run
+*/
+enum F_AFFINITY
+{
+  F_AFFINITY_NONE = 0, /**< anywhere, as the scheduler sees fit */
+  F_AFFINITY_CORES, /**< worker i is pinned to online cpu i, wrapping around */
+  F_AFFINITY_LIST, /**< worker i is pinned to cpus[i], wrapping around */
+  F_AFFINITY_NODES /**< workers are spread over the numa nodes in blocks, and run on any cpu of theirs */
+};
+
+/**
+  A task run on a worker
+  @param payload the payload given to f_runtime_spawn
+  @return the result handed to f_runtime_join
+*/
+typedef void* (*f_runtime_fn)(void* payload);
+
+/** @struct FRuntimeConfig
+* @brief how to create a runtime
+* @var FRuntimeConfig::threads
+* the number of workers (0 for the online cpus)
+* @var FRuntimeConfig::concurrency
+* the number of tasks that run at once across every operation (0 for `threads`)
+* @var FRuntimeConfig::affinity
+* where workers run
+* @var FRuntimeConfig::cpus
+* the cpus to pin workers to, for F_AFFINITY_LIST
+* @var FRuntimeConfig::cpus_len
+* the number of cpus
+*/
+typedef struct FRuntimeConfig
+{
+  int threads;
+  int concurrency;
+  enum F_AFFINITY affinity;
+  const int* cpus;
+  int cpus_len;
+} f_runtime_config;
+
+/** @struct FRuntimeTask
+* @brief a task that was spawned, until it is joined
+* @var FRuntimeTask::runtime
+* the runtime it is queued on (NULL if it has a thread of its own)
+* @var FRuntimeTask::thread
+* its own thread, without a runtime
+* @var FRuntimeTask::run
+* the function to run
+* @var FRuntimeTask::payload
+* passed to run
+* @var FRuntimeTask::result
+* what run returned
+* @var FRuntimeTask::done
+* true once run returned
+* @var FRuntimeTask::next
+* the next queued task
+*/
+typedef struct FRuntimeTask
+{
+  struct FRuntime* runtime;
+  pthread_t thread;
+  f_runtime_fn run;
+  void* payload;
+  void* result;
+  bool done;
+  struct FRuntimeTask* next;
+} f_runtime_task;
+
+/** @struct FRuntimeWorker
+* @brief a thread of a runtime
+* @var FRuntimeWorker::runtime
+* the runtime
+* @var FRuntimeWorker::thread
+* the pthread
+* @var FRuntimeWorker::index
+* the position of the worker, for its affinity
+*/
+typedef struct FRuntimeWorker
+{
+  struct FRuntime* runtime;
+  pthread_t thread;
+  int index;
+} f_runtime_worker;
+
+/** @struct FRuntime
+* @brief a pool of threads tasks are queued on
+* @var FRuntime::workers
+* the threads
+* @var FRuntime::len
+* the number of threads
+* @var FRuntime::config
+* the config it was created with
+* @var FRuntime::numa
+* the numa nodes, for F_AFFINITY_NODES (NULL otherwise)
+* @var FRuntime::concurrency
+* the number of tasks that can run at once
+* @var FRuntime::running
+* the number of tasks running
+* @var FRuntime::head
+* the first queued task
+* @var FRuntime::tail
+* the last queued task
+* @var FRuntime::stop
+* true once the workers should exit, after the queued tasks
+* @var FRuntime::lock
+* serializes the fields above
+* @var FRuntime::ready
+* signaled when a task is queued or can start
+* @var FRuntime::finished
+* broadcast when a task is done
+*/
+typedef struct FRuntime
+{
+  f_runtime_worker* workers;
+  int len;
+  f_runtime_config config;
+  f_numa* numa;
+  int concurrency;
+  int running;
+  f_runtime_task* head;
+  f_runtime_task* tail;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t finished;
+} f_runtime;
+
+/**
+  Creates a runtime and starts its workers
+  @param out the runtime
+  @param config how many workers, the concurrency cap and affinity
+  @return non zero for error
+*/
+int f_runtime_init(f_runtime** out, f_runtime_config config);
+
+/**
+  Runs a task on a runtime, or on a thread of its own
+  @param out the task, to join
+  @param runtime the runtime to queue the task on (NULL for a thread of its own)
+  @param run the function to run
+  @param payload passed to run
+  @return non zero for error
+*/
+int f_runtime_spawn(f_runtime_task** out, f_runtime* runtime, f_runtime_fn run, void* payload);
+
+/**
+  Waits for a task and frees it
+  @param task the task
+  @param result what the task returned (NULL if unused)
+  @return non zero for error
+*/
+int f_runtime_join(f_runtime_task* task, void** result);
+
+/**
+  Changes how many tasks run at once, tasks that are running aren't stopped
+  @param runtime the runtime
+  @param concurrency the new cap (0 for the number of workers)
+*/
+void f_runtime_set_concurrency(f_runtime* runtime, int concurrency);
+
+/**
+  Runs the queued tasks, stops the workers and frees the runtime.
+  The operations using the runtime have to be done.
+  @param runtime the runtime to free
+*/
+void f_runtime_free(f_runtime** runtime);
 
 #endif
 #ifndef FLASHLIGHT_NODE_H
@@ -606,6 +1289,9 @@ void f_node_free(f_node** node);
 * This allows for indexing parts of a file to later be recombined into a single FNode
 */
 
+// set on the offsets of non atomic bytes written to a lookup file, until they are resolved.
+#define F_BYTES_TAG ((size_t) 1 << (sizeof(size_t) * 8 - 1))
+
 /** @struct FBytes
 * @brief representation of the start of a file unit to index
 * @var FBytes::atomic 
@@ -725,6 +1411,8 @@ int f_bytes_node_prepend(f_bytes_node** head, f_bytes_node** parent);
 * true if the chunk doesn't have an FBytesNode
 * @var FChunk::line_count
 * the count of offsets used in this chunk
+* @var FChunk::pooled
+* true if its FBytesNode are in an arena, and are freed when the arena is reset
 */
 typedef struct FChunk
 {
@@ -733,6 +1421,7 @@ typedef struct FChunk
   f_bytes_node* last;
   bool empty;
   unsigned int line_count;
+  bool pooled;
 } f_chunk;
 
 /**
@@ -751,7 +1440,7 @@ int f_chunk_new(f_chunk** out, unsigned long int current, f_bytes_node* firstref
 void f_chunk_free(f_chunk** chunk);
 
 /**
-  Free a chunk and the FBytesNode in it.
+  Free a chunk and the FBytesNode in it, unless they are pooled.
   @param chunk the chunk to free
 */
 void f_chunk_free_all(f_chunk* chunk);
@@ -804,6 +1493,9 @@ void f_chunk_array_free_all(f_chunk** chunks, size_t len);
 #ifndef FLASHLIGHT_LOOKUP_H
 #define FLASHLIGHT_LOOKUP_H
 
+// offsets swapped at a time while reversing a lookup file.
+#define F_LOOKUP_REVERSE 4096
+
 /** @struct FLookupFile
 * @brief an persistent index
 * @var path
@@ -815,127 +1507,1411 @@ void f_chunk_array_free_all(f_chunk** chunks, size_t len);
 * @var len
 * the number of lines in the target file
 */
-typedef struct FLookupFile
-{
-  char* path;
-  int fd;
-  FILE* fp;
-  unsigned int len;
-} f_lookup_file;
+typedef struct FLookupFile
+{
+  char* path;
+  int fd;
+  FILE* fp;
+  unsigned int len;
+} f_lookup_file;
+
+/** @struct FLookupMem
+* @brief an in-memory index
+* @var len
+* the number of lines in the target file
+* @var values
+* an array of line offsets
+*/
+typedef struct FLookupMem
+{
+  size_t len;
+  size_t* values;
+} f_lookup_mem;
+
+/**
+  Create a memory lookup from an FChunk
+  @param out the lookup to init
+  @param chunk the chunk to use
+  @return non zero for error
+*/
+int f_lookup_mem_from_chunk(f_lookup_mem** out, f_chunk* chunk);
+void f_lookup_mem_free(f_lookup_mem* lookup);
+
+/**
+  Init an persistent index
+  @param out the lookup to init
+  @param path the filename for the index
+  @return non zero for error
+*/
+int f_lookup_file_init(f_lookup_file** out, char* path);
+
+/**
+  Append an offset to the persistent index
+  @param db the lookup to append to
+  @param offset the offset to append
+  @return non zero for error
+*/
+int f_lookup_file_append(f_lookup_file* db, size_t offset);
+
+/**
+  Init a persistent index from an FChunk
+  @param out the lookup to use
+  @param chunk the chunk to use
+  @param path the filename for the index
+  @param first if true, create the lookup, else the lookup is expected to be inited
+  @param last if true, add a 0 byte offset to represent the beginning of the target file
+
+  Offsets of non atomic bytes are written with F_BYTES_TAG set.
+  The nodes of the chunk are freed, unless they are pooled.
+*/
+int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bool first, bool last);
+
+/**
+  Reverses the offsets of a persistent index in place
+
+  For formats that find records front to back, the lookup stores them from the end of the target.
+  @param lookup the lookup, with every offset appended
+  @param count the number of offsets
+  @return non zero for error
+*/
+int f_lookup_file_reverse(f_lookup_file* lookup, size_t count);
+void f_lookup_file_free(f_lookup_file** lookupref);
+
+#endif
+#ifndef FLASHLIGHT_COMPRESS_H
+#define FLASHLIGHT_COMPRESS_H
+
+/** @file compress.h
+* @brief Random access into gzip and zstd targets
+*
+* A compressed target is decompressed once while it is indexed, and checkpoints
+* are kept along the way: the start of every zstd frame or gzip member, and a
+* snapshot of the gzip window every `span` bytes. Offsets are in uncompressed
+* coordinates, a read only decompresses from the checkpoint before it.
+* Spans that were decompressed recently are kept in a small cache.
+*
+* zstd targets with several frames and bgzip targets are split without decompressing them,
+* and their frames are decompressed in parallel, ahead of the bytes being consumed in order.
+* A frame can also be looked at on the thread that decompressed it, before its offset is known.
+*/
+
+// the size of a deflate window.
+#define F_COMPRESS_WINDOW 32768
+// compressed bytes read at a time.
+#define F_COMPRESS_READ 65536
+// uncompressed bytes between gzip checkpoints, when none is given.
+#define F_COMPRESS_DEFAULT_SPAN (1u << 20)
+// decompressed spans kept around.
+#define F_COMPRESS_CACHE 8
+// spans bigger than this, e.g. a zstd target with a single frame, are decompressed on every read instead of cached.
+#define F_COMPRESS_CACHE_MAX (16u << 20)
+// frames bigger than this are decompressed in a single stream, it bounds the memory of the frames in flight.
+#define F_COMPRESS_FRAME_MAX (8u << 20)
+// frames decompressed ahead of the one being consumed, per thread.
+#define F_COMPRESS_AHEAD 2
+
+/**
+* @brief the compression of a target
+*/
+enum F_COMPRESSION
+{
+  F_COMPRESSION_NONE = 0, /**< raw bytes */
+  F_COMPRESSION_AUTO, /**< detected from the magic bytes at the start of the target */
+  F_COMPRESSION_GZIP, /**< gzip, one or more members */
+  F_COMPRESSION_ZSTD /**< zstd, one or more frames */
+};
+
+/** @struct FCompressPoint
+* @brief a place decompression can start from
+* @var FCompressPoint::out
+* the uncompressed offset
+* @var FCompressPoint::in
+* the compressed offset
+* @var FCompressPoint::bits
+* the bits of the byte before `in` that are still to be decompressed (gzip only)
+* @var FCompressPoint::window
+* the last F_COMPRESS_WINDOW uncompressed bytes before the point, NULL at the start of a gzip member or zstd frame
+*/
+typedef struct FCompressPoint
+{
+  size_t out;
+  size_t in;
+  int bits;
+  uint8_t* window;
+} f_compress_point;
+
+/** @struct FCompressSpan
+* @brief a decompressed span between two points
+* @var FCompressSpan::point
+* the point the span starts at
+* @var FCompressSpan::data
+* the bytes of the span (NULL if the slot is empty)
+* @var FCompressSpan::len
+* the number of bytes
+* @var FCompressSpan::used
+* when the span was last read, to find the oldest one
+*/
+typedef struct FCompressSpan
+{
+  size_t point;
+  uint8_t* data;
+  size_t len;
+  uint64_t used;
+} f_compress_span;
+
+/** @struct FCompressed
+* @brief the checkpoints of a compressed target
+* @var FCompressed::kind
+* the compression
+* @var FCompressed::fd
+* the file descriptor of the compressed target
+* @var FCompressed::size
+* the uncompressed size
+* @var FCompressed::points
+* the checkpoints, by offset
+* @var FCompressed::len
+* the number of checkpoints
+* @var FCompressed::cap
+* the capacity of the checkpoints array
+* @var FCompressed::lock
+* serializes the cache
+* @var FCompressed::cache
+* the spans decompressed recently
+* @var FCompressed::clock
+* counts cache reads
+*/
+typedef struct FCompressed
+{
+  enum F_COMPRESSION kind;
+  int fd;
+  size_t size;
+  f_compress_point* points;
+  size_t len;
+  size_t cap;
+  pthread_mutex_t lock;
+  f_compress_span cache[F_COMPRESS_CACHE];
+  uint64_t clock;
+} f_compressed;
+
+/** @struct FCompressFrame
+* @brief a gzip member or zstd frame that is decompressed on its own
+* @var FCompressFrame::in
+* the compressed offset
+* @var FCompressFrame::len
+* the compressed size
+* @var FCompressFrame::data
+* the decompressed bytes (NULL until done, or if it failed)
+* @var FCompressFrame::out_len
+* the decompressed size
+* @var FCompressFrame::result
+* what on_frame found in the bytes, allocated with malloc (NULL if unused)
+* @var FCompressFrame::done
+* true once a thread finished with the frame
+*/
+typedef struct FCompressFrame
+{
+  size_t in;
+  size_t len;
+  uint8_t* data;
+  size_t out_len;
+  void* result;
+  bool done;
+} f_compress_frame;
+
+/**
+  Called on a decompression thread with the bytes of a whole frame, in any order
+  @param payload the payload given to f_compressed_build
+  @param data the decompressed bytes of the frame
+  @param len the number of bytes
+  @param result what was found in the bytes, allocated with malloc, handed to on_data and freed after it
+  @return non zero for error
+*/
+typedef int (*f_compressed_frame_cb)(void* payload, const uint8_t* data, size_t len, void** result);
+
+/** @struct FCompressPipeline
+* @brief frames decompressed by a pool of threads, consumed in order
+* @var FCompressPipeline::compressed
+* the target
+* @var FCompressPipeline::frames
+* the frames, by offset
+* @var FCompressPipeline::len
+* the number of frames
+* @var FCompressPipeline::next
+* the next frame a thread picks up
+* @var FCompressPipeline::consumed
+* the number of frames consumed, threads stay within `window` of it
+* @var FCompressPipeline::window
+* the frames that can be in flight
+* @var FCompressPipeline::stop
+* true once the threads should exit
+* @var FCompressPipeline::failed
+* true if a frame couldn't be decompressed
+* @var FCompressPipeline::lock
+* serializes the fields above
+* @var FCompressPipeline::ready
+* signaled when a frame is done or consumed
+* @var FCompressPipeline::on_frame
+* called on the threads with every decompressed frame (NULL if unused)
+* @var FCompressPipeline::payload
+* passed to on_frame
+*/
+typedef struct FCompressPipeline
+{
+  f_compressed* compressed;
+  f_compress_frame* frames;
+  size_t len;
+  size_t next;
+  size_t consumed;
+  size_t window;
+  bool stop;
+  bool failed;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  f_compressed_frame_cb on_frame;
+  void* payload;
+} f_compress_pipeline;
+
+/**
+  Called with the bytes of a target as it is decompressed, in order
+  @param payload the payload given to f_compressed_build
+  @param data the decompressed bytes
+  @param len the number of bytes
+  @param offset the uncompressed offset of the bytes
+  @param result what on_frame found in the bytes (NULL if they weren't decompressed as a frame)
+  @return non zero to stop
+*/
+typedef int (*f_compressed_cb)(void* payload, const uint8_t* data, size_t len, size_t offset, void* result);
+
+/**
+  Detects the compression of a target from its magic bytes
+  @param fd the file descriptor of the target
+  @return F_COMPRESSION_GZIP, F_COMPRESSION_ZSTD or F_COMPRESSION_NONE
+*/
+enum F_COMPRESSION f_compressed_detect(int fd);
+
+/**
+  Decompresses a target once and keeps checkpoints to read it from
+
+  Frames that can be found without decompressing them are decompressed on `threads` threads,
+  and handed to on_frame there. on_data is still called in order, on the calling thread.
+  @param out the checkpoints
+  @param fd the file descriptor of the target, not owned
+  @param kind F_COMPRESSION_GZIP or F_COMPRESSION_ZSTD
+  @param span the uncompressed bytes between gzip checkpoints (0 for the default)
+  @param threads the threads to decompress frames on (1 for a single stream)
+  @param on_frame called on the threads with every frame (NULL if unused)
+  @param on_data called with the decompressed bytes (NULL if unused)
+  @param payload passed to on_frame and on_data
+  @return non zero for error, or what on_data returned if it stopped
+*/
+int f_compressed_build(f_compressed** out, int fd, enum F_COMPRESSION kind, size_t span, int threads, f_compressed_frame_cb on_frame, f_compressed_cb on_data, void* payload);
+
+/**
+  Reads the uncompressed bytes of a target, like pread
+  @param compressed the checkpoints
+  @param buffer where to copy the bytes
+  @param len the number of bytes to read
+  @param offset the uncompressed offset to read from
+  @return the number of bytes read, less at the end of the target, -1 for error
+*/
+ssize_t f_compressed_read(f_compressed* compressed, void* buffer, size_t len, size_t offset);
+
+/**
+  Frees the checkpoints of a target
+  @param compressed the checkpoints to free
+*/
+void f_compressed_free(f_compressed** compressed);
+
+#endif
+#ifndef FLASHLIGHT_RECORD_H
+#define FLASHLIGHT_RECORD_H
+
+/** @file record.h
+* @brief Detectors for where a record ends, when a record can hold newlines
+*
+* The indexer only looks at newlines, a detector decides which of them end a record.
+* Records then take the place of lines everywhere: line numbers count records,
+* and a line returned by a lookup or a search can hold newlines.
+*/
+
+// bytes read past the end of a chunk, to match the line that starts after its last newline.
+#define F_RECORD_LOOKAHEAD 4096
+// offsets of the lookup file read at a time while resolving quotes.
+#define F_RECORD_RESOLVE 4096
+
+/**
+* @brief which newlines end a record
+*/
+enum F_RECORD
+{
+  F_RECORD_LINE = 0, /**< every newline */
+  F_RECORD_QUOTED, /**< newlines outside quotes, for CSV with quoted newlines */
+  F_RECORD_PREFIX /**< newlines followed by a line that matches a prefix regex, for multi line log events */
+};
+
+/** @struct FRecordChunk
+* @brief the quotes of one chunk of the target
+* @var FRecordChunk::from
+* the offset the chunk starts at
+* @var FRecordChunk::flips
+* true if the chunk has an odd number of quotes
+*/
+typedef struct FRecordChunk
+{
+  size_t from;
+  bool flips;
+} f_record_chunk;
+
+/** @struct FRecord
+* @brief the record detector of one indexing run
+*
+* Chunks are scanned in parallel, before the quote state at their start is known.
+* A quoted detector marks the newlines that are inside quotes if the chunk starts outside them as non atomic,
+* and `f_record_resolve` keeps the right ones once every chunk was scanned.
+* @var FRecord::mode
+* the detector
+* @var FRecord::quote
+* the byte fields are quoted with (quoted only)
+* @var FRecord::prefix
+* the regex a line has to match at its start to begin a record (prefix only)
+* @var FRecord::file_size
+* the size of the target
+* @var FRecord::lock
+* serializes adding chunks
+* @var FRecord::chunks
+* the chunks scanned so far (quoted only)
+* @var FRecord::len
+* the number of chunks
+* @var FRecord::cap
+* the capacity of the chunks array
+*/
+typedef struct FRecord
+{
+  enum F_RECORD mode;
+  char quote;
+  pcre2_code* prefix;
+  size_t file_size;
+  pthread_mutex_t lock;
+  f_record_chunk* chunks;
+  size_t len;
+  size_t cap;
+} f_record;
+
+/** @struct FRecordScan
+* @brief the state of a detector in one chunk
+* @var FRecordScan::quoted
+* true if the scan is inside quotes, assuming the chunk started outside them
+* @var FRecordScan::match_data
+* the match data of the prefix regex (prefix only)
+*/
+typedef struct FRecordScan
+{
+  bool quoted;
+  pcre2_match_data* match_data;
+} f_record_scan;
+
+/**
+  Initializes a record detector
+
+  @param record the detector
+  @param mode which newlines end a record
+  @param quote the byte fields are quoted with ('\0' for '"')
+  @param prefix the regex a line starts a record with (F_RECORD_PREFIX only)
+  @param file_size the size of the target
+  @return non zero for error
+*/
+int f_record_init(f_record* record, enum F_RECORD mode, char quote, const char* prefix, size_t file_size);
+
+/**
+  Starts scanning a chunk
+  @param scan the state to init
+  @param record the detector
+  @return non zero for error
+*/
+int f_record_scan_init(f_record_scan* scan, f_record* record);
+
+/**
+  Decides if a newline ends a record
+
+  Quoted detectors have to see every byte of the chunk, in order, through this function.
+  @param record the detector
+  @param scan the state of the chunk
+  @param buffer the bytes read, which can go past the chunk
+  @param pos the position of the byte in buffer
+  @param len the number of bytes read
+  @param offset the offset of the byte in the target
+  @param atomic false if the newline only ends a record when the chunk starts inside quotes
+  @return true if the byte is a newline that can end a record
+*/
+bool f_record_boundary(f_record* record, f_record_scan* scan, const uint8_t* buffer, size_t pos, size_t len, size_t offset, bool* atomic);
+
+/**
+  Finishes scanning a chunk
+  @param record the detector
+  @param scan the state of the chunk
+  @param from the offset the chunk starts at
+  @return non zero for error
+*/
+int f_record_scan_done(f_record* record, f_record_scan* scan, size_t from);
+
+/**
+  Keeps the offsets of a lookup that end a record, once every chunk was scanned
+
+  The lookup is compacted in place and its len is updated.
+  @param record the detector
+  @param lookup the lookup written from the chunks
+  @return non zero for error
+*/
+int f_record_resolve(f_record* record, f_lookup_file* lookup);
+
+/**
+  Frees what a record detector allocated
+  @param record the detector
+*/
+void f_record_free(f_record* record);
+
+#endif
+#ifndef FLASHLIGHT_INDEX_H
+#define FLASHLIGHT_INDEX_H
+
+/** @struct FIndex
+* @brief an index of a target file that resides on disk
+* 
+* The index is the main export of this library.
+* The index itself can be stored in memory (FLookupMem) 
+* or also live on disk (FLookupFile).  It cannot be both.
+* @var FIndex::filename
+* the target filename
+* @var FIndex::filename_len
+* the target filename length
+* @var FIndex::fd
+* the target file descriptor
+* @var FIndex::fp
+* a file pointer to the target.
+* @var FIndex::flookup
+* a file lookup (NULL if unused)
+* @var FIndex::mlookup
+* an in-memory lookup (NULL if unsed)
+* @var FIndex::trigrams
+* a trigram index to skip blocks that can't match (NULL if unused)
+* @var FIndex::tokens
+* a token index for exact term lookups (NULL if unused)
+* @var FIndex::times
+* sampled line timestamps to seek to a time window (NULL if unused)
+* @var FIndex::fields
+* the field offsets of a delimited file (NULL if unused)
+* @var FIndex::records
+* true if lines are split on the offsets of the lookup only, because a record can hold newlines
+* @var FIndex::record_head
+* the bytes at the start of every record that aren't part of the line, e.g. a length prefix
+* @var FIndex::record_tail
+* the byte every record ends with, not part of the line ('\n' for text, -1 for none)
+* @var FIndex::record_width
+* the size of every record if they all have the same size, lines are then found without a lookup (0 if unused)
+* @var FIndex::record_start
+* the offset of the first record of a fixed width index, after a file header
+* @var FIndex::record_count
+* the number of records of a fixed width index
+* @var FIndex::compressed
+* the checkpoints to read a gzip or zstd target from, offsets are then uncompressed (NULL for a raw target)
+*/
+typedef struct FIndex
+{
+  char* filename;
+  int filename_len;
+  int fd;
+  FILE* fp;
+  f_lookup_file* flookup;
+  f_lookup_mem* mlookup;
+  struct FTrigramIndex* trigrams;
+  struct FTokenIndex* tokens;
+  struct FTimeIndex* times;
+  struct FFieldIndex* fields;
+  bool records;
+  size_t record_head;
+  int record_tail;
+  size_t record_width;
+  size_t record_start;
+  size_t record_count;
+  struct FCompressed* compressed;
+} f_index;
+
+/** @struct FIndexLines
+* @brief lines fetched from the target, with where each one starts
+* @var FIndexLines::data
+* the lines, zero terminated (NULL if there were none to fetch)
+* @var FIndexLines::offsets
+* `count + 1` offsets into data, line i is [offsets[i], offsets[i + 1]) with its newline
+* @var FIndexLines::count
+* the number of lines
+* @var FIndexLines::head
+* the bytes skipped at the start of every line
+* @var FIndexLines::tail
+* the byte stripped from the end of every line (-1 for none)
+*/
+typedef struct FIndexLines
+{
+  char* data;
+  size_t* offsets;
+  size_t count;
+  size_t head;
+  int tail;
+} f_index_lines;
+
+/**
+  Initializes a new index
+
+  @param out the index to initialize
+  @param filename the target filename for the index
+  @param filename_len the target filename length
+  @param flookup a file lookup (NULL if unused)
+  @param mlookup an memory lookup (NULL if unused)
+  @return non zero for error
+*/
+int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file* flookup, f_lookup_mem* mlookup);
+
+/**
+  Initializes an index of records that all have the same size
+
+  Offsets are computed from the record size, there is no lookup.
+  @param out the index to initialize
+  @param filename the target filename for the index
+  @param filename_len the target filename length
+  @param start the offset of the first record, after a file header
+  @param width the size of every record
+  @return non zero for error
+*/
+int f_index_init_fixed(f_index** out, char* filename, int filename_len, size_t start, size_t width);
+
+/**
+  Counts the lines of an index
+  @param index the index
+  @return the number of lines, or records
+*/
+size_t f_index_line_count(f_index* index);
+
+/**
+  Fetches a portion of the file
+  
+  @param out the fetched string, zero terminated
+  @param index the index to search
+  @param start the start line index
+  @param count the number of lines to fetch
+  @return non zero for error
+*/
+int f_index_lookup(char** out, f_index* index, size_t start, size_t count);
+
+/**
+  Fetches a portion of the file, split into lines
+
+  Lines of an index built with a record detector can hold newlines,
+  so they are split with the offsets of the lookup instead.
+  @param out the fetched lines, freed with f_index_lines_free
+  @param index the index to search
+  @param start the start line index
+  @param count the number of lines to fetch
+  @return non zero for error
+*/
+int f_index_lookup_lines(f_index_lines* out, f_index* index, size_t start, size_t count);
+
+/**
+  Gets one of the fetched lines
+  @param lines the fetched lines
+  @param i the line, 0 for the first fetched line
+  @param line the start of the line
+  @param line_len the length of the line, without its newline, or the head and tail of its record
+*/
+void f_index_lines_get(f_index_lines* lines, size_t i, char** line, size_t* line_len);
+
+/**
+  Frees fetched lines
+  @param lines the lines to free
+*/
+void f_index_lines_free(f_index_lines* lines);
+
+/**
+  Frees an index and it's lookup
+
+  If the lookup is a FLookupFile, the file is deleted,
+  and so are the trigram, token and field indexes
+  @param index the index to free
+*/
+void f_index_free(f_index** index);
+typedef void (*lookup_stream_cb)(char* data);
+
+#endif
+#ifndef FLASHLIGHT_TRIGRAM_H
+#define FLASHLIGHT_TRIGRAM_H
+
+/** @file trigram.h
+* @brief A per block trigram filter, to skip lines that can't match a regex
+*
+* Every block of lines gets a fixed size bitset with one (hashed) bit
+* for each trigram in its lines. A search derives the trigrams a match
+* must contain from its pattern, and only reads the blocks that have them all.
+* Bits can collide, so a block that passes may still have no match.
+*/
+
+#define F_TRIGRAM_MAGIC 0x47544c46u
+#define F_TRIGRAM_VERSION 1u
+#define F_TRIGRAM_DEFAULT_FILTER 4096
+
+/** @struct FTrigramHeader
+* @brief the header of a trigram index file, followed by one filter per block
+* @var FTrigramHeader::magic
+* F_TRIGRAM_MAGIC
+* @var FTrigramHeader::version
+* F_TRIGRAM_VERSION
+* @var FTrigramHeader::block_lines
+* the number of lines in each block
+* @var FTrigramHeader::filter_bytes
+* the size of each block's filter
+* @var FTrigramHeader::block_count
+* the number of blocks
+*/
+typedef struct FTrigramHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t block_lines;
+  uint64_t filter_bytes;
+  uint64_t block_count;
+} f_trigram_header;
+
+/** @struct FTrigramIndex
+* @brief a trigram index, mapped from the file next to the lookup
+* @var FTrigramIndex::path
+* the location of the trigram index
+* @var FTrigramIndex::fd
+* the file descriptor of the trigram index
+* @var FTrigramIndex::map
+* the mapped file
+* @var FTrigramIndex::map_len
+* the size of the mapped file
+* @var FTrigramIndex::block_lines
+* the number of lines in each block
+* @var FTrigramIndex::filter_bytes
+* the size of each block's filter
+* @var FTrigramIndex::block_count
+* the number of blocks
+* @var FTrigramIndex::filters
+* the filters, `filter_bytes` for each block
+*/
+typedef struct FTrigramIndex
+{
+  char* path;
+  int fd;
+  void* map;
+  size_t map_len;
+  size_t block_lines;
+  size_t filter_bytes;
+  size_t block_count;
+  uint8_t* filters;
+} f_trigram_index;
+
+/** @struct FTrigramQuery
+* @brief the trigrams a line must contain to match a pattern
+*
+* A line can only match if it has every trigram of at least one branch.
+* @var FTrigramQuery::trigrams
+* the hashed trigrams of every branch, one after the other
+* @var FTrigramQuery::branch_len
+* how many trigrams each branch has
+* @var FTrigramQuery::branches
+* the number of branches
+*/
+typedef struct FTrigramQuery
+{
+  uint32_t* trigrams;
+  size_t* branch_len;
+  size_t branches;
+} f_trigram_query;
+
+/** @struct FTrigramThread
+* @brief the blocks one thread builds filters for
+* @var FTrigramThread::trigrams
+* the trigram index being built
+* @var FTrigramThread::index
+* the index to read lines from
+* @var FTrigramThread::from
+* the first block
+* @var FTrigramThread::to
+* the block to stop at
+* @var FTrigramThread::cancel
+* the cancellation state of the indexing
+* @var FTrigramThread::rc
+* non zero if building failed
+*/
+typedef struct FTrigramThread
+{
+  f_trigram_index* trigrams;
+  f_index* index;
+  size_t from;
+  size_t to;
+  f_cancel_state* cancel;
+  int rc;
+} f_trigram_thread;
+
+/**
+  Builds a trigram index for every line of an index
+
+  Blocks are split between `threads`, each writes its filters straight to `path`.
+  The file is then mapped read only.
+  @param out the trigram index
+  @param index the index to read lines from
+  @param path the file to write, owned by the trigram index (freed on error)
+  @param block_lines the number of lines in each block, at least 1
+  @param filter_bytes the size of each block's filter (0 for the default)
+  @param threads how many threads to build with, at least 1
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_trigram_index_build(f_trigram_index** out, f_index* index, char* path, size_t block_lines, size_t filter_bytes, int threads, f_cancel_state* cancel);
+
+/**
+  Checks if a block can have lines that match
+  @param trigrams the trigram index
+  @param query the query of the pattern
+  @param block the block to check
+  @return false if no line of the block can match
+*/
+bool f_trigram_index_maybe(f_trigram_index* trigrams, f_trigram_query* query, size_t block);
+
+/**
+  Unmaps and deletes a trigram index
+  @param trigrams the trigram index to free
+*/
+void f_trigram_index_free(f_trigram_index** trigrams);
+
+/**
+  Derives the trigrams a match of `pattern` must contain
+
+  Only literal runs are used, anything the parser isn't sure about
+  (groups, classes, options, optional characters) just ends a run.
+  @param out the query, NULL if the pattern doesn't require any trigram
+  @param pattern the regex
+  @return non zero for error
+*/
+int f_trigram_query_init(f_trigram_query** out, const char* pattern);
+
+/**
+  Frees a trigram query
+  @param query the query to free
+*/
+void f_trigram_query_free(f_trigram_query** query);
+
+#endif
+#ifndef FLASHLIGHT_BITMAP_H
+#define FLASHLIGHT_BITMAP_H
+
+/** @file bitmap.h
+* @brief A compressed set of line numbers
+*
+* Line numbers are split into a high key and a low 16 bits, roaring style.
+* Each key owns a container that stores the low bits as a sorted array
+* while it is sparse, and as a 65536 bit bitset once it is dense.
+*/
+
+#define F_BITMAP_ARRAY_MAX 4096
+#define F_BITMAP_WORDS 1024
+
+/** @struct FBitmapContainer
+* @brief the line numbers that share the same high bits
+* @var FBitmapContainer::key
+* the high bits (line number >> 16)
+* @var FBitmapContainer::cardinality
+* the number of line numbers in this container
+* @var FBitmapContainer::cap
+* the capacity of the array (unused for a bitset)
+* @var FBitmapContainer::array
+* sorted low bits (NULL once the container is a bitset)
+* @var FBitmapContainer::bits
+* a bitset of low bits (NULL while the container is an array)
+*/
+typedef struct FBitmapContainer
+{
+  size_t key;
+  unsigned int cardinality;
+  unsigned int cap;
+  uint16_t* array;
+  uint64_t* bits;
+} f_bitmap_container;
+
+/** @struct FBitmap
+* @brief a set of line numbers
+* @var FBitmap::containers
+* containers sorted by key
+* @var FBitmap::len
+* the number of containers
+* @var FBitmap::cap
+* the capacity of the containers array
+* @var FBitmap::cardinality
+* the number of line numbers in the set
+*/
+typedef struct FBitmap
+{
+  f_bitmap_container* containers;
+  size_t len;
+  size_t cap;
+  size_t cardinality;
+} f_bitmap;
+
+/**
+  Initializes an empty bitmap
+  @param out the bitmap to init
+  @return non zero for error
+*/
+int f_bitmap_init(f_bitmap** out);
+
+/**
+  Adds a line number to the bitmap
+
+  Adding in ascending order is the fast path.
+  @param bitmap the bitmap
+  @param line the line number to add
+  @return non zero for error
+*/
+int f_bitmap_add(f_bitmap* bitmap, size_t line);
+
+/**
+  Checks if a line number is in the bitmap
+  @param bitmap the bitmap
+  @param line the line number to check
+  @return true if the line number is set
+*/
+bool f_bitmap_contains(f_bitmap* bitmap, size_t line);
+
+/**
+  Counts the line numbers in [start, end)
+
+  Useful for building a histogram without walking every line.
+  @param bitmap the bitmap
+  @param start the first line number to count
+  @param end the line number to stop at
+  @return the number of line numbers in the range
+*/
+size_t f_bitmap_count_range(f_bitmap* bitmap, size_t start, size_t end);
+
+/**
+  Finds the first line number that is greater or equal to `from`
+  @param bitmap the bitmap
+  @param from the line number to start from
+  @param out the line number found
+  @return true if a line number was found
+*/
+bool f_bitmap_next(f_bitmap* bitmap, size_t from, size_t* out);
+
+/**
+  Adds every line number of `other` to `bitmap`
+  @param bitmap the bitmap to merge into
+  @param other the bitmap to merge
+  @return non zero for error
+*/
+int f_bitmap_merge(f_bitmap* bitmap, f_bitmap* other);
+
+/**
+  Free a bitmap
+  @param bitmap the bitmap to free
+*/
+void f_bitmap_free(f_bitmap** bitmap);
+
+#endif
+#ifndef FLASHLIGHT_TOKEN_H
+#define FLASHLIGHT_TOKEN_H
+
+/** @file token.h
+* @brief An inverted index from tokens to the lines they are on
+*
+* Lines are split into tokens, each token is hashed and gets a posting
+* list of the line numbers it is on, delta and varint encoded.
+* The index is a sidecar file next to the lookup, mapped read only:
+* a header, the posting lists, then a directory sorted by hash.
+*/
+
+#define F_TOKEN_MAGIC 0x4b544c46u
+#define F_TOKEN_VERSION 1u
+// pairs a thread sorts in memory before spilling them to its run file.
+#define F_TOKEN_RUN_PAIRS (1 << 20)
+// pairs buffered for each run while merging.
+#define F_TOKEN_READ_PAIRS 4096
+// lines a thread reads at a time.
+#define F_TOKEN_READ_LINES 4096
+
+/**
+* @brief how lines are split into tokens
+*/
+enum F_TOKENIZER
+{
+  F_TOKENIZER_NONE = 0, /**< no token index */
+  F_TOKENIZER_WHITESPACE, /**< tokens are separated by whitespace */
+  F_TOKENIZER_PUNCTUATION /**< tokens are runs of letters, digits, '_' and non ascii bytes */
+};
+
+/** @struct FTokenHeader
+* @brief the header of a token index file
+* @var FTokenHeader::magic
+* F_TOKEN_MAGIC
+* @var FTokenHeader::version
+* F_TOKEN_VERSION
+* @var FTokenHeader::tokenizer
+* the tokenizer the lines were split with
+* @var FTokenHeader::entry_count
+* the number of distinct tokens
+* @var FTokenHeader::directory_offset
+* where the directory starts
+*/
+typedef struct FTokenHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t tokenizer;
+  uint64_t entry_count;
+  uint64_t directory_offset;
+} f_token_header;
+
+/** @struct FTokenEntry
+* @brief the posting list of one token
+* @var FTokenEntry::hash
+* the hash of the token
+* @var FTokenEntry::offset
+* where the posting list starts
+* @var FTokenEntry::count
+* the number of lines in the posting list
+*/
+typedef struct FTokenEntry
+{
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t count;
+} f_token_entry;
+
+/** @struct FTokenPair
+* @brief a token on a line, as collected before merging
+* @var FTokenPair::hash
+* the hash of the token
+* @var FTokenPair::line
+* the line number
+*/
+typedef struct FTokenPair
+{
+  uint64_t hash;
+  uint64_t line;
+} f_token_pair;
+
+/** @struct FTokenRun
+* @brief a sorted run being merged
+* @var FTokenRun::fd
+* the run file the run is in
+* @var FTokenRun::offset
+* where the pairs that weren't read yet start
+* @var FTokenRun::remaining
+* how many pairs weren't read yet
+* @var FTokenRun::pairs
+* the pairs read
+* @var FTokenRun::pos
+* the next pair to merge
+* @var FTokenRun::len
+* the number of pairs read
+* @var FTokenRun::failed
+* true if reading the run failed
+*/
+typedef struct FTokenRun
+{
+  int fd;
+  off_t offset;
+  size_t remaining;
+  f_token_pair* pairs;
+  size_t pos;
+  size_t len;
+  bool failed;
+} f_token_run;
+
+/** @struct FTokenIndex
+* @brief a token index, mapped from the file next to the lookup
+* @var FTokenIndex::path
+* the location of the token index
+* @var FTokenIndex::fd
+* the file descriptor of the token index
+* @var FTokenIndex::map
+* the mapped file
+* @var FTokenIndex::map_len
+* the size of the mapped file
+* @var FTokenIndex::tokenizer
+* the tokenizer the lines were split with
+* @var FTokenIndex::entry_count
+* the number of distinct tokens
+* @var FTokenIndex::entries
+* the directory, sorted by hash
+*/
+typedef struct FTokenIndex
+{
+  char* path;
+  int fd;
+  void* map;
+  size_t map_len;
+  enum F_TOKENIZER tokenizer;
+  size_t entry_count;
+  f_token_entry* entries;
+} f_token_index;
+
+/** @struct FTokenThread
+* @brief the lines one thread tokenizes
+* @var FTokenThread::index
+* the index to read lines from
+* @var FTokenThread::tokenizer
+* how to split lines
+* @var FTokenThread::from
+* the first line
+* @var FTokenThread::to
+* the line to stop at
+* @var FTokenThread::run_path
+* the file the sorted runs are spilled to
+* @var FTokenThread::run_fd
+* the file descriptor of the run file
+* @var FTokenThread::runs
+* how many pairs each run has, runs follow each other in the run file
+* @var FTokenThread::run_count
+* the number of runs
+* @var FTokenThread::cancel
+* the cancellation state of the indexing
+* @var FTokenThread::rc
+* non zero if tokenizing failed
+*/
+typedef struct FTokenThread
+{
+  f_index* index;
+  enum F_TOKENIZER tokenizer;
+  size_t from;
+  size_t to;
+  char* run_path;
+  int run_fd;
+  size_t* runs;
+  size_t run_count;
+  f_cancel_state* cancel;
+  int rc;
+} f_token_thread;
+
+/**
+  Builds a token index for every line of an index
+
+  Each thread spills sorted runs of (token, line) pairs to a temporary file,
+  the runs are then merged into posting lists, so memory use doesn't grow with the file.
+  @param out the token index
+  @param index the index to read lines from
+  @param path the file to write, owned by the token index (freed on error)
+  @param tokenizer how to split lines
+  @param threads how many threads to tokenize with
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_token_index_build(f_token_index** out, f_index* index, char* path, enum F_TOKENIZER tokenizer, int threads, f_cancel_state* cancel);
+
+/**
+  Finds the lines that contain a term
+
+  The term is split with the tokenizer of the index, a line has to contain every token.
+  Tokens are compared by a 64 bit hash, so a collision could add a line.
+  @param out the line numbers, the same as `FSearchResult::line_number`
+  @param index an index built with a tokenizer
+  @param term the term to find
+  @return non zero for error, -2 if the index has no token index
+*/
+int f_index_token_lookup(f_bitmap** out, f_index* index, const char* term);
+
+/**
+  Unmaps and deletes a token index
+  @param tokens the token index to free
+*/
+void f_token_index_free(f_token_index** tokens);
+
+#endif
+#ifndef FLASHLIGHT_TIMESTAMP_H
+#define FLASHLIGHT_TIMESTAMP_H
+
+/** @file timestamp.h
+* @brief A sparse index of line timestamps, to seek to a time window
+*
+* The timestamp of every Kth line is parsed while indexing and kept in memory.
+* A running max from the start and a running min from the end make
+* the samples searchable even when lines are slightly out of order.
+*/
 
-/** @struct FLookupMem
-* @brief an in-memory index
-* @var len
-* the number of lines in the target file
-* @var values
-* an array of line offsets
+#define F_TIMESTAMP_DEFAULT_EVERY 1024
+// lines read from the start of a block to find one with a timestamp.
+#define F_TIMESTAMP_PROBE 16
+// marks a block that had no timestamp.
+#define F_TIMESTAMP_NONE INT64_MIN
+
+/** @struct FTimeIndex
+* @brief the sampled timestamps of an index
+* @var FTimeIndex::every
+* the number of lines in each block, one sample per block
+* @var FTimeIndex::lines
+* the number of lines in the index
+* @var FTimeIndex::len
+* the number of blocks
+* @var FTimeIndex::times
+* the sample of each block in milliseconds since the epoch (F_TIMESTAMP_NONE if it had none)
+* @var FTimeIndex::prefix_max
+* the latest sample of the blocks up to and including each block
+* @var FTimeIndex::suffix_min
+* the earliest sample of each block and the blocks after it
 */
-typedef struct FLookupMem
+typedef struct FTimeIndex
 {
+  size_t every;
+  size_t lines;
   size_t len;
-  size_t* values;
-} f_lookup_mem;
+  int64_t* times;
+  int64_t* prefix_max;
+  int64_t* suffix_min;
+} f_time_index;
 
 /**
-  Create a memory lookup from an FChunk
-  @param out the lookup to init
-  @param chunk the chunk to use
-  @return non zero for error
+  Parses a timestamp with a strptime like format
+
+  Supports %Y %y %m %d %e %b %H %M %S %f (fractional seconds) %z (Z or +hh[:]mm) %s (epoch seconds) and %%.
+  A space in the format matches any run of whitespace, other characters match themselves.
+  Fields that aren't in the format default to 1970-01-01 00:00:00 UTC.
+  @param out milliseconds since the epoch
+  @param text the text to parse, only its start has to match
+  @param len the length of text
+  @param format the format of the timestamp
+  @return non zero if text doesn't start with a timestamp
 */
-int f_lookup_mem_from_chunk(f_lookup_mem** out, f_chunk* chunk);
-void f_lookup_mem_free(f_lookup_mem* lookup);
+int f_timestamp_parse(int64_t* out, const char* text, size_t len, const char* format);
 
 /**
-  Init an persistent index
-  @param out the lookup to init
-  @param path the filename for the index
-  @return non zero for error
+  Samples the timestamp of every `every` lines of an index
+
+  @param out the time index
+  @param index the index to read lines from
+  @param format the format of the timestamp, see f_timestamp_parse
+  @param regex where the timestamp is on a line, capture group 1 or else the whole match (NULL for the line start)
+  @param every the number of lines in each block (0 for the default)
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
 */
-int f_lookup_file_init(f_lookup_file** out, char* path);
+int f_time_index_build(f_time_index** out, f_index* index, const char* format, const char* regex, size_t every, f_cancel_state* cancel);
 
 /**
-  Append an offset to the persistent index
-  @param db the lookup to append to
-  @param offset the offset to append
-  @return non zero for error
+  Finds the lines to search for a time window
+
+  The range covers every block that can have a line in the window,
+  plus one block on each side for lines that are out of order by less than a block.
+  The line numbers can be passed to `FSearcher::start_line` and `FSearcher::end_line`.
+  @param index an index built with a time format
+  @param from the start of the window in milliseconds since the epoch
+  @param to the end of the window, inclusive
+  @param start_line the first line, 1 based
+  @param end_line the last line, inclusive
+  @return 0 for a range, 1 if no line can be in the window, -1 for error, -2 if the index has no time index
 */
-int f_lookup_file_append(f_lookup_file* db, size_t offset);
+int f_index_seek_time(f_index* index, int64_t from, int64_t to, size_t* start_line, size_t* end_line);
 
 /**
-  Init a persistent index from an FChunk
-  @param out the lookup to use
-  @param chunk the chunk to use
-  @param path the filename for the index
-  @param first if true, create the lookup, else the lookup is expected to be inited
-  @param last if true, add a 0 byte offset to represent the beginning of the target file
+  Frees a time index
+  @param times the time index to free
 */
-int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bool first, bool last);
-void f_lookup_file_free(f_lookup_file** lookupref);
+void f_time_index_free(f_time_index** times);
 
 #endif
-#ifndef FLASHLIGHT_INDEX_H
-#define FLASHLIGHT_INDEX_H
+#ifndef FLASHLIGHT_FIELD_H
+#define FLASHLIGHT_FIELD_H
 
-/** @struct FIndex
-* @brief an index of a target file that resides on disk
-* 
-* The index is the main export of this library.
-* The index itself can be stored in memory (FLookupMem) 
-* or also live on disk (FLookupFile).  It cannot be both.
-* @var FIndex::filename
-* the target filename
-* @var FIndex::filename_len
-* the target filename length
-* @var FIndex::fd
-* the target file descriptor
-* @var FIndex::fp
-* a file pointer to the target.
-* @var FIndex::flookup
-* a file lookup (NULL if unused)
-* @var FIndex::mlookup
-* an in-memory lookup (NULL if unsed)
+/** @file field.h
+* @brief Field offsets of a delimited file (CSV, TSV)
+*
+* Every line gets a span per column, relative to the line start, so a column
+* can be read or searched without parsing lines again. A quoted field can hold
+* newlines, so rows are numbered separately from lines and a row can span lines.
+* The index is a sidecar file next to the lookup, mapped read only:
+* a header, the spans of every line, then the first line of every row.
 */
-typedef struct FIndex
+
+#define F_FIELD_MAGIC 0x44464c46u
+#define F_FIELD_VERSION 1u
+// lines a thread reads at a time.
+#define F_FIELD_READ_LINES 4096
+// the span of a column that isn't on a line.
+#define F_FIELD_NONE UINT32_MAX
+
+/** @struct FFieldHeader
+* @brief the header of a field index file
+* @var FFieldHeader::magic
+* F_FIELD_MAGIC
+* @var FFieldHeader::version
+* F_FIELD_VERSION
+* @var FFieldHeader::delimiter
+* the byte between fields
+* @var FFieldHeader::quote
+* the byte fields are quoted with
+* @var FFieldHeader::columns
+* the number of columns with spans
+* @var FFieldHeader::lines
+* the number of lines
+* @var FFieldHeader::rows
+* the number of rows
+* @var FFieldHeader::rows_offset
+* where the first line of every row is stored
+*/
+typedef struct FFieldHeader
 {
-  char* filename;
-  int filename_len;
+  uint32_t magic;
+  uint32_t version;
+  uint32_t delimiter;
+  uint32_t quote;
+  uint64_t columns;
+  uint64_t lines;
+  uint64_t rows;
+  uint64_t rows_offset;
+} f_field_header;
+
+/** @struct FFieldSpan
+* @brief the part of a column that is on a line
+* @var FFieldSpan::start
+* the offset from the start of the line
+* @var FFieldSpan::end
+* the offset the column ends at
+*
+* Both are F_FIELD_NONE if the column isn't on the line.
+*/
+typedef struct FFieldSpan
+{
+  uint32_t start;
+  uint32_t end;
+} f_field_span;
+
+/** @struct FFieldIndex
+* @brief a field index, mapped from the file next to the lookup
+* @var FFieldIndex::path
+* the location of the field index
+* @var FFieldIndex::fd
+* the file descriptor of the field index
+* @var FFieldIndex::map
+* the mapped file
+* @var FFieldIndex::map_len
+* the size of the mapped file
+* @var FFieldIndex::delimiter
+* the byte between fields
+* @var FFieldIndex::quote
+* the byte fields are quoted with
+* @var FFieldIndex::columns
+* the number of columns with spans, fields past it are part of the last column
+* @var FFieldIndex::lines
+* the number of lines
+* @var FFieldIndex::rows
+* the number of rows
+* @var FFieldIndex::spans
+* `columns` spans for every line
+* @var FFieldIndex::row_lines
+* the first line of every row, 0 based
+*/
+typedef struct FFieldIndex
+{
+  char* path;
   int fd;
-  FILE* fp;
-  f_lookup_file* flookup;
-  f_lookup_mem* mlookup;
-} f_index;
+  void* map;
+  size_t map_len;
+  char delimiter;
+  char quote;
+  size_t columns;
+  size_t lines;
+  size_t rows;
+  f_field_span* spans;
+  uint64_t* row_lines;
+} f_field_index;
+
+/** @struct FFieldThread
+* @brief the lines one thread scans
+*
+* The first pass finds out how the range would be split for both quote states it could start in,
+* the second writes the spans once the state at the start of every range is known.
+* @var FFieldThread::fields
+* the field index being built
+* @var FFieldThread::index
+* the index to read lines from
+* @var FFieldThread::from
+* the first line
+* @var FFieldThread::to
+* the line to stop at
+* @var FFieldThread::flips
+* true if the range has an odd number of quotes
+* @var FFieldThread::starts
+* the rows that start in the range, for a range that starts outside or inside quotes
+* @var FFieldThread::tail
+* the column at the end of the range, counted from its last row start, or from the range start if it has none
+* @var FFieldThread::quoted
+* true if the range starts inside quotes
+* @var FFieldThread::column
+* the column at the start of the range
+* @var FFieldThread::row
+* the first row that starts in the range
+* @var FFieldThread::cancel
+* the cancellation state of the indexing
+* @var FFieldThread::rc
+* non zero if scanning failed
+*/
+typedef struct FFieldThread
+{
+  f_field_index* fields;
+  f_index* index;
+  size_t from;
+  size_t to;
+  bool flips;
+  size_t starts[2];
+  size_t tail[2];
+  bool quoted;
+  size_t column;
+  size_t row;
+  f_cancel_state* cancel;
+  int rc;
+} f_field_thread;
 
 /**
-  Initializes a new index
-
-  @param out the index to initialize
-  @param filename the target filename for the index
-  @param filename_len the target filename length
-  @param flookup a file lookup (NULL if unused)
-  @param mlookup an memory lookup (NULL if unused)
-  @return non zero for error
+  Builds a field index for every line of an index
+
+  @param out the field index
+  @param index the index to read lines from
+  @param path the file to write, owned by the field index (freed on error)
+  @param delimiter the byte between fields
+  @param quote the byte fields are quoted with (0 for '"')
+  @param columns the number of columns to keep spans for (0 for the number of fields in the first row)
+  @param threads how many threads to scan with
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
 */
-int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file* flookup, f_lookup_mem* mlookup);
+int f_field_index_build(f_field_index** out, f_index* index, char* path, char delimiter, char quote, size_t columns, int threads, f_cancel_state* cancel);
 
 /**
-  Fetches a portion of the file
-  
-  @param out the fetched string, zero terminated
-  @param index the index to search
-  @param start the start line index
-  @param count the number of lines to fetch
-  @return non zero for error
+  Finds the part of a column that is on a line
+  @param fields the field index
+  @param line the line, 0 based
+  @param column the column, 1 based
+  @param offset the offset of the column from the start of the line
+  @param len the length of the column on the line
+  @return false if the column isn't on the line
 */
-int f_index_lookup(char** out, f_index* index, size_t start, size_t count);
+bool f_field_index_span(f_field_index* fields, size_t line, size_t column, size_t* offset, size_t* len);
 
 /**
-  Frees an index and it's lookup
+  Fetches one column of a range of rows
+
+  Quotes are removed from the values. A value can hold a newline if it was quoted.
+  @param out the values, newline separated and zero terminated
+  @param index an index built with a field delimiter
+  @param start the first row, 0 based
+  @param count the number of rows to fetch
+  @param column the column, 1 based
+  @return non zero for error, -2 if the index has no field index
+*/
+int f_index_lookup_column(char** out, f_index* index, size_t start, size_t count, size_t column);
 
-  If the lookup is a FLookupFile, the file is deleted
-  @param index the index to free
+/**
+  Unmaps and deletes a field index
+  @param fields the field index to free
 */
-void f_index_free(f_index** index);
-typedef void (*lookup_stream_cb)(char* data);
+void f_field_index_free(f_field_index** fields);
 
 #endif
 #ifndef FLASHLIGHT_INDEXER_H
@@ -948,6 +2924,51 @@ typedef void (*lookup_stream_cb)(char* data);
 
 typedef void (*indexer_progress_cb)(double progress, void* payload);
 
+struct FIndexer;
+
+/**
+  Adds the end of a record to the chunk being scanned
+  @param sink the chunk
+  @param offset the offset after the end of the record
+  @param atomic false if the offset has to be resolved by the format's merge
+  @return non zero for error
+*/
+typedef int (*f_indexer_emit)(void* sink, size_t offset, bool atomic);
+
+/** @struct FIndexerFormat
+* @brief how an indexer finds records, plugged into the threaded scanning of f_index_text_file
+*
+* Chunks are scanned on their own, in parallel and in any order.
+* What a chunk can't decide alone, e.g. if it starts inside quotes, is fixed by `merge` once every chunk was scanned.
+* @var FIndexerFormat::name
+* the name of the format, for logs
+* @var FIndexerFormat::init
+* creates the state of an indexing run and sets how many bytes past a chunk `scan` needs to see
+* @var FIndexerFormat::open
+* creates the index without scanning the target, e.g. when offsets can be computed (NULL to scan)
+* @var FIndexerFormat::scan
+* emits the end of every record that ends in a chunk, in order (NULL if `merge` finds every record)
+* @var FIndexerFormat::merge
+* fixes the lookup across chunk boundaries once every chunk was scanned (NULL if chunks are independent)
+* @var FIndexerFormat::relative
+* true if `scan` only depends on the bytes it is given, so they can be scanned from 0 before their offset is known (NULL if it always does)
+* @var FIndexerFormat::finalize
+* sets how lines are cut out of records on the new index (NULL for newline terminated lines)
+* @var FIndexerFormat::free
+* frees the state
+*/
+typedef struct FIndexerFormat
+{
+  const char* name;
+  int (*init)(void** state, size_t* lookahead, struct FIndexer* indexer, int fd, size_t file_size);
+  int (*open)(void* state, f_index** out, struct FIndexer* indexer);
+  int (*scan)(void* state, const uint8_t* buffer, size_t len, size_t read, size_t from, f_indexer_emit emit, void* sink);
+  int (*merge)(void* state, f_lookup_file* lookup);
+  bool (*relative)(void* state);
+  void (*finalize)(void* state, f_index* index);
+  void (*free)(void* state);
+} f_indexer_format;
+
 
 /** @struct FIndexer
 * @brief the configuration to supply to the indexer.
@@ -958,17 +2979,68 @@ typedef void (*indexer_progress_cb)(double progress, void* payload);
 * @var FIndexer::lookup_dir
 * the directory to store the lookup index
 * @var FIndexer::threads
-* the number of threads to spawn during indexing.
+* the number of threads to spawn during indexing (0 to pick one for the device and cores, see tune.h)
 * @var FIndexer::concurrency
-* the number of concurrent calls to make in each thread
+* the number of concurrent calls to make in each thread (0 to pick one for the device)
 * @var FIndexer::buffer_size
-* the buffer to use for each concurrent call
+* the buffer to use for each concurrent call (0 to pick one for the device)
 * @var FIndexer::max_bytes_per_iteration
-* a hard limit on how many bytes to index at one time.
+* a hard limit on how many bytes to index at one time (0 to pick one that bounds memory)
 * @var on_progress
 * a callback to track the progress of the indexing (NULL if unused)
 * @var payload
 * a payload that is passed to the progress callback (NULL if unused)
+* @var cancel
+* a token to cancel the indexing from another thread (NULL if unused)
+* @var timeout_ms
+* cancel the indexing after this many milliseconds (0 for no deadline)
+* @var trigram_block
+* build a trigram index with a filter for every block of this many lines (0 for none)
+* @var trigram_filter
+* the size in bytes of each block's trigram filter (0 for the default)
+* @var tokenizer
+* build a token index, splitting lines with this tokenizer (F_TOKENIZER_NONE for none)
+* @var time_format
+* sample line timestamps in this format, see f_timestamp_parse (NULL for none)
+* @var time_regex
+* where the timestamp is on a line, capture group 1 or else the whole match (NULL for the line start)
+* @var time_every
+* sample the timestamp of every this many lines (0 for the default)
+* @var field_delimiter
+* build a field index, splitting rows on this byte, e.g. ',' or '\t' ('\0' for none)
+* @var field_quote
+* the byte fields are quoted with ('\0' for '"')
+* @var field_columns
+* the number of columns to index (0 for the number of fields in the first row)
+* @var record
+* which newlines end a record, records then count as lines (F_RECORD_LINE for every newline)
+* @var record_quote
+* the byte fields are quoted with, for F_RECORD_QUOTED ('\0' for '"')
+* @var record_prefix
+* the regex a line has to match at its start to begin a record, for F_RECORD_PREFIX
+* @var format
+* how records are found (NULL for f_indexer_format_text)
+* @var record_delimiter
+* the byte records end with, for f_indexer_format_delimited ('\0' for NUL delimited records)
+* @var record_width
+* the size of every record, for f_indexer_format_fixed
+* @var record_start
+* the bytes before the first record, e.g. a file header, for f_indexer_format_fixed
+* @var record_length_bytes
+* the size of the little endian length before every record, for f_indexer_format_length (0 for 4)
+* @var compression
+* how the target is compressed, F_COMPRESSION_AUTO to detect gzip and zstd (F_COMPRESSION_NONE by default)
+* @var compression_span
+* the uncompressed bytes between gzip checkpoints, smaller spans make reads faster and the index bigger (0 for the default)
+* @var stats
+* filled in with counters and stage timings of the run, initialized by the caller with f_stats_init (NULL if unused)
+* @var adaptive
+* adjust the buffer size between iterations while throughput improves, a picked max_bytes_per_iteration then splits the target in several iterations
+* @var runtime
+* the thread pool to run the indexing threads on (NULL for threads of their own)
+* @var numa
+* bind indexing threads to numa nodes, so their read buffers and offsets are allocated on their node.
+* neighbouring ranges of the target share a node. A runtime binds its workers with F_AFFINITY_NODES instead
 */
 typedef struct FIndexer
 {
@@ -981,6 +3053,31 @@ typedef struct FIndexer
   size_t max_bytes_per_iteration;
   indexer_progress_cb on_progress;
   void* payload;
+  f_cancel* cancel;
+  unsigned long timeout_ms;
+  size_t trigram_block;
+  size_t trigram_filter;
+  enum F_TOKENIZER tokenizer;
+  char* time_format;
+  char* time_regex;
+  size_t time_every;
+  char field_delimiter;
+  char field_quote;
+  size_t field_columns;
+  enum F_RECORD record;
+  char record_quote;
+  char* record_prefix;
+  const f_indexer_format* format;
+  char record_delimiter;
+  size_t record_width;
+  size_t record_start;
+  size_t record_length_bytes;
+  enum F_COMPRESSION compression;
+  size_t compression_span;
+  f_stats* stats;
+  bool adaptive;
+  f_runtime* runtime;
+  bool numa;
 } f_indexer;
 
 
@@ -1035,7 +3132,7 @@ typedef struct FIndexerChunk
 /** @struct FIndexerChunks
 * @brief An array of configs
 * @var FIndexerChunks::chunks
-* the list of FIndexerChunk
+* the list of FIndexerChunk, allocated with the list
 * @var FIndexerChunks::concurrency
 * the computed concurrency
 * @var FIndexerChunks::len
@@ -1080,10 +3177,225 @@ void f_indexer_chunks_free(f_indexer_chunks* index);
 int f_indexer_threads_init(f_indexer_threads** out, int threads, size_t total_bytes_count, size_t buffer_size, size_t offset);
 void f_indexer_threads_free(f_indexer_threads* index);
 
+#endif
+#ifndef FLASHLIGHT_TUNE_H
+#define FLASHLIGHT_TUNE_H
+
+/** @file tune.h
+* @brief Picks indexing parameters for the device a target is on
+*
+* The device is probed once: the rotational flag, block size and queue depth from sysfs,
+* the filesystem type for network mounts, the number of cores, and a few timed reads of the target.
+* Only the parameters left at 0 in an `f_indexer` are picked.
+* With `adaptive`, the buffer size is also adjusted between iterations while throughput improves.
+*/
+
+// bytes of each calibration read.
+#define F_TUNE_CALIBRATE_SIZE (256u << 10)
+// calibration reads, spread over the target.
+#define F_TUNE_CALIBRATE_READS 4
+// a calibration read faster than this came from the page cache.
+#define F_TUNE_CACHED_NS 100000ull
+// a calibration read slower than this needs bigger buffers to amortize the latency.
+#define F_TUNE_SLOW_NS 2000000ull
+// bounds of the buffer size.
+#define F_TUNE_BUFFER_MIN (64u << 10)
+#define F_TUNE_BUFFER_MAX (64u << 20)
+// bounds of the bytes indexed per iteration.
+#define F_TUNE_ITERATION_MIN (16ull << 20)
+#define F_TUNE_ITERATION_MAX (128ull << 20)
+// the memory a record end takes until its iteration is merged.
+#define F_TUNE_OFFSET_BYTES 32
+// the short average line the record ends of an iteration are budgeted for.
+#define F_TUNE_LINE_BYTES 16
+// the record ends of an iteration take at most 1/n of the available memory.
+#define F_TUNE_MEMORY_SHARE 8
+// iterations an adaptive run is split into at least, so there are samples to adapt on.
+#define F_TUNE_ADAPT_ITERATIONS 8
+// throughput has to improve by this much for a buffer size to count as better.
+#define F_TUNE_ADAPT_NOISE 0.05
+
+/**
+* @brief the kind of storage a target is on
+*/
+enum F_DEVICE
+{
+  F_DEVICE_UNKNOWN = 0, /**< nothing could be probed */
+  F_DEVICE_ROTATIONAL, /**< a spinning disk, seeks are expensive */
+  F_DEVICE_SOLID, /**< an ssd or nvme drive */
+  F_DEVICE_MEMORY, /**< tmpfs, or a target that is in the page cache */
+  F_DEVICE_NETWORK /**< nfs, smb and other network or fuse mounts, reads have a high latency */
+};
+
+/** @struct FTuneProbe
+* @brief what was found out about the device and the host
+* @var FTuneProbe::device
+* the kind of storage
+* @var FTuneProbe::cores
+* the online cores
+* @var FTuneProbe::block_size
+* the logical block size of the device, or the preferred io size of the file
+* @var FTuneProbe::queue_depth
+* the requests the device queues (0 if unknown)
+* @var FTuneProbe::optimal_io
+* the optimal io size of the device (0 if unknown)
+* @var FTuneProbe::read_ns
+* the fastest calibration read (0 if the target was too small)
+* @var FTuneProbe::read_mb_per_sec
+* the throughput of the calibration reads
+* @var FTuneProbe::available_memory
+* the free physical memory of the host (0 if unknown)
+*/
+typedef struct FTuneProbe
+{
+  enum F_DEVICE device;
+  int cores;
+  size_t block_size;
+  size_t queue_depth;
+  size_t optimal_io;
+  uint64_t read_ns;
+  double read_mb_per_sec;
+  size_t available_memory;
+} f_tune_probe;
+
+/** @struct FTuneAdapt
+* @brief adjusts the buffer size between iterations, doubling it while throughput improves
+* @var FTuneAdapt::buffer_size
+* the buffer size of the next iteration
+* @var FTuneAdapt::block_size
+* buffer sizes are a multiple of it
+* @var FTuneAdapt::best_size
+* the buffer size with the best throughput so far
+* @var FTuneAdapt::best_rate
+* its throughput in bytes per nanosecond (0 before the first sample)
+* @var FTuneAdapt::direction
+* 1 while growing, -1 while shrinking
+* @var FTuneAdapt::locked
+* true once the direction is fixed, because a step helped or shrinking is tried
+* @var FTuneAdapt::settled
+* true once the best size was found, it isn't changed anymore
+*/
+typedef struct FTuneAdapt
+{
+  size_t buffer_size;
+  size_t block_size;
+  size_t best_size;
+  double best_rate;
+  int direction;
+  bool locked;
+  bool settled;
+} f_tune_adapt;
+
+/**
+  Probes the device and host a target is read from
+  @param out what was found out
+  @param fd the file descriptor of the target
+  @param file_size the size of the target, to spread the calibration reads (0 to skip them)
+  @return non zero for error
+*/
+int f_tune_probe_fd(f_tune_probe* out, int fd, size_t file_size);
+
+/**
+  Picks threads, concurrency, buffer_size and max_bytes_per_iteration where they are 0.
+  Every record end of an iteration is held in memory until the merge, so the bytes per iteration
+  are bounded by what the record ends of short lines would take, and by the available memory.
+  @param indexer the indexer config to fill in
+  @param probe the device and host
+  @param file_size the size of the target
+*/
+void f_tune_indexer(f_indexer* indexer, const f_tune_probe* probe, size_t file_size);
+
+/**
+  Starts adapting the buffer size
+  @param adapt the state to init
+  @param buffer_size the buffer size of the first iteration
+  @param block_size buffer sizes are a multiple of it (0 for none)
+*/
+void f_tune_adapt_init(f_tune_adapt* adapt, size_t buffer_size, size_t block_size);
+
+/**
+  Records the throughput of an iteration
+  @param adapt the state
+  @param bytes the bytes the iteration indexed
+  @param elapsed_ns how long it took
+  @return the buffer size of the next iteration
+*/
+size_t f_tune_adapt_next(f_tune_adapt* adapt, size_t bytes, uint64_t elapsed_ns);
+
+#endif
+#ifndef FLASHLIGHT_INDEXERS_FORMATS_H
+#define FLASHLIGHT_INDEXERS_FORMATS_H
+
+/** @file formats.h
+* @brief The record formats that ship with the indexer
+*
+* A format only finds where records end, f_index_text_file reads the target,
+* runs the threads and writes the lookup. Other formats implement FIndexerFormat
+* and are passed as `format` on the f_indexer.
+*/
+
+// bytes read at a time while walking length prefixed records.
+#define F_FORMAT_LENGTH_READ 65536
+
+/** @struct FFormatState
+* @brief the state of the binary formats
+* @var FFormatState::delimiter
+* the byte records end with (delimited only)
+* @var FFormatState::width
+* the size of every record (fixed only)
+* @var FFormatState::start
+* the offset of the first record (fixed only)
+* @var FFormatState::length_bytes
+* the size of the length before every record (length only)
+* @var FFormatState::fd
+* the file descriptor of the target
+* @var FFormatState::file_size
+* the size of the target
+*/
+typedef struct FFormatState
+{
+  uint8_t delimiter;
+  size_t width;
+  size_t start;
+  size_t length_bytes;
+  int fd;
+  size_t file_size;
+} f_format_state;
+
+/**
+  Lines, or records of several lines, see record.h
+*/
+extern const f_indexer_format f_indexer_format_text;
+
+/**
+  Records that end with a byte, e.g. NUL. The byte isn't part of the line.
+*/
+extern const f_indexer_format f_indexer_format_delimited;
+
+/**
+  Records that all have the same size, after an optional header
+
+  Offsets are computed from the record size: the target isn't scanned and there is no lookup file.
+*/
+extern const f_indexer_format f_indexer_format_fixed;
+
+/**
+  Records that start with their length, little endian. The length isn't part of the line.
+
+  A record only starts where the one before it ends, so records are walked front to back
+  from their lengths instead of scanned in chunks.
+*/
+extern const f_indexer_format f_indexer_format_length;
+
 #endif
 #ifndef FLASHLIGHT_INDEXERS_TEXT_H
 #define FLASHLIGHT_INDEXERS_TEXT_H
 
+// read buffers are aligned and sized to this, so they can be read into with O_DIRECT.
+#define F_TEXT_BUFFER_ALIGN 4096
+// record ends a frame of a compressed target has room for at first.
+#define F_TEXT_FRAME_ENDS 1024
+
 /** @struct FTextThread
 * @brief a config to pass to each thread
 * @var FTextThread::fd
@@ -1101,7 +3413,33 @@ void f_indexer_threads_free(f_indexer_threads* index);
 * @var FTextThread::thread
 * the thread index
 * @var FTextThread::progress
-* the current progress of this thread
+* the current progress of this thread, read by the thread reporting progress
+* @var FTextThread::cancel
+* the cancellation state shared by the threads of this indexing run
+* @var FTextThread::format
+* how records are found
+* @var FTextThread::state
+* the state of the format for this indexing run
+* @var FTextThread::lookahead
+* the bytes the format needs to see past every chunk
+* @var FTextThread::stats
+* where to count reads and timings (NULL if unused)
+* @var FTextThread::busy
+* the nanoseconds this thread spent reading and scanning (only with stats)
+* @var FTextThread::numa
+* the numa nodes to bind the thread to (NULL if unused)
+* @var FTextThread::node
+* the node of the thread
+* @var FTextThread::arena
+* where the thread's chunks and record ends are allocated, kept across iterations and reset after each
+* @var FTextThread::buffers
+* the thread's read buffers, one for each coroutine of a round, kept across chunks and iterations
+* @var FTextThread::buffers_len
+* the number of read buffers
+* @var FTextThread::buffers_size
+* the size of every read buffer
+* @var FTextThread::done
+* true once the thread is about to exit
 */
 typedef struct FTextThread 
 {
@@ -1113,14 +3451,115 @@ typedef struct FTextThread
   size_t buffer_size;
   int concurrency;
   int thread;
-  double progress;
+  _Atomic double progress;
+  f_cancel_state* cancel;
+  const f_indexer_format* format;
+  void* state;
+  size_t lookahead;
+  f_stats* stats;
+  uint64_t busy;
+  f_numa* numa;
+  int node;
+  f_arena* arena;
+  uint8_t** buffers;
+  int buffers_len;
+  size_t buffers_size;
+  atomic_bool done;
 } f_text_thread;
 
 
+/** @struct FTextSink
+* @brief the record ends found in one chunk
+* @var FTextSink::first
+* the last record end found, the list is in reverse
+* @var FTextSink::last
+* the first record end found
+* @var FTextSink::line_count
+* the number of record ends
+* @var FTextSink::arena
+* where the record ends are allocated
+*/
+typedef struct FTextSink
+{
+  f_bytes_node* first;
+  f_bytes_node* last;
+  unsigned int line_count;
+  f_arena* arena;
+} f_text_sink;
+
+/** @struct FTextStream
+* @brief the decompressed bytes of a compressed target, taken in order
+* @var FTextStream::format
+* how records are found
+* @var FTextStream::state
+* the state of the format for this indexing run
+* @var FTextStream::block
+* the bytes scanned at a time
+* @var FTextStream::lookahead
+* the bytes the format needs to see past every block
+* @var FTextStream::stats
+* where to count timings (NULL if unused)
+* @var FTextStream::buffer
+* the staged bytes, `block + 2 * lookahead` big, so the start of a frame fits after a full block
+* @var FTextStream::len
+* the number of staged bytes
+* @var FTextStream::from
+* the uncompressed offset of the first staged byte
+* @var FTextStream::lookup
+* the lookup record ends are appended to, front to back
+* @var FTextStream::line_count
+* the number of record ends
+* @var FTextStream::cancel
+* the cancellation state of this indexing run
+* @var FTextStream::relative
+* true if frames are scanned on the threads that decompress them
+*/
+typedef struct FTextStream
+{
+  const f_indexer_format* format;
+  void* state;
+  size_t block;
+  size_t lookahead;
+  f_stats* stats;
+  uint8_t* buffer;
+  size_t len;
+  size_t from;
+  f_lookup_file* lookup;
+  size_t line_count;
+  f_cancel_state* cancel;
+  bool relative;
+} f_text_stream;
+
+/** @struct FTextFrame
+* @brief the record ends of a frame of a compressed target, found before the frame's offset is known
+* @var FTextFrame::scanned
+* the bytes scanned from the start of the frame, the others are the lookahead of the last ones
+* @var FTextFrame::len
+* the number of record ends
+* @var FTextFrame::cap
+* the capacity of the record ends
+* @var FTextFrame::offsets
+* the record ends from the start of the frame, tagged with F_BYTES_TAG if they aren't atomic
+*/
+typedef struct FTextFrame
+{
+  size_t scanned;
+  size_t len;
+  size_t cap;
+  size_t offsets[];
+} f_text_frame;
+
 /**
   Indexes a text file of an arbitrary size concurrently, in multiple threads
+
+  Threads stop between rounds of coroutines once `cancel` is requested
+  or `timeout_ms` has passed, the partial lookup is deleted,
+  and errno is set to ECANCELED or ETIMEDOUT.
+  Records are found by `format` on the indexer, newline terminated lines by default.
+  A gzip or zstd target is decompressed once, in a single pass, when `compression` is set.
+  Its frames are decompressed and scanned on the indexer's threads when it can be split.
   @param indexer the configuration for the indexer
-  @return an FIndex
+  @return an FIndex, NULL for error or if cancelled
 */
 f_index* f_index_text_file(f_indexer indexer);
 
@@ -1144,11 +3583,19 @@ f_index* f_index_text_file(f_indexer indexer);
 * @var FSearchResult::str
 * the full line that matched
 * @var FSearchResult::matches_substring_offset
-* An array of offsets for each match
+* An array of offsets for each match, allocated with the result
 * @var FSearchResult::matches_substring_len
-* An array of match lengths
+* An array of match lengths, allocated with the result
 * @var FSearchResult::matches_len
 * The number of matches
+* @var FSearchResult::before
+* The context lines before the match, newline separated (NULL if there are none)
+* @var FSearchResult::before_len
+* The number of context lines before the match
+* @var FSearchResult::after
+* The context lines after the match, newline separated (NULL if there are none)
+* @var FSearchResult::after_len
+* The number of context lines after the match
 */
 typedef struct FSearchResult {
   size_t line_number;
@@ -1156,6 +3603,10 @@ typedef struct FSearchResult {
   size_t* matches_substring_offset;
   size_t* matches_substring_len;
   unsigned int matches_len;
+  char* before;
+  unsigned int before_len;
+  char* after;
+  unsigned int after_len;
 } f_search_result;
 
 /** @struct FSearchResults
@@ -1173,9 +3624,109 @@ typedef struct FSearchResults {
   struct FSearchResults* next;
 } f_search_results;
 
+/**
+* @brief what a search collects for each matching line
+*/
+enum F_SEARCH_MODE
+{
+  F_SEARCH_RESULTS = 0, /**< an FSearchResult for each match */
+  F_SEARCH_COUNT, /**< only the number of matching lines */
+  F_SEARCH_BITMAP /**< the matching line numbers, as an FBitmap */
+};
+
 typedef void (*searcher_progress_cb)(double progress, void* payload);
 typedef void (*searcher_cb)(f_search_result* result, void* payload);
 
+/** @struct FSearchBatch
+* @brief a batch of search results collected by a single thread
+*
+* Threads collect matches into a batch and flush the whole
+* batch at once, instead of synchronizing on every match.
+* @var FSearchBatch::results
+* The collected results
+* @var FSearchBatch::len
+* The number of collected results
+* @var FSearchBatch::cap
+* The capacity of the results array
+* @var FSearchBatch::next
+* The next batch waiting to be consumed
+*/
+typedef struct FSearchBatch {
+  f_search_result** results;
+  unsigned int len;
+  unsigned int cap;
+  struct FSearchBatch* next;
+} f_search_batch;
+
+/** @struct FSearchState
+* @brief state shared between the threads of one search
+*
+* Every call to `f_index_search` owns its own state,
+* so concurrent searches in one process don't contend with each other.
+* @var FSearchState::lock
+* Serializes batch flushes
+* @var FSearchState::result_count
+* The current number of results
+* @var FSearchState::result_limit
+* The max number of results
+* @var FSearchState::result_batch
+* The initial capacity of each batch
+* @var FSearchState::single_consumer
+* true if batches are queued for the calling thread
+* @var FSearchState::stop
+* true once the threads should stop searching
+* @var FSearchState::pending
+* Batches waiting to be consumed (single consumer only)
+* @var FSearchState::pending_tail
+* The last pending batch
+* @var FSearchState::ordered
+* true if results are delivered in ascending line order
+* @var FSearchState::window
+* The reorder window, one completed batch per slot (ordered only)
+* @var FSearchState::window_len
+* How many blocks can be buffered ahead of the last delivered block
+* @var FSearchState::window_cond
+* Signaled when the window has room for more blocks
+* @var FSearchState::reverse
+* true if blocks are claimed, and lines matched, from the end of the range
+* @var FSearchState::block_count
+* The number of blocks of `line_buffer` lines to search
+* @var FSearchState::next_block
+* The next block to claim
+* @var FSearchState::emit_block
+* The next block to deliver
+* @var FSearchState::cancel
+* The cancellation token and deadline of this search
+* @var FSearchState::ready_cond
+* Signaled when a batch is queued or a thread exits
+* @var FSearchState::running
+* The number of threads still searching
+* @var FSearchState::trigrams
+* The trigrams a match must contain, when the index has a trigram index (NULL if unused)
+*/
+typedef struct FSearchState {
+  pthread_mutex_t lock;
+  atomic_int result_count;
+  int result_limit;
+  unsigned int result_batch;
+  bool single_consumer;
+  atomic_bool stop;
+  f_search_batch* pending;
+  f_search_batch* pending_tail;
+  bool ordered;
+  f_search_batch** window;
+  size_t window_len;
+  pthread_cond_t window_cond;
+  bool reverse;
+  size_t block_count;
+  size_t next_block;
+  size_t emit_block;
+  f_cancel_state cancel;
+  pthread_cond_t ready_cond;
+  int running;
+  f_trigram_query* trigrams;
+} f_search_state;
+
 /** @struct FSearcher
 * @brief a config to pass to f_index_search
 *
@@ -1188,7 +3739,7 @@ typedef void (*searcher_cb)(f_search_result* result, void* payload);
 * @var FSearcher::result_limit
 * The maximum number of results returned
 * @var FSearcher::line_buffer
-* How many lines to read from disk on a search iteration
+* How many lines to read from disk on a search iteration (at least 1)
 * @var FSearcher::on_progress
 * Progress callback
 * @var FSearcher::progress_payload
@@ -1197,6 +3748,36 @@ typedef void (*searcher_cb)(f_search_result* result, void* payload);
 * Search result callback
 * @var FSearcher::result_payload
 * Payload for result callback
+* @var FSearcher::result_batch
+* How many results a thread collects before flushing them (0 for the default)
+* @var FSearcher::single_consumer
+* If true, `on_result` is called from the calling thread instead of the search threads
+* @var FSearcher::ordered
+* If true, results are delivered in ascending line order and `result_limit` keeps the first matches in the file
+* @var FSearcher::reorder_window
+* How many blocks of `line_buffer` lines an ordered search may buffer ahead of the last delivered block (0 for the default)
+* @var FSearcher::cancel
+* A token to cancel the search from another thread (NULL if unused)
+* @var FSearcher::timeout_ms
+* Cancel the search after this many milliseconds (0 for no deadline)
+* @var FSearcher::start_line
+* The first line number to search (0 for the first line)
+* @var FSearcher::end_line
+* The last line number to search, inclusive (0 for the last line)
+* @var FSearcher::reverse
+* If true, lines are searched from `end_line` backwards and results are delivered in descending line order, as if `ordered` was set
+* @var FSearcher::context_before
+* How many lines before each match to attach to its result (like grep -B)
+* @var FSearcher::context_after
+* How many lines after each match to attach to its result (like grep -A)
+* @var FSearcher::column
+* Only match the regex against this column, 1 based, the index needs a field index (0 for the whole line).
+* Quotes are part of the column, match offsets stay relative to the line
+* @var FSearcher::stats
+* Filled in with counters and stage timings of the search, initialized by the caller with f_stats_init (NULL if unused).
+* They are complete once the search was waited on
+* @var FSearcher::runtime
+* The thread pool to run the search threads on (NULL for threads of their own)
 */
 typedef struct FSearcher {
   char* regex;
@@ -1208,8 +3789,58 @@ typedef struct FSearcher {
   void* progress_payload;
   searcher_cb on_result;
   void* result_payload;
+  unsigned int result_batch;
+  bool single_consumer;
+  bool ordered;
+  unsigned int reorder_window;
+  f_cancel* cancel;
+  unsigned long timeout_ms;
+  size_t start_line;
+  size_t end_line;
+  bool reverse;
+  unsigned int context_before;
+  unsigned int context_after;
+  size_t column;
+  f_stats* stats;
+  f_runtime* runtime;
 } f_searcher;
 
+/** @struct FSearchContext
+* @brief context collected while a thread matches one buffer
+*
+* Lines are counted in the order they are scanned. "ahead" is the
+* side of a match that hasn't been scanned yet, "behind" the side that has.
+* @var FSearchContext::result
+* The last result, held back until its context ahead is collected (NULL if none)
+* @var FSearchContext::open
+* true while the last match still claims the lines ahead of it
+* @var FSearchContext::open_line
+* The scan position of the last match
+* @var FSearchContext::covered
+* The scan position of the last line that is a match or context
+* @var FSearchContext::lines
+* The number of lines collected ahead of the last match
+* @var FSearchContext::lo
+* The start of the lines collected ahead
+* @var FSearchContext::hi
+* The end of the lines collected ahead
+* @var FSearchContext::ring
+* The last `behind` lines scanned
+* @var FSearchContext::ring_len
+* The length of each line in `ring`
+*/
+typedef struct FSearchContext {
+  f_search_result* result;
+  bool open;
+  size_t open_line;
+  size_t covered;
+  unsigned int lines;
+  char* lo;
+  char* hi;
+  char** ring;
+  size_t* ring_len;
+} f_search_context;
+
 /** @struct FSearcherThread
 * @brief search config is passed to each thread
 *
@@ -1226,10 +3857,32 @@ typedef struct FSearcher {
 * How many lines to read from disk at a time
 * @var FSearcherThread::result_limit
 * The max number of results
-* @var FSearcherThread::result_count
-* The current number of results
+* @var FSearcherThread::state
+* The state shared with the other threads of this search
+* @var FSearcherThread::batch
+* The results collected by this thread and not yet flushed
+* @var FSearcherThread::mode
+* What to collect for each match
+* @var FSearcherThread::matches
+* The number of matching lines (count and bitmap modes)
+* @var FSearcherThread::bitmap
+* The matching line numbers (bitmap mode)
 * @var FSearcherThread::progress
-* This threads progress
+* This threads progress, read by the thread polling the search
+* @var FSearcherThread::done
+* true once the thread has flushed its results and is about to exit
+* @var FSearcherThread::context_before
+* How many lines before each match to attach
+* @var FSearcherThread::context_after
+* How many lines after each match to attach
+* @var FSearcherThread::column
+* The column to match against, 1 based (0 for the whole line)
+* @var FSearcherThread::stats
+* Where to count reads and timings (NULL if unused)
+* @var FSearcherThread::started
+* When the thread started (only with stats)
+* @var FSearcherThread::busy
+* The nanoseconds this thread spent reading and matching (only with stats)
 * @var FSearcherThread::on_result
 * Result callback
 * @var FSearcherThread::result_payload
@@ -1243,12 +3896,71 @@ typedef struct FSearcherThread {
   size_t count;
   size_t buffer;
   int result_limit;
-  int* result_count;
-  double progress;
+  f_search_state* state;
+  f_search_batch* batch;
+  enum F_SEARCH_MODE mode;
+  size_t matches;
+  f_bitmap* bitmap;
+  _Atomic double progress;
+  atomic_bool done;
+  unsigned int context_before;
+  unsigned int context_after;
+  size_t column;
+  f_stats* stats;
+  uint64_t started;
+  uint64_t busy;
   searcher_cb on_result;
   void* result_payload;
 } f_searcher_thread;
 
+/** @struct FSearchHandle
+* @brief a search running in the background
+*
+* Created by `f_index_search_start`, the caller polls it for
+* progress and pulls batches of results at its own pace.
+* @var FSearchHandle::state
+* The state shared with the search threads
+* @var FSearchHandle::regex
+* The compiled search term
+* @var FSearchHandle::threads
+* The search threads
+* @var FSearchHandle::tasks
+* The tasks the search threads run as, on the runtime or on threads of their own
+* @var FSearchHandle::len
+* The number of threads that were started
+* @var FSearchHandle::mode
+* What the threads collect for each match
+* @var FSearchHandle::joined
+* true once the threads have been joined
+* @var FSearchHandle::rc
+* The result of the search, once joined
+* @var FSearchHandle::ready
+* Batches taken from the threads and not yet handed out
+* @var FSearchHandle::ready_tail
+* The last ready batch
+* @var FSearchHandle::config
+* The config the search was started with
+* @var FSearchHandle::started
+* When the search was started (only with stats)
+* @var FSearchHandle::lines
+* The number of lines in the searched range
+*/
+typedef struct FSearchHandle {
+  f_search_state state;
+  pcre2_code* regex;
+  f_searcher_thread** threads;
+  f_runtime_task** tasks;
+  int len;
+  enum F_SEARCH_MODE mode;
+  bool joined;
+  int rc;
+  f_search_batch* ready;
+  f_search_batch* ready_tail;
+  f_searcher config;
+  uint64_t started;
+  size_t lines;
+} f_search_handle;
+
 /**
   Initializes a search result
 
@@ -1285,18 +3997,113 @@ void f_search_results_prepend(f_search_results** results, f_search_result* addit
 */
 void f_search_results_free(f_search_results** results);
 
+/**
+  Allocates a new search batch
+
+  @param out the search batch
+  @param cap how many results the batch can hold
+  @return non zero for error
+*/
+int f_search_batch_init(f_search_batch** out, unsigned int cap);
+
+/**
+  Free a search batch and any results left in it.
+
+  @param batch the batch to free
+*/
+void f_search_batch_free(f_search_batch* batch);
+
 /**
   Searches an index concurrently
 
   Note: search results can only be aggregated through
   the `on_result` callback.
 
-  @param out the search results
+  Threads stop between buffers once `cancel` is requested
+  or `timeout_ms` has passed. Results queued but not yet
+  delivered are dropped, and errno is set to ECANCELED or ETIMEDOUT.
+
   @param config the search config
-  @return non zero for error, -2 for invalid regex.
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
 */
 int f_index_search(f_searcher config);
 
+/**
+  Starts searching an index in the background
+
+  Results are queued on the handle instead of being sent to `on_result`,
+  so they are consumed on the callers thread with `f_search_handle_next_batch`.
+  `on_progress` is not called, use `f_search_handle_poll` instead.
+
+  @param out the search handle
+  @param config the search config
+  @return non zero for error, -2 for invalid regex.
+*/
+int f_index_search_start(f_search_handle** out, f_searcher config);
+
+/**
+  Checks on a search without blocking
+
+  Also enforces the deadline and cancellation token of the search.
+  @param handle the search handle
+  @param progress the progress of the search (0 - 1), can be NULL
+  @return true once every search thread is done
+*/
+bool f_search_handle_poll(f_search_handle* handle, double* progress);
+
+/**
+  Takes the next batch of results without blocking
+
+  With `ordered` set, batches come out in ascending line order,
+  descending with `reverse`.
+  The caller owns the batch and frees it with `f_search_batch_free`.
+  @param out the next batch, NULL if none are ready yet
+  @param handle the search handle
+  @return non zero for error
+*/
+int f_search_handle_next_batch(f_search_batch** out, f_search_handle* handle);
+
+/**
+  Blocks until every search thread is done
+
+  Results that weren't taken stay on the handle for `f_search_handle_next_batch`,
+  unless the search was cancelled.
+  @param handle the search handle
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_search_handle_wait(f_search_handle* handle);
+
+/**
+  Stops the search if it is still running and frees the handle
+  @param handle the search handle
+*/
+void f_search_handle_free(f_search_handle** handle);
+
+/**
+  Counts the lines of an index that match
+
+  No result is allocated per match, `on_result`, `ordered`
+  and `result_limit` are ignored.
+
+  @param config the search config
+  @param out the number of matching lines
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
+*/
+int f_index_search_count(f_searcher config, size_t* out);
+
+/**
+  Collects the line numbers of an index that match
+
+  Line numbers are the same as `FSearchResult::line_number`.
+  No result is allocated per match, `on_result`, `ordered`
+  and `result_limit` are ignored.
+
+  @param config the search config
+  @param out the matching line numbers, free with `f_bitmap_free`
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
+*/
+int f_index_search_bitmap(f_searcher config, f_bitmap** out);
+
 
 
 #endif
@@ -2,6 +2,12 @@
 #define FLASHLIGHT_INDEX
 #define _FILE_OFFSET_BITS == 64
 #include "index.h"
+#include "trigram.h"
+#include "bitmap.h"
+#include "token.h"
+#include "timestamp.h"
+#include "field.h"
+#include "compress.h"
 #include <string.h>
 
 int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file* flookup, f_lookup_mem* mlookup)
@@ -14,6 +20,17 @@ int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file*
 
   init->filename = filename;
   init->filename_len = filename_len;
+  init->trigrams = NULL;
+  init->tokens = NULL;
+  init->times = NULL;
+  init->fields = NULL;
+  init->records = false;
+  init->record_head = 0;
+  init->record_tail = '\n';
+  init->record_width = 0;
+  init->record_start = 0;
+  init->record_count = 0;
+  init->compressed = NULL;
 
   if (mlookup == NULL)
   {
@@ -48,13 +65,108 @@ int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file*
   return 0;
 }
 
+int f_index_init_fixed(f_index** out, char* filename, int filename_len, size_t start, size_t width)
+{
+  if (width == 0)
+  {
+    f_log(F_LOG_ERROR, "fixed records need a record width");
+    return -1;
+  }
+
+  f_index* init;
+  if (f_index_init(&init, filename, filename_len, NULL, NULL) == -1)
+  {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(init->fd, &st) == -1)
+  {
+    perror("cant stat target");
+    f_index_free(&init);
+    return -1;
+  }
+
+  // a record cut off at the end of the target isn't counted.
+  size_t size = (size_t) st.st_size;
+  init->records = true;
+  init->record_tail = -1;
+  init->record_width = width;
+  init->record_start = start;
+  init->record_count = size > start ? (size - start) / width : 0;
+
+  *out = init;
+  return 0;
+}
+
+/*
+  reads the target, through its checkpoints if it is compressed.
+*/
+static ssize_t f_index_read(f_index* index, void* buffer, size_t len, off_t offset)
+{
+  if (index->compressed != NULL)
+  {
+    return f_compressed_read(index->compressed, buffer, len, (size_t) offset);
+  }
+
+  return pread(index->fd, buffer, len, offset);
+}
+
+size_t f_index_line_count(f_index* index)
+{
+  if (index->record_width > 0)
+  {
+    return index->record_count;
+  }
+
+  return index->flookup->len > 0 ? index->flookup->len - 1 : 0;
+}
+
+/*
+  reads a range of fixed width records, without a lookup.
+*/
+static int f_index_lookup_fixed(char** out, f_index* index, size_t start, size_t count)
+{
+  *out = NULL;
+  if (start >= index->record_count)
+  {
+    f_log(F_LOG_WARN, "start %zu is greater than max %zu", start, index->record_count);
+    return 0;
+  }
+
+  count = start + count > index->record_count ? index->record_count - start : count;
+  size_t len = count * index->record_width;
+  char* string = malloc(sizeof(char) * (len + 1));
+  if (string == NULL)
+  {
+    f_log(F_LOG_ERROR, "Couldn't allocate string!");
+    return -1;
+  }
+
+  off_t offset = (off_t) (index->record_start + start * index->record_width);
+  if (f_index_read(index, string, len, offset) != (ssize_t) len)
+  {
+    perror("read failed");
+    free(string);
+    return -1;
+  }
+  string[len] = '\0';
+
+  *out = string;
+  return 0;
+}
+
 int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
 {
-  enum F_LOG_LEVEL log_level = f_logger_get_level();
+  if (index->record_width > 0)
+  {
+    return f_index_lookup_fixed(out, index, start, count);
+  }
+
 
   if (start > index->flookup->len - 1)
   {
-    f_log(F_LOG_WARN, "start %u is greater than max %u", start, index->flookup->len - 1);
+    f_log(F_LOG_WARN, "start %zu is greater than max %u", start, index->flookup->len - 1);
     *out = NULL;
     return 0;
   }
@@ -89,7 +201,7 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
   if (pread(index->flookup->fd, start_bytes, buffer_size, start_offset) < 0)
   {
     perror("read failed");
-    f_log(F_LOG_ERROR, "index read at %u returned 0 bytes", start);
+    f_log(F_LOG_ERROR, "index read at %zu returned 0 bytes", start);
     *out = NULL;
 
     free(start_bytes);
@@ -100,7 +212,7 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
   if (pread(index->flookup->fd, end_bytes, buffer_size, end_offset) < 0)
   {
     perror("read failed");
-    f_log(F_LOG_ERROR, "index read at %u returned 0 bytes", start);
+    f_log(F_LOG_ERROR, "index read at %zu returned 0 bytes", start);
     *out = NULL;
 
     free(start_bytes);
@@ -109,7 +221,7 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
   }
 
   // Check the zero offset for logging
-  if (log_level & F_LOG_FINE)
+  if (F_LOG_ENABLED(F_LOG_FINE))
   {
     size_t* zero_bytes = malloc(buffer_size);
     if (pread(index->flookup->fd, zero_bytes, buffer_size, (off_t) 0) < 0)
@@ -130,7 +242,7 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
 
   if (*start_bytes > *end_bytes)
   {
-    f_log(F_LOG_ERROR, "something went wrong - (zo: %zu) start: %ld, count: %ld, (start_offset: %zu, end_offset %zu, count offset: %zu) %zu, %zu", zero_offset, start, count, start_offset, end_offset, count_offset, start_bytes, end_bytes);
+    f_log(F_LOG_ERROR, "something went wrong - (zo: %zu) start: %zu, count: %zu, (start_offset: %zu, end_offset %zu, count offset: %zu) %zu, %zu", zero_offset, start, count, start_offset, end_offset, count_offset, *start_bytes, *end_bytes);
     *out = NULL;
     
     free(start_bytes);
@@ -151,14 +263,14 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
   }
 
   off_t starting_bytes = (off_t) *start_bytes;
-  ssize_t bytes_read = pread(index->fd, buffer, bytes, starting_bytes);
+  ssize_t bytes_read = f_index_read(index, buffer, bytes, starting_bytes);
 
   if (bytes_read < 0)
   {
     perror("bytes_read is negative");
 
     f_log(F_LOG_ERROR, "invalid - bytes: %zu  start bytes: %zu, end_bytes: %zu offt (%ld)\n", bytes, *start_bytes, *end_bytes, starting_bytes);
-    f_log(F_LOG_DEBUG, "[debug] bytes read: %d lines are: %zu, %zu, [allocation %zu]", bytes_read, start, start + count, bytes);
+    f_log(F_LOG_DEBUG, "[debug] bytes read: %zd lines are: %zu, %zu, [allocation %zu]", bytes_read, start, start + count, bytes);
     f_log(F_LOG_DEBUG, "Start off: %ld - Count off %ld, End off: %ld zero off: %ld", start_offset, count_offset, end_offset, zero_offset);
 
     free(buffer);
@@ -189,15 +301,168 @@ int f_index_lookup(char** out, f_index* index, size_t start, size_t count)
   return 0;
 }
 
+int f_index_lookup_lines(f_index_lines* out, f_index* index, size_t start, size_t count)
+{
+  out->data = NULL;
+  out->offsets = NULL;
+  out->count = 0;
+  out->head = index->record_head;
+  out->tail = index->record_tail;
+
+  size_t lines = f_index_line_count(index);
+  if (start >= lines)
+  {
+    f_log(F_LOG_WARN, "start %zu is greater than max %zu", start, lines);
+    return 0;
+  }
+
+  count = start + count > lines ? lines - start : count;
+  out->offsets = malloc(sizeof(size_t) * (count + 1));
+  if (out->offsets == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate line offsets");
+    return -1;
+  }
+
+  if (index->record_width > 0)
+  {
+    if (f_index_lookup_fixed(&out->data, index, start, count) != 0 || out->data == NULL)
+    {
+      f_index_lines_free(out);
+      return -1;
+    }
+
+    for (size_t i=0; i<=count; i++)
+    {
+      out->offsets[i] = i * index->record_width;
+    }
+
+    out->count = count;
+    return 0;
+  }
+
+  if (!index->records)
+  {
+    if (f_index_lookup(&out->data, index, start, count) != 0 || out->data == NULL)
+    {
+      f_index_lines_free(out);
+      return -1;
+    }
+
+    char* cursor = out->data;
+    char* end = out->data + strlen(out->data);
+    out->offsets[0] = 0;
+    for (size_t i=1; i<=count; i++)
+    {
+      char* newline = memchr(cursor, '\n', end - cursor);
+      cursor = newline == NULL ? end : newline + 1;
+      out->offsets[i] = (size_t) (cursor - out->data);
+    }
+
+    out->count = count;
+    return 0;
+  }
+
+  /*
+    records can hold newlines, so every offset of the range is read.
+    they are stored from the end of the target, the last one is line 0.
+  */
+  off_t zero_offset = (off_t) ((index->flookup->len - 1) * sizeof(size_t));
+  size_t bytes = (count + 1) * sizeof(size_t);
+  if (pread(index->flookup->fd, out->offsets, bytes, zero_offset - (off_t) ((start + count) * sizeof(size_t))) != (ssize_t) bytes)
+  {
+    perror("read failed");
+    f_index_lines_free(out);
+    return -1;
+  }
+
+  // ascending, relative to the first line.
+  for (size_t i=0; i<(count + 1) / 2; i++)
+  {
+    size_t tmp = out->offsets[i];
+    out->offsets[i] = out->offsets[count - i];
+    out->offsets[count - i] = tmp;
+  }
+
+  size_t first = out->offsets[0];
+  size_t len = out->offsets[count] - first;
+  for (size_t i=0; i<=count; i++)
+  {
+    out->offsets[i] -= first;
+  }
+
+  out->data = malloc(sizeof(char) * (len + 1));
+  if (out->data == NULL)
+  {
+    f_log(F_LOG_ERROR, "Couldn't allocate string!");
+    f_index_lines_free(out);
+    return -1;
+  }
+
+  if (f_index_read(index, out->data, len, (off_t) first) != (ssize_t) len)
+  {
+    perror("read failed");
+    f_index_lines_free(out);
+    return -1;
+  }
+  out->data[len] = '\0';
+
+  out->count = count;
+  return 0;
+}
+
+void f_index_lines_get(f_index_lines* lines, size_t i, char** line, size_t* line_len)
+{
+  size_t len = lines->offsets[i + 1] - lines->offsets[i];
+  size_t head = lines->head < len ? lines->head : len;
+  *line = lines->data + lines->offsets[i] + head;
+  len -= head;
+  *line_len = len > 0 && lines->tail >= 0 && (uint8_t) (*line)[len - 1] == lines->tail ? len - 1 : len;
+}
+
+void f_index_lines_free(f_index_lines* lines)
+{
+  free(lines->data);
+  free(lines->offsets);
+  lines->data = NULL;
+  lines->offsets = NULL;
+  lines->count = 0;
+}
+
 void f_index_free(f_index** index)
 {
   f_index* i = *index;
   fclose(i->fp);
-  if (i->mlookup == NULL)
+  if (i->compressed != NULL)
+  {
+    f_compressed_free(&i->compressed);
+  }
+
+  if (i->trigrams != NULL)
+  {
+    f_trigram_index_free(&i->trigrams);
+  }
+
+  if (i->tokens != NULL)
+  {
+    f_token_index_free(&i->tokens);
+  }
+
+  if (i->times != NULL)
+  {
+    f_time_index_free(&i->times);
+  }
+
+  if (i->fields != NULL)
+  {
+    f_field_index_free(&i->fields);
+  }
+
+  if (i->mlookup == NULL && i->flookup != NULL)
   {
     f_lookup_file_free(&i->flookup);
   }
-  else
+  else if (i->mlookup != NULL)
   {
     f_lookup_mem_free(i->mlookup);
   }
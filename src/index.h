@@ -19,6 +19,28 @@
 * a file lookup (NULL if unused)
 * @var FIndex::mlookup
 * an in-memory lookup (NULL if unsed)
+* @var FIndex::trigrams
+* a trigram index to skip blocks that can't match (NULL if unused)
+* @var FIndex::tokens
+* a token index for exact term lookups (NULL if unused)
+* @var FIndex::times
+* sampled line timestamps to seek to a time window (NULL if unused)
+* @var FIndex::fields
+* the field offsets of a delimited file (NULL if unused)
+* @var FIndex::records
+* true if lines are split on the offsets of the lookup only, because a record can hold newlines
+* @var FIndex::record_head
+* the bytes at the start of every record that aren't part of the line, e.g. a length prefix
+* @var FIndex::record_tail
+* the byte every record ends with, not part of the line ('\n' for text, -1 for none)
+* @var FIndex::record_width
+* the size of every record if they all have the same size, lines are then found without a lookup (0 if unused)
+* @var FIndex::record_start
+* the offset of the first record of a fixed width index, after a file header
+* @var FIndex::record_count
+* the number of records of a fixed width index
+* @var FIndex::compressed
+* the checkpoints to read a gzip or zstd target from, offsets are then uncompressed (NULL for a raw target)
 */
 typedef struct FIndex
 {
@@ -28,8 +50,41 @@ typedef struct FIndex
   FILE* fp;
   f_lookup_file* flookup;
   f_lookup_mem* mlookup;
+  struct FTrigramIndex* trigrams;
+  struct FTokenIndex* tokens;
+  struct FTimeIndex* times;
+  struct FFieldIndex* fields;
+  bool records;
+  size_t record_head;
+  int record_tail;
+  size_t record_width;
+  size_t record_start;
+  size_t record_count;
+  struct FCompressed* compressed;
 } f_index;
 
+/** @struct FIndexLines
+* @brief lines fetched from the target, with where each one starts
+* @var FIndexLines::data
+* the lines, zero terminated (NULL if there were none to fetch)
+* @var FIndexLines::offsets
+* `count + 1` offsets into data, line i is [offsets[i], offsets[i + 1]) with its newline
+* @var FIndexLines::count
+* the number of lines
+* @var FIndexLines::head
+* the bytes skipped at the start of every line
+* @var FIndexLines::tail
+* the byte stripped from the end of every line (-1 for none)
+*/
+typedef struct FIndexLines
+{
+  char* data;
+  size_t* offsets;
+  size_t count;
+  size_t head;
+  int tail;
+} f_index_lines;
+
 /**
   Initializes a new index
 
@@ -42,6 +97,26 @@ typedef struct FIndex
 */
 int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file* flookup, f_lookup_mem* mlookup);
 
+/**
+  Initializes an index of records that all have the same size
+
+  Offsets are computed from the record size, there is no lookup.
+  @param out the index to initialize
+  @param filename the target filename for the index
+  @param filename_len the target filename length
+  @param start the offset of the first record, after a file header
+  @param width the size of every record
+  @return non zero for error
+*/
+int f_index_init_fixed(f_index** out, char* filename, int filename_len, size_t start, size_t width);
+
+/**
+  Counts the lines of an index
+  @param index the index
+  @return the number of lines, or records
+*/
+size_t f_index_line_count(f_index* index);
+
 /**
   Fetches a portion of the file
   
@@ -53,10 +128,39 @@ int f_index_init(f_index** out, char* filename, int filename_len, f_lookup_file*
 */
 int f_index_lookup(char** out, f_index* index, size_t start, size_t count);
 
+/**
+  Fetches a portion of the file, split into lines
+
+  Lines of an index built with a record detector can hold newlines,
+  so they are split with the offsets of the lookup instead.
+  @param out the fetched lines, freed with f_index_lines_free
+  @param index the index to search
+  @param start the start line index
+  @param count the number of lines to fetch
+  @return non zero for error
+*/
+int f_index_lookup_lines(f_index_lines* out, f_index* index, size_t start, size_t count);
+
+/**
+  Gets one of the fetched lines
+  @param lines the fetched lines
+  @param i the line, 0 for the first fetched line
+  @param line the start of the line
+  @param line_len the length of the line, without its newline, or the head and tail of its record
+*/
+void f_index_lines_get(f_index_lines* lines, size_t i, char** line, size_t* line_len);
+
+/**
+  Frees fetched lines
+  @param lines the lines to free
+*/
+void f_index_lines_free(f_index_lines* lines);
+
 /**
   Frees an index and it's lookup
 
-  If the lookup is a FLookupFile, the file is deleted
+  If the lookup is a FLookupFile, the file is deleted,
+  and so are the trigram, token and field indexes
   @param index the index to free
 */
 void f_index_free(f_index** index);
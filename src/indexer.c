@@ -25,7 +25,8 @@ int f_indexer_chunks_init(f_indexer_chunks** out, int concurrency, size_t buffer
 
   init->concurrency = concurrency;
   init->len = chunks_count;
-  init->chunks = malloc(sizeof(f_indexer_chunk*) * chunks_count);
+  // the chunks live right after their pointers, in one allocation.
+  init->chunks = malloc((sizeof(f_indexer_chunk*) + sizeof(f_indexer_chunk)) * (chunks_count > 0 ? chunks_count : 1));
 
   if (init->chunks == NULL)
   {
@@ -33,6 +34,8 @@ int f_indexer_chunks_init(f_indexer_chunks** out, int concurrency, size_t buffer
     return -1;
   }
 
+  f_indexer_chunk* slab = (f_indexer_chunk*) (init->chunks + chunks_count);
+
   for(int cc=0; cc<chunks_count; cc++)
   {
     size_t start_position = from + (cc * buffer_size);
@@ -42,14 +45,7 @@ int f_indexer_chunks_init(f_indexer_chunks** out, int concurrency, size_t buffer
       buffer_size = (bytes_count + from) - start_position;
     }
 
-    f_indexer_chunk* chunk = malloc(sizeof(f_indexer_chunk));
-    if (chunk == NULL)
-    {
-      free(init->chunks);
-      free(init);
-      return -1;
-    }
-
+    f_indexer_chunk* chunk = &slab[cc];
     chunk->index = cc;
     chunk->from = start_position;
     chunk->count = buffer_size;
@@ -63,11 +59,6 @@ int f_indexer_chunks_init(f_indexer_chunks** out, int concurrency, size_t buffer
 
 void f_indexer_chunks_free(f_indexer_chunks* index)
 {
-  for (int i=0; i<index->len; i++)
-  {
-    free(index->chunks[i]);
-  }
-
   free(index->chunks);
   free(index);
   index = NULL;
@@ -109,15 +100,9 @@ int f_indexer_threads_init(f_indexer_threads** out, int threads, size_t total_by
 
   for (int i=0; i<threads; i++)
   {
+    // ranges touch, so every byte is scanned once. the last one takes the remainder.
     unsigned long int start_position = (i * pages);
-    start_position += i;
-
-    if (start_position + pages > total_bytes_count)
-    {
-      pages = (total_bytes_count - start_position);
-    }
-
-    unsigned long int to = start_position + pages;
+    unsigned long int to = i == threads - 1 ? total_bytes_count : start_position + pages;
 
     f_indexer_thread index = {
       .from = start_position + offset,
@@ -8,6 +8,51 @@
 
 typedef void (*indexer_progress_cb)(double progress, void* payload);
 
+struct FIndexer;
+
+/**
+  Adds the end of a record to the chunk being scanned
+  @param sink the chunk
+  @param offset the offset after the end of the record
+  @param atomic false if the offset has to be resolved by the format's merge
+  @return non zero for error
+*/
+typedef int (*f_indexer_emit)(void* sink, size_t offset, bool atomic);
+
+/** @struct FIndexerFormat
+* @brief how an indexer finds records, plugged into the threaded scanning of f_index_text_file
+*
+* Chunks are scanned on their own, in parallel and in any order.
+* What a chunk can't decide alone, e.g. if it starts inside quotes, is fixed by `merge` once every chunk was scanned.
+* @var FIndexerFormat::name
+* the name of the format, for logs
+* @var FIndexerFormat::init
+* creates the state of an indexing run and sets how many bytes past a chunk `scan` needs to see
+* @var FIndexerFormat::open
+* creates the index without scanning the target, e.g. when offsets can be computed (NULL to scan)
+* @var FIndexerFormat::scan
+* emits the end of every record that ends in a chunk, in order (NULL if `merge` finds every record)
+* @var FIndexerFormat::merge
+* fixes the lookup across chunk boundaries once every chunk was scanned (NULL if chunks are independent)
+* @var FIndexerFormat::relative
+* true if `scan` only depends on the bytes it is given, so they can be scanned from 0 before their offset is known (NULL if it always does)
+* @var FIndexerFormat::finalize
+* sets how lines are cut out of records on the new index (NULL for newline terminated lines)
+* @var FIndexerFormat::free
+* frees the state
+*/
+typedef struct FIndexerFormat
+{
+  const char* name;
+  int (*init)(void** state, size_t* lookahead, struct FIndexer* indexer, int fd, size_t file_size);
+  int (*open)(void* state, f_index** out, struct FIndexer* indexer);
+  int (*scan)(void* state, const uint8_t* buffer, size_t len, size_t read, size_t from, f_indexer_emit emit, void* sink);
+  int (*merge)(void* state, f_lookup_file* lookup);
+  bool (*relative)(void* state);
+  void (*finalize)(void* state, f_index* index);
+  void (*free)(void* state);
+} f_indexer_format;
+
 
 /** @struct FIndexer
 * @brief the configuration to supply to the indexer.
@@ -18,17 +63,68 @@ typedef void (*indexer_progress_cb)(double progress, void* payload);
 * @var FIndexer::lookup_dir
 * the directory to store the lookup index
 * @var FIndexer::threads
-* the number of threads to spawn during indexing.
+* the number of threads to spawn during indexing (0 to pick one for the device and cores, see tune.h)
 * @var FIndexer::concurrency
-* the number of concurrent calls to make in each thread
+* the number of concurrent calls to make in each thread (0 to pick one for the device)
 * @var FIndexer::buffer_size
-* the buffer to use for each concurrent call
+* the buffer to use for each concurrent call (0 to pick one for the device)
 * @var FIndexer::max_bytes_per_iteration
-* a hard limit on how many bytes to index at one time.
+* a hard limit on how many bytes to index at one time (0 to pick one that bounds memory)
 * @var on_progress
 * a callback to track the progress of the indexing (NULL if unused)
 * @var payload
 * a payload that is passed to the progress callback (NULL if unused)
+* @var cancel
+* a token to cancel the indexing from another thread (NULL if unused)
+* @var timeout_ms
+* cancel the indexing after this many milliseconds (0 for no deadline)
+* @var trigram_block
+* build a trigram index with a filter for every block of this many lines (0 for none)
+* @var trigram_filter
+* the size in bytes of each block's trigram filter (0 for the default)
+* @var tokenizer
+* build a token index, splitting lines with this tokenizer (F_TOKENIZER_NONE for none)
+* @var time_format
+* sample line timestamps in this format, see f_timestamp_parse (NULL for none)
+* @var time_regex
+* where the timestamp is on a line, capture group 1 or else the whole match (NULL for the line start)
+* @var time_every
+* sample the timestamp of every this many lines (0 for the default)
+* @var field_delimiter
+* build a field index, splitting rows on this byte, e.g. ',' or '\t' ('\0' for none)
+* @var field_quote
+* the byte fields are quoted with ('\0' for '"')
+* @var field_columns
+* the number of columns to index (0 for the number of fields in the first row)
+* @var record
+* which newlines end a record, records then count as lines (F_RECORD_LINE for every newline)
+* @var record_quote
+* the byte fields are quoted with, for F_RECORD_QUOTED ('\0' for '"')
+* @var record_prefix
+* the regex a line has to match at its start to begin a record, for F_RECORD_PREFIX
+* @var format
+* how records are found (NULL for f_indexer_format_text)
+* @var record_delimiter
+* the byte records end with, for f_indexer_format_delimited ('\0' for NUL delimited records)
+* @var record_width
+* the size of every record, for f_indexer_format_fixed
+* @var record_start
+* the bytes before the first record, e.g. a file header, for f_indexer_format_fixed
+* @var record_length_bytes
+* the size of the little endian length before every record, for f_indexer_format_length (0 for 4)
+* @var compression
+* how the target is compressed, F_COMPRESSION_AUTO to detect gzip and zstd (F_COMPRESSION_NONE by default)
+* @var compression_span
+* the uncompressed bytes between gzip checkpoints, smaller spans make reads faster and the index bigger (0 for the default)
+* @var stats
+* filled in with counters and stage timings of the run, initialized by the caller with f_stats_init (NULL if unused)
+* @var adaptive
+* adjust the buffer size between iterations while throughput improves, a picked max_bytes_per_iteration then splits the target in several iterations
+* @var runtime
+* the thread pool to run the indexing threads on (NULL for threads of their own)
+* @var numa
+* bind indexing threads to numa nodes, so their read buffers and offsets are allocated on their node.
+* neighbouring ranges of the target share a node. A runtime binds its workers with F_AFFINITY_NODES instead
 */
 typedef struct FIndexer
 {
@@ -41,6 +137,31 @@ typedef struct FIndexer
   size_t max_bytes_per_iteration;
   indexer_progress_cb on_progress;
   void* payload;
+  f_cancel* cancel;
+  unsigned long timeout_ms;
+  size_t trigram_block;
+  size_t trigram_filter;
+  enum F_TOKENIZER tokenizer;
+  char* time_format;
+  char* time_regex;
+  size_t time_every;
+  char field_delimiter;
+  char field_quote;
+  size_t field_columns;
+  enum F_RECORD record;
+  char record_quote;
+  char* record_prefix;
+  const f_indexer_format* format;
+  char record_delimiter;
+  size_t record_width;
+  size_t record_start;
+  size_t record_length_bytes;
+  enum F_COMPRESSION compression;
+  size_t compression_span;
+  f_stats* stats;
+  bool adaptive;
+  f_runtime* runtime;
+  bool numa;
 } f_indexer;
 
 
@@ -95,7 +216,7 @@ typedef struct FIndexerChunk
 /** @struct FIndexerChunks
 * @brief An array of configs
 * @var FIndexerChunks::chunks
-* the list of FIndexerChunk
+* the list of FIndexerChunk, allocated with the list
 * @var FIndexerChunks::concurrency
 * the computed concurrency
 * @var FIndexerChunks::len
@@ -0,0 +1,288 @@
+#ifndef FLASHLIGHT_INDEXERS_FORMATS
+#define FLASHLIGHT_INDEXERS_FORMATS
+
+#include "formats.h"
+
+/*
+  emits the offset after every `byte` of a chunk.
+*/
+static int f_format_scan_byte(uint8_t byte, const uint8_t* buffer, size_t len, size_t from, f_indexer_emit emit, void* sink)
+{
+  const uint8_t* cursor = buffer;
+  const uint8_t* end = buffer + len;
+  while (cursor < end)
+  {
+    const uint8_t* found = memchr(cursor, byte, (size_t) (end - cursor));
+    if (found == NULL)
+    {
+      break;
+    }
+
+    cursor = found + 1;
+    if (emit(sink, from + (size_t) (cursor - buffer), true) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int f_format_text_init(void** state, size_t* lookahead, f_indexer* indexer, int fd, size_t file_size)
+{
+  f_record* record = malloc(sizeof(*record));
+  if (record == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate record detector");
+    return -1;
+  }
+
+  if (f_record_init(record, indexer->record, indexer->record_quote, indexer->record_prefix, file_size) == -1)
+  {
+    free(record);
+    return -1;
+  }
+
+  // a prefix detector looks at the line after the chunk's last newline.
+  *lookahead = record->mode == F_RECORD_PREFIX ? F_RECORD_LOOKAHEAD : 0;
+  *state = record;
+  return 0;
+}
+
+static int f_format_text_scan(void* state, const uint8_t* buffer, size_t len, size_t read, size_t from, f_indexer_emit emit, void* sink)
+{
+  f_record* record = state;
+  if (record->mode == F_RECORD_LINE)
+  {
+    return f_format_scan_byte('\n', buffer, len, from, emit, sink);
+  }
+
+  f_record_scan scan;
+  if (f_record_scan_init(&scan, record) == -1)
+  {
+    return -1;
+  }
+
+  for (size_t pos=0; pos<len; pos++)
+  {
+    bool atomic;
+    if (f_record_boundary(record, &scan, buffer, pos, read, from + pos, &atomic) && emit(sink, from + pos + 1, atomic) != 0)
+    {
+      pcre2_match_data_free(scan.match_data);
+      return -1;
+    }
+  }
+
+  return f_record_scan_done(record, &scan, from);
+}
+
+static int f_format_text_merge(void* state, f_lookup_file* lookup)
+{
+  // quoted records are only known once every chunk was scanned.
+  return f_record_resolve(state, lookup);
+}
+
+static bool f_format_text_relative(void* state)
+{
+  // quoted chunks are resolved by the offset they were scanned at.
+  f_record* record = state;
+  return record->mode != F_RECORD_QUOTED;
+}
+
+static void f_format_text_finalize(void* state, f_index* index)
+{
+  f_record* record = state;
+  index->records = record->mode != F_RECORD_LINE;
+}
+
+static void f_format_text_free(void* state)
+{
+  f_record_free(state);
+  free(state);
+}
+
+const f_indexer_format f_indexer_format_text = {
+  .name = "text",
+  .init = f_format_text_init,
+  .open = NULL,
+  .scan = f_format_text_scan,
+  .merge = f_format_text_merge,
+  .relative = f_format_text_relative,
+  .finalize = f_format_text_finalize,
+  .free = f_format_text_free
+};
+
+static int f_format_state_init(void** state, size_t* lookahead, f_indexer* indexer, int fd, size_t file_size)
+{
+  f_format_state* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate format state");
+    return -1;
+  }
+
+  init->delimiter = (uint8_t) indexer->record_delimiter;
+  init->width = indexer->record_width;
+  init->start = indexer->record_start;
+  init->length_bytes = indexer->record_length_bytes == 0 ? 4 : indexer->record_length_bytes;
+  init->fd = fd;
+  init->file_size = file_size;
+
+  *lookahead = 0;
+  *state = init;
+  return 0;
+}
+
+static int f_format_delimited_scan(void* state, const uint8_t* buffer, size_t len, size_t read, size_t from, f_indexer_emit emit, void* sink)
+{
+  f_format_state* format = state;
+  return f_format_scan_byte(format->delimiter, buffer, len, from, emit, sink);
+}
+
+static void f_format_delimited_finalize(void* state, f_index* index)
+{
+  f_format_state* format = state;
+  index->records = true;
+  index->record_tail = format->delimiter;
+}
+
+const f_indexer_format f_indexer_format_delimited = {
+  .name = "delimited",
+  .init = f_format_state_init,
+  .open = NULL,
+  .scan = f_format_delimited_scan,
+  .merge = NULL,
+  .relative = NULL,
+  .finalize = f_format_delimited_finalize,
+  .free = free
+};
+
+static int f_format_fixed_init(void** state, size_t* lookahead, f_indexer* indexer, int fd, size_t file_size)
+{
+  if (indexer->record_width == 0)
+  {
+    f_log(F_LOG_ERROR, "fixed records need a record width");
+    return -1;
+  }
+
+  return f_format_state_init(state, lookahead, indexer, fd, file_size);
+}
+
+static int f_format_fixed_open(void* state, f_index** out, f_indexer* indexer)
+{
+  f_format_state* format = state;
+  return f_index_init_fixed(out, indexer->filename, indexer->filename_len, format->start, format->width);
+}
+
+const f_indexer_format f_indexer_format_fixed = {
+  .name = "fixed",
+  .init = f_format_fixed_init,
+  .open = f_format_fixed_open,
+  .scan = NULL,
+  .merge = NULL,
+  .relative = NULL,
+  .finalize = NULL,
+  .free = free
+};
+
+static int f_format_length_init(void** state, size_t* lookahead, f_indexer* indexer, int fd, size_t file_size)
+{
+  if (indexer->record_length_bytes > sizeof(uint64_t))
+  {
+    f_log(F_LOG_ERROR, "record lengths can't be longer than %zu bytes", sizeof(uint64_t));
+    return -1;
+  }
+
+  return f_format_state_init(state, lookahead, indexer, fd, file_size);
+}
+
+static int f_format_length_merge(void* state, f_lookup_file* lookup)
+{
+  f_format_state* format = state;
+
+  uint8_t* buffer = malloc(sizeof(uint8_t) * F_FORMAT_LENGTH_READ);
+  if (buffer == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate length buffer");
+    return -1;
+  }
+
+  size_t count = 0;
+  size_t offset = 0;
+  size_t buffer_from = 0;
+  size_t buffer_len = 0;
+  while (offset + format->length_bytes <= format->file_size)
+  {
+    if (offset < buffer_from || offset + format->length_bytes > buffer_from + buffer_len)
+    {
+      ssize_t bytes_read = pread(format->fd, buffer, F_FORMAT_LENGTH_READ, (off_t) offset);
+      if (bytes_read < (ssize_t) format->length_bytes)
+      {
+        perror("cant read record length");
+        free(buffer);
+        return -1;
+      }
+      buffer_from = offset;
+      buffer_len = (size_t) bytes_read;
+    }
+
+    uint64_t len = 0;
+    const uint8_t* length = buffer + (offset - buffer_from);
+    for (size_t i=0; i<format->length_bytes; i++)
+    {
+      len |= (uint64_t) length[i] << (8 * i);
+    }
+
+    if (len > format->file_size - offset - format->length_bytes)
+    {
+      f_log(F_LOG_WARN, "record at %zu is cut off", offset);
+      break;
+    }
+
+    offset += format->length_bytes + (size_t) len;
+    if (f_lookup_file_append(lookup, offset) == -1)
+    {
+      free(buffer);
+      return -1;
+    }
+    count++;
+  }
+
+  free(buffer);
+
+  // found front to back, stored from the end of the target.
+  if (f_lookup_file_reverse(lookup, count) == -1 || f_lookup_file_append(lookup, 0ul) == -1)
+  {
+    return -1;
+  }
+
+  if (fflush(lookup->fp) != 0)
+  {
+    perror("didn't flush");
+    return -1;
+  }
+
+  lookup->len = (unsigned int) (count + 1);
+  return 0;
+}
+
+static void f_format_length_finalize(void* state, f_index* index)
+{
+  f_format_state* format = state;
+  index->records = true;
+  index->record_head = format->length_bytes;
+  index->record_tail = -1;
+}
+
+const f_indexer_format f_indexer_format_length = {
+  .name = "length",
+  .init = f_format_length_init,
+  .open = NULL,
+  .scan = NULL,
+  .merge = f_format_length_merge,
+  .relative = NULL,
+  .finalize = f_format_length_finalize,
+  .free = free
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FLASHLIGHT_INDEXERS_FORMATS_H
+#define FLASHLIGHT_INDEXERS_FORMATS_H
+
+/** @file formats.h
+* @brief The record formats that ship with the indexer
+*
+* A format only finds where records end, f_index_text_file reads the target,
+* runs the threads and writes the lookup. Other formats implement FIndexerFormat
+* and are passed as `format` on the f_indexer.
+*/
+
+// bytes read at a time while walking length prefixed records.
+#define F_FORMAT_LENGTH_READ 65536
+
+/** @struct FFormatState
+* @brief the state of the binary formats
+* @var FFormatState::delimiter
+* the byte records end with (delimited only)
+* @var FFormatState::width
+* the size of every record (fixed only)
+* @var FFormatState::start
+* the offset of the first record (fixed only)
+* @var FFormatState::length_bytes
+* the size of the length before every record (length only)
+* @var FFormatState::fd
+* the file descriptor of the target
+* @var FFormatState::file_size
+* the size of the target
+*/
+typedef struct FFormatState
+{
+  uint8_t delimiter;
+  size_t width;
+  size_t start;
+  size_t length_bytes;
+  int fd;
+  size_t file_size;
+} f_format_state;
+
+/**
+  Lines, or records of several lines, see record.h
+*/
+extern const f_indexer_format f_indexer_format_text;
+
+/**
+  Records that end with a byte, e.g. NUL. The byte isn't part of the line.
+*/
+extern const f_indexer_format f_indexer_format_delimited;
+
+/**
+  Records that all have the same size, after an optional header
+
+  Offsets are computed from the record size: the target isn't scanned and there is no lookup file.
+*/
+extern const f_indexer_format f_indexer_format_fixed;
+
+/**
+  Records that start with their length, little endian. The length isn't part of the line.
+
+  A record only starts where the one before it ends, so records are walked front to back
+  from their lengths instead of scanned in chunks.
+*/
+extern const f_indexer_format f_indexer_format_length;
+
+#endif
@@ -2,7 +2,6 @@
 #define FLASHLIGHT_INDEXERS_TEXT
 #include <pthread.h>
 #include <libdill.h>
-#include <signal.h>
 #include "text_indexer.h"
 
 /*
@@ -24,87 +23,109 @@ static void rand_string(char* str, size_t size)
   }
 }
 
-coroutine void f_index_text_bytes(int fd, int done, f_indexer_chunk* ic, int thread)
+/*
+  tells the waiting thread that this chunk failed.
+*/
+static void f_index_text_bytes_fail(int done)
 {
-  const size_t buffer_size = ic->count;
-  size_t total_bytes_offset = ic->from;
+  f_chunk* none = NULL;
+  if (chsend(done, &none, sizeof(none), -1) != 0)
+  {
+    f_log(F_LOG_WARN, "couldn't send channel message to thread");
+  }
+}
 
-  uint8_t* buffer = malloc(sizeof(*buffer) * buffer_size);
-  if (buffer == NULL)
+/*
+  adds the end of a record to the chunk being scanned.
+*/
+static int f_index_text_emit(void* payload, size_t offset, bool atomic)
+{
+  f_text_sink* sink = payload;
+
+  // one per record, from the thread's arena rather than two mallocs.
+  f_bytes* bytes = f_arena_alloc(sink->arena, sizeof(*bytes));
+  f_bytes_node* node = f_arena_alloc(sink->arena, sizeof(*node));
+  if (bytes == NULL || node == NULL)
   {
-    f_log(F_LOG_ERROR, "failed to allocate read buffer");
-    chsend(done, NULL, sizeof(f_chunk*), -1);
-    return;
+    return -1;
   }
 
-  f_bytes_node* last_chunk_node = NULL;
-  f_bytes_node* start_node = NULL;
+  bytes->atomic = atomic;
+  bytes->offset = offset;
+  node->bytes = bytes;
+  node->next = NULL;
 
-  // ssize_t bytes_read;
-  bool head = true;
-  unsigned int line_count = 0u;
+  if (sink->last == NULL)
+  {
+    sink->last = node;
+  }
+
+  if (sink->first == NULL)
+  {
+    sink->first = node;
+  }
+  else
+  {
+    f_bytes_node_prepend(&sink->first, &node);
+  }
+
+  sink->line_count++;
+  return 0;
+}
+
+coroutine void f_index_text_bytes(f_text_thread* tthread, int done, f_indexer_chunk* ic, uint8_t* buffer)
+{
+  const f_indexer_format* format = tthread->format;
+  const size_t buffer_size = ic->count;
+  const size_t read_size = buffer_size + tthread->lookahead;
 
-  const ssize_t bytes_read = pread(fd, buffer, buffer_size, total_bytes_offset);
+  uint64_t started = tthread->stats != NULL ? f_stats_now() : 0;
+  const ssize_t bytes_read = pread(tthread->fd, buffer, read_size, ic->from);
   if (bytes_read == -1)
   {
     perror("failed to pread on file");
-    chsend(done, NULL, sizeof(f_chunk*), -1);
+    f_index_text_bytes_fail(done);
     return;
   }
+  f_stats_read(tthread->stats, (size_t) bytes_read, started);
 
-  int pos = 0;
+  // the lookahead can be looked at, but records ending in it belong to the next chunk.
+  const size_t chunk_end = (size_t) bytes_read < buffer_size ? (size_t) bytes_read : buffer_size;
 
-  while (pos < bytes_read)
-  {
-    total_bytes_offset++;
-    if ((char) buffer[pos] == '\n')
-    {
-      line_count++;
+  f_text_sink sink = {
+    .first = NULL,
+    .last = NULL,
+    .line_count = 0u,
+    .arena = tthread->arena
+  };
 
-      f_bytes* bytes;
-      if (f_bytes_new(&bytes, true, total_bytes_offset) == -1)
-      {
-        chsend(done, NULL, sizeof(f_chunk*), -1);
-        return;
-      }
-
-      f_bytes_node* node;
-      if (f_bytes_node_new(&node, bytes) == -1)
-      {
-        chsend(done, NULL, sizeof(f_chunk*), -1);
-        return;
-      }
+  uint64_t scan_started = tthread->stats != NULL ? f_stats_now() : 0;
+  int rc = format->scan(tthread->state, buffer, chunk_end, (size_t) bytes_read, ic->from, f_index_text_emit, &sink);
+  f_stats_since(tthread->stats, F_STATS_SCAN, scan_started);
 
-      if (head)
-      {
-        last_chunk_node = node;
-        head = false;
-      }
-  
-      if (start_node == NULL) 
-      {
-        start_node = node;
-      }
-      else 
-      {
-        f_bytes_node_prepend(&start_node, &node);
-      }
-    }
+  // coroutines of a thread never run at the same time.
+  tthread->busy += tthread->stats != NULL ? f_stats_now() - started : 0;
 
-    pos++;
+  if (rc != 0)
+  {
+    f_log(F_LOG_ERROR, "%s format failed to scan chunk at %zu", format->name, ic->from);
+    f_index_text_bytes_fail(done);
+    return;
   }
 
-  free(buffer);
-  F_MTRIM(0);
-
-  f_chunk* chunk;
-  if (f_chunk_new(&chunk, ic->index, start_node, last_chunk_node) == -1)
+  f_chunk* chunk = f_arena_alloc(tthread->arena, sizeof(*chunk));
+  if (chunk == NULL)
   {
-    chsend(done, NULL, sizeof(chunk), -1);
+    f_index_text_bytes_fail(done);
     return;
   }
 
-  chunk->line_count = line_count;
+  chunk->current = ic->index;
+  chunk->first = sink.first;
+  chunk->last = sink.last;
+  chunk->empty = sink.first == NULL;
+  chunk->line_count = sink.line_count;
+  chunk->pooled = true;
 
   if (chsend(done, &chunk, sizeof(chunk), -1) != 0)
   {
@@ -112,24 +133,82 @@ coroutine void f_index_text_bytes(int fd, int done, f_indexer_chunk* ic, int thr
   }
 }
 
-void* f_index_text_chunk(void* payload)
+/*
+  frees the read buffers of a thread.
+*/
+static void f_index_text_buffers_free(f_text_thread* tthread)
 {
-  f_text_thread* tthread = (f_text_thread*) payload;
+  for (int i=0; i<tthread->buffers_len; i++)
+  {
+    free(tthread->buffers[i]);
+  }
+  free(tthread->buffers);
+  tthread->buffers = NULL;
+  tthread->buffers_len = 0;
+  tthread->buffers_size = 0;
+}
 
+/*
+  makes sure the thread has a read buffer for every coroutine of a round, `size` big.
+  the ring is only reallocated when the concurrency or the buffer size grew.
+*/
+static int f_index_text_buffers(f_text_thread* tthread, int len, size_t size)
+{
+  size = (size + F_TEXT_BUFFER_ALIGN - 1) & ~((size_t) F_TEXT_BUFFER_ALIGN - 1);
+  if (tthread->buffers_len >= len && tthread->buffers_size >= size)
+  {
+    return 0;
+  }
+
+  f_index_text_buffers_free(tthread);
+  tthread->buffers = calloc(len, sizeof(uint8_t*));
+  if (tthread->buffers == NULL)
+  {
+    return -1;
+  }
+
+  for (int i=0; i<len; i++)
+  {
+    void* buffer;
+    if (posix_memalign(&buffer, F_TEXT_BUFFER_ALIGN, size) != 0)
+    {
+      f_index_text_buffers_free(tthread);
+      return -1;
+    }
+    tthread->buffers[i] = buffer;
+    tthread->buffers_len++;
+  }
+
+  tthread->buffers_size = size;
+  return 0;
+}
+
+f_chunk* f_index_text_chunk_run(f_text_thread* tthread)
+{
   unsigned int line_count = 0u;
 
   f_indexer_chunks* ic;
   if (f_indexer_chunks_init(&ic, tthread->concurrency, tthread->buffer_size, tthread->total_bytes_count, tthread->from, tthread->to) == -1)
   {
     f_log(F_LOG_ERROR, "cannot init indexer chunks");
-    pthread_exit(NULL);
+    return NULL;
   }
 
-  f_chunk** chunk_array;
-  if (f_chunk_array_new(&chunk_array, ic->len) == -1)
+  f_chunk** chunk_array = calloc(ic->len > 0 ? ic->len : 1, sizeof(f_chunk*));
+  if (chunk_array == NULL)
   {
     f_log(F_LOG_ERROR, "cannot init chunk array");
-    pthread_exit(NULL);
+    f_indexer_chunks_free(ic);
+    return NULL;
+  }
+
+  // coroutine c of every round reads into buffer c.
+  if (f_index_text_buffers(tthread, ic->concurrency, tthread->buffer_size + tthread->lookahead) == -1)
+  {
+    f_log(F_LOG_ERROR, "failed to allocate read buffers");
+    free(chunk_array);
+    f_indexer_chunks_free(ic);
+    return NULL;
   }
 
   int chunks_finished = 0;
@@ -139,14 +218,25 @@ void* f_index_text_chunk(void* payload)
   if (rc == -1)
   {
     f_log(F_LOG_ERROR, "cannot create concurrency channel");
-    pthread_exit(NULL);
+    free(chunk_array);
+    f_indexer_chunks_free(ic);
+    return NULL;
   }
 
   int send = chv[0];
   int recv = chv[1];
+  bool stopped = false;
 
-  for (int i=0; i<ic->len; i+=ic->concurrency)
+  for (int i=0; i<ic->len && !stopped; i+=ic->concurrency)
   {
+    // cancellation is checked between rounds of coroutines.
+    if (f_cancel_state_poll(tthread->cancel) != F_CANCEL_NONE)
+    {
+      stopped = true;
+      break;
+    }
+
+    int launched = 0;
     for (int c=0; c<ic->concurrency; c++)
     {
       unsigned long int index = i + c;
@@ -158,35 +248,33 @@ void* f_index_text_chunk(void* payload)
 
       f_indexer_chunk* chunk = ic->chunks[index];
 
-      f_log(F_LOG_DEBUG, "[%d] [%lu] [cc: %d] [buf: %zu] chunk start %u [total: %zu]", tthread->thread, index, c, chunk->count, chunk->from, chunk->from + chunk->count);
+      f_log(F_LOG_DEBUG, "[%d] [%lu] [cc: %d] [buf: %zu] chunk start %zu [total: %zu]", tthread->thread, index, c, chunk->count, chunk->from, chunk->from + chunk->count);
 
-      if (bundle_go(b, f_index_text_bytes(tthread->fd, send, chunk, tthread->thread)) == -1)
+      if (bundle_go(b, f_index_text_bytes(tthread, send, chunk, tthread->buffers[c])) == -1)
       {
-        f_log(F_LOG_ERROR, "cannot run coroutine for chunk %d", index);
-        pthread_exit(NULL);
+        f_log(F_LOG_ERROR, "cannot run coroutine for chunk %lu", index);
+        stopped = true;
+        break;
       }
+      launched++;
     }
 
-    for (int c=0; c<ic->concurrency; c++)
+    // always collect every coroutine that was started.
+    for (int c=0; c<launched; c++)
     {
-      unsigned long int index = i + c;
-
-      if (index >= ic->len)
-      {
-        break;
-      }
-
       f_chunk* chunk;
       if (chrecv(recv, &chunk, sizeof(chunk), -1) != 0)
       {
         f_log(F_LOG_ERROR, "cannot receive chunk");
-        pthread_exit(NULL);
+        stopped = true;
+        break;
       }
 
       if (chunk == NULL)
       {
         f_log(F_LOG_ERROR, "chunk is NULL");
-        pthread_exit(NULL);
+        stopped = true;
+        continue;
       }
 
       line_count += chunk->line_count;
@@ -195,7 +283,7 @@ void* f_index_text_chunk(void* payload)
     }
 
     double prog = ((double) (chunks_finished) / ic->len);
-    tthread->progress = prog;
+    atomic_store_explicit(&tthread->progress, prog, memory_order_relaxed);
   }
 
   if (hclose(send) == -1)
@@ -213,25 +301,449 @@ void* f_index_text_chunk(void* payload)
     perror("couldn't close channel bundle");
   }
 
+  // chunks received before stopping are dropped with the arena.
+  if (stopped)
+  {
+    free(chunk_array);
+    f_indexer_chunks_free(ic);
+    return NULL;
+  }
+
   f_chunk* ret;
   if (f_chunk_array_reverse_reduce(&ret, tthread->thread, chunk_array, ic->len) == -1)
   {
     f_log(F_LOG_ERROR, "couldn't reduce chunk array");
-    pthread_exit(NULL);
+    free(chunk_array);
+    f_indexer_chunks_free(ic);
+    return NULL;
   }
 
   ret->line_count = line_count;
 
-  f_chunk_array_free(chunk_array, ic->len);
+  // the chunks themselves are in the arena.
+  free(chunk_array);
   f_indexer_chunks_free(ic);
+  return ret;
+}
+
+void* f_index_text_chunk(void* payload)
+{
+  f_text_thread* tthread = (f_text_thread*) payload;
+  uint64_t started = tthread->stats != NULL ? f_stats_now() : 0;
+
+  // bound before anything is allocated, so it is allocated on the node.
+  if (tthread->numa != NULL)
+  {
+    f_numa_bind(tthread->numa, tthread->node);
+  }
+
+  f_chunk* ret = NULL;
+  if (tthread->arena == NULL && f_arena_init(&tthread->arena, 0) == -1)
+  {
+    f_log(F_LOG_ERROR, "cannot create arena for thread %d", tthread->thread);
+  }
+  else
+  {
+    ret = f_index_text_chunk_run(tthread);
+  }
+  f_stats_thread(tthread->stats, tthread->thread, started, tthread->busy);
+  if (ret == NULL)
+  {
+    // stop the other threads of this indexing run.
+    f_cancel_state_fail(tthread->cancel);
+  }
+
+  atomic_store_explicit(&tthread->progress, 1.0, memory_order_relaxed);
+  atomic_store(&tthread->done, true);
   return (void*) ret;
 }
 
+/*
+  joins the threads of an iteration that was stopped early
+  and frees whatever they produced.
+*/
+static void f_index_text_threads_abort(f_runtime_task** tasks, int len)
+{
+  for (int i=0; i<len; i++)
+  {
+    void* result;
+    if (f_runtime_join(tasks[i], &result) != 0)
+    {
+      perror("can't join thread");
+      continue;
+    }
+
+    if (result != NULL)
+    {
+      f_chunk_free_all((f_chunk*) result);
+    }
+  }
+}
+
+/*
+  frees the configs of the threads of an indexing run, their arenas and read buffers.
+*/
+static void f_index_text_threads_free(f_text_thread* tthreads, int len)
+{
+  for (int i=0; i<len; i++)
+  {
+    if (tthreads[i].arena != NULL)
+    {
+      f_arena_free(&tthreads[i].arena);
+    }
+    f_index_text_buffers_free(&tthreads[i]);
+  }
+  free(tthreads);
+}
+
+/*
+  adds the end of a record of a compressed target to the lookup, front to back.
+*/
+static int f_index_text_stream_emit(void* payload, size_t offset, bool atomic)
+{
+  f_text_stream* stream = payload;
+  if (f_lookup_file_append(stream->lookup, atomic ? offset : offset | F_BYTES_TAG) == -1)
+  {
+    return -1;
+  }
+
+  stream->line_count++;
+  return 0;
+}
+
+/*
+  scans the first `len` staged bytes, the ones after them are the lookahead.
+*/
+static int f_index_text_stream_scan(f_text_stream* stream, size_t len)
+{
+  uint64_t started = stream->stats != NULL ? f_stats_now() : 0;
+  int rc = stream->format->scan(stream->state, stream->buffer, len, stream->len, stream->from, f_index_text_stream_emit, stream);
+  f_stats_since(stream->stats, F_STATS_SCAN, started);
+  if (rc != 0)
+  {
+    f_log(F_LOG_ERROR, "%s format failed to scan chunk at %zu", stream->format->name, stream->from);
+    return -1;
+  }
+
+  memmove(stream->buffer, stream->buffer + len, stream->len - len);
+  stream->len -= len;
+  stream->from += len;
+  return 0;
+}
+
+/*
+  stages the decompressed bytes, and scans a block once its lookahead is there too.
+*/
+static int f_index_text_stream_stage(f_text_stream* stream, const uint8_t* data, size_t len)
+{
+  const size_t size = stream->block + stream->lookahead;
+
+  while (len > 0)
+  {
+    size_t n = size - stream->len < len ? size - stream->len : len;
+    memcpy(stream->buffer + stream->len, data, n);
+    stream->len += n;
+    data += n;
+    len -= n;
+
+    if (stream->len == size)
+    {
+      if (f_cancel_state_poll(stream->cancel) != F_CANCEL_NONE)
+      {
+        return F_CANCELLED;
+      }
+
+      if (f_index_text_stream_scan(stream, stream->block) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*
+  adds the end of a record to a frame, from the start of the frame.
+*/
+static int f_index_text_frame_emit(void* payload, size_t offset, bool atomic)
+{
+  f_text_frame** frame = payload;
+  if ((*frame)->len == (*frame)->cap)
+  {
+    size_t cap = (*frame)->cap * 2;
+    f_text_frame* grown = realloc(*frame, sizeof(f_text_frame) + sizeof(size_t) * cap);
+    if (grown == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant grow frame record ends");
+      return -1;
+    }
+    grown->cap = cap;
+    *frame = grown;
+  }
+
+  (*frame)->offsets[(*frame)->len++] = atomic ? offset : offset | F_BYTES_TAG;
+  return 0;
+}
+
+/*
+  scans a frame on the thread that decompressed it, before the frames in front of it are done.
+  the last `lookahead` bytes are only looked at, the records ending in them are found with the next frame.
+*/
+static int f_index_text_frame(void* payload, const uint8_t* data, size_t len, void** result)
+{
+  f_text_stream* stream = payload;
+  f_text_frame* frame = malloc(sizeof(f_text_frame) + sizeof(size_t) * F_TEXT_FRAME_ENDS);
+  if (frame == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate frame record ends");
+    return -1;
+  }
+
+  frame->scanned = len > stream->lookahead ? len - stream->lookahead : 0;
+  frame->len = 0;
+  frame->cap = F_TEXT_FRAME_ENDS;
+
+  uint64_t started = stream->stats != NULL ? f_stats_now() : 0;
+  int rc = frame->scanned > 0 ? stream->format->scan(stream->state, data, frame->scanned, len, 0, f_index_text_frame_emit, &frame) : 0;
+  f_stats_since(stream->stats, F_STATS_SCAN, started);
+  if (rc != 0)
+  {
+    f_log(F_LOG_ERROR, "%s format failed to scan frame", stream->format->name);
+    free(frame);
+    return -1;
+  }
+
+  *result = frame;
+  return 0;
+}
+
+/*
+  takes the decompressed bytes in order.
+  a frame scanned on its thread only leaves the bytes around its start to scan here,
+  the record ends it found are moved to its offset.
+*/
+static int f_index_text_stream(void* payload, const uint8_t* data, size_t len, size_t offset, void* result)
+{
+  f_text_stream* stream = payload;
+  f_text_frame* frame = result;
+  if (frame == NULL || frame->scanned == 0)
+  {
+    return f_index_text_stream_stage(stream, data, len);
+  }
+
+  if (f_cancel_state_poll(stream->cancel) != F_CANCEL_NONE)
+  {
+    return F_CANCELLED;
+  }
+
+  // the staged bytes end where the frame starts, its first bytes are their lookahead.
+  size_t staged = stream->len;
+  memcpy(stream->buffer + stream->len, data, stream->lookahead);
+  stream->len += stream->lookahead;
+  if (staged > 0 && f_index_text_stream_scan(stream, staged) != 0)
+  {
+    return -1;
+  }
+
+  for (size_t i=0; i<frame->len; i++)
+  {
+    // the tag is above any offset, it's kept as is.
+    if (f_lookup_file_append(stream->lookup, frame->offsets[i] + offset) == -1)
+    {
+      return -1;
+    }
+  }
+  stream->line_count += frame->len;
+
+  // the end of the frame waits for the start of the next one.
+  memcpy(stream->buffer, data + frame->scanned, len - frame->scanned);
+  stream->len = len - frame->scanned;
+  stream->from = offset + frame->scanned;
+  return 0;
+}
+
+/*
+  decompresses a target once, finding its records in order and keeping checkpoints to read it later.
+  frames are decompressed and scanned on the indexer's threads when the target can be split,
+  their record ends are moved to their offset and added to the lookup in order once the frames before them are.
+*/
+static int f_index_text_compressed(f_compressed** out, f_lookup_file* lookup, int fd, enum F_COMPRESSION kind, f_indexer* indexer, const f_indexer_format* format, void* state, size_t lookahead, f_cancel_state* cancel)
+{
+  f_text_stream stream = {
+    .format = format,
+    .state = state,
+    .block = indexer->buffer_size > 0 ? indexer->buffer_size : F_COMPRESS_READ,
+    .lookahead = lookahead,
+    .stats = indexer->stats,
+    .buffer = NULL,
+    .len = 0,
+    .from = 0,
+    .lookup = lookup,
+    .line_count = 0,
+    .cancel = cancel,
+    .relative = format->relative == NULL || format->relative(state)
+  };
+
+  stream.buffer = malloc(sizeof(uint8_t) * (stream.block + 2 * stream.lookahead));
+  if (stream.buffer == NULL)
+  {
+    f_log(F_LOG_ERROR, "failed to allocate read buffer");
+    return -1;
+  }
+
+  f_compressed* compressed = NULL;
+  int rc = f_compressed_build(&compressed, fd, kind, indexer->compression_span, indexer->threads, stream.relative ? f_index_text_frame : NULL, f_index_text_stream, &stream);
+
+  // the end of the target has no lookahead.
+  while (rc == 0 && stream.len > 0)
+  {
+    rc = f_index_text_stream_scan(&stream, stream.len < stream.block ? stream.len : stream.block);
+  }
+  free(stream.buffer);
+
+  // found front to back, stored from the end of the target.
+  if (rc == 0 && (f_lookup_file_reverse(lookup, stream.line_count) == -1 || f_lookup_file_append(lookup, 0ul) == -1 || fflush(lookup->fp) != 0))
+  {
+    f_log(F_LOG_ERROR, "failed to write compressed lookup");
+    rc = -1;
+  }
+
+  if (rc != 0)
+  {
+    if (compressed != NULL)
+    {
+      f_compressed_free(&compressed);
+    }
+    return rc;
+  }
+
+  lookup->len = (unsigned int) (stream.line_count + 1);
+  *out = compressed;
+  return 0;
+}
+
+/*
+  fills in the totals of the run, once the index is complete.
+*/
+static f_index* f_index_text_stats(f_index* index, f_indexer* indexer, uint64_t started)
+{
+  if (index != NULL && indexer->stats != NULL)
+  {
+    f_stats_add(indexer->stats, F_STATS_LINES, f_index_line_count(index));
+    f_stats_finish(indexer->stats, started, indexer->threads);
+  }
+  return index;
+}
+
+/*
+  builds the optional indexes next to the lookup, frees the index if one fails.
+*/
+static f_index* f_index_text_sidecars(f_index* index, f_indexer* indexer, const char* index_filename, f_cancel_state* cancel)
+{
+  /*
+    the trigram index is a second pass over the lines,
+    blocks can't be numbered until every chunk is in the lookup.
+  */
+  if (indexer->trigram_block > 0)
+  {
+    size_t trigram_filename_len = strlen(index_filename) + 5;
+    char* trigram_filename = malloc(sizeof(char) * trigram_filename_len);
+    if (trigram_filename == NULL)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate trigram index path");
+      f_index_free(&index);
+      return NULL;
+    }
+    snprintf(trigram_filename, trigram_filename_len, "%s.tri", index_filename);
+
+    int rc = f_trigram_index_build(&index->trigrams, index, trigram_filename, indexer->trigram_block, indexer->trigram_filter, indexer->threads, cancel);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to build trigram index");
+      f_index_free(&index);
+      if (rc == F_CANCELLED)
+      {
+        f_cancel_state_errno(cancel);
+      }
+      return NULL;
+    }
+  }
+
+  if (indexer->tokenizer != F_TOKENIZER_NONE)
+  {
+    size_t token_filename_len = strlen(index_filename) + 5;
+    char* token_filename = malloc(sizeof(char) * token_filename_len);
+    if (token_filename == NULL)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate token index path");
+      f_index_free(&index);
+      return NULL;
+    }
+    snprintf(token_filename, token_filename_len, "%s.tok", index_filename);
+
+    int rc = f_token_index_build(&index->tokens, index, token_filename, indexer->tokenizer, indexer->threads, cancel);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to build token index");
+      f_index_free(&index);
+      if (rc == F_CANCELLED)
+      {
+        f_cancel_state_errno(cancel);
+      }
+      return NULL;
+    }
+  }
+
+  if (indexer->time_format != NULL)
+  {
+    int rc = f_time_index_build(&index->times, index, indexer->time_format, indexer->time_regex, indexer->time_every, cancel);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to build time index");
+      f_index_free(&index);
+      if (rc == F_CANCELLED)
+      {
+        f_cancel_state_errno(cancel);
+      }
+      return NULL;
+    }
+  }
+
+  if (indexer->field_delimiter != '\0')
+  {
+    size_t field_filename_len = strlen(index_filename) + 5;
+    char* field_filename = malloc(sizeof(char) * field_filename_len);
+    if (field_filename == NULL)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate field index path");
+      f_index_free(&index);
+      return NULL;
+    }
+    snprintf(field_filename, field_filename_len, "%s.fld", index_filename);
+
+    int rc = f_field_index_build(&index->fields, index, field_filename, indexer->field_delimiter, indexer->field_quote, indexer->field_columns, indexer->threads, cancel);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to build field index");
+      f_index_free(&index);
+      if (rc == F_CANCELLED)
+      {
+        f_cancel_state_errno(cancel);
+      }
+      return NULL;
+    }
+  }
+
+  return index;
+}
+
 /*
   entry point for this indexer.
 */
 f_index* f_index_text_file(f_indexer indexer)
 {
+  uint64_t started = indexer.stats != NULL ? f_stats_now() : 0;
   f_chunk* result_chunk;
 
   // get filehandle and total bytes. make nonblocking.
@@ -278,6 +790,42 @@ f_index* f_index_text_file(f_indexer indexer)
     return NULL;
   }
 
+  f_cancel_state cancel;
+  f_cancel_state_init(&cancel, indexer.cancel, indexer.timeout_ms);
+
+  f_tune_probe probe = { .block_size = 0 };
+  if (indexer.threads <= 0 || indexer.concurrency <= 0 || indexer.buffer_size == 0 || indexer.max_bytes_per_iteration == 0 || indexer.adaptive)
+  {
+    if (f_tune_probe_fd(&probe, fd, (size_t) total_bytes_count) == -1)
+    {
+      fclose(fp);
+      return NULL;
+    }
+    f_tune_indexer(&indexer, &probe, (size_t) total_bytes_count);
+  }
+
+  const f_indexer_format* format = indexer.format != NULL ? indexer.format : &f_indexer_format_text;
+  enum F_COMPRESSION compression = indexer.compression == F_COMPRESSION_AUTO ? f_compressed_detect(fd) : indexer.compression;
+
+  // formats that read the target themselves need its raw bytes.
+  if (compression != F_COMPRESSION_NONE && (format->scan == NULL || format->open != NULL))
+  {
+    f_log(F_LOG_ERROR, "%s records can't be read from a compressed target", format->name);
+    fclose(fp);
+    return NULL;
+  }
+
+  // the uncompressed size is only known once the target was decompressed.
+  void* state;
+  size_t lookahead = 0;
+  size_t file_size = compression != F_COMPRESSION_NONE ? SIZE_MAX : (size_t) total_bytes_count;
+  if (format->init(&state, &lookahead, &indexer, fd, file_size) == -1)
+  {
+    f_log(F_LOG_ERROR, "failed to init %s format", format->name);
+    fclose(fp);
+    return NULL;
+  }
+
   double reported_progress = 0.0;
   size_t max_bytes_per_iteration = indexer.max_bytes_per_iteration;
   int thread_it_count = (int) ceil((double) total_bytes_count / (double) (max_bytes_per_iteration));
@@ -286,6 +834,12 @@ f_index* f_index_text_file(f_indexer indexer)
     thread_it_count = 1;
   }
 
+  // formats without a scan find every record in their merge, or don't need to scan at all. compressed targets are scanned as they are decompressed.
+  if (format->scan == NULL || format->open != NULL || compression != F_COMPRESSION_NONE)
+  {
+    thread_it_count = 0;
+  }
+
   f_log(F_LOG_DEBUG, "max bytes per iteration %zu, thread it count: %d", max_bytes_per_iteration, thread_it_count);
 
   f_lookup_file* lookup = NULL;
@@ -295,8 +849,40 @@ f_index* f_index_text_file(f_indexer indexer)
   rand_string(random, 10);
   cwk_path_join(indexer.lookup_dir, random, index_filename, index_filename_len);
 
+  f_tune_adapt adapt;
+  f_tune_adapt_init(&adapt, indexer.buffer_size, probe.block_size);
+
+  // workers of a runtime are already placed by its affinity.
+  f_numa* numa = NULL;
+  if (indexer.numa && indexer.runtime == NULL && thread_it_count > 0 && f_numa_init(&numa) == -1)
+  {
+    f_log(F_LOG_WARN, "cannot find numa nodes, threads aren't bound");
+    numa = NULL;
+  }
+
+  // threads keep their config and arena across iterations.
+  int threads_len = indexer.threads > 0 ? indexer.threads : 1;
+  f_text_thread* tthreads = NULL;
+  f_runtime_task** tasks = NULL;
+  if (thread_it_count > 0)
+  {
+    tthreads = calloc(threads_len, sizeof(*tthreads));
+    tasks = malloc(sizeof(*tasks) * threads_len);
+    if (tthreads == NULL || tasks == NULL)
+    {
+      f_log(F_LOG_ERROR, "cannot allocate indexer threads");
+      free(tthreads);
+      free(tasks);
+      free(index_filename);
+      fclose(fp);
+      format->free(state);
+      return NULL;
+    }
+  }
+
   for (int itc=thread_it_count - 1; itc>=0; itc--)
   {
+    uint64_t iteration_started = indexer.adaptive ? f_stats_now() : 0;
     unsigned long int thread_it_start = itc * max_bytes_per_iteration;
     size_t local_max_bytes_per_iteration = max_bytes_per_iteration;
 
@@ -327,31 +913,17 @@ f_index* f_index_text_file(f_indexer indexer)
       return NULL;
     }
 
-    f_text_thread** tthreads = malloc(sizeof(*tthreads) * it->len);
-    if (tthreads == NULL)
-    {
-      // TODO: free allocations
-      return NULL;
-    }
-    pthread_t* thread_ids = malloc(sizeof(pthread_t) * it->len);
-    if (thread_ids == NULL)
-    {
-      // TODO: free allocations
-      return NULL;
-    }
-
     unsigned int line_count = 0u;
+    int spawned = 0;
+    int joined = 0;
 
     // spawn threads.
     for (int i=0; i<it->len; i++)
     {
+      chunks[i] = NULL;
+
       // add extra container.
-      f_text_thread* tthread = malloc(sizeof(*tthread));
-      if (tthread == NULL)
-      {
-        // TODO: free allocations
-        return NULL;
-      }
+      f_text_thread* tthread = &tthreads[i];
       tthread->fd = fd;
       tthread->from = it->threads[i].from;
       tthread->to = it->threads[i].to;
@@ -359,38 +931,44 @@ f_index* f_index_text_file(f_indexer indexer)
       tthread->buffer_size = it->threads[i].buffer_size;
       tthread->concurrency = indexer.concurrency;
       tthread->thread = i;
-      tthread->progress = (double) 0.0;
-
-      tthreads[i] = tthread;
-      if (pthread_create(&thread_ids[i], NULL, f_index_text_chunk, tthreads[i]) != 0)
+      atomic_init(&tthread->progress, 0.0);
+      tthread->cancel = &cancel;
+      tthread->format = format;
+      tthread->state = state;
+      tthread->lookahead = lookahead;
+      tthread->stats = indexer.stats;
+      tthread->busy = 0;
+      tthread->numa = numa;
+      tthread->node = numa != NULL ? f_numa_node_of(numa, i, it->len) : 0;
+      atomic_init(&tthread->done, false);
+
+      if (f_runtime_spawn(&tasks[i], indexer.runtime, f_index_text_chunk, tthread) != 0)
       {
-        // kill already created threads.
-        for (int ti=0; ti<i; ti++)
-        {
-          pthread_kill(thread_ids[ti], SIGINT);
-        }
+        // already created threads stop at their next round.
         f_log(F_LOG_ERROR, "Couldn't create thread %d", i);
-        return NULL;
+        f_cancel_state_fail(&cancel);
+        break;
       }
+      spawned++;
     }
 
     double report = 0.0;
     // join threads.
-    for (int i=0; i<it->len; i++)
+    for (int i=0; i<spawned && atomic_load(&cancel.reason) == F_CANCEL_NONE; i++)
     {
       bool next = false;
 
-      // block i thread join until i thread progress is 1.
+      // block i thread join until i thread is done.
       // report progress in the meantime.
       while (!next)
       {
-        next = tthreads[i]->progress >= 1;
+        next = atomic_load(&tthreads[i].done);
         double progress = 0.0;
 
         // if i progresses reached 1, go to next block
-        for (int p=0; p<it->len; p++)
+        for (int p=0; p<spawned; p++)
         {
-          progress += (tthreads[p]->progress / it->len);
+          progress += (atomic_load_explicit(&tthreads[p].progress, memory_order_relaxed) / it->len);
         }
         
         if (indexer.on_progress != NULL)
@@ -401,21 +979,26 @@ f_index* f_index_text_file(f_indexer indexer)
       }
 
       // join next thread.
-      if (pthread_join(thread_ids[i], (void**) &result_chunk) != 0)
+      if (f_runtime_join(tasks[i], (void**) &result_chunk) != 0)
       {
         perror("can't join thread - results may be incomplete.");
       }
+      joined++;
 
       f_chunk* result = (f_chunk*) result_chunk;
       if (result == NULL)
       {
-        f_log(F_LOG_ERROR, "result chunk %d is NULL", i);
-        // kill the rest of the threads
-        for (int ti=i; ti<it->len; ti++)
+        // a thread stops early without a chunk once the indexing is cancelled.
+        enum F_CANCEL_REASON reason = f_cancel_state_poll(&cancel);
+        if (reason == F_CANCEL_REQUESTED || reason == F_CANCEL_DEADLINE)
         {
-          pthread_kill(thread_ids[ti], SIGINT);
+          f_log(F_LOG_DEBUG, "thread %d stopped, indexing was cancelled", i);
+          break;
         }
-        return NULL;
+
+        f_log(F_LOG_ERROR, "result chunk %d is NULL", i);
+        f_cancel_state_fail(&cancel);
+        break;
       }
 
       line_count += result->line_count;
@@ -423,8 +1006,49 @@ f_index* f_index_text_file(f_indexer indexer)
       chunks[result->current] = result;
     }
 
+    if (atomic_load(&cancel.reason) != F_CANCEL_NONE)
+    {
+      /*
+        stopped early: wait for the remaining threads to notice,
+        and throw away the partial index.
+      */
+      f_index_text_threads_abort(&tasks[joined], spawned - joined);
+
+      for (int i=0; i<spawned; i++)
+      {
+        if (chunks[i] != NULL)
+        {
+          f_chunk_free_all(chunks[i]);
+        }
+      }
+
+      free(chunks);
+      f_index_text_threads_free(tthreads, threads_len);
+      free(tasks);
+      f_indexer_threads_free(it);
+
+      if (lookup != NULL)
+      {
+        f_lookup_file_free(&lookup);
+      }
+      else
+      {
+        free(index_filename);
+      }
+
+      if (numa != NULL)
+      {
+        f_numa_free(&numa);
+      }
+      fclose(fp);
+      format->free(state);
+      f_cancel_state_errno(&cancel);
+      return NULL;
+    }
+
     reported_progress += report;
 
+    uint64_t merge_started = indexer.stats != NULL ? f_stats_now() : 0;
     f_chunk* final_chunk;
     if (f_chunk_array_reverse_reduce(&final_chunk, 0, chunks, it->len) == -1)
     {
@@ -449,33 +1073,149 @@ f_index* f_index_text_file(f_indexer indexer)
       f_log(F_LOG_ERROR, "failed to create index");
       return NULL;
     }
+    f_stats_since(indexer.stats, F_STATS_MERGE, merge_started);
 
     /* free allocations */
     f_chunk_array_free(chunks, it->len);
+    f_indexer_threads_free(it);
 
-    for(int z=0; z<it->len; z++)
+    // every record end of this iteration is in the lookup now.
+    for (int z=0; z<threads_len; z++)
     {
-      free(tthreads[z]);
+      if (tthreads[z].arena != NULL)
+      {
+        f_arena_reset(tthreads[z].arena);
+      }
+    }
+
+    if (indexer.adaptive)
+    {
+      size_t buffer_size = f_tune_adapt_next(&adapt, local_max_bytes_per_iteration, f_stats_now() - iteration_started);
+      if (buffer_size != indexer.buffer_size)
+      {
+        f_log(F_LOG_DEBUG, "buffer size %zu -> %zu", indexer.buffer_size, buffer_size);
+        indexer.buffer_size = buffer_size;
+      }
+    }
+  }
+
+  if (numa != NULL)
+  {
+    f_numa_free(&numa);
+  }
+
+  if (tthreads != NULL)
+  {
+    f_index_text_threads_free(tthreads, threads_len);
+    free(tasks);
+  }
+  // memory is given back to the system once, rather than after every chunk.
+  F_MTRIM(0);
+
+  f_compressed* compressed = NULL;
+  if (compression != F_COMPRESSION_NONE)
+  {
+    if (f_lookup_file_init(&lookup, index_filename) == -1)
+    {
+      f_log(F_LOG_ERROR, "failed to create index");
+      format->free(state);
+      fclose(fp);
+      return NULL;
     }
-    f_indexer_threads_free(it);
 
-    free(tthreads);
-    free(thread_ids);
+    int rc = f_index_text_compressed(&compressed, lookup, fd, compression, &indexer, format, state, lookahead, &cancel);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to index compressed target");
+      f_lookup_file_free(&lookup);
+      format->free(state);
+      fclose(fp);
+      if (rc == F_CANCELLED)
+      {
+        f_cancel_state_errno(&cancel);
+      }
+      return NULL;
+    }
   }
 
+  f_index* index;
+  if (format->open != NULL)
+  {
+    fclose(fp);
+    int rc = format->open(state, &index, &indexer);
+    format->free(state);
+    if (rc != 0)
+    {
+      f_log(F_LOG_ERROR, "failed to open %s index", format->name);
+      free(index_filename);
+      return NULL;
+    }
+
+    // there is no lookup to own the path the other indexes are named after, or to create their directory.
+    if (mkdir(indexer.lookup_dir, 0755) != 0 && errno != EEXIST)
+    {
+      f_log(F_LOG_WARN, "cannot create %s", indexer.lookup_dir);
+    }
+    index = f_index_text_sidecars(index, &indexer, index_filename, &cancel);
+    free(index_filename);
+    return f_index_text_stats(index, &indexer, started);
+  }
+
+  if (lookup == NULL && f_lookup_file_init(&lookup, index_filename) == -1)
+  {
+    f_log(F_LOG_ERROR, "failed to create index");
+    format->free(state);
+    fclose(fp);
+    return NULL;
+  }
+
+  // records that span chunks are only known once every chunk was scanned.
+  uint64_t merge_started = indexer.stats != NULL ? f_stats_now() : 0;
+  if (format->merge != NULL && format->merge(state, lookup) != 0)
+  {
+    f_log(F_LOG_ERROR, "failed to merge %s records", format->name);
+    format->free(state);
+    fclose(fp);
+    f_lookup_file_free(&lookup);
+    if (compressed != NULL)
+    {
+      f_compressed_free(&compressed);
+    }
+    return NULL;
+  }
+  f_stats_since(indexer.stats, F_STATS_MERGE, merge_started);
+
   if (fclose(fp) != 0)
   {
     f_log(F_LOG_WARN, "cannot close file descriptor");
   }
 
-  f_index* index;
   if (f_index_init(&index, indexer.filename, indexer.filename_len, lookup, NULL) == -1)
   {
     f_log(F_LOG_ERROR, "failed to initialize index");
+    format->free(state);
+    if (compressed != NULL)
+    {
+      f_compressed_free(&compressed);
+    }
     return NULL;
   }
 
-  return index;
+  // the checkpoints read through the index's own descriptor from now on.
+  if (compressed != NULL)
+  {
+    compressed->fd = index->fd;
+    index->compressed = compressed;
+  }
+
+  if (format->finalize != NULL)
+  {
+    format->finalize(state, index);
+  }
+  format->free(state);
+
+  index = f_index_text_sidecars(index, &indexer, index_filename, &cancel);
+  return f_index_text_stats(index, &indexer, started);
 }
 
 #endif
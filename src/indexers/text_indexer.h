@@ -1,6 +1,11 @@
 #ifndef FLASHLIGHT_INDEXERS_TEXT_H
 #define FLASHLIGHT_INDEXERS_TEXT_H
 
+// read buffers are aligned and sized to this, so they can be read into with O_DIRECT.
+#define F_TEXT_BUFFER_ALIGN 4096
+// record ends a frame of a compressed target has room for at first.
+#define F_TEXT_FRAME_ENDS 1024
+
 /** @struct FTextThread
 * @brief a config to pass to each thread
 * @var FTextThread::fd
@@ -18,7 +23,33 @@
 * @var FTextThread::thread
 * the thread index
 * @var FTextThread::progress
-* the current progress of this thread
+* the current progress of this thread, read by the thread reporting progress
+* @var FTextThread::cancel
+* the cancellation state shared by the threads of this indexing run
+* @var FTextThread::format
+* how records are found
+* @var FTextThread::state
+* the state of the format for this indexing run
+* @var FTextThread::lookahead
+* the bytes the format needs to see past every chunk
+* @var FTextThread::stats
+* where to count reads and timings (NULL if unused)
+* @var FTextThread::busy
+* the nanoseconds this thread spent reading and scanning (only with stats)
+* @var FTextThread::numa
+* the numa nodes to bind the thread to (NULL if unused)
+* @var FTextThread::node
+* the node of the thread
+* @var FTextThread::arena
+* where the thread's chunks and record ends are allocated, kept across iterations and reset after each
+* @var FTextThread::buffers
+* the thread's read buffers, one for each coroutine of a round, kept across chunks and iterations
+* @var FTextThread::buffers_len
+* the number of read buffers
+* @var FTextThread::buffers_size
+* the size of every read buffer
+* @var FTextThread::done
+* true once the thread is about to exit
 */
 typedef struct FTextThread 
 {
@@ -30,14 +61,115 @@ typedef struct FTextThread
   size_t buffer_size;
   int concurrency;
   int thread;
-  double progress;
+  _Atomic double progress;
+  f_cancel_state* cancel;
+  const f_indexer_format* format;
+  void* state;
+  size_t lookahead;
+  f_stats* stats;
+  uint64_t busy;
+  f_numa* numa;
+  int node;
+  f_arena* arena;
+  uint8_t** buffers;
+  int buffers_len;
+  size_t buffers_size;
+  atomic_bool done;
 } f_text_thread;
 
 
+/** @struct FTextSink
+* @brief the record ends found in one chunk
+* @var FTextSink::first
+* the last record end found, the list is in reverse
+* @var FTextSink::last
+* the first record end found
+* @var FTextSink::line_count
+* the number of record ends
+* @var FTextSink::arena
+* where the record ends are allocated
+*/
+typedef struct FTextSink
+{
+  f_bytes_node* first;
+  f_bytes_node* last;
+  unsigned int line_count;
+  f_arena* arena;
+} f_text_sink;
+
+/** @struct FTextStream
+* @brief the decompressed bytes of a compressed target, taken in order
+* @var FTextStream::format
+* how records are found
+* @var FTextStream::state
+* the state of the format for this indexing run
+* @var FTextStream::block
+* the bytes scanned at a time
+* @var FTextStream::lookahead
+* the bytes the format needs to see past every block
+* @var FTextStream::stats
+* where to count timings (NULL if unused)
+* @var FTextStream::buffer
+* the staged bytes, `block + 2 * lookahead` big, so the start of a frame fits after a full block
+* @var FTextStream::len
+* the number of staged bytes
+* @var FTextStream::from
+* the uncompressed offset of the first staged byte
+* @var FTextStream::lookup
+* the lookup record ends are appended to, front to back
+* @var FTextStream::line_count
+* the number of record ends
+* @var FTextStream::cancel
+* the cancellation state of this indexing run
+* @var FTextStream::relative
+* true if frames are scanned on the threads that decompress them
+*/
+typedef struct FTextStream
+{
+  const f_indexer_format* format;
+  void* state;
+  size_t block;
+  size_t lookahead;
+  f_stats* stats;
+  uint8_t* buffer;
+  size_t len;
+  size_t from;
+  f_lookup_file* lookup;
+  size_t line_count;
+  f_cancel_state* cancel;
+  bool relative;
+} f_text_stream;
+
+/** @struct FTextFrame
+* @brief the record ends of a frame of a compressed target, found before the frame's offset is known
+* @var FTextFrame::scanned
+* the bytes scanned from the start of the frame, the others are the lookahead of the last ones
+* @var FTextFrame::len
+* the number of record ends
+* @var FTextFrame::cap
+* the capacity of the record ends
+* @var FTextFrame::offsets
+* the record ends from the start of the frame, tagged with F_BYTES_TAG if they aren't atomic
+*/
+typedef struct FTextFrame
+{
+  size_t scanned;
+  size_t len;
+  size_t cap;
+  size_t offsets[];
+} f_text_frame;
+
 /**
   Indexes a text file of an arbitrary size concurrently, in multiple threads
+
+  Threads stop between rounds of coroutines once `cancel` is requested
+  or `timeout_ms` has passed, the partial lookup is deleted,
+  and errno is set to ECANCELED or ETIMEDOUT.
+  Records are found by `format` on the indexer, newline terminated lines by default.
+  A gzip or zstd target is decompressed once, in a single pass, when `compression` is set.
+  Its frames are decompressed and scanned on the indexer's threads when it can be split.
   @param indexer the configuration for the indexer
-  @return an FIndex
+  @return an FIndex, NULL for error or if cancelled
 */
 f_index* f_index_text_file(f_indexer indexer);
 
@@ -3,14 +3,28 @@
 
 #include "lib.h"
 #include "log.c"
+#include "arena.c"
+#include "cancel.c"
+#include "stats.c"
+#include "numa.c"
+#include "runtime.c"
 #include "../vendor/cwalk.c"
 #include "node.c"
 #include "bytes.c"
 #include "chunk.c"
 #include "debug.c"
 #include "lookup.c"
+#include "compress.c"
+#include "record.c"
 #include "index.c"
+#include "trigram.c"
+#include "bitmap.c"
+#include "token.c"
+#include "timestamp.c"
+#include "field.c"
 #include "indexer.c"
+#include "tune.c"
+#include "indexers/formats.c"
 #include "indexers/text_indexer.c"
 #include "search.c"
 
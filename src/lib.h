@@ -10,6 +10,7 @@
 #endif
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -20,5 +21,8 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #endif
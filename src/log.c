@@ -1,6 +1,7 @@
 #ifndef FLASHLIGHT_LOG
 #define FLASHLIGHT_LOG
 #include <time.h>
+#include <sched.h>
 #include "log.h"
 
 void f_default_on_log_message(f_log_message msg)
@@ -11,6 +12,7 @@ void f_default_on_log_message(f_log_message msg)
     {
       case F_LOG_FINE: {
         fprintf(stderr, ANSI_COLOR_YELLOW " [%s] " ANSI_COLOR_RESET "%s\n", msg.datetime, msg.message);
+        break;
       }
       case F_LOG_DEBUG: {
         fprintf(stderr, ANSI_COLOR_CYAN " [%s] " ANSI_COLOR_RESET "%s\n", msg.datetime, msg.message);
@@ -34,7 +36,7 @@ void f_default_on_log_message(f_log_message msg)
 
 void f_logger_set_level(enum F_LOG_LEVEL level)
 {
-  f_log_level = level;
+  atomic_store(&f_log_level, (int) level);
 }
 
 void f_logger_set_cb(f_logger_cb cb, volatile void* payload)
@@ -55,22 +57,36 @@ volatile void* f_logger_get_payload()
 
 enum F_LOG_LEVEL f_logger_get_level()
 {
-  return f_log_level;
+  return (enum F_LOG_LEVEL) atomic_load(&f_log_level);
 }
 
-void f_log(enum F_LOG_LEVEL level, char* fmt, ...)
+/*
+  the async logger. rings are kept once created, a thread that exits leaves its ring to the next one,
+  and their records are freed when the logger stops.
+*/
+static atomic_bool f_log_async_running = false;
+static atomic_int f_log_async_writers = 0;
+static atomic_size_t f_log_async_dropped = 0;
+static atomic_bool f_log_async_stopping = false;
+static pthread_mutex_t f_log_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t f_log_async_thread;
+static f_log_ring* f_log_async_rings = NULL;
+static size_t f_log_async_capacity = 0;
+static pthread_key_t f_log_async_key;
+static pthread_once_t f_log_async_key_once = PTHREAD_ONCE_INIT;
+
+static _Thread_local f_log_ring* f_log_thread_ring = NULL;
+// true on the drain thread, where a callback that logs writes right away.
+static _Thread_local bool f_log_thread_draining = false;
+
+static void f_log_deliver(enum F_LOG_LEVEL level, time_t t, char* message)
 {
-  time_t t = time(NULL);
-  struct tm* tm = localtime(&t);
+  struct tm tm;
   char datetime[64];
-  strftime(datetime, sizeof(datetime), "%c", tm);
-  char message[500];
-  volatile void* payload = f_logger_get_payload();
-
-  va_list args;
-  va_start(args, fmt);
-  vsprintf(message, fmt, args);
-  va_end(args);
+  if (localtime_r(&t, &tm) == NULL || strftime(datetime, sizeof(datetime), "%c", &tm) == 0)
+  {
+    datetime[0] = '\0';
+  }
 
   f_log_message msg = {datetime, level, message};
 
@@ -80,8 +96,259 @@ void f_log(enum F_LOG_LEVEL level, char* fmt, ...)
   }
   else
   {
-    f_log_cb(msg, payload);
+    f_log_cb(msg, f_logger_get_payload());
+  }
+}
+
+/*
+  gives the ring of an exiting thread to the next thread that logs.
+*/
+static void f_log_ring_release(void* ring)
+{
+  atomic_store(&((f_log_ring*) ring)->owned, false);
+}
+
+static void f_log_async_key_init()
+{
+  if (pthread_key_create(&f_log_async_key, f_log_ring_release) != 0)
+  {
+    fprintf(stderr, "cant create log ring key\n");
+  }
+}
+
+/*
+  the ring of the calling thread, claimed or created on its first message.
+*/
+static f_log_ring* f_log_ring_get()
+{
+  f_log_ring* ring = f_log_thread_ring;
+  if (ring != NULL && ring->records != NULL)
+  {
+    return ring;
   }
+
+  pthread_mutex_lock(&f_log_async_lock);
+  if (ring == NULL)
+  {
+    for (ring = f_log_async_rings; ring != NULL; ring = ring->next)
+    {
+      bool owned = false;
+      if (atomic_compare_exchange_strong(&ring->owned, &owned, true))
+      {
+        break;
+      }
+    }
+  }
+
+  if (ring == NULL)
+  {
+    ring = malloc(sizeof(*ring));
+    if (ring == NULL)
+    {
+      pthread_mutex_unlock(&f_log_async_lock);
+      return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->owned, true);
+    ring->cap = 0;
+    ring->records = NULL;
+    ring->next = f_log_async_rings;
+    f_log_async_rings = ring;
+  }
+
+  // the records of a ring are freed when the logger stops.
+  if (ring->records == NULL)
+  {
+    ring->records = malloc(sizeof(f_log_record) * f_log_async_capacity);
+    ring->cap = ring->records == NULL ? 0 : f_log_async_capacity;
+  }
+  pthread_mutex_unlock(&f_log_async_lock);
+
+  if (f_log_thread_ring != ring)
+  {
+    f_log_thread_ring = ring;
+    pthread_setspecific(f_log_async_key, ring);
+  }
+  return ring->records == NULL ? NULL : ring;
+}
+
+/*
+  hands the queued records of every ring to the callback, returns how many there were.
+*/
+static size_t f_log_async_drain()
+{
+  size_t drained = 0;
+
+  /*
+    rings are only ever added to the front and each has a single writer,
+    so the callback is called without holding up threads logging for the first time.
+  */
+  pthread_mutex_lock(&f_log_async_lock);
+  f_log_ring* rings = f_log_async_rings;
+  pthread_mutex_unlock(&f_log_async_lock);
+
+  for (f_log_ring* ring = rings; ring != NULL; ring = ring->next)
+  {
+    // the records of a ring were allocated before anything was queued on it.
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (; tail != head; tail++)
+    {
+      f_log_record* record = &ring->records[tail % ring->cap];
+      f_log_deliver(record->level, record->time, record->message);
+      atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+      drained++;
+    }
+  }
+
+  return drained;
+}
+
+static void* f_log_async_run(void* payload)
+{
+  f_log_thread_draining = true;
+  size_t reported = 0;
+  while (!atomic_load(&f_log_async_stopping))
+  {
+    size_t drained = f_log_async_drain();
+
+    size_t dropped = atomic_load(&f_log_async_dropped);
+    if (dropped != reported && (F_LOG_WARN & atomic_load_explicit(&f_log_level, memory_order_relaxed)))
+    {
+      char message[F_LOG_MESSAGE];
+      snprintf(message, sizeof(message), "dropped %zu log messages, the rings are full", dropped - reported);
+      f_log_deliver(F_LOG_WARN, time(NULL), message);
+    }
+    reported = dropped;
+
+    if (drained == 0)
+    {
+      struct timespec wait = { 0, F_LOG_DRAIN_NS };
+      nanosleep(&wait, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+int f_logger_async_start(size_t capacity)
+{
+  pthread_once(&f_log_async_key_once, f_log_async_key_init);
+
+  pthread_mutex_lock(&f_log_async_lock);
+  if (atomic_load(&f_log_async_running))
+  {
+    pthread_mutex_unlock(&f_log_async_lock);
+    return -1;
+  }
+
+  f_log_async_capacity = capacity == 0 ? F_LOG_RING : capacity;
+  atomic_store(&f_log_async_dropped, 0);
+  atomic_store(&f_log_async_stopping, false);
+
+  if (pthread_create(&f_log_async_thread, NULL, f_log_async_run, NULL) != 0)
+  {
+    pthread_mutex_unlock(&f_log_async_lock);
+    return -1;
+  }
+
+  atomic_store(&f_log_async_running, true);
+  pthread_mutex_unlock(&f_log_async_lock);
+  return 0;
+}
+
+void f_logger_async_stop()
+{
+  if (!atomic_exchange(&f_log_async_running, false))
+  {
+    return;
+  }
+
+  // threads that already saw the logger running finish their record.
+  while (atomic_load(&f_log_async_writers) > 0)
+  {
+    sched_yield();
+  }
+
+  atomic_store(&f_log_async_stopping, true);
+  pthread_join(f_log_async_thread, NULL);
+  f_log_async_drain();
+
+  pthread_mutex_lock(&f_log_async_lock);
+  for (f_log_ring* ring = f_log_async_rings; ring != NULL; ring = ring->next)
+  {
+    free(ring->records);
+    ring->records = NULL;
+    ring->cap = 0;
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
+  }
+  pthread_mutex_unlock(&f_log_async_lock);
+}
+
+size_t f_logger_async_dropped()
+{
+  return atomic_load(&f_log_async_dropped);
+}
+
+/*
+  queues a message on the calling thread's ring, false if it has to be logged right away.
+*/
+static bool f_log_async_write(enum F_LOG_LEVEL level, const char* fmt, va_list args)
+{
+  atomic_fetch_add(&f_log_async_writers, 1);
+  if (!atomic_load(&f_log_async_running))
+  {
+    atomic_fetch_sub(&f_log_async_writers, 1);
+    return false;
+  }
+
+  f_log_ring* ring = f_log_ring_get();
+  if (ring == NULL)
+  {
+    atomic_fetch_sub(&f_log_async_writers, 1);
+    return false;
+  }
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= ring->cap)
+  {
+    atomic_fetch_add(&f_log_async_dropped, 1);
+  }
+  else
+  {
+    f_log_record* record = &ring->records[head % ring->cap];
+    record->level = level;
+    record->time = time(NULL);
+    vsnprintf(record->message, sizeof(record->message), fmt, args);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  }
+
+  atomic_fetch_sub(&f_log_async_writers, 1);
+  return true;
+}
+
+void f_log_write(enum F_LOG_LEVEL level, const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  bool queued = !f_log_thread_draining && atomic_load_explicit(&f_log_async_running, memory_order_relaxed) && f_log_async_write(level, fmt, args);
+  va_end(args);
+
+  if (queued)
+  {
+    return;
+  }
+
+  // long messages are cut off.
+  char message[F_LOG_MESSAGE];
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+
+  f_log_deliver(level, time(NULL), message);
 }
 
 #endif
@@ -7,6 +7,13 @@
 #define ANSI_COLOR_CYAN    "\x1b[36m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
+// the longest message, longer ones are cut off.
+#define F_LOG_MESSAGE 500
+// records each thread can queue while logging asynchronously, when none is given.
+#define F_LOG_RING 1024
+// how long the async logger sleeps when every ring is empty.
+#define F_LOG_DRAIN_NS 1000000
+
 enum F_LOG_LEVEL
 {
   F_LOG_ERROR = 1 << 0,
@@ -25,14 +32,94 @@ typedef struct FLogMessage
 
 typedef void (*f_logger_cb)(f_log_message message, volatile void* payload);
 static volatile f_logger_cb f_log_cb = NULL;
-static volatile enum F_LOG_LEVEL f_log_level = F_LOG_ERROR;
+static atomic_int f_log_level = F_LOG_ERROR;
 static volatile void* f_log_payload = NULL;
 
+// the levels compiled in, release builds drop debug and fine messages. define it to override.
+#ifndef F_LOG_COMPILED
+#ifdef NDEBUG
+#define F_LOG_COMPILED (F_LOG_ERROR | F_LOG_WARN | F_LOG_INFO)
+#else
+#define F_LOG_COMPILED (F_LOG_ERROR | F_LOG_WARN | F_LOG_INFO | F_LOG_DEBUG | F_LOG_FINE)
+#endif
+#endif
+
+// true if a message of `level` would be logged, to skip work that only feeds a message.
+#define F_LOG_ENABLED(level) (((level) & F_LOG_COMPILED) && ((level) & atomic_load_explicit(&f_log_level, memory_order_relaxed)))
+
+/*
+  the level is checked before the arguments are evaluated or anything is formatted,
+  and levels that aren't compiled in are removed.
+*/
+#define f_log(level, ...) do { if (F_LOG_ENABLED(level)) f_log_write(level, __VA_ARGS__); } while (0)
+
+/** @struct FLogRecord
+* @brief a message queued by the async logger, formatted by the thread that logged it
+* @var FLogRecord::level
+* the level of the message
+* @var FLogRecord::time
+* when it was logged
+* @var FLogRecord::message
+* the message
+*/
+typedef struct FLogRecord
+{
+  enum F_LOG_LEVEL level;
+  time_t time;
+  char message[F_LOG_MESSAGE];
+} f_log_record;
+
+/** @struct FLogRing
+* @brief the queue of one thread, written by that thread only and read by the drain thread only
+* @var FLogRing::head
+* the records written
+* @var FLogRing::tail
+* the records read
+* @var FLogRing::cap
+* the number of slots
+* @var FLogRing::records
+* the slots
+* @var FLogRing::owned
+* true while a thread writes to the ring, a ring whose thread exited is reused by the next one
+* @var FLogRing::next
+* the next ring of the logger
+*/
+typedef struct FLogRing
+{
+  atomic_size_t head;
+  atomic_size_t tail;
+  size_t cap;
+  f_log_record* records;
+  atomic_bool owned;
+  struct FLogRing* next;
+} f_log_ring;
+
 void f_logger_set_level(enum F_LOG_LEVEL level);
 void f_logger_set_cb(f_logger_cb cb, volatile void* payload);
 f_logger_cb f_logger_get_cb();
 enum F_LOG_LEVEL f_logger_get_level();
 volatile void* f_logger_get_payload();
-void f_log(enum F_LOG_LEVEL level, char* fmt, ...);
+void f_log_write(enum F_LOG_LEVEL level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+  Queues messages instead of writing them on the thread that logs them
+
+  Every thread formats into its own lock free ring, and a background thread hands
+  the messages to the callback (or stderr), so the callback only ever runs on that thread.
+  A message is dropped when its thread's ring is full.
+  @param capacity the records each thread can queue (0 for F_LOG_RING)
+  @return non zero for error, or if it is already started
+*/
+int f_logger_async_start(size_t capacity);
+
+/**
+  Delivers every queued message and goes back to logging on the calling thread
+*/
+void f_logger_async_stop();
+
+/**
+  The number of messages dropped because a ring was full, since the async logger started
+*/
+size_t f_logger_async_dropped();
 
 #endif
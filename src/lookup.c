@@ -32,8 +32,11 @@ int f_lookup_mem_from_chunk(f_lookup_mem** out, f_chunk* chunk)
     f_bytes_node* tmp = current;
     current = current->next;
     // let's try to free everything while we are making 1 pass
-    free(tmp->bytes);
-    free(tmp);
+    if (!chunk->pooled)
+    {
+      free(tmp->bytes);
+      free(tmp);
+    }
   }
 
   free(chunk);
@@ -154,7 +157,8 @@ int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bo
 
   while (current != NULL)
   { 
-    if (f_lookup_file_append(init, current->bytes->offset) == -1)
+    size_t offset = current->bytes->atomic ? current->bytes->offset : current->bytes->offset | F_BYTES_TAG;
+    if (f_lookup_file_append(init, offset) == -1)
     {
       f_log(F_LOG_ERROR, "error appending to file");
       return -1;
@@ -163,11 +167,18 @@ int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bo
     f_bytes_node* tmp = current;
     current = current->next;
     // let's try to free everything while we are making 1 pass
-    free(tmp->bytes);
-    free(tmp);
+    if (!chunk->pooled)
+    {
+      free(tmp->bytes);
+      free(tmp);
+    }
   }
 
-  F_MTRIM(0);
+  // pooled nodes go back to their arena at once, and are trimmed by the caller.
+  if (!chunk->pooled)
+  {
+    F_MTRIM(0);
+  }
 
   if (last)
   {
@@ -196,6 +207,66 @@ int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bo
   return 0;
 }
 
+int f_lookup_file_reverse(f_lookup_file* lookup, size_t count)
+{
+  if (fflush(lookup->fp) != 0)
+  {
+    perror("didn't flush");
+    return -1;
+  }
+
+  size_t* front = malloc(sizeof(size_t) * F_LOOKUP_REVERSE);
+  size_t* back = malloc(sizeof(size_t) * F_LOOKUP_REVERSE);
+  if (front == NULL || back == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate lookup blocks");
+    free(front);
+    free(back);
+    return -1;
+  }
+
+  // swaps a block from each end until they meet.
+  int rc = 0;
+  size_t low = 0;
+  size_t high = count;
+  while (high - low > 1)
+  {
+    size_t n = (high - low) / 2;
+    n = n > F_LOOKUP_REVERSE ? F_LOOKUP_REVERSE : n;
+    size_t bytes = n * sizeof(size_t);
+    off_t low_offset = (off_t) (low * sizeof(size_t));
+    off_t high_offset = (off_t) ((high - n) * sizeof(size_t));
+
+    if (pread(lookup->fd, front, bytes, low_offset) != (ssize_t) bytes || pread(lookup->fd, back, bytes, high_offset) != (ssize_t) bytes)
+    {
+      perror("cant read lookup");
+      rc = -1;
+      break;
+    }
+
+    for (size_t i=0; i<n; i++)
+    {
+      size_t tmp = front[i];
+      front[i] = back[n - 1 - i];
+      back[n - 1 - i] = tmp;
+    }
+
+    if (pwrite(lookup->fd, front, bytes, low_offset) != (ssize_t) bytes || pwrite(lookup->fd, back, bytes, high_offset) != (ssize_t) bytes)
+    {
+      perror("cant write lookup");
+      rc = -1;
+      break;
+    }
+
+    low += n;
+    high -= n;
+  }
+
+  free(front);
+  free(back);
+  return rc;
+}
+
 void f_lookup_file_free(f_lookup_file** lookupref)
 {
   f_lookup_file* lookup = *lookupref;
@@ -1,6 +1,9 @@
 #ifndef FLASHLIGHT_LOOKUP_H
 #define FLASHLIGHT_LOOKUP_H
 
+// offsets swapped at a time while reversing a lookup file.
+#define F_LOOKUP_REVERSE 4096
+
 /** @struct FLookupFile
 * @brief an persistent index
 * @var path
@@ -65,8 +68,21 @@ int f_lookup_file_append(f_lookup_file* db, size_t offset);
   @param path the filename for the index
   @param first if true, create the lookup, else the lookup is expected to be inited
   @param last if true, add a 0 byte offset to represent the beginning of the target file
+
+  Offsets of non atomic bytes are written with F_BYTES_TAG set.
+  The nodes of the chunk are freed, unless they are pooled.
 */
 int f_lookup_file_from_chunk(f_lookup_file** out, f_chunk* chunk, char* path, bool first, bool last);
+
+/**
+  Reverses the offsets of a persistent index in place
+
+  For formats that find records front to back, the lookup stores them from the end of the target.
+  @param lookup the lookup, with every offset appended
+  @param count the number of offsets
+  @return non zero for error
+*/
+int f_lookup_file_reverse(f_lookup_file* lookup, size_t count);
 void f_lookup_file_free(f_lookup_file** lookupref);
 
 #endif
@@ -0,0 +1,227 @@
+#ifndef FLASHLIGHT_NUMA
+#define FLASHLIGHT_NUMA
+#include <sched.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "numa.h"
+
+// MPOL_PREFERRED from linux/mempolicy.h.
+#define F_NUMA_PREFERRED 1
+
+/*
+  parses a sysfs list like "0-3,8-11", -1 for error.
+*/
+static int f_numa_parse(const char* list, int** out, int* len)
+{
+  int cap = 16;
+  int* values = malloc(sizeof(int) * cap);
+  if (values == NULL)
+  {
+    return -1;
+  }
+
+  *len = 0;
+  const char* at = list;
+  while (*at != '\0' && *at != '\n')
+  {
+    char* end;
+    long from = strtol(at, &end, 10);
+    long to = from;
+    if (end == at || from < 0)
+    {
+      free(values);
+      return -1;
+    }
+
+    if (*end == '-')
+    {
+      at = end + 1;
+      to = strtol(at, &end, 10);
+      if (end == at || to < from)
+      {
+        free(values);
+        return -1;
+      }
+    }
+
+    for (long v=from; v<=to; v++)
+    {
+      if (*len == cap)
+      {
+        cap *= 2;
+        int* grown = realloc(values, sizeof(int) * cap);
+        if (grown == NULL)
+        {
+          free(values);
+          return -1;
+        }
+        values = grown;
+      }
+      values[(*len)++] = (int) v;
+    }
+
+    at = *end == ',' ? end + 1 : end;
+  }
+
+  *out = values;
+  return 0;
+}
+
+/*
+  reads a sysfs list, -1 if there is none.
+*/
+static int f_numa_read(const char* path, int** out, int* len)
+{
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+
+  char line[4096];
+  char* read = fgets(line, sizeof(line), fp);
+  fclose(fp);
+  return read == NULL ? -1 : f_numa_parse(line, out, len);
+}
+
+int f_numa_init(f_numa** out)
+{
+  f_numa* numa = malloc(sizeof(*numa));
+  if (numa == NULL)
+  {
+    return -1;
+  }
+  numa->len = 0;
+  numa->nodes = NULL;
+
+  int* ids = NULL;
+  int ids_len = 0;
+  if (f_numa_read("/sys/devices/system/node/online", &ids, &ids_len) == 0 && ids_len > 0)
+  {
+    numa->nodes = malloc(sizeof(f_numa_node) * ids_len);
+    for (int i=0; numa->nodes != NULL && i<ids_len; i++)
+    {
+      char path[128];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+
+      // nodes with memory and no cpus can't run threads.
+      f_numa_node* node = &numa->nodes[numa->len];
+      node->id = ids[i];
+      if (f_numa_read(path, &node->cpus, &node->len) == 0)
+      {
+        if (node->len > 0)
+        {
+          numa->len++;
+        }
+        else
+        {
+          free(node->cpus);
+        }
+      }
+    }
+  }
+  free(ids);
+
+  if (numa->len == 0)
+  {
+    // a single node with every cpu.
+    free(numa->nodes);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    numa->nodes = malloc(sizeof(f_numa_node));
+    if (numa->nodes == NULL)
+    {
+      free(numa);
+      return -1;
+    }
+
+    numa->nodes[0].id = 0;
+    numa->nodes[0].len = cpus > 0 ? (int) cpus : 1;
+    numa->nodes[0].cpus = malloc(sizeof(int) * numa->nodes[0].len);
+    if (numa->nodes[0].cpus == NULL)
+    {
+      free(numa->nodes);
+      free(numa);
+      return -1;
+    }
+
+    for (int i=0; i<numa->nodes[0].len; i++)
+    {
+      numa->nodes[0].cpus[i] = i;
+    }
+    numa->len = 1;
+  }
+
+  f_log(F_LOG_DEBUG, "%d numa nodes", numa->len);
+  *out = numa;
+  return 0;
+}
+
+int f_numa_node_of(f_numa* numa, int index, int count)
+{
+  if (count <= 0 || index < 0)
+  {
+    return 0;
+  }
+  return (int) ((long) (index % count) * numa->len / count);
+}
+
+int f_numa_bind(f_numa* numa, int node)
+{
+  if (node < 0 || node >= numa->len)
+  {
+    return -1;
+  }
+
+#if defined(__linux__) && defined(CPU_SET)
+  f_numa_node* n = &numa->nodes[node];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i=0; i<n->len; i++)
+  {
+    if (n->cpus[i] < CPU_SETSIZE)
+    {
+      CPU_SET(n->cpus[i], &set);
+    }
+  }
+
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+  {
+    f_log(F_LOG_WARN, "cannot bind thread to numa node %d", n->id);
+    return -1;
+  }
+
+#ifdef SYS_set_mempolicy
+  // pages are placed when first touched, a single node has nowhere else to put them.
+  if (numa->len > 1 && n->id < F_NUMA_MAX_NODES)
+  {
+    unsigned long mask[F_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[n->id / (8 * sizeof(unsigned long))] |= 1ul << (n->id % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy, F_NUMA_PREFERRED, mask, (unsigned long) F_NUMA_MAX_NODES + 1) != 0)
+    {
+      f_log(F_LOG_DEBUG, "cannot prefer the memory of numa node %d", n->id);
+    }
+  }
+#endif
+  return 0;
+#else
+  f_log(F_LOG_WARN, "numa binding isn't supported in this build");
+  return -1;
+#endif
+}
+
+void f_numa_free(f_numa** numaref)
+{
+  f_numa* numa = *numaref;
+  for (int i=0; i<numa->len; i++)
+  {
+    free(numa->nodes[i].cpus);
+  }
+  free(numa->nodes);
+  free(numa);
+  *numaref = NULL;
+}
+
+#endif
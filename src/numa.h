@@ -0,0 +1,74 @@
+#ifndef FLASHLIGHT_NUMA_H
+#define FLASHLIGHT_NUMA_H
+
+/** @file numa.h
+* @brief The NUMA nodes of the host, to keep threads and their memory on one node
+*
+* Nodes and their cpus are read from sysfs, a host without them is a single node with every online cpu.
+* A thread bound to a node only runs on its cpus and prefers its memory, so the read buffers and offsets
+* it allocates and touches first stay local. Memory is placed with set_mempolicy, without libnuma.
+*/
+
+// the nodes a preferred memory policy can name.
+#define F_NUMA_MAX_NODES 64
+
+/** @struct FNumaNode
+* @brief a node and its cpus
+* @var FNumaNode::id
+* the node number
+* @var FNumaNode::cpus
+* the cpus of the node
+* @var FNumaNode::len
+* the number of cpus
+*/
+typedef struct FNumaNode
+{
+  int id;
+  int* cpus;
+  int len;
+} f_numa_node;
+
+/** @struct FNuma
+* @brief the nodes of the host
+* @var FNuma::nodes
+* the nodes with cpus, by id
+* @var FNuma::len
+* the number of nodes
+*/
+typedef struct FNuma
+{
+  f_numa_node* nodes;
+  int len;
+} f_numa;
+
+/**
+  Finds the nodes of the host
+  @param out the nodes
+  @return non zero for error
+*/
+int f_numa_init(f_numa** out);
+
+/**
+  Spreads threads over the nodes in contiguous blocks, so neighbouring threads share a node
+  @param numa the nodes
+  @param index the thread
+  @param count the number of threads
+  @return the position of the node in `numa->nodes`
+*/
+int f_numa_node_of(f_numa* numa, int index, int count);
+
+/**
+  Runs the calling thread on the cpus of a node and prefers its memory
+  @param numa the nodes
+  @param node the position of the node in `numa->nodes`
+  @return non zero if the thread couldn't be bound
+*/
+int f_numa_bind(f_numa* numa, int node);
+
+/**
+  Frees the nodes
+  @param numa the nodes to free
+*/
+void f_numa_free(f_numa** numa);
+
+#endif
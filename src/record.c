@@ -0,0 +1,234 @@
+#ifndef FLASHLIGHT_RECORD
+#define FLASHLIGHT_RECORD
+
+#include "record.h"
+#include <string.h>
+
+int f_record_init(f_record* record, enum F_RECORD mode, char quote, const char* prefix, size_t file_size)
+{
+  record->mode = mode;
+  record->quote = quote == '\0' ? '"' : quote;
+  record->prefix = NULL;
+  record->file_size = file_size;
+  record->chunks = NULL;
+  record->len = 0;
+  record->cap = 0;
+
+  if (mode == F_RECORD_PREFIX)
+  {
+    if (prefix == NULL)
+    {
+      f_log(F_LOG_ERROR, "prefix records need a prefix regex");
+      return -1;
+    }
+
+    int error_number;
+    PCRE2_SIZE error_offset;
+    record->prefix = pcre2_compile((PCRE2_SPTR) prefix, PCRE2_ZERO_TERMINATED, PCRE2_ANCHORED, &error_number, &error_offset, NULL);
+    if (record->prefix == NULL)
+    {
+      PCRE2_UCHAR buffer[256];
+      pcre2_get_error_message(error_number, buffer, sizeof(buffer));
+      f_log(F_LOG_ERROR, "record prefix failed to compile at offset %d: %s", (int) error_offset, buffer);
+      return -1;
+    }
+  }
+
+  if (pthread_mutex_init(&record->lock, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init mutex");
+    pcre2_code_free(record->prefix);
+    return -1;
+  }
+
+  return 0;
+}
+
+int f_record_scan_init(f_record_scan* scan, f_record* record)
+{
+  scan->quoted = false;
+  scan->match_data = NULL;
+
+  if (record->mode == F_RECORD_PREFIX)
+  {
+    scan->match_data = pcre2_match_data_create_from_pattern(record->prefix, NULL);
+    if (scan->match_data == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant allocate matchdata block");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+bool f_record_boundary(f_record* record, f_record_scan* scan, const uint8_t* buffer, size_t pos, size_t len, size_t offset, bool* atomic)
+{
+  *atomic = true;
+
+  if (record->mode == F_RECORD_QUOTED && buffer[pos] == (uint8_t) record->quote)
+  {
+    scan->quoted = !scan->quoted;
+    return false;
+  }
+
+  if (buffer[pos] != '\n')
+  {
+    return false;
+  }
+
+  switch (record->mode)
+  {
+    case F_RECORD_QUOTED:
+      *atomic = !scan->quoted;
+      return true;
+    case F_RECORD_PREFIX:
+    {
+      // the end of the target always ends a record.
+      if (offset + 1 >= record->file_size || pos + 1 >= len)
+      {
+        return true;
+      }
+
+      const uint8_t* line = buffer + pos + 1;
+      const uint8_t* newline = memchr(line, '\n', len - pos - 1);
+      size_t line_len = newline == NULL ? len - pos - 1 : (size_t) (newline - line);
+      return pcre2_match(record->prefix, line, line_len, 0, 0, scan->match_data, NULL) >= 0;
+    }
+    default:
+      return true;
+  }
+}
+
+int f_record_scan_done(f_record* record, f_record_scan* scan, size_t from)
+{
+  pcre2_match_data_free(scan->match_data);
+  scan->match_data = NULL;
+
+  if (record->mode != F_RECORD_QUOTED)
+  {
+    return 0;
+  }
+
+  pthread_mutex_lock(&record->lock);
+  if (record->len == record->cap)
+  {
+    size_t cap = record->cap == 0 ? 64 : record->cap * 2;
+    f_record_chunk* chunks = realloc(record->chunks, sizeof(f_record_chunk) * cap);
+    if (chunks == NULL)
+    {
+      pthread_mutex_unlock(&record->lock);
+      f_log(F_LOG_ERROR, "cant grow record chunks");
+      return -1;
+    }
+    record->chunks = chunks;
+    record->cap = cap;
+  }
+
+  record->chunks[record->len].from = from;
+  record->chunks[record->len].flips = scan->quoted;
+  record->len++;
+  pthread_mutex_unlock(&record->lock);
+  return 0;
+}
+
+static int f_record_chunk_compare(const void* a, const void* b)
+{
+  const f_record_chunk* ca = a;
+  const f_record_chunk* cb = b;
+  return (ca->from > cb->from) - (ca->from < cb->from);
+}
+
+int f_record_resolve(f_record* record, f_lookup_file* lookup)
+{
+  if (record->mode != F_RECORD_QUOTED || lookup == NULL)
+  {
+    return 0;
+  }
+
+  /*
+    the quote state at the start of a chunk is the parity of every chunk before it.
+    `flips` is reused for the state at the start.
+  */
+  qsort(record->chunks, record->len, sizeof(f_record_chunk), f_record_chunk_compare);
+  bool quoted = false;
+  for (size_t i=0; i<record->len; i++)
+  {
+    bool flips = record->chunks[i].flips;
+    record->chunks[i].flips = quoted;
+    quoted = quoted != flips;
+  }
+
+  size_t* offsets = malloc(sizeof(size_t) * F_RECORD_RESOLVE);
+  if (offsets == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate record offsets");
+    return -1;
+  }
+
+  // offsets are stored from the end of the target, the last one is the start of the first line.
+  size_t total = lookup->len;
+  size_t kept = 0;
+  size_t chunk = record->len;
+  for (size_t read=0; read<total; read+=F_RECORD_RESOLVE)
+  {
+    size_t count = read + F_RECORD_RESOLVE > total ? total - read : F_RECORD_RESOLVE;
+    size_t bytes = count * sizeof(size_t);
+    if (pread(lookup->fd, offsets, bytes, (off_t) (read * sizeof(size_t))) != (ssize_t) bytes)
+    {
+      perror("cant read lookup");
+      free(offsets);
+      return -1;
+    }
+
+    size_t write = 0;
+    for (size_t i=0; i<count; i++)
+    {
+      bool tagged = (offsets[i] & F_BYTES_TAG) != 0;
+      size_t offset = offsets[i] & ~F_BYTES_TAG;
+
+      // offsets are descending, so the chunk of the newline only moves back.
+      while (offset > 0 && chunk > 0 && record->chunks[chunk - 1].from > offset - 1)
+      {
+        chunk--;
+      }
+
+      bool start_quoted = offset > 0 && chunk > 0 ? record->chunks[chunk - 1].flips : false;
+      if (offset == 0 || offset >= record->file_size || tagged == start_quoted)
+      {
+        offsets[write++] = offset;
+      }
+    }
+
+    bytes = write * sizeof(size_t);
+    if (pwrite(lookup->fd, offsets, bytes, (off_t) (kept * sizeof(size_t))) != (ssize_t) bytes)
+    {
+      perror("cant write lookup");
+      free(offsets);
+      return -1;
+    }
+    kept += write;
+  }
+
+  free(offsets);
+
+  if (ftruncate(lookup->fd, (off_t) (kept * sizeof(size_t))) != 0)
+  {
+    perror("cant truncate lookup");
+    return -1;
+  }
+
+  lookup->len = (unsigned int) kept;
+  return 0;
+}
+
+void f_record_free(f_record* record)
+{
+  pthread_mutex_destroy(&record->lock);
+  pcre2_code_free(record->prefix);
+  free(record->chunks);
+  record->chunks = NULL;
+  record->prefix = NULL;
+}
+
+#endif
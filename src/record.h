@@ -0,0 +1,148 @@
+#ifndef FLASHLIGHT_RECORD_H
+#define FLASHLIGHT_RECORD_H
+
+/** @file record.h
+* @brief Detectors for where a record ends, when a record can hold newlines
+*
+* The indexer only looks at newlines, a detector decides which of them end a record.
+* Records then take the place of lines everywhere: line numbers count records,
+* and a line returned by a lookup or a search can hold newlines.
+*/
+
+// bytes read past the end of a chunk, to match the line that starts after its last newline.
+#define F_RECORD_LOOKAHEAD 4096
+// offsets of the lookup file read at a time while resolving quotes.
+#define F_RECORD_RESOLVE 4096
+
+/**
+* @brief which newlines end a record
+*/
+enum F_RECORD
+{
+  F_RECORD_LINE = 0, /**< every newline */
+  F_RECORD_QUOTED, /**< newlines outside quotes, for CSV with quoted newlines */
+  F_RECORD_PREFIX /**< newlines followed by a line that matches a prefix regex, for multi line log events */
+};
+
+/** @struct FRecordChunk
+* @brief the quotes of one chunk of the target
+* @var FRecordChunk::from
+* the offset the chunk starts at
+* @var FRecordChunk::flips
+* true if the chunk has an odd number of quotes
+*/
+typedef struct FRecordChunk
+{
+  size_t from;
+  bool flips;
+} f_record_chunk;
+
+/** @struct FRecord
+* @brief the record detector of one indexing run
+*
+* Chunks are scanned in parallel, before the quote state at their start is known.
+* A quoted detector marks the newlines that are inside quotes if the chunk starts outside them as non atomic,
+* and `f_record_resolve` keeps the right ones once every chunk was scanned.
+* @var FRecord::mode
+* the detector
+* @var FRecord::quote
+* the byte fields are quoted with (quoted only)
+* @var FRecord::prefix
+* the regex a line has to match at its start to begin a record (prefix only)
+* @var FRecord::file_size
+* the size of the target
+* @var FRecord::lock
+* serializes adding chunks
+* @var FRecord::chunks
+* the chunks scanned so far (quoted only)
+* @var FRecord::len
+* the number of chunks
+* @var FRecord::cap
+* the capacity of the chunks array
+*/
+typedef struct FRecord
+{
+  enum F_RECORD mode;
+  char quote;
+  pcre2_code* prefix;
+  size_t file_size;
+  pthread_mutex_t lock;
+  f_record_chunk* chunks;
+  size_t len;
+  size_t cap;
+} f_record;
+
+/** @struct FRecordScan
+* @brief the state of a detector in one chunk
+* @var FRecordScan::quoted
+* true if the scan is inside quotes, assuming the chunk started outside them
+* @var FRecordScan::match_data
+* the match data of the prefix regex (prefix only)
+*/
+typedef struct FRecordScan
+{
+  bool quoted;
+  pcre2_match_data* match_data;
+} f_record_scan;
+
+/**
+  Initializes a record detector
+
+  @param record the detector
+  @param mode which newlines end a record
+  @param quote the byte fields are quoted with ('\0' for '"')
+  @param prefix the regex a line starts a record with (F_RECORD_PREFIX only)
+  @param file_size the size of the target
+  @return non zero for error
+*/
+int f_record_init(f_record* record, enum F_RECORD mode, char quote, const char* prefix, size_t file_size);
+
+/**
+  Starts scanning a chunk
+  @param scan the state to init
+  @param record the detector
+  @return non zero for error
+*/
+int f_record_scan_init(f_record_scan* scan, f_record* record);
+
+/**
+  Decides if a newline ends a record
+
+  Quoted detectors have to see every byte of the chunk, in order, through this function.
+  @param record the detector
+  @param scan the state of the chunk
+  @param buffer the bytes read, which can go past the chunk
+  @param pos the position of the byte in buffer
+  @param len the number of bytes read
+  @param offset the offset of the byte in the target
+  @param atomic false if the newline only ends a record when the chunk starts inside quotes
+  @return true if the byte is a newline that can end a record
+*/
+bool f_record_boundary(f_record* record, f_record_scan* scan, const uint8_t* buffer, size_t pos, size_t len, size_t offset, bool* atomic);
+
+/**
+  Finishes scanning a chunk
+  @param record the detector
+  @param scan the state of the chunk
+  @param from the offset the chunk starts at
+  @return non zero for error
+*/
+int f_record_scan_done(f_record* record, f_record_scan* scan, size_t from);
+
+/**
+  Keeps the offsets of a lookup that end a record, once every chunk was scanned
+
+  The lookup is compacted in place and its len is updated.
+  @param record the detector
+  @param lookup the lookup written from the chunks
+  @return non zero for error
+*/
+int f_record_resolve(f_record* record, f_lookup_file* lookup);
+
+/**
+  Frees what a record detector allocated
+  @param record the detector
+*/
+void f_record_free(f_record* record);
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef FLASHLIGHT_RUNTIME
+#define FLASHLIGHT_RUNTIME
+#include <sched.h>
+#include "runtime.h"
+
+/*
+  pins the calling worker, cpu sets need _GNU_SOURCE on linux and aren't there elsewhere.
+*/
+static void f_runtime_pin(f_runtime_worker* worker)
+{
+  f_runtime_config* config = &worker->runtime->config;
+  if (config->affinity == F_AFFINITY_NONE)
+  {
+    return;
+  }
+
+  if (config->affinity == F_AFFINITY_NODES)
+  {
+    f_numa_bind(worker->runtime->numa, f_numa_node_of(worker->runtime->numa, worker->index, config->threads));
+    return;
+  }
+
+#if defined(__linux__) && defined(CPU_SET)
+  int cpu;
+  if (config->affinity == F_AFFINITY_LIST && config->cpus != NULL && config->cpus_len > 0)
+  {
+    cpu = config->cpus[worker->index % config->cpus_len];
+  }
+  else
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu = worker->index % (cpus > 0 ? (int) cpus : 1);
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+  {
+    f_log(F_LOG_WARN, "cannot pin worker %d to cpu %d", worker->index, cpu);
+  }
+#else
+  f_log(F_LOG_WARN, "cpu affinity isn't supported in this build");
+#endif
+}
+
+static void* f_runtime_work(void* payload)
+{
+  f_runtime_worker* worker = payload;
+  f_runtime* runtime = worker->runtime;
+  f_runtime_pin(worker);
+
+  pthread_mutex_lock(&runtime->lock);
+  while (true)
+  {
+    // queued tasks still run after stop.
+    while ((runtime->head == NULL && !runtime->stop) || (runtime->head != NULL && runtime->running >= runtime->concurrency))
+    {
+      pthread_cond_wait(&runtime->ready, &runtime->lock);
+    }
+
+    if (runtime->head == NULL)
+    {
+      break;
+    }
+
+    f_runtime_task* task = runtime->head;
+    runtime->head = task->next;
+    if (runtime->head == NULL)
+    {
+      runtime->tail = NULL;
+    }
+    runtime->running++;
+    pthread_mutex_unlock(&runtime->lock);
+
+    void* result = task->run(task->payload);
+
+    pthread_mutex_lock(&runtime->lock);
+    runtime->running--;
+    task->result = result;
+    task->done = true;
+    pthread_cond_broadcast(&runtime->finished);
+    pthread_cond_signal(&runtime->ready);
+  }
+  pthread_mutex_unlock(&runtime->lock);
+
+  return NULL;
+}
+
+int f_runtime_init(f_runtime** out, f_runtime_config config)
+{
+  f_runtime* runtime = malloc(sizeof(*runtime));
+  if (runtime == NULL)
+  {
+    f_log(F_LOG_ERROR, "cannot allocate runtime");
+    return -1;
+  }
+
+  if (config.threads <= 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    config.threads = cpus > 0 ? (int) cpus : 1;
+  }
+
+  runtime->workers = malloc(sizeof(f_runtime_worker) * config.threads);
+  if (runtime->workers == NULL)
+  {
+    f_log(F_LOG_ERROR, "cannot allocate runtime workers");
+    free(runtime);
+    return -1;
+  }
+
+  runtime->len = 0;
+  runtime->config = config;
+  runtime->numa = NULL;
+  if (config.affinity == F_AFFINITY_NODES && f_numa_init(&runtime->numa) == -1)
+  {
+    f_log(F_LOG_ERROR, "cannot find numa nodes");
+    free(runtime->workers);
+    free(runtime);
+    return -1;
+  }
+  runtime->concurrency = config.concurrency > 0 && config.concurrency < config.threads ? config.concurrency : config.threads;
+  runtime->running = 0;
+  runtime->head = NULL;
+  runtime->tail = NULL;
+  runtime->stop = false;
+  pthread_mutex_init(&runtime->lock, NULL);
+  pthread_cond_init(&runtime->ready, NULL);
+  pthread_cond_init(&runtime->finished, NULL);
+
+  for (int i=0; i<config.threads; i++)
+  {
+    runtime->workers[i].runtime = runtime;
+    runtime->workers[i].index = i;
+    if (pthread_create(&runtime->workers[i].thread, NULL, f_runtime_work, &runtime->workers[i]) != 0)
+    {
+      f_log(F_LOG_ERROR, "cannot create runtime worker %d", i);
+      f_runtime_free(&runtime);
+      return -1;
+    }
+    runtime->len++;
+  }
+
+  *out = runtime;
+  return 0;
+}
+
+int f_runtime_spawn(f_runtime_task** out, f_runtime* runtime, f_runtime_fn run, void* payload)
+{
+  f_runtime_task* task = malloc(sizeof(*task));
+  if (task == NULL)
+  {
+    f_log(F_LOG_ERROR, "cannot allocate task");
+    return -1;
+  }
+
+  task->runtime = runtime;
+  task->run = run;
+  task->payload = payload;
+  task->result = NULL;
+  task->done = false;
+  task->next = NULL;
+
+  if (runtime == NULL)
+  {
+    if (pthread_create(&task->thread, NULL, run, payload) != 0)
+    {
+      free(task);
+      return -1;
+    }
+
+    *out = task;
+    return 0;
+  }
+
+  pthread_mutex_lock(&runtime->lock);
+  if (runtime->stop)
+  {
+    pthread_mutex_unlock(&runtime->lock);
+    f_log(F_LOG_ERROR, "runtime is stopping");
+    free(task);
+    return -1;
+  }
+
+  if (runtime->tail == NULL)
+  {
+    runtime->head = task;
+  }
+  else
+  {
+    runtime->tail->next = task;
+  }
+  runtime->tail = task;
+  pthread_cond_signal(&runtime->ready);
+  pthread_mutex_unlock(&runtime->lock);
+
+  *out = task;
+  return 0;
+}
+
+int f_runtime_join(f_runtime_task* task, void** result)
+{
+  f_runtime* runtime = task->runtime;
+  int rc = 0;
+
+  if (runtime == NULL)
+  {
+    void* ret = NULL;
+    rc = pthread_join(task->thread, &ret) == 0 ? 0 : -1;
+    task->result = ret;
+  }
+  else
+  {
+    pthread_mutex_lock(&runtime->lock);
+    while (!task->done)
+    {
+      pthread_cond_wait(&runtime->finished, &runtime->lock);
+    }
+    pthread_mutex_unlock(&runtime->lock);
+  }
+
+  if (result != NULL)
+  {
+    *result = task->result;
+  }
+  free(task);
+  return rc;
+}
+
+void f_runtime_set_concurrency(f_runtime* runtime, int concurrency)
+{
+  pthread_mutex_lock(&runtime->lock);
+  runtime->concurrency = concurrency > 0 && concurrency < runtime->len ? concurrency : runtime->len;
+  pthread_cond_broadcast(&runtime->ready);
+  pthread_mutex_unlock(&runtime->lock);
+}
+
+void f_runtime_free(f_runtime** runtimeref)
+{
+  f_runtime* runtime = *runtimeref;
+
+  pthread_mutex_lock(&runtime->lock);
+  runtime->stop = true;
+  pthread_cond_broadcast(&runtime->ready);
+  pthread_mutex_unlock(&runtime->lock);
+
+  for (int i=0; i<runtime->len; i++)
+  {
+    pthread_join(runtime->workers[i].thread, NULL);
+  }
+
+  pthread_mutex_destroy(&runtime->lock);
+  pthread_cond_destroy(&runtime->ready);
+  pthread_cond_destroy(&runtime->finished);
+  if (runtime->numa != NULL)
+  {
+    f_numa_free(&runtime->numa);
+  }
+  free(runtime->workers);
+  free(runtime);
+  *runtimeref = NULL;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef FLASHLIGHT_RUNTIME_H
+#define FLASHLIGHT_RUNTIME_H
+
+/** @file runtime.h
+* @brief A pool of threads shared by indexing and searching
+*
+* A runtime is created once and given to any number of `f_indexer` and `f_searcher` configs,
+* their threads then become tasks queued on the runtime's workers instead of fresh pthreads.
+* The runtime caps how many tasks run at once across every operation using it.
+* Without a runtime, every task gets a thread of its own, as before.
+*
+* Tasks of an operation never wait on tasks that weren't started yet, so operations finish
+* with fewer workers than they ask threads for. A task must not wait on the runtime it runs on,
+* and an ordered search from `f_index_search_start` holds its workers while nobody takes its batches.
+*/
+
+/**
+* @brief where the workers of a runtime run
+*/
+enum F_AFFINITY
+{
+  F_AFFINITY_NONE = 0, /**< anywhere, as the scheduler sees fit */
+  F_AFFINITY_CORES, /**< worker i is pinned to online cpu i, wrapping around */
+  F_AFFINITY_LIST, /**< worker i is pinned to cpus[i], wrapping around */
+  F_AFFINITY_NODES /**< workers are spread over the numa nodes in blocks, and run on any cpu of theirs */
+};
+
+/**
+  A task run on a worker
+  @param payload the payload given to f_runtime_spawn
+  @return the result handed to f_runtime_join
+*/
+typedef void* (*f_runtime_fn)(void* payload);
+
+/** @struct FRuntimeConfig
+* @brief how to create a runtime
+* @var FRuntimeConfig::threads
+* the number of workers (0 for the online cpus)
+* @var FRuntimeConfig::concurrency
+* the number of tasks that run at once across every operation (0 for `threads`)
+* @var FRuntimeConfig::affinity
+* where workers run
+* @var FRuntimeConfig::cpus
+* the cpus to pin workers to, for F_AFFINITY_LIST
+* @var FRuntimeConfig::cpus_len
+* the number of cpus
+*/
+typedef struct FRuntimeConfig
+{
+  int threads;
+  int concurrency;
+  enum F_AFFINITY affinity;
+  const int* cpus;
+  int cpus_len;
+} f_runtime_config;
+
+/** @struct FRuntimeTask
+* @brief a task that was spawned, until it is joined
+* @var FRuntimeTask::runtime
+* the runtime it is queued on (NULL if it has a thread of its own)
+* @var FRuntimeTask::thread
+* its own thread, without a runtime
+* @var FRuntimeTask::run
+* the function to run
+* @var FRuntimeTask::payload
+* passed to run
+* @var FRuntimeTask::result
+* what run returned
+* @var FRuntimeTask::done
+* true once run returned
+* @var FRuntimeTask::next
+* the next queued task
+*/
+typedef struct FRuntimeTask
+{
+  struct FRuntime* runtime;
+  pthread_t thread;
+  f_runtime_fn run;
+  void* payload;
+  void* result;
+  bool done;
+  struct FRuntimeTask* next;
+} f_runtime_task;
+
+/** @struct FRuntimeWorker
+* @brief a thread of a runtime
+* @var FRuntimeWorker::runtime
+* the runtime
+* @var FRuntimeWorker::thread
+* the pthread
+* @var FRuntimeWorker::index
+* the position of the worker, for its affinity
+*/
+typedef struct FRuntimeWorker
+{
+  struct FRuntime* runtime;
+  pthread_t thread;
+  int index;
+} f_runtime_worker;
+
+/** @struct FRuntime
+* @brief a pool of threads tasks are queued on
+* @var FRuntime::workers
+* the threads
+* @var FRuntime::len
+* the number of threads
+* @var FRuntime::config
+* the config it was created with
+* @var FRuntime::numa
+* the numa nodes, for F_AFFINITY_NODES (NULL otherwise)
+* @var FRuntime::concurrency
+* the number of tasks that can run at once
+* @var FRuntime::running
+* the number of tasks running
+* @var FRuntime::head
+* the first queued task
+* @var FRuntime::tail
+* the last queued task
+* @var FRuntime::stop
+* true once the workers should exit, after the queued tasks
+* @var FRuntime::lock
+* serializes the fields above
+* @var FRuntime::ready
+* signaled when a task is queued or can start
+* @var FRuntime::finished
+* broadcast when a task is done
+*/
+typedef struct FRuntime
+{
+  f_runtime_worker* workers;
+  int len;
+  f_runtime_config config;
+  f_numa* numa;
+  int concurrency;
+  int running;
+  f_runtime_task* head;
+  f_runtime_task* tail;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t finished;
+} f_runtime;
+
+/**
+  Creates a runtime and starts its workers
+  @param out the runtime
+  @param config how many workers, the concurrency cap and affinity
+  @return non zero for error
+*/
+int f_runtime_init(f_runtime** out, f_runtime_config config);
+
+/**
+  Runs a task on a runtime, or on a thread of its own
+  @param out the task, to join
+  @param runtime the runtime to queue the task on (NULL for a thread of its own)
+  @param run the function to run
+  @param payload passed to run
+  @return non zero for error
+*/
+int f_runtime_spawn(f_runtime_task** out, f_runtime* runtime, f_runtime_fn run, void* payload);
+
+/**
+  Waits for a task and frees it
+  @param task the task
+  @param result what the task returned (NULL if unused)
+  @return non zero for error
+*/
+int f_runtime_join(f_runtime_task* task, void** result);
+
+/**
+  Changes how many tasks run at once, tasks that are running aren't stopped
+  @param runtime the runtime
+  @param concurrency the new cap (0 for the number of workers)
+*/
+void f_runtime_set_concurrency(f_runtime* runtime, int concurrency);
+
+/**
+  Runs the queued tasks, stops the workers and frees the runtime.
+  The operations using the runtime have to be done.
+  @param runtime the runtime to free
+*/
+void f_runtime_free(f_runtime** runtime);
+
+#endif
@@ -2,21 +2,24 @@
 #define FLASHLIGHT_SEARCH
 
 #include "search.h"
-pthread_mutex_t search_mutex;
+
+#define F_SEARCH_DEFAULT_BATCH 256
 
 int f_search_result_init(f_search_result** out, unsigned int num)
 {
-  f_search_result* init = malloc(sizeof(*init));
+  // the match arrays follow the result, so a hit is a single allocation.
+  f_search_result* init = malloc(sizeof(*init) + sizeof(size_t) * num * 2);
   if (init == NULL) return -1;
 
-  init->matches_substring_offset = malloc(sizeof(size_t) * num);
-  if (init->matches_substring_offset == NULL) return -1;
-
-  init->matches_substring_len = malloc(sizeof(size_t) * num);
-  if (init->matches_substring_len == NULL) return -1;
+  init->matches_substring_offset = (size_t*) (init + 1);
+  init->matches_substring_len = init->matches_substring_offset + num;
   init->matches_len = num;
   init->line_number = 0;
   init->str = NULL;
+  init->before = NULL;
+  init->before_len = 0;
+  init->after = NULL;
+  init->after_len = 0;
 
   *out = init;
   return 0;
@@ -24,9 +27,9 @@ int f_search_result_init(f_search_result** out, unsigned int num)
 
 void f_search_result_free(f_search_result* res)
 {
-  free(res->matches_substring_len);
-  free(res->matches_substring_offset);
   free(res->str);
+  free(res->before);
+  free(res->after);
   free(res);
 }
 
@@ -72,379 +75,1566 @@ void f_search_results_free(f_search_results** results)
   *results = NULL;
 }
 
-// https://stackoverflow.com/questions/42315585/split-string-into-tokens-in-c-when-there-are-2-delimiters-in-a-row
-char* tokenize(char** iptr, char* delim)
+int f_search_batch_init(f_search_batch** out, unsigned int cap)
 {
-  char* str = *iptr;
-  char* found = NULL;
-  int token_length = 0;
-  char* token = NULL;
-
-  if (!str) return NULL;
-
-  found = strstr(str, delim);
-  if (found)
+  f_search_batch* init = malloc(sizeof(*init));
+  if (init == NULL)
   {
-    token_length = found - str;
+    return -1;
   }
-  else
+
+  init->results = malloc(sizeof(f_search_result*) * cap);
+  if (init->results == NULL)
   {
-    token_length = strlen(str);
+    free(init);
+    return -1;
   }
 
-  if (token_length < 0)
+  init->len = 0;
+  init->cap = cap;
+  init->next = NULL;
+
+  *out = init;
+  return 0;
+}
+
+void f_search_batch_free(f_search_batch* batch)
+{
+  for (unsigned int i=0; i<batch->len; i++)
   {
-    *iptr = NULL;
-    return NULL;
+    f_search_result_free(batch->results[i]);
   }
 
-  token = malloc(sizeof(char) * (token_length + 1));
-  if (token == NULL)
+  free(batch->results);
+  free(batch);
+}
+
+int f_search_batch_push(f_search_batch* batch, f_search_result* res)
+{
+  if (batch->len == batch->cap)
   {
-    f_log(F_LOG_ERROR, "can't allocate token");
-    return NULL;
+    f_search_result** results = realloc(batch->results, sizeof(f_search_result*) * batch->cap * 2);
+    if (results == NULL)
+    {
+      return -1;
+    }
+
+    batch->results = results;
+    batch->cap *= 2;
   }
-  token[token_length] = '\0';
-  memcpy(token, str, token_length);
 
-  *iptr = found ? found + strlen(delim) : NULL;
-  return token;
+  batch->results[batch->len++] = res;
+  return 0;
 }
 
-void* f_index_search_thread(void* payload)
+/*
+  ordered searches count results when they are handed out rather than when they are matched,
+  so the limit applies to the first matches in the file.
+  drops the results past the limit and returns true if it was met.
+*/
+bool f_search_trim(f_search_state* state, f_search_batch* head)
 {
-  f_searcher_thread* config = payload;
-  f_index* index = config->index;
-  
-  pcre2_match_data* match_data;
-  match_data = pcre2_match_data_create_from_pattern(config->regex, NULL);
-  if (match_data == NULL)
+  if (!state->ordered)
   {
-    f_log(F_LOG_ERROR, "cant allocate matchdata block");
-    pthread_exit(NULL);
+    return false;
   }
 
-  PCRE2_SIZE* ovector;  
-  int rc;
-
-  for (size_t i=config->start; i<config->count + config->start; i+=config->buffer)
+  bool met_limit = false;
+  for (; head != NULL; head = head->next)
   {
-    if (*config->result_count >= config->result_limit) 
+    unsigned int keep = 0;
+    while (keep < head->len && atomic_fetch_add(&state->result_count, 1) < state->result_limit)
     {
-      f_log(F_LOG_INFO, "met result limit");
-      config->progress = (double) 1.0f;
-      pcre2_match_data_free(match_data);
-      pthread_exit(NULL);
+      keep++;
     }
 
-    char* lookup;
-    size_t buffer = config->buffer;
-    if (i + buffer > config->count + config->start)
+    if (keep < head->len)
     {
-      buffer = (config->count + config->start - i - 1);
+      for (unsigned int i=keep; i<head->len; i++)
+      {
+        f_search_result_free(head->results[i]);
+      }
+      head->len = keep;
+      met_limit = true;
     }
+  }
+
+  if (met_limit)
+  {
+    f_log(F_LOG_INFO, "met result limit");
+    atomic_store(&state->stop, true);
+  }
+
+  return met_limit;
+}
 
-    if (f_index_lookup(&lookup, index, i, buffer) != 0)
+/*
+  calls the result callback for a list of batches and frees them.
+*/
+void f_search_deliver(f_search_batch* head, searcher_cb on_result, void* payload)
+{
+  while (head != NULL)
+  {
+    f_search_batch* tmp = head->next;
+    for (unsigned int i=0; i<head->len; i++)
     {
-      f_log(F_LOG_ERROR, "lookup failed to start: %zu buffer: %zu", i, buffer); 
-      config->progress = (double) 1.0f;
-      pthread_exit(NULL); 
+      on_result(head->results[i], payload);
     }
 
-    if (lookup == NULL)
+    // delivered results are owned by the callback now.
+    head->len = 0;
+    f_search_batch_free(head);
+    head = tmp;
+  }
+}
+
+/*
+  hands the thread's batch off to the result callback.
+
+  the lock is taken once per batch rather than once per match.
+  with a single consumer, the batch is queued for the calling thread
+  and the thread starts a fresh one.
+*/
+int f_search_batch_flush(f_searcher_thread* config)
+{
+  f_search_batch* batch = config->batch;
+  f_search_state* state = config->state;
+
+  if (batch == NULL || batch->len == 0)
+  {
+    return 0;
+  }
+
+  if (state->single_consumer)
+  {
+    f_search_batch* next;
+    if (f_search_batch_init(&next, state->result_batch) == -1)
     {
-      f_log(F_LOG_WARN, "lookup is NULL");
-      config->progress = (double) 1.0f;
-      pthread_exit(NULL);
+      f_log(F_LOG_ERROR, "cant allocate search batch");
+      return -1;
     }
 
-    /*
-      we have 100 lines from disk, so we need to split them up.
-    */
-    size_t line_number = i;
-    char* line;
-    char* lookupcpy = lookup;
-
-    while ((line = tokenize(&lookupcpy, "\n")))
+    pthread_mutex_lock(&state->lock);
+    if (state->pending_tail == NULL)
+    {
+      state->pending = batch;
+    }
+    else
     {
-      line_number++;
+      state->pending_tail->next = batch;
+    }
+    state->pending_tail = batch;
+    pthread_cond_broadcast(&state->ready_cond);
+    pthread_mutex_unlock(&state->lock);
 
-      if (strlen(line) == 0)
-      {
-        f_log(F_LOG_DEBUG, "line is len of 0"); 
-        free(line);
-        continue;
-      }
+    config->batch = next;
+    return 0;
+  }
 
-      /*
-        match regex against lookup.
-      */
-      rc = pcre2_match(
-        config->regex,        /* the compiled pattern */
-        (PCRE2_SPTR8) line,                 /* the subject string */
-        strlen(line),         /* the length of the subject */
-        0,                    /* start at offset 0 in the subject */
-        0,                    /* default options */
-        match_data,           /* block for storing the result */
-        NULL
-      );
+  f_log(F_LOG_DEBUG, "locking for %u results", batch->len);
+  pthread_mutex_lock(&state->lock);
+  for (unsigned int i=0; i<batch->len; i++)
+  {
+    config->on_result(batch->results[i], config->result_payload);
+  }
+  pthread_mutex_unlock(&state->lock);
 
-      if (rc < 0 && rc != PCRE2_ERROR_NOMATCH)
-      {
-        f_log(F_LOG_ERROR, "bad pcre2 rc %d", rc);
-        free(line);
-        free(lookup);
-        pcre2_match_data_free(match_data);
-        config->progress = (double) 1.0f;
-        pthread_exit(NULL);
-      }
-      else
-      {
-        if (rc == PCRE2_ERROR_NOMATCH) {
-          free(line);
-          // check result count on no match.
-          if (*config->result_count >= config->result_limit) 
-          {
-            f_log(F_LOG_INFO, "met result limit");
-            config->progress = (double) 1.0f;
-            free(lookup);
-            pcre2_match_data_free(match_data);
-
-            pthread_exit(NULL);
-          }
-
-          continue;
-        }
-
-        ovector = pcre2_get_ovector_pointer(match_data);
-        f_search_result* res;
-        if (f_search_result_init(&res, rc) == -1)
-        {
-          // TODO free allocations.
-          f_log(F_LOG_ERROR, "cant init search result");
-          pthread_exit(NULL);
-        }
-        
-        res->line_number = line_number;
-        res->str = line;
-        res->matches_len = rc;
-
-        for (int m = 0; m < rc; m++)
-        {
-          res->matches_substring_offset[m] = ovector[2*m];
-          res->matches_substring_len[m] = ovector[2*m+1] - ovector[2*m];
-        }
-        
-        if (config->on_result != NULL)
-        {
-          f_log(F_LOG_DEBUG, "locking for result cb");
-
-          pthread_mutex_lock(&search_mutex);
-          if (*config->result_count >= config->result_limit) 
-          {
-            f_log(F_LOG_INFO, "met result limit");
-            config->progress = (double) 1.0f;
-            f_search_result_free(res);
-            free(lookup);
-            pcre2_match_data_free(match_data);
-            pthread_mutex_unlock(&search_mutex);
-
-            pthread_exit(NULL);
-          }
-
-          *config->result_count += 1;
-          f_log(F_LOG_DEBUG, "calling on result"); 
-          config->on_result(res, config->result_payload);
-          f_log(F_LOG_DEBUG, "on result finished");
-          pthread_mutex_unlock(&search_mutex);
-        }
-        else
-        {
-          // free if there isn't a supplied callback
-          f_search_result_free(res);
-        }
-      }
+  batch->len = 0;
+  return 0;
+}
+
+/*
+  removes the completed blocks that directly follow
+  the last delivered block from the reorder window.
+  must be called with the state locked.
+*/
+f_search_batch* f_search_window_take(f_search_state* state)
+{
+  f_search_batch* head = NULL;
+  f_search_batch* tail = NULL;
+
+  while (state->emit_block < state->block_count)
+  {
+    size_t slot = state->emit_block % state->window_len;
+    f_search_batch* batch = state->window[slot];
+    if (batch == NULL)
+    {
+      break;
+    }
+
+    state->window[slot] = NULL;
+    state->emit_block++;
+
+    if (tail == NULL)
+    {
+      head = batch;
+    }
+    else
+    {
+      tail->next = batch;
     }
+    tail = batch;
+  }
 
-    free(lookup);
-    config->progress = (double) (i - config->start) / (config->count);
+  if (head != NULL)
+  {
+    // room in the window for more blocks.
+    pthread_cond_broadcast(&state->window_cond);
   }
-  config->progress = (double) 1.0f;
-  f_log(F_LOG_DEBUG, "returning from thread");
-  pcre2_match_data_free(match_data);
-  pthread_exit(NULL);
+
+  return head;
 }
 
-int f_search_result_compare(const void* a, const void* b, void* udata)
+/*
+  claims the next block of an ordered search.
+
+  a block further than the reorder window ahead of
+  the last delivered block waits for earlier blocks to be delivered.
+  returns false when there is nothing left to claim.
+*/
+bool f_search_block_claim(f_search_state* state, size_t* out)
 {
-  const f_search_result* sa = a;
-  const f_search_result* sb = b;
-  return sa->line_number > sb->line_number;
+  pthread_mutex_lock(&state->lock);
+  while (!atomic_load(&state->stop) && state->next_block < state->block_count && state->next_block >= state->emit_block + state->window_len)
+  {
+    pthread_cond_wait(&state->window_cond, &state->lock);
+  }
+
+  if (atomic_load(&state->stop) || state->next_block >= state->block_count)
+  {
+    pthread_mutex_unlock(&state->lock);
+    return false;
+  }
+
+  *out = state->next_block++;
+  pthread_mutex_unlock(&state->lock);
+  return true;
 }
 
-int f_search_compile_term(pcre2_code** re, PCRE2_SPTR pattern)
+/*
+  places the thread's batch for a finished block in the reorder window,
+  delivering every block that is now in order unless a single consumer does that.
+*/
+int f_search_block_complete(f_searcher_thread* config, size_t block)
 {
-  int error_number;
-  PCRE2_SIZE error_offset;
-  *re = pcre2_compile(
-    pattern,               /* the pattern */
-    PCRE2_ZERO_TERMINATED, /* indicates pattern is zero-terminated */
-    0,                     /* default options */
-    &error_number,          /* for error number */
-    &error_offset,          /* for error offset */
-    NULL
-  );
+  f_search_state* state = config->state;
 
-  if (re == NULL || error_number != 100)
+  f_search_batch* next;
+  if (f_search_batch_init(&next, state->result_batch) == -1)
   {
-    PCRE2_UCHAR buffer[256];
-    pcre2_get_error_message(error_number, buffer, sizeof(buffer));
-    printf("PCRE2 compilation failed at offset %d: %s\n", (int)error_offset, buffer);
+    f_log(F_LOG_ERROR, "cant allocate search batch");
     return -1;
   }
 
+  pthread_mutex_lock(&state->lock);
+  state->window[block % state->window_len] = config->batch;
+  config->batch = next;
+
+  if (state->single_consumer)
+  {
+    pthread_cond_broadcast(&state->ready_cond);
+  }
+  else
+  {
+    f_search_batch* ready = f_search_window_take(state);
+    if (f_search_trim(state, ready))
+    {
+      pthread_cond_broadcast(&state->window_cond);
+    }
+    f_search_deliver(ready, config->on_result, config->result_payload);
+  }
+  pthread_mutex_unlock(&state->lock);
   return 0;
 }
 
-int f_index_search(f_searcher config)
+/*
+  stops every thread of this search, and wakes any thread waiting on the reorder window.
+*/
+void f_search_state_stop(f_search_state* state)
 {
-  f_index* index = config.index;
-  int threads = config.threads;
-  int total_lines = index->flookup->len;
-  
-  if(pthread_mutex_init(&search_mutex, NULL) != 0)
+  pthread_mutex_lock(&state->lock);
+  atomic_store(&state->stop, true);
+  pthread_cond_broadcast(&state->window_cond);
+  pthread_mutex_unlock(&state->lock);
+}
+
+bool f_search_should_stop(f_searcher_thread* config)
+{
+  f_search_state* state = config->state;
+  if (atomic_load(&state->stop) || state->ordered || config->mode != F_SEARCH_RESULTS)
   {
-    f_log(F_LOG_ERROR, "cant init mutex");
-    return -1;
+    return atomic_load(&state->stop);
   }
 
-  /*
-    Compile PCRE2 Regex to pass to threads.
-  */
-  pcre2_code* re;
-  PCRE2_SPTR pattern = (PCRE2_SPTR) config.regex;
-  if (f_search_compile_term(&re, pattern) != 0)
+  return atomic_load(&state->result_count) >= config->result_limit;
+}
+
+/*
+  frees the batches of a cancelled search without delivering them.
+*/
+void f_search_state_discard(f_search_state* state)
+{
+  f_search_batch* head = state->pending;
+  while (head != NULL)
   {
-    f_log(F_LOG_WARN, "Supplied regex is invalid");
-    return -2;
+    f_search_batch* tmp = head->next;
+    f_search_batch_free(head);
+    head = tmp;
   }
 
-  /*
-    Determine how many threads are at play, and the offsets.
-  */
-  if (threads > total_lines)
+  state->pending = NULL;
+  state->pending_tail = NULL;
+}
+
+/*
+  wakes whoever waits for the search once its last thread is done.
+*/
+void f_search_state_thread_done(f_search_state* state)
+{
+  pthread_mutex_lock(&state->lock);
+  state->running--;
+  pthread_cond_broadcast(&state->ready_cond);
+  pthread_mutex_unlock(&state->lock);
+}
+
+void f_search_thread_exit(f_searcher_thread* config, pcre2_match_data* match_data)
+{
+  f_stats_thread(config->stats, config->thread, config->started, config->busy);
+  if (!config->state->ordered && f_search_batch_flush(config) == -1)
   {
-    threads = total_lines;
+    f_log(F_LOG_ERROR, "failed to flush search results");
   }
 
-  f_searcher_thread** searcher_threads = malloc(sizeof(*searcher_threads) * threads);
-  if (searcher_threads == NULL)
+  atomic_store_explicit(&config->progress, 1.0, memory_order_relaxed);
+  atomic_store(&config->done, true);
+  pcre2_match_data_free(match_data);
+  f_search_state_thread_done(config->state);
+}
+
+/*
+  hands a finished result to the thread's batch.
+  ordered batches hold a whole block, unordered ones are flushed when full.
+*/
+int f_search_lines_push(f_searcher_thread* config, f_search_result* res)
+{
+  if (f_search_batch_push(config->batch, res) == -1)
   {
-    f_log(F_LOG_ERROR, "cant allocate searcher threads");
+    f_log(F_LOG_ERROR, "cant grow search batch");
+    f_search_result_free(res);
     return -1;
   }
 
-  pthread_t* thread_ids = malloc(sizeof(pthread_t) * threads);
-  if (thread_ids == NULL)
+  if (!config->state->ordered && config->batch->len == config->batch->cap && f_search_batch_flush(config) == -1)
   {
-    f_log(F_LOG_ERROR, "cant allocate thread ids");
     return -1;
   }
 
-  long int lines_per_thread = (long int) ceil(total_lines / threads);
-  int* result_count = malloc(sizeof(*result_count));
-  if (result_count == NULL)
+  return 0;
+}
+
+/*
+  copies the lines in [lo, hi) of a lookup, they are already newline separated.
+*/
+int f_search_context_copy(char** out, char* lo, char* hi)
+{
+  size_t len = (size_t) (hi - lo);
+  char* str = malloc(sizeof(char) * (len + 1));
+  if (str == NULL)
   {
-    f_log(F_LOG_ERROR, "failed to allocate int for result count");
     return -1;
   }
-  *result_count = 0;
 
-  for (int i=0; i<threads; i++)
+  memcpy(str, lo, len);
+  str[len] = '\0';
+  *out = str;
+  return 0;
+}
+
+/*
+  stops collecting context for the last match and hands its result to the batch.
+*/
+int f_search_context_close(f_searcher_thread* config, f_search_context* ctx)
+{
+  f_search_result* res = ctx->result;
+  ctx->result = NULL;
+  ctx->open = false;
+
+  if (res == NULL)
   {
-    size_t start_position = i * lines_per_thread;
-    
-    if (start_position + lines_per_thread > total_lines)
-    {
-      lines_per_thread = (total_lines - start_position);
-    }
+    return 0;
+  }
 
-    f_searcher_thread* searcher_thread = malloc(sizeof(*searcher_thread));
-    if (searcher_thread == NULL)
+  if (ctx->lines > 0)
+  {
+    // reverse searches collect the lines before a match last.
+    bool before = config->state->reverse;
+    if (f_search_context_copy(before ? &res->before : &res->after, ctx->lo, ctx->hi) == -1)
     {
-      f_log(F_LOG_ERROR, "failed to allocate searcher thread");
+      f_log(F_LOG_ERROR, "cant copy context lines");
+      f_search_result_free(res);
       return -1;
     }
 
-    /*
-      allocate search results buffer.
-    */
-    searcher_thread->thread = i;
-    searcher_thread->start = start_position;
-    searcher_thread->count = lines_per_thread;
-    searcher_thread->buffer = config.line_buffer;
-    searcher_thread->progress = 0.0f;
-    searcher_thread->regex = re;
-    searcher_thread->index = index;
-    searcher_thread->on_result = config.on_result;
-    searcher_thread->result_payload = config.result_payload;
-    searcher_thread->result_limit = config.result_limit;
-    searcher_thread->result_count = result_count;
-    searcher_threads[i] = searcher_thread;
-
-    if (pthread_create(&thread_ids[i], NULL, f_index_search_thread, searcher_threads[i]) != 0)
+    if (before)
     {
-      // kill already created threads.
-      for (int ti=0; ti<i; ti++)
-      {
-        pthread_kill(thread_ids[ti], SIGINT);
-      }
-      f_log(F_LOG_ERROR, "Couldn't create thread %d", i);
-      return -1;
+      res->before_len = ctx->lines;
+    }
+    else
+    {
+      res->after_len = ctx->lines;
     }
   }
 
-  // join threads.
-  for (int i=0; i<threads; i++)
+  return f_search_lines_push(config, res);
+}
+
+/*
+  a line that didn't match, it belongs to the last match while that match is within `ahead` lines.
+*/
+int f_search_context_line(f_searcher_thread* config, f_search_context* ctx, size_t ahead, size_t scanned, char* line, size_t line_len)
+{
+  if (!ctx->open)
   {
-    bool next = false;
-    // block i thread join until i thread progress is 1.
-    // report progress and any new results in the meantime.
-    while (!next)
-    {
-      // if i progresses reached 1, go to next block
-      next = searcher_threads[i]->progress >= 0.999;
-      double progress = 0.0f;
+    return 0;
+  }
 
-      for (int p=0; p<threads; p++)
-      {
-        progress += (searcher_threads[p]->progress / (double) threads);
-      }
+  ctx->covered = scanned;
+  if (ctx->result != NULL)
+  {
+    ctx->lo = ctx->lines == 0 || line < ctx->lo ? line : ctx->lo;
+    ctx->hi = ctx->lines == 0 || line + line_len > ctx->hi ? line + line_len : ctx->hi;
+    ctx->lines++;
+  }
 
-      if (config.on_progress != NULL)
-      {
-        config.on_progress(progress, config.progress_payload);
-      }
-    }
+  if (scanned - ctx->open_line >= ahead)
+  {
+    return f_search_context_close(config, ctx);
+  }
 
-    // join next thread.
-    if (pthread_join(thread_ids[i], NULL) != 0)
-    {
-      perror("can't join searcher thread");
-      f_log(F_LOG_WARN, "Can't joint thread %d", i);
-    }
+  return 0;
+}
+
+/*
+  attaches the lines behind a match that no earlier match claimed.
+*/
+int f_search_context_behind(f_searcher_thread* config, f_search_context* ctx, size_t behind, size_t scanned, f_search_result* res)
+{
+  size_t n = scanned - 1 - ctx->covered;
+  if (n > behind)
+  {
+    n = behind;
   }
 
-  for (int i=0; i<threads; i++)
+  if (n == 0)
+  {
+    return 0;
+  }
+
+  char* lo = NULL;
+  char* hi = NULL;
+  for (size_t k=scanned - n; k<scanned; k++)
+  {
+    char* line = ctx->ring[k % behind];
+    size_t line_len = ctx->ring_len[k % behind];
+    lo = lo == NULL || line < lo ? line : lo;
+    hi = hi == NULL || line + line_len > hi ? line + line_len : hi;
+  }
+
+  // forward searches scan the lines before a match first.
+  bool before = !config->state->reverse;
+  if (f_search_context_copy(before ? &res->before : &res->after, lo, hi) == -1)
+  {
+    f_log(F_LOG_ERROR, "cant copy context lines");
+    return -1;
+  }
+
+  if (before)
+  {
+    res->before_len = n;
+  }
+  else
+  {
+    res->after_len = n;
+  }
+
+  return 0;
+}
+
+/*
+  frees what one buffer's search allocated.
+  the result still collecting context is handed out, unless the search failed.
+*/
+int f_search_lines_done(f_searcher_thread* config, f_search_context* ctx, f_index_lines* lines, int rc)
+{
+  if (rc == -1)
+  {
+    if (ctx->result != NULL)
+    {
+      f_search_result_free(ctx->result);
+      ctx->result = NULL;
+    }
+  }
+  else if (f_search_context_close(config, ctx) == -1)
+  {
+    rc = -1;
+  }
+
+  free(ctx->ring);
+  free(ctx->ring_len);
+  f_index_lines_free(lines);
+  return rc;
+}
+
+/*
+  searches `count` lines from `start`, collecting matches into the thread's batch.
+  returns 1 if the search should stop, -1 for error.
+
+  with context lines, the read is extended on both sides of the buffer.
+  lines before the buffer are matched so context isn't repeated across buffers,
+  lines after it only until the last match has its context.
+*/
+int f_search_lines(f_searcher_thread* config, pcre2_match_data* match_data, size_t start, size_t count)
+{
+  f_search_state* state = config->state;
+  PCRE2_SIZE* ovector;  
+  int rc;
+
+  // cancellation is checked once per buffer.
+  if (f_cancel_state_poll(&state->cancel) != F_CANCEL_NONE)
+  {
+    f_search_state_stop(state);
+    return 1;
+  }
+
+  if (f_search_should_stop(config))
+  {
+    f_log(F_LOG_INFO, "met result limit");
+    return 1;
+  }
+
+  size_t ahead = state->reverse ? config->context_before : config->context_after;
+  size_t behind = state->reverse ? config->context_after : config->context_before;
+  f_search_context ctx = { .result = NULL, .open = false, .open_line = 0, .covered = 0, .lines = 0, .lo = NULL, .hi = NULL, .ring = NULL, .ring_len = NULL };
+
+  /*
+    lines scanned before the buffer can be claimed by a match up to `ahead` lines earlier.
+  */
+  size_t index_lines = f_index_line_count(config->index);
+  size_t extend_behind = behind > 0 ? behind + ahead : 0;
+  size_t extend_low = state->reverse ? ahead : extend_behind;
+  size_t extend_high = state->reverse ? extend_behind : ahead;
+  extend_low = extend_low > start ? start : extend_low;
+  extend_high = start + count + extend_high > index_lines ? index_lines - (start + count) : extend_high;
+  size_t lead = state->reverse ? extend_high : extend_low;
+
+  if (behind > 0)
+  {
+    ctx.ring = malloc(sizeof(char*) * behind);
+    ctx.ring_len = malloc(sizeof(size_t) * behind);
+    if (ctx.ring == NULL || ctx.ring_len == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant allocate context lines");
+      free(ctx.ring);
+      free(ctx.ring_len);
+      return -1;
+    }
+  }
+
+  f_index_lines lookup;
+  size_t read_start = start - extend_low;
+  size_t read_count = count + extend_low + extend_high;
+  uint64_t read_started = config->stats != NULL ? f_stats_now() : 0;
+  if (f_index_lookup_lines(&lookup, config->index, read_start, read_count) != 0)
+  {
+    f_log(F_LOG_ERROR, "lookup failed to start: %zu buffer: %zu", read_start, read_count); 
+    return f_search_lines_done(config, &ctx, &lookup, -1);
+  }
+  f_stats_read(config->stats, lookup.data != NULL ? lookup.offsets[lookup.count] : 0, read_started);
+
+  if (lookup.data == NULL)
+  {
+    f_log(F_LOG_WARN, "lookup is NULL");
+    return f_search_lines_done(config, &ctx, &lookup, -1);
+  }
+
+  /*
+    we have 100 lines from disk, already split up.
+    lines are matched in place and only copied when they become a result.
+  */
+  size_t scanned = 0;
+  char* line;
+  size_t line_len;
+
+  for (size_t k=0; k<lookup.count; k++)
+  {
+    size_t i = state->reverse ? lookup.count - 1 - k : k;
+    size_t line_number = read_start + i + 1;
+    f_index_lines_get(&lookup, i, &line, &line_len);
+
+    scanned++;
+    bool in_buffer = scanned > lead && scanned <= lead + count;
+    bool trailing = scanned > lead + count;
+
+    // lines after the buffer are only read for context.
+    if (trailing && ctx.result == NULL)
+    {
+      break;
+    }
+
+    rc = PCRE2_ERROR_NOMATCH;
+
+    // a column search only matches the part of the column on this line.
+    size_t subject_offset = 0;
+    size_t subject_len = line_len;
+    if (config->column > 0 && (!f_field_index_span(config->index->fields, line_number - 1, config->column, &subject_offset, &subject_len) || subject_offset + subject_len > line_len))
+    {
+      subject_len = 0;
+    }
+
+    if (subject_len == 0)
+    {
+      f_log(F_LOG_DEBUG, "line is len of 0"); 
+    }
+    else
+    {
+      /*
+        match regex against lookup.
+      */
+      uint64_t match_started = config->stats != NULL ? f_stats_now() : 0;
+      rc = pcre2_match(
+        config->regex,        /* the compiled pattern */
+        (PCRE2_SPTR8) line + subject_offset, /* the subject string */
+        subject_len,          /* the length of the subject */
+        0,                    /* start at offset 0 in the subject */
+        0,                    /* default options */
+        match_data,           /* block for storing the result */
+        NULL
+      );
+      f_stats_since(config->stats, F_STATS_MATCH, match_started);
+      if (rc >= 0)
+      {
+        f_stats_add(config->stats, F_STATS_MATCHES, 1);
+      }
+    }
+
+    if (rc < 0 && rc != PCRE2_ERROR_NOMATCH)
+    {
+      f_log(F_LOG_ERROR, "bad pcre2 rc %d", rc);
+      return f_search_lines_done(config, &ctx, &lookup, -1);
+    }
+
+    if (rc == PCRE2_ERROR_NOMATCH) {
+      if (f_search_context_line(config, &ctx, ahead, scanned, line, line_len) == -1)
+      {
+        return f_search_lines_done(config, &ctx, &lookup, -1);
+      }
+
+      if (behind > 0)
+      {
+        ctx.ring[scanned % behind] = line;
+        ctx.ring_len[scanned % behind] = line_len;
+      }
+
+      // check result count on no match.
+      if (in_buffer && f_search_should_stop(config)) 
+      {
+        f_log(F_LOG_INFO, "met result limit");
+        return f_search_lines_done(config, &ctx, &lookup, 1);
+      }
+
+      continue;
+    }
+
+    // a match ends the context of the one before it.
+    if (f_search_context_close(config, &ctx) == -1)
+    {
+      return f_search_lines_done(config, &ctx, &lookup, -1);
+    }
+
+    // matches outside the buffer belong to another buffer, they only claim context.
+    if (!in_buffer)
+    {
+      if (trailing)
+      {
+        break;
+      }
+
+      ctx.open = ahead > 0;
+      ctx.open_line = scanned;
+      ctx.covered = scanned;
+      if (behind > 0)
+      {
+        ctx.ring[scanned % behind] = line;
+        ctx.ring_len[scanned % behind] = line_len;
+      }
+      continue;
+    }
+
+    /*
+      count and bitmap searches don't build results.
+    */
+    if (config->mode == F_SEARCH_COUNT)
+    {
+      config->matches++;
+      continue;
+    }
+
+    if (config->mode == F_SEARCH_BITMAP)
+    {
+      config->matches++;
+      if (f_bitmap_add(config->bitmap, line_number) == -1)
+      {
+        f_log(F_LOG_ERROR, "cant add line to bitmap");
+        return f_search_lines_done(config, &ctx, &lookup, -1);
+      }
+      continue;
+    }
+
+    if (config->on_result == NULL && !state->single_consumer)
+    {
+      // nothing to deliver to.
+      continue;
+    }
+
+    // reserve a slot before building the result.
+    // ordered searches count on delivery instead.
+    if (!state->ordered && atomic_fetch_add(&state->result_count, 1) >= config->result_limit)
+    {
+      f_log(F_LOG_INFO, "met result limit");
+      return f_search_lines_done(config, &ctx, &lookup, 1);
+    }
+
+    ovector = pcre2_get_ovector_pointer(match_data);
+    f_search_result* res;
+    if (f_search_result_init(&res, rc) == -1)
+    {
+      f_log(F_LOG_ERROR, "cant init search result");
+      return f_search_lines_done(config, &ctx, &lookup, -1);
+    }
+
+    res->str = malloc(sizeof(char) * (line_len + 1));
+    if (res->str == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant copy matched line");
+      f_search_result_free(res);
+      return f_search_lines_done(config, &ctx, &lookup, -1);
+    }
+    memcpy(res->str, line, line_len);
+    res->str[line_len] = '\0';
+    
+    res->line_number = line_number;
+    res->matches_len = rc;
+
+    for (int m = 0; m < rc; m++)
+    {
+      res->matches_substring_offset[m] = subject_offset + ovector[2*m];
+      res->matches_substring_len[m] = ovector[2*m+1] - ovector[2*m];
+    }
+
+    if (behind > 0)
+    {
+      if (f_search_context_behind(config, &ctx, behind, scanned, res) == -1)
+      {
+        f_search_result_free(res);
+        return f_search_lines_done(config, &ctx, &lookup, -1);
+      }
+
+      ctx.ring[scanned % behind] = line;
+      ctx.ring_len[scanned % behind] = line_len;
+    }
+
+    // the result is held back while it collects the lines ahead of it.
+    ctx.result = res;
+    ctx.open = true;
+    ctx.open_line = scanned;
+    ctx.covered = scanned;
+    ctx.lines = 0;
+    if (ahead == 0 && f_search_context_close(config, &ctx) == -1)
+    {
+      return f_search_lines_done(config, &ctx, &lookup, -1);
+    }
+  }
+
+  return f_search_lines_done(config, &ctx, &lookup, 0);
+}
+
+/*
+  searches the parts of [start, start + count) whose trigram blocks can have a match.
+  runs of candidate blocks are searched in scan order, one read each.
+*/
+static int f_search_candidates_run(f_searcher_thread* config, pcre2_match_data* match_data, size_t start, size_t count)
+{
+  f_search_state* state = config->state;
+  f_trigram_index* trigrams = config->index->trigrams;
+
+  if (trigrams == NULL || state->trigrams == NULL || count == 0)
+  {
+    return f_search_lines(config, match_data, start, count);
+  }
+
+  size_t end = start + count;
+  size_t first_block = start / trigrams->block_lines;
+  size_t blocks = (end - 1) / trigrams->block_lines - first_block + 1;
+  size_t run_len = 0;
+
+  for (size_t i=0; i<=blocks; i++)
+  {
+    size_t block = state->reverse ? first_block + blocks - 1 - i : first_block + i;
+    if (i < blocks && f_trigram_index_maybe(trigrams, state->trigrams, block))
+    {
+      run_len++;
+      continue;
+    }
+
+    if (run_len == 0)
+    {
+      continue;
+    }
+
+    // the run ends at the block before this one, in scan order.
+    size_t low = state->reverse ? block + 1 : block - run_len;
+    size_t run_start = low * trigrams->block_lines;
+    size_t run_end = (low + run_len) * trigrams->block_lines;
+    run_start = run_start < start ? start : run_start;
+    run_end = run_end > end ? end : run_end;
+    run_len = 0;
+
+    int rc = f_search_lines(config, match_data, run_start, run_end - run_start);
+    if (rc != 0)
+    {
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
+int f_search_candidates(f_searcher_thread* config, pcre2_match_data* match_data, size_t start, size_t count)
+{
+  if (config->stats == NULL)
+  {
+    return f_search_candidates_run(config, match_data, start, count);
+  }
+
+  uint64_t started = f_stats_now();
+  int rc = f_search_candidates_run(config, match_data, start, count);
+  config->busy += f_stats_now() - started;
+  return rc;
+}
+
+void* f_index_search_thread(void* payload)
+{
+  f_searcher_thread* config = payload;
+  f_search_state* state = config->state;
+  config->started = config->stats != NULL ? f_stats_now() : 0;
+  
+  pcre2_match_data* match_data;
+  match_data = pcre2_match_data_create_from_pattern(config->regex, NULL);
+  if (match_data == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate matchdata block");
+    if (state->ordered)
+    {
+      f_search_state_stop(state);
+    }
+    atomic_store_explicit(&config->progress, 1.0, memory_order_relaxed);
+    atomic_store(&config->done, true);
+    f_search_state_thread_done(state);
+    return NULL;
+  }
+
+  if (state->ordered)
+  {
+    size_t block;
+    while (f_search_block_claim(state, &block))
+    {
+      size_t start = config->start + (block * config->buffer);
+      size_t count = config->buffer;
+      if (start + count > config->start + config->count)
+      {
+        count = config->start + config->count - start;
+      }
+
+      // reverse searches claim blocks from the end of the range.
+      if (state->reverse)
+      {
+        start = config->start + config->count - (block * config->buffer) - count;
+      }
+
+      if (f_search_candidates(config, match_data, start, count) == -1 || f_search_block_complete(config, block) == -1)
+      {
+        // a block that never completes would stall the window.
+        f_search_state_stop(state);
+        break;
+      }
+
+      atomic_store_explicit(&config->progress, (double) (block + 1) / state->block_count, memory_order_relaxed);
+    }
+
+    f_search_thread_exit(config, match_data);
+    return NULL;
+  }
+
+  for (size_t i=config->start; i<config->count + config->start; i+=config->buffer)
+  {
+    size_t buffer = config->buffer;
+    if (i + buffer > config->count + config->start)
+    {
+      buffer = (config->count + config->start - i);
+    }
+
+    if (f_search_candidates(config, match_data, i, buffer) != 0)
+    {
+      f_search_thread_exit(config, match_data);
+      return NULL;
+    }
+
+    // don't hold on to results longer than one buffer.
+    if (f_search_batch_flush(config) == -1)
+    {
+      f_search_thread_exit(config, match_data);
+      return NULL;
+    }
+
+    atomic_store_explicit(&config->progress, (double) (i - config->start) / (config->count), memory_order_relaxed);
+  }
+  f_log(F_LOG_DEBUG, "returning from thread");
+  f_search_thread_exit(config, match_data);
+  return NULL;
+}
+
+int f_search_result_compare(const void* a, const void* b, void* udata)
+{
+  const f_search_result* sa = a;
+  const f_search_result* sb = b;
+  return sa->line_number > sb->line_number;
+}
+
+int f_search_compile_term(pcre2_code** re, PCRE2_SPTR pattern)
+{
+  int error_number;
+  PCRE2_SIZE error_offset;
+  *re = pcre2_compile(
+    pattern,               /* the pattern */
+    PCRE2_ZERO_TERMINATED, /* indicates pattern is zero-terminated */
+    0,                     /* default options */
+    &error_number,          /* for error number */
+    &error_offset,          /* for error offset */
+    NULL
+  );
+
+  if (re == NULL || error_number != 100)
+  {
+    PCRE2_UCHAR buffer[256];
+    pcre2_get_error_message(error_number, buffer, sizeof(buffer));
+    printf("PCRE2 compilation failed at offset %d: %s\n", (int)error_offset, buffer);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+  moves batches that are ready from the search into the handle.
+  must be called with the state locked.
+*/
+void f_search_handle_take(f_search_handle* handle)
+{
+  f_search_state* state = &handle->state;
+  f_search_batch* head;
+
+  if (state->ordered)
+  {
+    head = f_search_window_take(state);
+  }
+  else
+  {
+    head = state->pending;
+    state->pending = NULL;
+    state->pending_tail = NULL;
+  }
+
+  if (head == NULL)
+  {
+    return;
+  }
+
+  if (f_search_trim(state, head))
+  {
+    // wake threads waiting on the reorder window so they can exit.
+    pthread_cond_broadcast(&state->window_cond);
+  }
+
+  if (handle->ready_tail == NULL)
+  {
+    handle->ready = head;
+  }
+  else
+  {
+    handle->ready_tail->next = head;
+  }
+
+  while (head->next != NULL)
+  {
+    head = head->next;
+  }
+  handle->ready_tail = head;
+}
+
+/*
+  frees every batch that wasn't handed out.
+*/
+void f_search_handle_discard(f_search_handle* handle)
+{
+  f_search_state* state = &handle->state;
+
+  f_search_state_discard(state);
+  for (size_t i=0; i<state->window_len; i++)
+  {
+    if (state->window[i] != NULL)
+    {
+      f_search_batch_free(state->window[i]);
+      state->window[i] = NULL;
+    }
+  }
+
+  while (handle->ready != NULL)
+  {
+    f_search_batch* tmp = handle->ready->next;
+    f_search_batch_free(handle->ready);
+    handle->ready = tmp;
+  }
+  handle->ready_tail = NULL;
+}
+
+/*
+  waits until a batch is ready, the threads are done, or `timeout_ms` passes.
+*/
+void f_search_handle_idle(f_search_handle* handle, long timeout_ms)
+{
+  f_search_state* state = &handle->state;
+
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_nsec += timeout_ms * 1000000l;
+  until.tv_sec += until.tv_nsec / 1000000000l;
+  until.tv_nsec %= 1000000000l;
+
+  pthread_mutex_lock(&state->lock);
+  while (state->running > 0 && state->pending == NULL && !(state->ordered && state->window[state->emit_block % state->window_len] != NULL))
+  {
+    if (pthread_cond_timedwait(&state->ready_cond, &state->lock, &until) != 0)
+    {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&state->lock);
+}
+
+/*
+  shared by every search mode.
+
+  `queued` searches hold their results for `f_search_handle_next_batch`,
+  other searches deliver them to `on_result` from the search threads.
+*/
+int f_index_search_begin(f_search_handle** out, f_searcher config, enum F_SEARCH_MODE mode, bool queued)
+{
+  uint64_t started = config.stats != NULL ? f_stats_now() : 0;
+  f_index* index = config.index;
+  int threads = config.threads;
+  // the lookup holds one more offset than there are lines.
+  size_t index_lines = f_index_line_count(index);
+
+  // line numbers are 1 based and inclusive, offsets are 0 based.
+  size_t first_line = config.start_line > 0 ? config.start_line - 1 : 0;
+  size_t last_line = config.end_line > 0 && config.end_line < index_lines ? config.end_line : index_lines;
+  size_t total_lines = last_line > first_line ? last_line - first_line : 0;
+  unsigned int result_batch = config.result_batch == 0 ? F_SEARCH_DEFAULT_BATCH : config.result_batch;
+
+  if (config.column > 0 && (index->fields == NULL || config.column > index->fields->columns))
+  {
+    f_log(F_LOG_ERROR, "column %zu isn't in the field index", config.column);
+    return -1;
+  }
+
+  if (config.line_buffer == 0)
+  {
+    f_log(F_LOG_ERROR, "line buffer has to be at least 1 line");
+    return -1;
+  }
+
+  /*
+    Compile PCRE2 Regex to pass to threads.
+  */
+  pcre2_code* re;
+  PCRE2_SPTR pattern = (PCRE2_SPTR) config.regex;
+  if (f_search_compile_term(&re, pattern) != 0)
+  {
+    f_log(F_LOG_WARN, "Supplied regex is invalid");
+    return -2;
+  }
+
+  f_search_handle* handle = malloc(sizeof(*handle));
+  if (handle == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate search handle");
+    pcre2_code_free(re);
+    return -1;
+  }
+
+  handle->config = config;
+  handle->started = started;
+  handle->lines = total_lines;
+  handle->mode = mode;
+  handle->regex = re;
+  handle->threads = NULL;
+  handle->tasks = NULL;
+  handle->len = 0;
+  handle->joined = false;
+  handle->rc = 0;
+  handle->ready = NULL;
+  handle->ready_tail = NULL;
+
+  f_search_state* state = &handle->state;
+  state->result_limit = config.result_limit;
+  state->result_batch = result_batch;
+  state->single_consumer = queued;
+  state->pending = NULL;
+  state->pending_tail = NULL;
+  state->ordered = (config.ordered || config.reverse) && mode == F_SEARCH_RESULTS;
+  state->reverse = config.reverse && state->ordered;
+  state->window = NULL;
+  state->window_len = 0;
+  state->block_count = 0;
+  state->next_block = 0;
+  state->emit_block = 0;
+  state->running = 0;
+  state->trigrams = NULL;
+  atomic_init(&state->result_count, 0);
+  atomic_init(&state->stop, false);
+  f_cancel_state_init(&state->cancel, config.cancel, config.timeout_ms);
+
+  if (pthread_mutex_init(&state->lock, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init mutex");
+    pcre2_code_free(re);
+    free(handle);
+    return -1;
+  }
+
+  if (pthread_cond_init(&state->window_cond, NULL) != 0 || pthread_cond_init(&state->ready_cond, NULL) != 0)
+  {
+    f_log(F_LOG_ERROR, "cant init condition");
+    pcre2_code_free(re);
+    pthread_mutex_destroy(&state->lock);
+    free(handle);
+    return -1;
+  }
+
+  // a query is only worth deriving when there are blocks to skip.
+  if (index->trigrams != NULL && f_trigram_query_init(&state->trigrams, config.regex) == -1)
+  {
+    f_log(F_LOG_ERROR, "cant derive trigrams");
+    f_search_handle_free(&handle);
+    return -1;
+  }
+
+  /*
+    Determine how many threads are at play, and the offsets.
+  */
+  if (threads > total_lines)
+  {
+    threads = total_lines > 0 ? (int) total_lines : 1;
+  }
+
+  /*
+    Ordered searches hand out blocks of `line_buffer` lines in order,
+    instead of giving each thread a fixed range.
+  */
+  if (state->ordered)
+  {
+    state->block_count = (size_t) ceil(total_lines / (double) config.line_buffer);
+
+    if (threads > state->block_count && state->block_count > 0)
+    {
+      threads = (int) state->block_count;
+    }
+
+    state->window_len = config.reorder_window == 0 ? (size_t) threads * 4 : config.reorder_window;
+    state->window = calloc(state->window_len, sizeof(f_search_batch*));
+    if (state->window == NULL)
+    {
+      f_log(F_LOG_ERROR, "cant allocate reorder window");
+      f_search_handle_free(&handle);
+      return -1;
+    }
+  }
+
+  handle->threads = malloc(sizeof(f_searcher_thread*) * threads);
+  if (handle->threads == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate searcher threads");
+    f_search_handle_free(&handle);
+    return -1;
+  }
+
+  handle->tasks = malloc(sizeof(f_runtime_task*) * threads);
+  if (handle->tasks == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate search tasks");
+    f_search_handle_free(&handle);
+    return -1;
+  }
+
+  size_t lines_per_thread = (size_t) ceil(total_lines / (double) threads);
+
+  for (int i=0; i<threads; i++)
+  {
+    size_t start_position = first_line + i * lines_per_thread;
+    
+    if (start_position > last_line)
+    {
+      start_position = last_line;
+    }
+
+    if (start_position + lines_per_thread > last_line)
+    {
+      lines_per_thread = (last_line - start_position);
+    }
+
+    f_searcher_thread* searcher_thread = malloc(sizeof(*searcher_thread));
+    if (searcher_thread == NULL)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate searcher thread");
+      f_search_handle_free(&handle);
+      return -1;
+    }
+
+    /*
+      allocate search results buffer.
+    */
+    if (f_search_batch_init(&searcher_thread->batch, result_batch) == -1)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate search batch");
+      free(searcher_thread);
+      f_search_handle_free(&handle);
+      return -1;
+    }
+
+    searcher_thread->thread = i;
+    searcher_thread->start = state->ordered ? first_line : start_position;
+    searcher_thread->count = state->ordered ? total_lines : lines_per_thread;
+    searcher_thread->buffer = config.line_buffer;
+    atomic_init(&searcher_thread->progress, 0.0);
+    searcher_thread->regex = re;
+    searcher_thread->index = index;
+    searcher_thread->on_result = config.on_result;
+    searcher_thread->result_payload = config.result_payload;
+    searcher_thread->result_limit = config.result_limit;
+    searcher_thread->state = state;
+    searcher_thread->mode = mode;
+    searcher_thread->matches = 0;
+    searcher_thread->bitmap = NULL;
+    searcher_thread->context_before = mode == F_SEARCH_RESULTS ? config.context_before : 0;
+    searcher_thread->context_after = mode == F_SEARCH_RESULTS ? config.context_after : 0;
+    searcher_thread->column = config.column;
+    searcher_thread->stats = config.stats;
+    searcher_thread->started = 0;
+    searcher_thread->busy = 0;
+    atomic_init(&searcher_thread->done, false);
+
+    if (mode == F_SEARCH_BITMAP && f_bitmap_init(&searcher_thread->bitmap) == -1)
+    {
+      f_log(F_LOG_ERROR, "failed to allocate bitmap");
+      f_search_batch_free(searcher_thread->batch);
+      free(searcher_thread);
+      f_search_handle_free(&handle);
+      return -1;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    state->running++;
+    pthread_mutex_unlock(&state->lock);
+
+    if (f_runtime_spawn(&handle->tasks[i], config.runtime, f_index_search_thread, searcher_thread) != 0)
+    {
+      // already created threads stop at their next buffer.
+      f_log(F_LOG_ERROR, "Couldn't create thread %d", i);
+      pthread_mutex_lock(&state->lock);
+      state->running--;
+      pthread_mutex_unlock(&state->lock);
+
+      if (searcher_thread->bitmap != NULL)
+      {
+        f_bitmap_free(&searcher_thread->bitmap);
+      }
+      f_search_batch_free(searcher_thread->batch);
+      free(searcher_thread);
+      f_search_handle_free(&handle);
+      return -1;
+    }
+
+    handle->threads[i] = searcher_thread;
+    handle->len++;
+  }
+
+  *out = handle;
+  return 0;
+}
+
+int f_index_search_start(f_search_handle** out, f_searcher config)
+{
+  return f_index_search_begin(out, config, F_SEARCH_RESULTS, true);
+}
+
+bool f_search_handle_poll(f_search_handle* handle, double* progress)
+{
+  f_search_state* state = &handle->state;
+
+  if (progress != NULL)
+  {
+    double total = 0.0;
+    for (int p=0; p<handle->len; p++)
+    {
+      total += (atomic_load_explicit(&handle->threads[p]->progress, memory_order_relaxed) / (double) handle->len);
+    }
+    *progress = total;
+  }
+
+  if (f_cancel_state_poll(&state->cancel) != F_CANCEL_NONE)
+  {
+    // wake threads waiting on the reorder window.
+    f_search_state_stop(state);
+  }
+
+  pthread_mutex_lock(&state->lock);
+  bool done = state->running == 0;
+  pthread_mutex_unlock(&state->lock);
+  return done;
+}
+
+int f_search_handle_next_batch(f_search_batch** out, f_search_handle* handle)
+{
+  f_search_state* state = &handle->state;
+  *out = NULL;
+
+  // the consumer may have cancelled from its own callback.
+  if (f_cancel_state_poll(&state->cancel) != F_CANCEL_NONE)
+  {
+    return 0;
+  }
+
+  if (handle->ready == NULL)
+  {
+    pthread_mutex_lock(&state->lock);
+    f_search_handle_take(handle);
+    pthread_mutex_unlock(&state->lock);
+  }
+
+  while (handle->ready != NULL)
+  {
+    f_search_batch* batch = handle->ready;
+    handle->ready = batch->next;
+    if (handle->ready == NULL)
+    {
+      handle->ready_tail = NULL;
+    }
+    batch->next = NULL;
+
+    // ordered blocks without matches still pass through here.
+    if (batch->len == 0)
+    {
+      f_search_batch_free(batch);
+      continue;
+    }
+
+    *out = batch;
+    return 0;
+  }
+
+  return 0;
+}
+
+int f_search_handle_wait(f_search_handle* handle)
+{
+  f_search_state* state = &handle->state;
+
+  if (handle->joined)
+  {
+    return handle->rc;
+  }
+
+  pthread_mutex_lock(&state->lock);
+  while (state->running > 0)
+  {
+    // keep the reorder window moving, nobody else drains it now.
+    if (state->single_consumer)
+    {
+      f_search_handle_take(handle);
+    }
+    pthread_cond_wait(&state->ready_cond, &state->lock);
+  }
+  pthread_mutex_unlock(&state->lock);
+
+  for (int i=0; i<handle->len; i++)
+  {
+    if (f_runtime_join(handle->tasks[i], NULL) != 0)
+    {
+      perror("can't join searcher thread");
+      f_log(F_LOG_WARN, "Can't joint thread %d", i);
+    }
+  }
+  handle->joined = true;
+
+  if (handle->config.stats != NULL)
+  {
+    f_stats_add(handle->config.stats, F_STATS_LINES, handle->lines);
+    f_stats_finish(handle->config.stats, handle->started, handle->len);
+  }
+
+  // only a search that was stopped early counts as cancelled.
+  int reason = atomic_load(&state->cancel.reason);
+  if (reason != F_CANCEL_NONE)
+  {
+    f_search_handle_discard(handle);
+    f_cancel_state_errno(&state->cancel);
+    handle->rc = reason == F_CANCEL_FAILED ? -1 : F_CANCELLED;
+  }
+
+  return handle->rc;
+}
+
+void f_search_handle_free(f_search_handle** handleref)
+{
+  f_search_handle* handle = *handleref;
+  f_search_state* state = &handle->state;
+
+  if (!handle->joined)
+  {
+    f_search_state_stop(state);
+    f_search_handle_wait(handle);
+  }
+
+  f_search_handle_discard(handle);
+
+  for (int i=0; i<handle->len; i++)
+  {
+    if (handle->threads[i]->bitmap != NULL)
+    {
+      f_bitmap_free(&handle->threads[i]->bitmap);
+    }
+
+    f_search_batch_free(handle->threads[i]->batch);
+    free(handle->threads[i]);
+  }
+
+  free(state->window);
+  free(handle->threads);
+  free(handle->tasks);
+  pcre2_code_free(handle->regex);
+  if (state->trigrams != NULL)
+  {
+    f_trigram_query_free(&state->trigrams);
+  }
+  pthread_cond_destroy(&state->ready_cond);
+  pthread_cond_destroy(&state->window_cond);
+  pthread_mutex_destroy(&state->lock);
+  free(handle);
+  *handleref = NULL;
+}
+
+/*
+  the blocking searches run on a handle from the calling thread.
+  count and bitmap searches collect per thread and combine once the threads are joined.
+*/
+int f_index_search_run(f_searcher config, enum F_SEARCH_MODE mode, size_t* count, f_bitmap** bitmap)
+{
+  bool queued = config.single_consumer && config.on_result != NULL && mode == F_SEARCH_RESULTS;
+
+  f_search_handle* handle;
+  int rc = f_index_search_begin(&handle, config, mode, queued);
+  if (rc != 0)
+  {
+    return rc;
+  }
+
+  // report progress and any new results until the threads are done.
+  double progress;
+  bool done = false;
+  while (!done)
+  {
+    done = f_search_handle_poll(handle, &progress);
+
+    f_search_batch* batch;
+    while (queued && f_search_handle_next_batch(&batch, handle) == 0 && batch != NULL)
+    {
+      f_search_deliver(batch, config.on_result, config.result_payload);
+    }
+
+    if (config.on_progress != NULL)
+    {
+      config.on_progress(progress, config.progress_payload);
+    }
+
+    if (!done)
+    {
+      f_search_handle_idle(handle, 10);
+    }
+  }
+
+  rc = f_search_handle_wait(handle);
+
+  if (count != NULL)
+  {
+    *count = 0;
+  }
+
+  for (int i=0; i<handle->len && rc == 0; i++)
+  {
+    if (count != NULL)
+    {
+      *count += handle->threads[i]->matches;
+    }
+
+    // thread ranges are ascending, so this mostly appends containers.
+    if (handle->threads[i]->bitmap != NULL && f_bitmap_merge(*bitmap, handle->threads[i]->bitmap) == -1)
+    {
+      f_log(F_LOG_ERROR, "failed to merge bitmap");
+      rc = -1;
+    }
+  }
+
+  f_search_handle_free(&handle);
+  return rc;
+}
+
+int f_index_search(f_searcher config)
+{
+  return f_index_search_run(config, F_SEARCH_RESULTS, NULL, NULL);
+}
+
+int f_index_search_count(f_searcher config, size_t* out)
+{
+  return f_index_search_run(config, F_SEARCH_COUNT, out, NULL);
+}
+
+int f_index_search_bitmap(f_searcher config, f_bitmap** out)
+{
+  f_bitmap* bitmap;
+  if (f_bitmap_init(&bitmap) == -1)
+  {
+    f_log(F_LOG_ERROR, "failed to allocate bitmap");
+    return -1;
+  }
+
+  int rc = f_index_search_run(config, F_SEARCH_BITMAP, NULL, &bitmap);
+  if (rc != 0)
   {
-    free(searcher_threads[i]);
+    f_bitmap_free(&bitmap);
+    return rc;
   }
 
-  free(searcher_threads);
-  free(thread_ids);
-  free(result_count);
-  pcre2_code_free(re);
-  pthread_mutex_destroy(&search_mutex);
+  *out = bitmap;
   return 0;
 }
 
@@ -17,11 +17,19 @@
 * @var FSearchResult::str
 * the full line that matched
 * @var FSearchResult::matches_substring_offset
-* An array of offsets for each match
+* An array of offsets for each match, allocated with the result
 * @var FSearchResult::matches_substring_len
-* An array of match lengths
+* An array of match lengths, allocated with the result
 * @var FSearchResult::matches_len
 * The number of matches
+* @var FSearchResult::before
+* The context lines before the match, newline separated (NULL if there are none)
+* @var FSearchResult::before_len
+* The number of context lines before the match
+* @var FSearchResult::after
+* The context lines after the match, newline separated (NULL if there are none)
+* @var FSearchResult::after_len
+* The number of context lines after the match
 */
 typedef struct FSearchResult {
   size_t line_number;
@@ -29,6 +37,10 @@ typedef struct FSearchResult {
   size_t* matches_substring_offset;
   size_t* matches_substring_len;
   unsigned int matches_len;
+  char* before;
+  unsigned int before_len;
+  char* after;
+  unsigned int after_len;
 } f_search_result;
 
 /** @struct FSearchResults
@@ -46,9 +58,109 @@ typedef struct FSearchResults {
   struct FSearchResults* next;
 } f_search_results;
 
+/**
+* @brief what a search collects for each matching line
+*/
+enum F_SEARCH_MODE
+{
+  F_SEARCH_RESULTS = 0, /**< an FSearchResult for each match */
+  F_SEARCH_COUNT, /**< only the number of matching lines */
+  F_SEARCH_BITMAP /**< the matching line numbers, as an FBitmap */
+};
+
 typedef void (*searcher_progress_cb)(double progress, void* payload);
 typedef void (*searcher_cb)(f_search_result* result, void* payload);
 
+/** @struct FSearchBatch
+* @brief a batch of search results collected by a single thread
+*
+* Threads collect matches into a batch and flush the whole
+* batch at once, instead of synchronizing on every match.
+* @var FSearchBatch::results
+* The collected results
+* @var FSearchBatch::len
+* The number of collected results
+* @var FSearchBatch::cap
+* The capacity of the results array
+* @var FSearchBatch::next
+* The next batch waiting to be consumed
+*/
+typedef struct FSearchBatch {
+  f_search_result** results;
+  unsigned int len;
+  unsigned int cap;
+  struct FSearchBatch* next;
+} f_search_batch;
+
+/** @struct FSearchState
+* @brief state shared between the threads of one search
+*
+* Every call to `f_index_search` owns its own state,
+* so concurrent searches in one process don't contend with each other.
+* @var FSearchState::lock
+* Serializes batch flushes
+* @var FSearchState::result_count
+* The current number of results
+* @var FSearchState::result_limit
+* The max number of results
+* @var FSearchState::result_batch
+* The initial capacity of each batch
+* @var FSearchState::single_consumer
+* true if batches are queued for the calling thread
+* @var FSearchState::stop
+* true once the threads should stop searching
+* @var FSearchState::pending
+* Batches waiting to be consumed (single consumer only)
+* @var FSearchState::pending_tail
+* The last pending batch
+* @var FSearchState::ordered
+* true if results are delivered in ascending line order
+* @var FSearchState::window
+* The reorder window, one completed batch per slot (ordered only)
+* @var FSearchState::window_len
+* How many blocks can be buffered ahead of the last delivered block
+* @var FSearchState::window_cond
+* Signaled when the window has room for more blocks
+* @var FSearchState::reverse
+* true if blocks are claimed, and lines matched, from the end of the range
+* @var FSearchState::block_count
+* The number of blocks of `line_buffer` lines to search
+* @var FSearchState::next_block
+* The next block to claim
+* @var FSearchState::emit_block
+* The next block to deliver
+* @var FSearchState::cancel
+* The cancellation token and deadline of this search
+* @var FSearchState::ready_cond
+* Signaled when a batch is queued or a thread exits
+* @var FSearchState::running
+* The number of threads still searching
+* @var FSearchState::trigrams
+* The trigrams a match must contain, when the index has a trigram index (NULL if unused)
+*/
+typedef struct FSearchState {
+  pthread_mutex_t lock;
+  atomic_int result_count;
+  int result_limit;
+  unsigned int result_batch;
+  bool single_consumer;
+  atomic_bool stop;
+  f_search_batch* pending;
+  f_search_batch* pending_tail;
+  bool ordered;
+  f_search_batch** window;
+  size_t window_len;
+  pthread_cond_t window_cond;
+  bool reverse;
+  size_t block_count;
+  size_t next_block;
+  size_t emit_block;
+  f_cancel_state cancel;
+  pthread_cond_t ready_cond;
+  int running;
+  f_trigram_query* trigrams;
+} f_search_state;
+
 /** @struct FSearcher
 * @brief a config to pass to f_index_search
 *
@@ -61,7 +173,7 @@ typedef void (*searcher_cb)(f_search_result* result, void* payload);
 * @var FSearcher::result_limit
 * The maximum number of results returned
 * @var FSearcher::line_buffer
-* How many lines to read from disk on a search iteration
+* How many lines to read from disk on a search iteration (at least 1)
 * @var FSearcher::on_progress
 * Progress callback
 * @var FSearcher::progress_payload
@@ -70,6 +182,36 @@ typedef void (*searcher_cb)(f_search_result* result, void* payload);
 * Search result callback
 * @var FSearcher::result_payload
 * Payload for result callback
+* @var FSearcher::result_batch
+* How many results a thread collects before flushing them (0 for the default)
+* @var FSearcher::single_consumer
+* If true, `on_result` is called from the calling thread instead of the search threads
+* @var FSearcher::ordered
+* If true, results are delivered in ascending line order and `result_limit` keeps the first matches in the file
+* @var FSearcher::reorder_window
+* How many blocks of `line_buffer` lines an ordered search may buffer ahead of the last delivered block (0 for the default)
+* @var FSearcher::cancel
+* A token to cancel the search from another thread (NULL if unused)
+* @var FSearcher::timeout_ms
+* Cancel the search after this many milliseconds (0 for no deadline)
+* @var FSearcher::start_line
+* The first line number to search (0 for the first line)
+* @var FSearcher::end_line
+* The last line number to search, inclusive (0 for the last line)
+* @var FSearcher::reverse
+* If true, lines are searched from `end_line` backwards and results are delivered in descending line order, as if `ordered` was set
+* @var FSearcher::context_before
+* How many lines before each match to attach to its result (like grep -B)
+* @var FSearcher::context_after
+* How many lines after each match to attach to its result (like grep -A)
+* @var FSearcher::column
+* Only match the regex against this column, 1 based, the index needs a field index (0 for the whole line).
+* Quotes are part of the column, match offsets stay relative to the line
+* @var FSearcher::stats
+* Filled in with counters and stage timings of the search, initialized by the caller with f_stats_init (NULL if unused).
+* They are complete once the search was waited on
+* @var FSearcher::runtime
+* The thread pool to run the search threads on (NULL for threads of their own)
 */
 typedef struct FSearcher {
   char* regex;
@@ -81,8 +223,58 @@ typedef struct FSearcher {
   void* progress_payload;
   searcher_cb on_result;
   void* result_payload;
+  unsigned int result_batch;
+  bool single_consumer;
+  bool ordered;
+  unsigned int reorder_window;
+  f_cancel* cancel;
+  unsigned long timeout_ms;
+  size_t start_line;
+  size_t end_line;
+  bool reverse;
+  unsigned int context_before;
+  unsigned int context_after;
+  size_t column;
+  f_stats* stats;
+  f_runtime* runtime;
 } f_searcher;
 
+/** @struct FSearchContext
+* @brief context collected while a thread matches one buffer
+*
+* Lines are counted in the order they are scanned. "ahead" is the
+* side of a match that hasn't been scanned yet, "behind" the side that has.
+* @var FSearchContext::result
+* The last result, held back until its context ahead is collected (NULL if none)
+* @var FSearchContext::open
+* true while the last match still claims the lines ahead of it
+* @var FSearchContext::open_line
+* The scan position of the last match
+* @var FSearchContext::covered
+* The scan position of the last line that is a match or context
+* @var FSearchContext::lines
+* The number of lines collected ahead of the last match
+* @var FSearchContext::lo
+* The start of the lines collected ahead
+* @var FSearchContext::hi
+* The end of the lines collected ahead
+* @var FSearchContext::ring
+* The last `behind` lines scanned
+* @var FSearchContext::ring_len
+* The length of each line in `ring`
+*/
+typedef struct FSearchContext {
+  f_search_result* result;
+  bool open;
+  size_t open_line;
+  size_t covered;
+  unsigned int lines;
+  char* lo;
+  char* hi;
+  char** ring;
+  size_t* ring_len;
+} f_search_context;
+
 /** @struct FSearcherThread
 * @brief search config is passed to each thread
 *
@@ -99,10 +291,32 @@ typedef struct FSearcher {
 * How many lines to read from disk at a time
 * @var FSearcherThread::result_limit
 * The max number of results
-* @var FSearcherThread::result_count
-* The current number of results
+* @var FSearcherThread::state
+* The state shared with the other threads of this search
+* @var FSearcherThread::batch
+* The results collected by this thread and not yet flushed
+* @var FSearcherThread::mode
+* What to collect for each match
+* @var FSearcherThread::matches
+* The number of matching lines (count and bitmap modes)
+* @var FSearcherThread::bitmap
+* The matching line numbers (bitmap mode)
 * @var FSearcherThread::progress
-* This threads progress
+* This threads progress, read by the thread polling the search
+* @var FSearcherThread::done
+* true once the thread has flushed its results and is about to exit
+* @var FSearcherThread::context_before
+* How many lines before each match to attach
+* @var FSearcherThread::context_after
+* How many lines after each match to attach
+* @var FSearcherThread::column
+* The column to match against, 1 based (0 for the whole line)
+* @var FSearcherThread::stats
+* Where to count reads and timings (NULL if unused)
+* @var FSearcherThread::started
+* When the thread started (only with stats)
+* @var FSearcherThread::busy
+* The nanoseconds this thread spent reading and matching (only with stats)
 * @var FSearcherThread::on_result
 * Result callback
 * @var FSearcherThread::result_payload
@@ -116,12 +330,71 @@ typedef struct FSearcherThread {
   size_t count;
   size_t buffer;
   int result_limit;
-  int* result_count;
-  double progress;
+  f_search_state* state;
+  f_search_batch* batch;
+  enum F_SEARCH_MODE mode;
+  size_t matches;
+  f_bitmap* bitmap;
+  _Atomic double progress;
+  atomic_bool done;
+  unsigned int context_before;
+  unsigned int context_after;
+  size_t column;
+  f_stats* stats;
+  uint64_t started;
+  uint64_t busy;
   searcher_cb on_result;
   void* result_payload;
 } f_searcher_thread;
 
+/** @struct FSearchHandle
+* @brief a search running in the background
+*
+* Created by `f_index_search_start`, the caller polls it for
+* progress and pulls batches of results at its own pace.
+* @var FSearchHandle::state
+* The state shared with the search threads
+* @var FSearchHandle::regex
+* The compiled search term
+* @var FSearchHandle::threads
+* The search threads
+* @var FSearchHandle::tasks
+* The tasks the search threads run as, on the runtime or on threads of their own
+* @var FSearchHandle::len
+* The number of threads that were started
+* @var FSearchHandle::mode
+* What the threads collect for each match
+* @var FSearchHandle::joined
+* true once the threads have been joined
+* @var FSearchHandle::rc
+* The result of the search, once joined
+* @var FSearchHandle::ready
+* Batches taken from the threads and not yet handed out
+* @var FSearchHandle::ready_tail
+* The last ready batch
+* @var FSearchHandle::config
+* The config the search was started with
+* @var FSearchHandle::started
+* When the search was started (only with stats)
+* @var FSearchHandle::lines
+* The number of lines in the searched range
+*/
+typedef struct FSearchHandle {
+  f_search_state state;
+  pcre2_code* regex;
+  f_searcher_thread** threads;
+  f_runtime_task** tasks;
+  int len;
+  enum F_SEARCH_MODE mode;
+  bool joined;
+  int rc;
+  f_search_batch* ready;
+  f_search_batch* ready_tail;
+  f_searcher config;
+  uint64_t started;
+  size_t lines;
+} f_search_handle;
+
 /**
   Initializes a search result
 
@@ -158,18 +431,113 @@ void f_search_results_prepend(f_search_results** results, f_search_result* addit
 */
 void f_search_results_free(f_search_results** results);
 
+/**
+  Allocates a new search batch
+
+  @param out the search batch
+  @param cap how many results the batch can hold
+  @return non zero for error
+*/
+int f_search_batch_init(f_search_batch** out, unsigned int cap);
+
+/**
+  Free a search batch and any results left in it.
+
+  @param batch the batch to free
+*/
+void f_search_batch_free(f_search_batch* batch);
+
 /**
   Searches an index concurrently
 
   Note: search results can only be aggregated through
   the `on_result` callback.
 
-  @param out the search results
+  Threads stop between buffers once `cancel` is requested
+  or `timeout_ms` has passed. Results queued but not yet
+  delivered are dropped, and errno is set to ECANCELED or ETIMEDOUT.
+
   @param config the search config
-  @return non zero for error, -2 for invalid regex.
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
 */
 int f_index_search(f_searcher config);
 
+/**
+  Starts searching an index in the background
+
+  Results are queued on the handle instead of being sent to `on_result`,
+  so they are consumed on the callers thread with `f_search_handle_next_batch`.
+  `on_progress` is not called, use `f_search_handle_poll` instead.
+
+  @param out the search handle
+  @param config the search config
+  @return non zero for error, -2 for invalid regex.
+*/
+int f_index_search_start(f_search_handle** out, f_searcher config);
+
+/**
+  Checks on a search without blocking
+
+  Also enforces the deadline and cancellation token of the search.
+  @param handle the search handle
+  @param progress the progress of the search (0 - 1), can be NULL
+  @return true once every search thread is done
+*/
+bool f_search_handle_poll(f_search_handle* handle, double* progress);
+
+/**
+  Takes the next batch of results without blocking
+
+  With `ordered` set, batches come out in ascending line order,
+  descending with `reverse`.
+  The caller owns the batch and frees it with `f_search_batch_free`.
+  @param out the next batch, NULL if none are ready yet
+  @param handle the search handle
+  @return non zero for error
+*/
+int f_search_handle_next_batch(f_search_batch** out, f_search_handle* handle);
+
+/**
+  Blocks until every search thread is done
+
+  Results that weren't taken stay on the handle for `f_search_handle_next_batch`,
+  unless the search was cancelled.
+  @param handle the search handle
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_search_handle_wait(f_search_handle* handle);
+
+/**
+  Stops the search if it is still running and frees the handle
+  @param handle the search handle
+*/
+void f_search_handle_free(f_search_handle** handle);
+
+/**
+  Counts the lines of an index that match
+
+  No result is allocated per match, `on_result`, `ordered`
+  and `result_limit` are ignored.
+
+  @param config the search config
+  @param out the number of matching lines
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
+*/
+int f_index_search_count(f_searcher config, size_t* out);
+
+/**
+  Collects the line numbers of an index that match
+
+  Line numbers are the same as `FSearchResult::line_number`.
+  No result is allocated per match, `on_result`, `ordered`
+  and `result_limit` are ignored.
+
+  @param config the search config
+  @param out the matching line numbers, free with `f_bitmap_free`
+  @return non zero for error, -2 for invalid regex, F_CANCELLED if cancelled.
+*/
+int f_index_search_bitmap(f_searcher config, f_bitmap** out);
+
 
 
 #endif
@@ -0,0 +1,130 @@
+#ifndef FLASHLIGHT_STATS
+#define FLASHLIGHT_STATS
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+void f_stats_init(f_stats* stats)
+{
+  atomic_init(&stats->bytes_read, 0);
+  atomic_init(&stats->reads, 0);
+  atomic_init(&stats->read_ns, 0);
+  for (int i=0; i<F_STATS_BUCKETS; i++)
+  {
+    atomic_init(&stats->read_latency[i], 0);
+  }
+  atomic_init(&stats->scan_ns, 0);
+  atomic_init(&stats->merge_ns, 0);
+  atomic_init(&stats->match_ns, 0);
+  atomic_init(&stats->lines, 0);
+  atomic_init(&stats->matches, 0);
+  for (int i=0; i<F_STATS_THREADS; i++)
+  {
+    atomic_init(&stats->busy_ns[i], 0);
+    atomic_init(&stats->idle_ns[i], 0);
+  }
+  stats->threads = 0;
+  stats->elapsed_ns = 0;
+  stats->lines_per_sec = 0.0;
+  stats->peak_rss = 0;
+}
+
+uint64_t f_stats_now()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+void f_stats_read(f_stats* stats, size_t bytes, uint64_t started)
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+
+  uint64_t elapsed = f_stats_now() - started;
+  atomic_fetch_add_explicit(&stats->bytes_read, bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->reads, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->read_ns, elapsed, memory_order_relaxed);
+
+  int bucket = 0;
+  for (uint64_t us = elapsed / 1000; us > 0 && bucket < F_STATS_BUCKETS - 1; us >>= 1)
+  {
+    bucket++;
+  }
+  atomic_fetch_add_explicit(&stats->read_latency[bucket], 1, memory_order_relaxed);
+}
+
+void f_stats_add(f_stats* stats, enum F_STATS_STAGE stage, uint64_t value)
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+
+  switch (stage)
+  {
+    case F_STATS_SCAN:
+      atomic_fetch_add_explicit(&stats->scan_ns, value, memory_order_relaxed);
+      break;
+    case F_STATS_MERGE:
+      atomic_fetch_add_explicit(&stats->merge_ns, value, memory_order_relaxed);
+      break;
+    case F_STATS_MATCH:
+      atomic_fetch_add_explicit(&stats->match_ns, value, memory_order_relaxed);
+      break;
+    case F_STATS_LINES:
+      atomic_fetch_add_explicit(&stats->lines, value, memory_order_relaxed);
+      break;
+    case F_STATS_MATCHES:
+      atomic_fetch_add_explicit(&stats->matches, value, memory_order_relaxed);
+      break;
+  }
+}
+
+uint64_t f_stats_since(f_stats* stats, enum F_STATS_STAGE stage, uint64_t started)
+{
+  if (stats == NULL)
+  {
+    return 0;
+  }
+
+  uint64_t elapsed = f_stats_now() - started;
+  f_stats_add(stats, stage, elapsed);
+  return elapsed;
+}
+
+void f_stats_thread(f_stats* stats, int thread, uint64_t started, uint64_t busy)
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+
+  uint64_t elapsed = f_stats_now() - started;
+  int slot = thread < F_STATS_THREADS ? thread : F_STATS_THREADS - 1;
+  atomic_fetch_add_explicit(&stats->busy_ns[slot], busy, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->idle_ns[slot], elapsed > busy ? elapsed - busy : 0, memory_order_relaxed);
+}
+
+void f_stats_finish(f_stats* stats, uint64_t started, int threads)
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+
+  stats->threads = threads;
+  stats->elapsed_ns = f_stats_now() - started;
+  stats->lines_per_sec = stats->elapsed_ns > 0 ? (double) atomic_load(&stats->lines) * 1e9 / (double) stats->elapsed_ns : 0.0;
+
+  // ru_maxrss is in kilobytes on linux.
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+    stats->peak_rss = (size_t) usage.ru_maxrss * 1024;
+  }
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef FLASHLIGHT_STATS_H
+#define FLASHLIGHT_STATS_H
+
+/** @file stats.h
+* @brief Counters and stage timings of an indexing run or a search
+*
+* The caller owns the stats and passes them on the `f_indexer` or `f_searcher`,
+* threads add to them as they go. Nothing is measured when no stats are given.
+* Times are in nanoseconds, and summed over every thread.
+*/
+
+// read latency buckets, bucket i counts reads that took under 2^i microseconds, the last one the slower ones.
+#define F_STATS_BUCKETS 20
+// threads timed on their own, threads past these share the last slots.
+#define F_STATS_THREADS 64
+
+/**
+* @brief the stage a time or count is added to
+*/
+enum F_STATS_STAGE
+{
+  F_STATS_SCAN = 0, /**< finding record ends in the bytes read */
+  F_STATS_MERGE, /**< reducing chunks and writing the lookup */
+  F_STATS_MATCH, /**< running the regex */
+  F_STATS_LINES, /**< lines indexed or searched */
+  F_STATS_MATCHES /**< lines that matched */
+};
+
+/** @struct FStats
+* @brief where the time of an indexing run or a search went
+* @var FStats::bytes_read
+* the bytes read from the target
+* @var FStats::reads
+* the reads of the target
+* @var FStats::read_ns
+* the time spent reading
+* @var FStats::read_latency
+* the reads by latency, see F_STATS_BUCKETS
+* @var FStats::scan_ns
+* the time spent finding record ends
+* @var FStats::merge_ns
+* the time spent reducing chunks and writing the lookup
+* @var FStats::match_ns
+* the time spent in pcre2
+* @var FStats::lines
+* the lines indexed or searched
+* @var FStats::matches
+* the lines that matched
+* @var FStats::busy_ns
+* the time each thread spent reading, scanning or matching
+* @var FStats::idle_ns
+* the time each thread spent waiting, or in between
+* @var FStats::threads
+* the number of threads used
+* @var FStats::elapsed_ns
+* the wall time of the whole operation
+* @var FStats::lines_per_sec
+* lines over elapsed time
+* @var FStats::peak_rss
+* the peak resident memory of the process in bytes, when the operation finished
+*/
+typedef struct FStats
+{
+  atomic_ullong bytes_read;
+  atomic_ullong reads;
+  atomic_ullong read_ns;
+  atomic_ullong read_latency[F_STATS_BUCKETS];
+  atomic_ullong scan_ns;
+  atomic_ullong merge_ns;
+  atomic_ullong match_ns;
+  atomic_ullong lines;
+  atomic_ullong matches;
+  atomic_ullong busy_ns[F_STATS_THREADS];
+  atomic_ullong idle_ns[F_STATS_THREADS];
+  int threads;
+  uint64_t elapsed_ns;
+  double lines_per_sec;
+  size_t peak_rss;
+} f_stats;
+
+/**
+  Resets stats to zero
+  @param stats the stats
+*/
+void f_stats_init(f_stats* stats);
+
+/**
+  A monotonic clock
+  @return nanoseconds
+*/
+uint64_t f_stats_now();
+
+/**
+  Counts a read of the target
+  @param stats the stats (NULL if unused)
+  @param bytes the bytes read
+  @param started when the read started, from f_stats_now
+*/
+void f_stats_read(f_stats* stats, size_t bytes, uint64_t started);
+
+/**
+  Adds to the time or count of a stage
+  @param stats the stats (NULL if unused)
+  @param stage the stage
+  @param value nanoseconds, or a count
+*/
+void f_stats_add(f_stats* stats, enum F_STATS_STAGE stage, uint64_t value);
+
+/**
+  Adds the time since `started` to a stage
+  @param stats the stats (NULL if unused)
+  @param stage the stage
+  @param started from f_stats_now
+  @return the nanoseconds added
+*/
+uint64_t f_stats_since(f_stats* stats, enum F_STATS_STAGE stage, uint64_t started);
+
+/**
+  Records how a thread spent its time once it is done
+  @param stats the stats (NULL if unused)
+  @param thread the thread index
+  @param started when the thread started, from f_stats_now
+  @param busy the nanoseconds it spent working
+*/
+void f_stats_thread(f_stats* stats, int thread, uint64_t started, uint64_t busy);
+
+/**
+  Fills in the totals once the operation is done
+  @param stats the stats (NULL if unused)
+  @param started when the operation started, from f_stats_now
+  @param threads the number of threads used
+*/
+void f_stats_finish(f_stats* stats, uint64_t started, int threads);
+
+#endif
@@ -0,0 +1,431 @@
+#ifndef FLASHLIGHT_TIMESTAMP
+#define FLASHLIGHT_TIMESTAMP
+
+#include "timestamp.h"
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+static const char* f_timestamp_months[12] = {
+  "jan", "feb", "mar", "apr", "may", "jun",
+  "jul", "aug", "sep", "oct", "nov", "dec"
+};
+
+/*
+  days since 1970-01-01 of a date in the proleptic gregorian calendar.
+*/
+static int64_t f_timestamp_days(int64_t year, int64_t month, int64_t day)
+{
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+/*
+  reads up to `max` digits, at least one.
+*/
+static int f_timestamp_digits(int64_t* out, const char** cursor, const char* end, int max)
+{
+  const char* c = *cursor;
+  int64_t value = 0;
+  int read = 0;
+  while (c < end && read < max && isdigit((unsigned char) *c))
+  {
+    value = value * 10 + (*c - '0');
+    c++;
+    read++;
+  }
+
+  if (read == 0)
+  {
+    return -1;
+  }
+
+  *out = value;
+  *cursor = c;
+  return 0;
+}
+
+int f_timestamp_parse(int64_t* out, const char* text, size_t len, const char* format)
+{
+  const char* c = text;
+  const char* end = text + len;
+  int64_t year = 1970, month = 1, day = 1, hour = 0, minute = 0, second = 0, millis = 0, offset = 0;
+  int64_t epoch = 0;
+  bool has_epoch = false;
+
+  for (const char* f=format; *f != '\0'; f++)
+  {
+    if (*f == ' ')
+    {
+      while (c < end && isspace((unsigned char) *c))
+      {
+        c++;
+      }
+      continue;
+    }
+
+    if (*f != '%' || f[1] == '%')
+    {
+      f += *f == '%';
+      if (c >= end || *c != *f)
+      {
+        return -1;
+      }
+      c++;
+      continue;
+    }
+
+    f++;
+    int rc = 0;
+    switch (*f)
+    {
+      case 'Y':
+        rc = f_timestamp_digits(&year, &c, end, 4);
+        break;
+      case 'y':
+        rc = f_timestamp_digits(&year, &c, end, 2);
+        year += year < 69 ? 2000 : 1900;
+        break;
+      case 'm':
+        rc = f_timestamp_digits(&month, &c, end, 2);
+        break;
+      case 'd':
+      case 'e':
+        // syslog pads single digit days with a space.
+        if (c < end && *c == ' ')
+        {
+          c++;
+        }
+        rc = f_timestamp_digits(&day, &c, end, 2);
+        break;
+      case 'H':
+        rc = f_timestamp_digits(&hour, &c, end, 2);
+        break;
+      case 'M':
+        rc = f_timestamp_digits(&minute, &c, end, 2);
+        break;
+      case 'S':
+        rc = f_timestamp_digits(&second, &c, end, 2);
+        break;
+      case 'f':
+      {
+        const char* start = c;
+        rc = f_timestamp_digits(&millis, &c, end, 3);
+        for (long digits=c - start; rc == 0 && digits < 3; digits++)
+        {
+          millis *= 10;
+        }
+        // precision past milliseconds is dropped.
+        while (c < end && isdigit((unsigned char) *c))
+        {
+          c++;
+        }
+        break;
+      }
+      case 'b':
+      {
+        rc = -1;
+        for (int i=0; i<12 && end - c >= 3; i++)
+        {
+          if (strncasecmp(c, f_timestamp_months[i], 3) == 0)
+          {
+            month = i + 1;
+            rc = 0;
+            break;
+          }
+        }
+        // full month names.
+        while (rc == 0 && c < end && isalpha((unsigned char) *c))
+        {
+          c++;
+        }
+        break;
+      }
+      case 'z':
+      {
+        if (c < end && *c == 'Z')
+        {
+          c++;
+          break;
+        }
+
+        if (c >= end || (*c != '+' && *c != '-'))
+        {
+          rc = -1;
+          break;
+        }
+
+        int64_t sign = *c == '-' ? -1 : 1;
+        int64_t hours = 0;
+        int64_t minutes = 0;
+        c++;
+        rc = f_timestamp_digits(&hours, &c, end, 2);
+        if (rc == 0 && c < end && *c == ':')
+        {
+          c++;
+        }
+        if (rc == 0 && c < end && isdigit((unsigned char) *c))
+        {
+          rc = f_timestamp_digits(&minutes, &c, end, 2);
+        }
+        if (rc == 0)
+        {
+          offset = sign * (hours * 60 + minutes) * 60000;
+        }
+        break;
+      }
+      case 's':
+        rc = f_timestamp_digits(&epoch, &c, end, 18);
+        has_epoch = true;
+        break;
+      default:
+        f_log(F_LOG_ERROR, "unsupported timestamp directive %%%c", *f);
+        return -1;
+    }
+
+    if (rc != 0)
+    {
+      return -1;
+    }
+  }
+
+  if (has_epoch)
+  {
+    *out = epoch * 1000 + millis;
+    return 0;
+  }
+
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+  {
+    return -1;
+  }
+
+  int64_t seconds = f_timestamp_days(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  *out = seconds * 1000 + millis - offset;
+  return 0;
+}
+
+/*
+  finds the timestamp on a line, either at its start or where the regex points.
+*/
+static int f_timestamp_line(int64_t* out, const char* line, size_t len, const char* format, pcre2_code* regex, pcre2_match_data* match_data)
+{
+  if (regex == NULL)
+  {
+    return f_timestamp_parse(out, line, len, format);
+  }
+
+  int rc = pcre2_match(regex, (PCRE2_SPTR) line, len, 0, 0, match_data, NULL);
+  if (rc < 0)
+  {
+    return -1;
+  }
+
+  PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(match_data);
+  int group = rc > 1 && ovector[2] != PCRE2_UNSET ? 1 : 0;
+  return f_timestamp_parse(out, line + ovector[2 * group], ovector[2 * group + 1] - ovector[2 * group], format);
+}
+
+int f_time_index_build(f_time_index** out, f_index* index, const char* format, const char* regex, size_t every, f_cancel_state* cancel)
+{
+  size_t lines = f_index_line_count(index);
+  every = every == 0 ? F_TIMESTAMP_DEFAULT_EVERY : every;
+
+  pcre2_code* re = NULL;
+  pcre2_match_data* match_data = NULL;
+  if (regex != NULL)
+  {
+    int error_number;
+    PCRE2_SIZE error_offset;
+    re = pcre2_compile((PCRE2_SPTR) regex, PCRE2_ZERO_TERMINATED, 0, &error_number, &error_offset, NULL);
+    if (re == NULL)
+    {
+      PCRE2_UCHAR buffer[256];
+      pcre2_get_error_message(error_number, buffer, sizeof(buffer));
+      f_log(F_LOG_ERROR, "timestamp regex failed to compile at offset %d: %s", (int) error_offset, buffer);
+      return -1;
+    }
+
+    match_data = pcre2_match_data_create_from_pattern(re, NULL);
+    if (match_data == NULL)
+    {
+      pcre2_code_free(re);
+      return -1;
+    }
+  }
+
+  f_time_index* init = calloc(1, sizeof(*init));
+  if (init == NULL)
+  {
+    pcre2_match_data_free(match_data);
+    pcre2_code_free(re);
+    return -1;
+  }
+
+  init->every = every;
+  init->lines = lines;
+  init->len = (lines + every - 1) / every;
+
+  // one allocation for all three arrays.
+  init->times = malloc(sizeof(int64_t) * 3 * (init->len > 0 ? init->len : 1));
+  if (init->times == NULL)
+  {
+    pcre2_match_data_free(match_data);
+    pcre2_code_free(re);
+    free(init);
+    return -1;
+  }
+  init->prefix_max = init->times + init->len;
+  init->suffix_min = init->prefix_max + init->len;
+
+  int rc = 0;
+  for (size_t block=0; block<init->len; block++)
+  {
+    if (cancel != NULL && f_cancel_state_poll(cancel) != F_CANCEL_NONE)
+    {
+      rc = F_CANCELLED;
+      break;
+    }
+
+    size_t start = block * every;
+    size_t count = start + every > lines ? lines - start : every;
+    count = count > F_TIMESTAMP_PROBE ? F_TIMESTAMP_PROBE : count;
+
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "timestamp lookup failed to start: %zu buffer: %zu", start, count);
+      rc = -1;
+      break;
+    }
+
+    // the first line of the block that has a timestamp.
+    init->times[block] = F_TIMESTAMP_NONE;
+    for (size_t i=0; i<lookup.count; i++)
+    {
+      char* line;
+      size_t line_len;
+      f_index_lines_get(&lookup, i, &line, &line_len);
+
+      int64_t time;
+      if (f_timestamp_line(&time, line, line_len, format, re, match_data) == 0)
+      {
+        init->times[block] = time;
+        break;
+      }
+    }
+    f_index_lines_free(&lookup);
+  }
+
+  pcre2_match_data_free(match_data);
+  pcre2_code_free(re);
+
+  if (rc != 0)
+  {
+    f_time_index_free(&init);
+    return rc;
+  }
+
+  int64_t max = INT64_MIN;
+  for (size_t i=0; i<init->len; i++)
+  {
+    if (init->times[i] != F_TIMESTAMP_NONE && init->times[i] > max)
+    {
+      max = init->times[i];
+    }
+    init->prefix_max[i] = max;
+  }
+
+  int64_t min = INT64_MAX;
+  for (size_t i=init->len; i>0; i--)
+  {
+    if (init->times[i - 1] != F_TIMESTAMP_NONE && init->times[i - 1] < min)
+    {
+      min = init->times[i - 1];
+    }
+    init->suffix_min[i - 1] = min;
+  }
+
+  *out = init;
+  return 0;
+}
+
+int f_index_seek_time(f_index* index, int64_t from, int64_t to, size_t* start_line, size_t* end_line)
+{
+  f_time_index* times = index->times;
+  if (times == NULL)
+  {
+    return -2;
+  }
+
+  if (from > to)
+  {
+    f_log(F_LOG_ERROR, "time window ends before it starts");
+    return -1;
+  }
+
+  *start_line = 0;
+  *end_line = 0;
+
+  // the first block whose samples so far reach the window, prefix_max never decreases.
+  size_t lo = 0, hi = times->len;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (times->prefix_max[mid] == INT64_MIN || times->prefix_max[mid] < from)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  size_t first = lo;
+
+  // the first block whose samples from there on are all past the window, suffix_min never decreases either.
+  lo = 0;
+  hi = times->len;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (times->suffix_min[mid] <= to)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  size_t past = lo;
+
+  // lines before the first sample in the window belong to the block before it.
+  size_t start_block = first > 0 ? first - 1 : 0;
+  if (start_block >= past)
+  {
+    return 1;
+  }
+
+  // one more block on each side catches lines that are slightly out of order.
+  start_block = start_block > 0 ? start_block - 1 : 0;
+  size_t end_block = past + 1 < times->len ? past + 1 : times->len;
+
+  *start_line = start_block * times->every + 1;
+  *end_line = end_block * times->every > times->lines ? times->lines : end_block * times->every;
+  return 0;
+}
+
+void f_time_index_free(f_time_index** times)
+{
+  f_time_index* t = *times;
+  free(t->times);
+  free(t);
+  *times = NULL;
+}
+
+#endif
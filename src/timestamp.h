@@ -0,0 +1,91 @@
+#ifndef FLASHLIGHT_TIMESTAMP_H
+#define FLASHLIGHT_TIMESTAMP_H
+
+/** @file timestamp.h
+* @brief A sparse index of line timestamps, to seek to a time window
+*
+* The timestamp of every Kth line is parsed while indexing and kept in memory.
+* A running max from the start and a running min from the end make
+* the samples searchable even when lines are slightly out of order.
+*/
+
+#define F_TIMESTAMP_DEFAULT_EVERY 1024
+// lines read from the start of a block to find one with a timestamp.
+#define F_TIMESTAMP_PROBE 16
+// marks a block that had no timestamp.
+#define F_TIMESTAMP_NONE INT64_MIN
+
+/** @struct FTimeIndex
+* @brief the sampled timestamps of an index
+* @var FTimeIndex::every
+* the number of lines in each block, one sample per block
+* @var FTimeIndex::lines
+* the number of lines in the index
+* @var FTimeIndex::len
+* the number of blocks
+* @var FTimeIndex::times
+* the sample of each block in milliseconds since the epoch (F_TIMESTAMP_NONE if it had none)
+* @var FTimeIndex::prefix_max
+* the latest sample of the blocks up to and including each block
+* @var FTimeIndex::suffix_min
+* the earliest sample of each block and the blocks after it
+*/
+typedef struct FTimeIndex
+{
+  size_t every;
+  size_t lines;
+  size_t len;
+  int64_t* times;
+  int64_t* prefix_max;
+  int64_t* suffix_min;
+} f_time_index;
+
+/**
+  Parses a timestamp with a strptime like format
+
+  Supports %Y %y %m %d %e %b %H %M %S %f (fractional seconds) %z (Z or +hh[:]mm) %s (epoch seconds) and %%.
+  A space in the format matches any run of whitespace, other characters match themselves.
+  Fields that aren't in the format default to 1970-01-01 00:00:00 UTC.
+  @param out milliseconds since the epoch
+  @param text the text to parse, only its start has to match
+  @param len the length of text
+  @param format the format of the timestamp
+  @return non zero if text doesn't start with a timestamp
+*/
+int f_timestamp_parse(int64_t* out, const char* text, size_t len, const char* format);
+
+/**
+  Samples the timestamp of every `every` lines of an index
+
+  @param out the time index
+  @param index the index to read lines from
+  @param format the format of the timestamp, see f_timestamp_parse
+  @param regex where the timestamp is on a line, capture group 1 or else the whole match (NULL for the line start)
+  @param every the number of lines in each block (0 for the default)
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_time_index_build(f_time_index** out, f_index* index, const char* format, const char* regex, size_t every, f_cancel_state* cancel);
+
+/**
+  Finds the lines to search for a time window
+
+  The range covers every block that can have a line in the window,
+  plus one block on each side for lines that are out of order by less than a block.
+  The line numbers can be passed to `FSearcher::start_line` and `FSearcher::end_line`.
+  @param index an index built with a time format
+  @param from the start of the window in milliseconds since the epoch
+  @param to the end of the window, inclusive
+  @param start_line the first line, 1 based
+  @param end_line the last line, inclusive
+  @return 0 for a range, 1 if no line can be in the window, -1 for error, -2 if the index has no time index
+*/
+int f_index_seek_time(f_index* index, int64_t from, int64_t to, size_t* start_line, size_t* end_line);
+
+/**
+  Frees a time index
+  @param times the time index to free
+*/
+void f_time_index_free(f_time_index** times);
+
+#endif
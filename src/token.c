@@ -0,0 +1,753 @@
+#ifndef FLASHLIGHT_TOKEN
+#define FLASHLIGHT_TOKEN
+
+#include "token.h"
+#include <ctype.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static uint64_t f_token_hash(const unsigned char* token, size_t len)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i=0; i<len; i++)
+  {
+    hash ^= token[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static bool f_token_separator(enum F_TOKENIZER tokenizer, unsigned char c)
+{
+  if (tokenizer == F_TOKENIZER_WHITESPACE)
+  {
+    return isspace(c);
+  }
+
+  return !(isalnum(c) || c == '_' || c >= 0x80);
+}
+
+/*
+  finds the next token in [cursor, end).
+  returns its length, 0 once there are no more tokens.
+*/
+static size_t f_token_next(enum F_TOKENIZER tokenizer, const unsigned char** cursor, const unsigned char* end, const unsigned char** token)
+{
+  const unsigned char* c = *cursor;
+  while (c < end && f_token_separator(tokenizer, *c))
+  {
+    c++;
+  }
+
+  *token = c;
+  while (c < end && !f_token_separator(tokenizer, *c))
+  {
+    c++;
+  }
+
+  *cursor = c;
+  return (size_t) (c - *token);
+}
+
+static int f_token_pair_compare(const void* a, const void* b)
+{
+  const f_token_pair* pa = a;
+  const f_token_pair* pb = b;
+
+  if (pa->hash != pb->hash)
+  {
+    return pa->hash < pb->hash ? -1 : 1;
+  }
+
+  if (pa->line != pb->line)
+  {
+    return pa->line < pb->line ? -1 : 1;
+  }
+
+  return 0;
+}
+
+/*
+  sorts the pairs and appends them to the thread's run file as a new run.
+*/
+static int f_token_spill(f_token_thread* config, f_token_pair* pairs, size_t len)
+{
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  size_t* runs = realloc(config->runs, sizeof(size_t) * (config->run_count + 1));
+  if (runs == NULL)
+  {
+    return -1;
+  }
+  config->runs = runs;
+
+  qsort(pairs, len, sizeof(f_token_pair), f_token_pair_compare);
+
+  char* data = (char*) pairs;
+  size_t left = len * sizeof(f_token_pair);
+  while (left > 0)
+  {
+    ssize_t written = write(config->run_fd, data, left);
+    if (written < 0)
+    {
+      perror("cant write token run");
+      return -1;
+    }
+    data += written;
+    left -= (size_t) written;
+  }
+
+  config->runs[config->run_count++] = len;
+  return 0;
+}
+
+void* f_token_thread_build(void* payload)
+{
+  f_token_thread* config = payload;
+
+  f_token_pair* pairs = malloc(sizeof(f_token_pair) * F_TOKEN_RUN_PAIRS);
+  if (pairs == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate token pairs");
+    config->rc = -1;
+    return NULL;
+  }
+
+  size_t len = 0;
+  for (size_t start=config->from; start<config->to && config->rc == 0; start+=F_TOKEN_READ_LINES)
+  {
+    if (config->cancel != NULL && f_cancel_state_poll(config->cancel) != F_CANCEL_NONE)
+    {
+      config->rc = F_CANCELLED;
+      break;
+    }
+
+    size_t count = start + F_TOKEN_READ_LINES > config->to ? config->to - start : F_TOKEN_READ_LINES;
+
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, config->index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "token lookup failed to start: %zu buffer: %zu", start, count);
+      config->rc = -1;
+      break;
+    }
+
+    for (size_t i=0; i<lookup.count && config->rc == 0; i++)
+    {
+      char* text;
+      size_t text_len;
+      f_index_lines_get(&lookup, i, &text, &text_len);
+
+      // line numbers are 1 based, like search results.
+      size_t line_number = start + i + 1;
+      const unsigned char* line = (const unsigned char*) text;
+      const unsigned char* line_end = line + text_len;
+
+      const unsigned char* token;
+      size_t token_len;
+      while ((token_len = f_token_next(config->tokenizer, &line, line_end, &token)) > 0)
+      {
+        if (len == F_TOKEN_RUN_PAIRS)
+        {
+          if (f_token_spill(config, pairs, len) == -1)
+          {
+            config->rc = -1;
+            break;
+          }
+          len = 0;
+        }
+
+        pairs[len].hash = f_token_hash(token, token_len);
+        pairs[len].line = line_number;
+        len++;
+      }
+    }
+
+    f_index_lines_free(&lookup);
+  }
+
+  if (config->rc == 0 && f_token_spill(config, pairs, len) == -1)
+  {
+    config->rc = -1;
+  }
+
+  free(pairs);
+  return NULL;
+}
+
+/*
+  reads the next pairs of a run, returns false once the run is done.
+*/
+static bool f_token_run_fill(f_token_run* run)
+{
+  if (run->pos < run->len)
+  {
+    return true;
+  }
+
+  if (run->remaining == 0)
+  {
+    return false;
+  }
+
+  size_t n = run->remaining > F_TOKEN_READ_PAIRS ? F_TOKEN_READ_PAIRS : run->remaining;
+  ssize_t bytes = pread(run->fd, run->pairs, n * sizeof(f_token_pair), run->offset);
+  if (bytes != (ssize_t) (n * sizeof(f_token_pair)))
+  {
+    perror("cant read token run");
+    run->failed = true;
+    return false;
+  }
+
+  run->offset += (off_t) bytes;
+  run->remaining -= n;
+  run->pos = 0;
+  run->len = n;
+  return true;
+}
+
+static bool f_token_run_less(f_token_run* a, f_token_run* b)
+{
+  return f_token_pair_compare(&a->pairs[a->pos], &b->pairs[b->pos]) < 0;
+}
+
+static void f_token_heap_down(f_token_run** heap, size_t len, size_t i)
+{
+  while (true)
+  {
+    size_t smallest = i;
+    size_t l = 2 * i + 1;
+    size_t r = 2 * i + 2;
+
+    if (l < len && f_token_run_less(heap[l], heap[smallest]))
+    {
+      smallest = l;
+    }
+    if (r < len && f_token_run_less(heap[r], heap[smallest]))
+    {
+      smallest = r;
+    }
+    if (smallest == i)
+    {
+      return;
+    }
+
+    f_token_run* tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+static int f_token_write_varint(FILE* fp, uint64_t value, uint64_t* written)
+{
+  while (value >= 0x80)
+  {
+    if (fputc((int) ((value & 0x7f) | 0x80), fp) == EOF)
+    {
+      return -1;
+    }
+    value >>= 7;
+    (*written)++;
+  }
+
+  if (fputc((int) value, fp) == EOF)
+  {
+    return -1;
+  }
+  (*written)++;
+  return 0;
+}
+
+/*
+  merges the runs of every thread into posting lists, written after the header of `fp`.
+  the directory is collected in `dir` and appended once the posting lists are done.
+*/
+static int f_token_merge(FILE* fp, FILE* dir, f_token_run** heap, size_t heap_len, f_token_header* header)
+{
+  uint64_t offset = sizeof(f_token_header);
+  f_token_entry entry = { .hash = 0, .offset = 0, .count = 0 };
+  uint64_t last_line = 0;
+
+  for (size_t i=heap_len; i>0; i--)
+  {
+    f_token_heap_down(heap, heap_len, i - 1);
+  }
+
+  while (heap_len > 0)
+  {
+    f_token_run* run = heap[0];
+    f_token_pair pair = run->pairs[run->pos++];
+
+    if (!f_token_run_fill(run))
+    {
+      if (run->failed)
+      {
+        return -1;
+      }
+      heap[0] = heap[--heap_len];
+    }
+    f_token_heap_down(heap, heap_len, 0);
+
+    if (entry.count == 0 || pair.hash != entry.hash)
+    {
+      if (entry.count > 0 && fwrite(&entry, sizeof(entry), 1, dir) != 1)
+      {
+        return -1;
+      }
+
+      header->entry_count += entry.count > 0 ? 1 : 0;
+      entry.hash = pair.hash;
+      entry.offset = offset;
+      entry.count = 0;
+      last_line = 0;
+    }
+    else if (pair.line == last_line)
+    {
+      // the same token twice on a line.
+      continue;
+    }
+
+    if (f_token_write_varint(fp, pair.line - last_line, &offset) == -1)
+    {
+      return -1;
+    }
+    last_line = pair.line;
+    entry.count++;
+  }
+
+  if (entry.count > 0)
+  {
+    if (fwrite(&entry, sizeof(entry), 1, dir) != 1)
+    {
+      return -1;
+    }
+    header->entry_count++;
+  }
+
+  // keep the directory aligned for the mapping.
+  while (offset % sizeof(uint64_t) != 0)
+  {
+    if (fputc(0, fp) == EOF)
+    {
+      return -1;
+    }
+    offset++;
+  }
+  header->directory_offset = offset;
+
+  rewind(dir);
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), dir)) > 0)
+  {
+    if (fwrite(buffer, 1, read, fp) != read)
+    {
+      return -1;
+    }
+  }
+
+  return ferror(dir) ? -1 : 0;
+}
+
+/*
+  merges the runs of every thread into the token index file.
+*/
+static int f_token_write(char* path, f_token_thread* tthreads, int threads, enum F_TOKENIZER tokenizer)
+{
+  size_t run_count = 0;
+  for (int i=0; i<threads; i++)
+  {
+    run_count += tthreads[i].run_count;
+  }
+
+  f_token_run* runs = calloc(run_count > 0 ? run_count : 1, sizeof(f_token_run));
+  f_token_run** heap = malloc(sizeof(f_token_run*) * (run_count > 0 ? run_count : 1));
+  if (runs == NULL || heap == NULL)
+  {
+    free(runs);
+    free(heap);
+    return -1;
+  }
+
+  int rc = 0;
+  size_t heap_len = 0;
+  for (int i=0; i<threads && rc == 0; i++)
+  {
+    off_t offset = 0;
+    for (size_t r=0; r<tthreads[i].run_count; r++)
+    {
+      f_token_run* run = &runs[heap_len];
+      run->fd = tthreads[i].run_fd;
+      run->offset = offset;
+      run->remaining = tthreads[i].runs[r];
+      run->pos = 0;
+      run->len = 0;
+      run->failed = false;
+      run->pairs = malloc(sizeof(f_token_pair) * F_TOKEN_READ_PAIRS);
+      offset += (off_t) (tthreads[i].runs[r] * sizeof(f_token_pair));
+
+      if (run->pairs == NULL || !f_token_run_fill(run))
+      {
+        free(run->pairs);
+        rc = -1;
+        break;
+      }
+      heap[heap_len++] = run;
+    }
+  }
+
+  size_t dir_path_len = strlen(path) + 5;
+  char* dir_path = malloc(dir_path_len);
+  FILE* fp = fopen(path, "w+b");
+  FILE* dir = NULL;
+  if (dir_path != NULL)
+  {
+    snprintf(dir_path, dir_path_len, "%s.dir", path);
+    dir = fopen(dir_path, "w+b");
+  }
+
+  if (fp == NULL || dir == NULL)
+  {
+    perror("cant open token index");
+    rc = -1;
+  }
+
+  f_token_header header = {
+    .magic = F_TOKEN_MAGIC,
+    .version = F_TOKEN_VERSION,
+    .tokenizer = tokenizer,
+    .entry_count = 0,
+    .directory_offset = 0
+  };
+
+  if (rc == 0 && (fwrite(&header, sizeof(header), 1, fp) != 1 || f_token_merge(fp, dir, heap, heap_len, &header) == -1))
+  {
+    perror("cant write token index");
+    rc = -1;
+  }
+
+  if (rc == 0 && (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1))
+  {
+    perror("cant write token index header");
+    rc = -1;
+  }
+
+  if (fp != NULL && fclose(fp) != 0)
+  {
+    rc = -1;
+  }
+
+  if (dir != NULL)
+  {
+    fclose(dir);
+    remove(dir_path);
+  }
+
+  for (size_t r=0; r<heap_len; r++)
+  {
+    free(runs[r].pairs);
+  }
+
+  free(dir_path);
+  free(runs);
+  free(heap);
+  return rc;
+}
+
+int f_token_index_build(f_token_index** out, f_index* index, char* path, enum F_TOKENIZER tokenizer, int threads, f_cancel_state* cancel)
+{
+  size_t lines = f_index_line_count(index);
+
+  f_token_index* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    free(path);
+    return -1;
+  }
+
+  init->path = path;
+  init->fd = -1;
+  init->map = NULL;
+  init->map_len = 0;
+  init->tokenizer = tokenizer;
+  init->entry_count = 0;
+  init->entries = NULL;
+
+  if (threads > lines)
+  {
+    threads = lines > 0 ? (int) lines : 1;
+  }
+
+  f_token_thread* tthreads = calloc(threads, sizeof(f_token_thread));
+  pthread_t* thread_ids = malloc(sizeof(pthread_t) * threads);
+  size_t run_path_len = strlen(path) + 16;
+  if (tthreads == NULL || thread_ids == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate token threads");
+    free(tthreads);
+    free(thread_ids);
+    f_token_index_free(&init);
+    return -1;
+  }
+
+  size_t lines_per_thread = (lines + threads - 1) / threads;
+  int spawned = 0;
+  int rc = 0;
+  for (int i=0; i<threads; i++)
+  {
+    size_t from = i * lines_per_thread;
+    size_t to = from + lines_per_thread;
+    tthreads[i].index = index;
+    tthreads[i].tokenizer = tokenizer;
+    tthreads[i].from = from > lines ? lines : from;
+    tthreads[i].to = to > lines ? lines : to;
+    tthreads[i].runs = NULL;
+    tthreads[i].run_count = 0;
+    tthreads[i].cancel = cancel;
+    tthreads[i].rc = 0;
+    tthreads[i].run_fd = -1;
+
+    tthreads[i].run_path = malloc(run_path_len);
+    if (tthreads[i].run_path == NULL)
+    {
+      rc = -1;
+      break;
+    }
+    snprintf(tthreads[i].run_path, run_path_len, "%s.run%d", path, i);
+
+    tthreads[i].run_fd = open(tthreads[i].run_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tthreads[i].run_fd == -1)
+    {
+      perror("cant open token run");
+      free(tthreads[i].run_path);
+      tthreads[i].run_path = NULL;
+      rc = -1;
+      break;
+    }
+
+    if (pthread_create(&thread_ids[i], NULL, f_token_thread_build, &tthreads[i]) != 0)
+    {
+      f_log(F_LOG_ERROR, "Couldn't create token thread %d", i);
+      close(tthreads[i].run_fd);
+      remove(tthreads[i].run_path);
+      free(tthreads[i].run_path);
+      tthreads[i].run_path = NULL;
+      rc = -1;
+      break;
+    }
+    spawned++;
+  }
+
+  for (int i=0; i<spawned; i++)
+  {
+    pthread_join(thread_ids[i], NULL);
+    if (rc == 0 && tthreads[i].rc != 0)
+    {
+      rc = tthreads[i].rc;
+    }
+  }
+
+  if (rc == 0 && f_token_write(path, tthreads, spawned, tokenizer) == -1)
+  {
+    f_log(F_LOG_ERROR, "failed to merge token runs");
+    rc = -1;
+  }
+
+  for (int i=0; i<spawned; i++)
+  {
+    close(tthreads[i].run_fd);
+    remove(tthreads[i].run_path);
+    free(tthreads[i].run_path);
+    free(tthreads[i].runs);
+  }
+
+  free(tthreads);
+  free(thread_ids);
+
+  if (rc != 0)
+  {
+    f_token_index_free(&init);
+    return rc;
+  }
+
+  init->fd = open(path, O_RDONLY);
+  struct stat st;
+  if (init->fd == -1 || fstat(init->fd, &st) != 0)
+  {
+    perror("cant open token index");
+    f_token_index_free(&init);
+    return -1;
+  }
+
+  init->map_len = (size_t) st.st_size;
+  init->map = mmap(NULL, init->map_len, PROT_READ, MAP_SHARED, init->fd, 0);
+  if (init->map == MAP_FAILED)
+  {
+    perror("cant map token index");
+    init->map = NULL;
+    f_token_index_free(&init);
+    return -1;
+  }
+
+  f_token_header* header = init->map;
+  init->entry_count = header->entry_count;
+  init->entries = (f_token_entry*) ((char*) init->map + header->directory_offset);
+  *out = init;
+  return 0;
+}
+
+static f_token_entry* f_token_index_find(f_token_index* tokens, uint64_t hash)
+{
+  size_t lo = 0;
+  size_t hi = tokens->entry_count;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (tokens->entries[mid].hash < hash)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return lo < tokens->entry_count && tokens->entries[lo].hash == hash ? &tokens->entries[lo] : NULL;
+}
+
+static int f_token_index_postings(f_bitmap* out, f_token_index* tokens, f_token_entry* entry)
+{
+  const unsigned char* data = (const unsigned char*) tokens->map + entry->offset;
+  uint64_t line = 0;
+
+  for (uint64_t i=0; i<entry->count; i++)
+  {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (*data & 0x80)
+    {
+      delta |= (uint64_t) (*data++ & 0x7f) << shift;
+      shift += 7;
+    }
+    delta |= (uint64_t) *data++ << shift;
+
+    line += delta;
+    if (f_bitmap_add(out, (size_t) line) == -1)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int f_index_token_lookup(f_bitmap** out, f_index* index, const char* term)
+{
+  f_token_index* tokens = index->tokens;
+  if (tokens == NULL)
+  {
+    return -2;
+  }
+
+  f_bitmap* lines = NULL;
+  const unsigned char* cursor = (const unsigned char*) term;
+  const unsigned char* end = cursor + strlen(term);
+  const unsigned char* token;
+  size_t token_len;
+
+  while ((token_len = f_token_next(tokens->tokenizer, &cursor, end, &token)) > 0)
+  {
+    f_bitmap* postings;
+    if (f_bitmap_init(&postings) == -1)
+    {
+      if (lines != NULL)
+      {
+        f_bitmap_free(&lines);
+      }
+      return -1;
+    }
+
+    f_token_entry* entry = f_token_index_find(tokens, f_token_hash(token, token_len));
+    if (entry != NULL && f_token_index_postings(postings, tokens, entry) == -1)
+    {
+      f_bitmap_free(&postings);
+      if (lines != NULL)
+      {
+        f_bitmap_free(&lines);
+      }
+      return -1;
+    }
+
+    if (lines == NULL)
+    {
+      lines = postings;
+      continue;
+    }
+
+    // every token of the term has to be on the line.
+    f_bitmap* both;
+    if (f_bitmap_init(&both) == -1)
+    {
+      f_bitmap_free(&postings);
+      f_bitmap_free(&lines);
+      return -1;
+    }
+
+    size_t line = 0;
+    while (f_bitmap_next(lines, line, &line))
+    {
+      if (f_bitmap_contains(postings, line) && f_bitmap_add(both, line) == -1)
+      {
+        f_bitmap_free(&both);
+        f_bitmap_free(&postings);
+        f_bitmap_free(&lines);
+        return -1;
+      }
+      line++;
+    }
+
+    f_bitmap_free(&postings);
+    f_bitmap_free(&lines);
+    lines = both;
+  }
+
+  if (lines == NULL && f_bitmap_init(&lines) == -1)
+  {
+    return -1;
+  }
+
+  *out = lines;
+  return 0;
+}
+
+void f_token_index_free(f_token_index** tokensref)
+{
+  f_token_index* tokens = *tokensref;
+
+  if (tokens->map != NULL)
+  {
+    munmap(tokens->map, tokens->map_len);
+  }
+
+  if (tokens->fd != -1)
+  {
+    close(tokens->fd);
+  }
+
+  if (remove(tokens->path) != 0 && errno != ENOENT)
+  {
+    f_log(F_LOG_WARN, "Cannot free token index path");
+  }
+
+  free(tokens->path);
+  free(tokens);
+  *tokensref = NULL;
+}
+
+#endif
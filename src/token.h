@@ -0,0 +1,209 @@
+#ifndef FLASHLIGHT_TOKEN_H
+#define FLASHLIGHT_TOKEN_H
+
+/** @file token.h
+* @brief An inverted index from tokens to the lines they are on
+*
+* Lines are split into tokens, each token is hashed and gets a posting
+* list of the line numbers it is on, delta and varint encoded.
+* The index is a sidecar file next to the lookup, mapped read only:
+* a header, the posting lists, then a directory sorted by hash.
+*/
+
+#define F_TOKEN_MAGIC 0x4b544c46u
+#define F_TOKEN_VERSION 1u
+// pairs a thread sorts in memory before spilling them to its run file.
+#define F_TOKEN_RUN_PAIRS (1 << 20)
+// pairs buffered for each run while merging.
+#define F_TOKEN_READ_PAIRS 4096
+// lines a thread reads at a time.
+#define F_TOKEN_READ_LINES 4096
+
+/**
+* @brief how lines are split into tokens
+*/
+enum F_TOKENIZER
+{
+  F_TOKENIZER_NONE = 0, /**< no token index */
+  F_TOKENIZER_WHITESPACE, /**< tokens are separated by whitespace */
+  F_TOKENIZER_PUNCTUATION /**< tokens are runs of letters, digits, '_' and non ascii bytes */
+};
+
+/** @struct FTokenHeader
+* @brief the header of a token index file
+* @var FTokenHeader::magic
+* F_TOKEN_MAGIC
+* @var FTokenHeader::version
+* F_TOKEN_VERSION
+* @var FTokenHeader::tokenizer
+* the tokenizer the lines were split with
+* @var FTokenHeader::entry_count
+* the number of distinct tokens
+* @var FTokenHeader::directory_offset
+* where the directory starts
+*/
+typedef struct FTokenHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t tokenizer;
+  uint64_t entry_count;
+  uint64_t directory_offset;
+} f_token_header;
+
+/** @struct FTokenEntry
+* @brief the posting list of one token
+* @var FTokenEntry::hash
+* the hash of the token
+* @var FTokenEntry::offset
+* where the posting list starts
+* @var FTokenEntry::count
+* the number of lines in the posting list
+*/
+typedef struct FTokenEntry
+{
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t count;
+} f_token_entry;
+
+/** @struct FTokenPair
+* @brief a token on a line, as collected before merging
+* @var FTokenPair::hash
+* the hash of the token
+* @var FTokenPair::line
+* the line number
+*/
+typedef struct FTokenPair
+{
+  uint64_t hash;
+  uint64_t line;
+} f_token_pair;
+
+/** @struct FTokenRun
+* @brief a sorted run being merged
+* @var FTokenRun::fd
+* the run file the run is in
+* @var FTokenRun::offset
+* where the pairs that weren't read yet start
+* @var FTokenRun::remaining
+* how many pairs weren't read yet
+* @var FTokenRun::pairs
+* the pairs read
+* @var FTokenRun::pos
+* the next pair to merge
+* @var FTokenRun::len
+* the number of pairs read
+* @var FTokenRun::failed
+* true if reading the run failed
+*/
+typedef struct FTokenRun
+{
+  int fd;
+  off_t offset;
+  size_t remaining;
+  f_token_pair* pairs;
+  size_t pos;
+  size_t len;
+  bool failed;
+} f_token_run;
+
+/** @struct FTokenIndex
+* @brief a token index, mapped from the file next to the lookup
+* @var FTokenIndex::path
+* the location of the token index
+* @var FTokenIndex::fd
+* the file descriptor of the token index
+* @var FTokenIndex::map
+* the mapped file
+* @var FTokenIndex::map_len
+* the size of the mapped file
+* @var FTokenIndex::tokenizer
+* the tokenizer the lines were split with
+* @var FTokenIndex::entry_count
+* the number of distinct tokens
+* @var FTokenIndex::entries
+* the directory, sorted by hash
+*/
+typedef struct FTokenIndex
+{
+  char* path;
+  int fd;
+  void* map;
+  size_t map_len;
+  enum F_TOKENIZER tokenizer;
+  size_t entry_count;
+  f_token_entry* entries;
+} f_token_index;
+
+/** @struct FTokenThread
+* @brief the lines one thread tokenizes
+* @var FTokenThread::index
+* the index to read lines from
+* @var FTokenThread::tokenizer
+* how to split lines
+* @var FTokenThread::from
+* the first line
+* @var FTokenThread::to
+* the line to stop at
+* @var FTokenThread::run_path
+* the file the sorted runs are spilled to
+* @var FTokenThread::run_fd
+* the file descriptor of the run file
+* @var FTokenThread::runs
+* how many pairs each run has, runs follow each other in the run file
+* @var FTokenThread::run_count
+* the number of runs
+* @var FTokenThread::cancel
+* the cancellation state of the indexing
+* @var FTokenThread::rc
+* non zero if tokenizing failed
+*/
+typedef struct FTokenThread
+{
+  f_index* index;
+  enum F_TOKENIZER tokenizer;
+  size_t from;
+  size_t to;
+  char* run_path;
+  int run_fd;
+  size_t* runs;
+  size_t run_count;
+  f_cancel_state* cancel;
+  int rc;
+} f_token_thread;
+
+/**
+  Builds a token index for every line of an index
+
+  Each thread spills sorted runs of (token, line) pairs to a temporary file,
+  the runs are then merged into posting lists, so memory use doesn't grow with the file.
+  @param out the token index
+  @param index the index to read lines from
+  @param path the file to write, owned by the token index (freed on error)
+  @param tokenizer how to split lines
+  @param threads how many threads to tokenize with
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_token_index_build(f_token_index** out, f_index* index, char* path, enum F_TOKENIZER tokenizer, int threads, f_cancel_state* cancel);
+
+/**
+  Finds the lines that contain a term
+
+  The term is split with the tokenizer of the index, a line has to contain every token.
+  Tokens are compared by a 64 bit hash, so a collision could add a line.
+  @param out the line numbers, the same as `FSearchResult::line_number`
+  @param index an index built with a tokenizer
+  @param term the term to find
+  @return non zero for error, -2 if the index has no token index
+*/
+int f_index_token_lookup(f_bitmap** out, f_index* index, const char* term);
+
+/**
+  Unmaps and deletes a token index
+  @param tokens the token index to free
+*/
+void f_token_index_free(f_token_index** tokens);
+
+#endif
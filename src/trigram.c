@@ -0,0 +1,556 @@
+#ifndef FLASHLIGHT_TRIGRAM
+#define FLASHLIGHT_TRIGRAM
+
+#include "trigram.h"
+#include <ctype.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static uint32_t f_trigram_hash(unsigned char a, unsigned char b, unsigned char c)
+{
+  return (((uint32_t) a << 16) | ((uint32_t) b << 8) | (uint32_t) c) * 2654435761u;
+}
+
+static void f_trigram_filter_set(uint8_t* filter, size_t filter_bytes, uint32_t hash)
+{
+  size_t bit = hash % (filter_bytes * 8);
+  filter[bit >> 3] |= (uint8_t) (1u << (bit & 7));
+}
+
+static bool f_trigram_filter_has(uint8_t* filter, size_t filter_bytes, uint32_t hash)
+{
+  size_t bit = hash % (filter_bytes * 8);
+  return (filter[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/*
+  sets the bit of every trigram in each line of a lookup.
+  trigrams don't cross lines, a match never does.
+*/
+static void f_trigram_filter_lines(uint8_t* filter, size_t filter_bytes, f_index_lines* lookup)
+{
+  for (size_t i=0; i<lookup->count; i++)
+  {
+    char* text;
+    size_t len;
+    f_index_lines_get(lookup, i, &text, &len);
+
+    unsigned char* line = (unsigned char*) text;
+    for (unsigned char* c=line; c + 2 < line + len; c++)
+    {
+      f_trigram_filter_set(filter, filter_bytes, f_trigram_hash(c[0], c[1], c[2]));
+    }
+  }
+}
+
+void* f_trigram_thread_build(void* payload)
+{
+  f_trigram_thread* config = payload;
+  f_trigram_index* trigrams = config->trigrams;
+  size_t lines = f_index_line_count(config->index);
+
+  uint8_t* filter = malloc(trigrams->filter_bytes);
+  if (filter == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate trigram filter");
+    config->rc = -1;
+    return NULL;
+  }
+
+  for (size_t block=config->from; block<config->to; block++)
+  {
+    if (config->cancel != NULL && f_cancel_state_poll(config->cancel) != F_CANCEL_NONE)
+    {
+      config->rc = F_CANCELLED;
+      break;
+    }
+
+    size_t start = block * trigrams->block_lines;
+    size_t count = start + trigrams->block_lines > lines ? lines - start : trigrams->block_lines;
+
+    f_index_lines lookup;
+    if (f_index_lookup_lines(&lookup, config->index, start, count) != 0 || lookup.data == NULL)
+    {
+      f_log(F_LOG_ERROR, "trigram lookup failed to start: %zu buffer: %zu", start, count);
+      config->rc = -1;
+      break;
+    }
+
+    memset(filter, 0, trigrams->filter_bytes);
+    f_trigram_filter_lines(filter, trigrams->filter_bytes, &lookup);
+    f_index_lines_free(&lookup);
+
+    off_t offset = (off_t) (sizeof(f_trigram_header) + block * trigrams->filter_bytes);
+    if (pwrite(trigrams->fd, filter, trigrams->filter_bytes, offset) != (ssize_t) trigrams->filter_bytes)
+    {
+      perror("cant write trigram filter");
+      config->rc = -1;
+      break;
+    }
+  }
+
+  free(filter);
+  return NULL;
+}
+
+int f_trigram_index_build(f_trigram_index** out, f_index* index, char* path, size_t block_lines, size_t filter_bytes, int threads, f_cancel_state* cancel)
+{
+  if (block_lines == 0 || threads < 1)
+  {
+    f_log(F_LOG_ERROR, "trigram index needs at least 1 line per block and 1 thread");
+    free(path);
+    return -1;
+  }
+
+  size_t lines = f_index_line_count(index);
+  filter_bytes = filter_bytes == 0 ? F_TRIGRAM_DEFAULT_FILTER : filter_bytes;
+
+  f_trigram_index* init = malloc(sizeof(*init));
+  if (init == NULL)
+  {
+    free(path);
+    return -1;
+  }
+
+  init->path = path;
+  init->block_lines = block_lines;
+  init->filter_bytes = filter_bytes;
+  init->block_count = (lines + block_lines - 1) / block_lines;
+  init->map = NULL;
+  init->map_len = sizeof(f_trigram_header) + init->block_count * filter_bytes;
+  init->filters = NULL;
+
+  init->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (init->fd == -1)
+  {
+    perror("cant open trigram index");
+    free(path);
+    free(init);
+    return -1;
+  }
+
+  f_trigram_header header = {
+    .magic = F_TRIGRAM_MAGIC,
+    .version = F_TRIGRAM_VERSION,
+    .block_lines = block_lines,
+    .filter_bytes = filter_bytes,
+    .block_count = init->block_count
+  };
+
+  if (ftruncate(init->fd, (off_t) init->map_len) != 0 || pwrite(init->fd, &header, sizeof(header), 0) != sizeof(header))
+  {
+    perror("cant write trigram index");
+    f_trigram_index_free(&init);
+    return -1;
+  }
+
+  if (threads > init->block_count)
+  {
+    threads = init->block_count > 0 ? (int) init->block_count : 1;
+  }
+
+  f_trigram_thread* tthreads = malloc(sizeof(f_trigram_thread) * threads);
+  pthread_t* thread_ids = malloc(sizeof(pthread_t) * threads);
+  if (tthreads == NULL || thread_ids == NULL)
+  {
+    f_log(F_LOG_ERROR, "cant allocate trigram threads");
+    free(tthreads);
+    free(thread_ids);
+    f_trigram_index_free(&init);
+    return -1;
+  }
+
+  size_t blocks_per_thread = (init->block_count + threads - 1) / threads;
+  int spawned = 0;
+  int rc = 0;
+  for (int i=0; i<threads; i++)
+  {
+    size_t from = i * blocks_per_thread;
+    size_t to = from + blocks_per_thread;
+    tthreads[i].trigrams = init;
+    tthreads[i].index = index;
+    tthreads[i].from = from > init->block_count ? init->block_count : from;
+    tthreads[i].to = to > init->block_count ? init->block_count : to;
+    tthreads[i].cancel = cancel;
+    tthreads[i].rc = 0;
+
+    if (pthread_create(&thread_ids[i], NULL, f_trigram_thread_build, &tthreads[i]) != 0)
+    {
+      f_log(F_LOG_ERROR, "Couldn't create trigram thread %d", i);
+      rc = -1;
+      break;
+    }
+    spawned++;
+  }
+
+  for (int i=0; i<spawned; i++)
+  {
+    pthread_join(thread_ids[i], NULL);
+    if (rc == 0 && tthreads[i].rc != 0)
+    {
+      rc = tthreads[i].rc;
+    }
+  }
+
+  free(tthreads);
+  free(thread_ids);
+
+  if (rc != 0)
+  {
+    f_trigram_index_free(&init);
+    return rc;
+  }
+
+  init->map = mmap(NULL, init->map_len, PROT_READ, MAP_SHARED, init->fd, 0);
+  if (init->map == MAP_FAILED)
+  {
+    perror("cant map trigram index");
+    init->map = NULL;
+    f_trigram_index_free(&init);
+    return -1;
+  }
+
+  init->filters = (uint8_t*) init->map + sizeof(f_trigram_header);
+  *out = init;
+  return 0;
+}
+
+bool f_trigram_index_maybe(f_trigram_index* trigrams, f_trigram_query* query, size_t block)
+{
+  if (query == NULL || block >= trigrams->block_count)
+  {
+    return true;
+  }
+
+  uint8_t* filter = trigrams->filters + block * trigrams->filter_bytes;
+  uint32_t* trigram = query->trigrams;
+
+  for (size_t b=0; b<query->branches; b++)
+  {
+    bool maybe = true;
+    for (size_t t=0; t<query->branch_len[b] && maybe; t++)
+    {
+      maybe = f_trigram_filter_has(filter, trigrams->filter_bytes, trigram[t]);
+    }
+
+    if (maybe)
+    {
+      return true;
+    }
+    trigram += query->branch_len[b];
+  }
+
+  return false;
+}
+
+void f_trigram_index_free(f_trigram_index** trigramsref)
+{
+  f_trigram_index* trigrams = *trigramsref;
+
+  if (trigrams->map != NULL)
+  {
+    munmap(trigrams->map, trigrams->map_len);
+  }
+
+  close(trigrams->fd);
+  if (remove(trigrams->path) != 0)
+  {
+    f_log(F_LOG_WARN, "Cannot free trigram index path");
+  }
+
+  free(trigrams->path);
+  free(trigrams);
+  *trigramsref = NULL;
+}
+
+/*
+  adds the trigrams of a literal run to the current branch.
+*/
+static int f_trigram_query_run(f_trigram_query* query, unsigned char* run, size_t run_len)
+{
+  if (run_len < 3)
+  {
+    return 0;
+  }
+
+  size_t len = 0;
+  for (size_t b=0; b<query->branches; b++)
+  {
+    len += query->branch_len[b];
+  }
+
+  uint32_t* trigrams = realloc(query->trigrams, sizeof(uint32_t) * (len + run_len - 2));
+  if (trigrams == NULL)
+  {
+    return -1;
+  }
+
+  query->trigrams = trigrams;
+  for (size_t i=0; i + 2<run_len; i++)
+  {
+    query->trigrams[len++] = f_trigram_hash(run[i], run[i + 1], run[i + 2]);
+  }
+  query->branch_len[query->branches - 1] += run_len - 2;
+  return 0;
+}
+
+/*
+  skips a character class, `i` is on the '['.
+  returns the position after the ']', or 0 if it never closes.
+*/
+static size_t f_trigram_skip_class(const char* pattern, size_t i)
+{
+  i++;
+  if (pattern[i] == '^')
+  {
+    i++;
+  }
+
+  // a leading ']' is a literal.
+  if (pattern[i] == ']')
+  {
+    i++;
+  }
+
+  while (pattern[i] != '\0' && pattern[i] != ']')
+  {
+    i += pattern[i] == '\\' && pattern[i + 1] != '\0' ? 2 : 1;
+  }
+
+  return pattern[i] == ']' ? i + 1 : 0;
+}
+
+/*
+  skips a group, `i` is on the '('.
+  returns the position after the matching ')', or 0 if it never closes.
+*/
+static size_t f_trigram_skip_group(const char* pattern, size_t i)
+{
+  int depth = 0;
+  while (pattern[i] != '\0')
+  {
+    if (pattern[i] == '\\' && pattern[i + 1] != '\0')
+    {
+      i += 2;
+      continue;
+    }
+
+    if (pattern[i] == '[')
+    {
+      i = f_trigram_skip_class(pattern, i);
+      if (i == 0)
+      {
+        return 0;
+      }
+      continue;
+    }
+
+    if (pattern[i] == '(')
+    {
+      depth++;
+    }
+    else if (pattern[i] == ')' && --depth == 0)
+    {
+      return i + 1;
+    }
+    i++;
+  }
+
+  return 0;
+}
+
+/*
+  skips a quantifier and its lazy or possessive suffix.
+  returns the position after it, and if it can repeat zero times.
+*/
+static size_t f_trigram_skip_quantifier(const char* pattern, size_t i, bool* optional)
+{
+  *optional = false;
+  char c = pattern[i];
+
+  if (c == '*' || c == '?')
+  {
+    *optional = true;
+    i++;
+  }
+  else if (c == '+')
+  {
+    i++;
+  }
+  else if (c == '{')
+  {
+    char* close = strchr(pattern + i, '}');
+    if (close == NULL)
+    {
+      return i;
+    }
+
+    // conservatively treat any counted repeat as optional.
+    *optional = true;
+    i = (size_t) (close - pattern) + 1;
+  }
+  else
+  {
+    return i;
+  }
+
+  if (pattern[i] == '?' || pattern[i] == '+')
+  {
+    i++;
+  }
+  return i;
+}
+
+int f_trigram_query_init(f_trigram_query** out, const char* pattern)
+{
+  *out = NULL;
+
+  // options like (?i) and \Q..\E change what the rest means.
+  if (strstr(pattern, "(?") != NULL || strstr(pattern, "(*") != NULL || strstr(pattern, "\\Q") != NULL)
+  {
+    return 0;
+  }
+
+  size_t pattern_len = strlen(pattern);
+  f_trigram_query* query = malloc(sizeof(*query));
+  unsigned char* run = malloc(pattern_len + 1);
+  if (query == NULL || run == NULL)
+  {
+    free(query);
+    free(run);
+    return -1;
+  }
+
+  query->trigrams = NULL;
+  query->branches = 1;
+  // there can't be more branches than characters.
+  query->branch_len = calloc(pattern_len + 1, sizeof(size_t));
+  if (query->branch_len == NULL)
+  {
+    free(query);
+    free(run);
+    return -1;
+  }
+
+  size_t run_len = 0;
+  bool usable = true;
+  size_t i = 0;
+
+  while (usable && i <= pattern_len)
+  {
+    char c = pattern[i];
+
+    if (c == '\0' || c == '|')
+    {
+      if (f_trigram_query_run(query, run, run_len) == -1)
+      {
+        f_trigram_query_free(&query);
+        free(run);
+        return -1;
+      }
+      run_len = 0;
+
+      // a branch without trigrams matches any block.
+      if (query->branch_len[query->branches - 1] == 0)
+      {
+        usable = false;
+        break;
+      }
+
+      if (c == '\0')
+      {
+        break;
+      }
+
+      query->branches++;
+      i++;
+      continue;
+    }
+
+    bool literal = false;
+    unsigned char value = (unsigned char) c;
+    size_t next = i + 1;
+
+    if (c == '\\')
+    {
+      if (pattern[i + 1] == '\0')
+      {
+        usable = false;
+        break;
+      }
+
+      // \d, \w, \x41 and friends aren't single literals.
+      literal = !isalnum((unsigned char) pattern[i + 1]);
+      value = (unsigned char) pattern[i + 1];
+      next = i + 2;
+    }
+    else if (c == '[')
+    {
+      next = f_trigram_skip_class(pattern, i);
+    }
+    else if (c == '(')
+    {
+      next = f_trigram_skip_group(pattern, i);
+    }
+    else if (c == ')' || c == '*' || c == '+' || c == '?' || c == '{')
+    {
+      // a quantifier without anything to repeat.
+      next = c == '{' ? i + 1 : 0;
+    }
+    else if (c != '.' && c != '^' && c != '$')
+    {
+      literal = true;
+    }
+
+    if (next == 0)
+    {
+      usable = false;
+      break;
+    }
+
+    bool optional;
+    size_t after = f_trigram_skip_quantifier(pattern, next, &optional);
+
+    if (literal && !optional)
+    {
+      run[run_len++] = value;
+    }
+
+    // anything that isn't a single required literal ends the run.
+    // a repeated literal is still required once, but nothing follows it directly.
+    if (!literal || after != next)
+    {
+      if (f_trigram_query_run(query, run, run_len) == -1)
+      {
+        f_trigram_query_free(&query);
+        free(run);
+        return -1;
+      }
+      run_len = 0;
+    }
+
+    i = after;
+  }
+
+  free(run);
+
+  if (!usable)
+  {
+    f_trigram_query_free(&query);
+    return 0;
+  }
+
+  *out = query;
+  return 0;
+}
+
+void f_trigram_query_free(f_trigram_query** queryref)
+{
+  f_trigram_query* query = *queryref;
+  free(query->trigrams);
+  free(query->branch_len);
+  free(query);
+  *queryref = NULL;
+}
+
+#endif
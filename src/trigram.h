@@ -0,0 +1,161 @@
+#ifndef FLASHLIGHT_TRIGRAM_H
+#define FLASHLIGHT_TRIGRAM_H
+
+/** @file trigram.h
+* @brief A per block trigram filter, to skip lines that can't match a regex
+*
+* Every block of lines gets a fixed size bitset with one (hashed) bit
+* for each trigram in its lines. A search derives the trigrams a match
+* must contain from its pattern, and only reads the blocks that have them all.
+* Bits can collide, so a block that passes may still have no match.
+*/
+
+#define F_TRIGRAM_MAGIC 0x47544c46u
+#define F_TRIGRAM_VERSION 1u
+#define F_TRIGRAM_DEFAULT_FILTER 4096
+
+/** @struct FTrigramHeader
+* @brief the header of a trigram index file, followed by one filter per block
+* @var FTrigramHeader::magic
+* F_TRIGRAM_MAGIC
+* @var FTrigramHeader::version
+* F_TRIGRAM_VERSION
+* @var FTrigramHeader::block_lines
+* the number of lines in each block
+* @var FTrigramHeader::filter_bytes
+* the size of each block's filter
+* @var FTrigramHeader::block_count
+* the number of blocks
+*/
+typedef struct FTrigramHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t block_lines;
+  uint64_t filter_bytes;
+  uint64_t block_count;
+} f_trigram_header;
+
+/** @struct FTrigramIndex
+* @brief a trigram index, mapped from the file next to the lookup
+* @var FTrigramIndex::path
+* the location of the trigram index
+* @var FTrigramIndex::fd
+* the file descriptor of the trigram index
+* @var FTrigramIndex::map
+* the mapped file
+* @var FTrigramIndex::map_len
+* the size of the mapped file
+* @var FTrigramIndex::block_lines
+* the number of lines in each block
+* @var FTrigramIndex::filter_bytes
+* the size of each block's filter
+* @var FTrigramIndex::block_count
+* the number of blocks
+* @var FTrigramIndex::filters
+* the filters, `filter_bytes` for each block
+*/
+typedef struct FTrigramIndex
+{
+  char* path;
+  int fd;
+  void* map;
+  size_t map_len;
+  size_t block_lines;
+  size_t filter_bytes;
+  size_t block_count;
+  uint8_t* filters;
+} f_trigram_index;
+
+/** @struct FTrigramQuery
+* @brief the trigrams a line must contain to match a pattern
+*
+* A line can only match if it has every trigram of at least one branch.
+* @var FTrigramQuery::trigrams
+* the hashed trigrams of every branch, one after the other
+* @var FTrigramQuery::branch_len
+* how many trigrams each branch has
+* @var FTrigramQuery::branches
+* the number of branches
+*/
+typedef struct FTrigramQuery
+{
+  uint32_t* trigrams;
+  size_t* branch_len;
+  size_t branches;
+} f_trigram_query;
+
+/** @struct FTrigramThread
+* @brief the blocks one thread builds filters for
+* @var FTrigramThread::trigrams
+* the trigram index being built
+* @var FTrigramThread::index
+* the index to read lines from
+* @var FTrigramThread::from
+* the first block
+* @var FTrigramThread::to
+* the block to stop at
+* @var FTrigramThread::cancel
+* the cancellation state of the indexing
+* @var FTrigramThread::rc
+* non zero if building failed
+*/
+typedef struct FTrigramThread
+{
+  f_trigram_index* trigrams;
+  f_index* index;
+  size_t from;
+  size_t to;
+  f_cancel_state* cancel;
+  int rc;
+} f_trigram_thread;
+
+/**
+  Builds a trigram index for every line of an index
+
+  Blocks are split between `threads`, each writes its filters straight to `path`.
+  The file is then mapped read only.
+  @param out the trigram index
+  @param index the index to read lines from
+  @param path the file to write, owned by the trigram index (freed on error)
+  @param block_lines the number of lines in each block, at least 1
+  @param filter_bytes the size of each block's filter (0 for the default)
+  @param threads how many threads to build with, at least 1
+  @param cancel the cancellation state of the indexing (NULL if unused)
+  @return non zero for error, F_CANCELLED if cancelled.
+*/
+int f_trigram_index_build(f_trigram_index** out, f_index* index, char* path, size_t block_lines, size_t filter_bytes, int threads, f_cancel_state* cancel);
+
+/**
+  Checks if a block can have lines that match
+  @param trigrams the trigram index
+  @param query the query of the pattern
+  @param block the block to check
+  @return false if no line of the block can match
+*/
+bool f_trigram_index_maybe(f_trigram_index* trigrams, f_trigram_query* query, size_t block);
+
+/**
+  Unmaps and deletes a trigram index
+  @param trigrams the trigram index to free
+*/
+void f_trigram_index_free(f_trigram_index** trigrams);
+
+/**
+  Derives the trigrams a match of `pattern` must contain
+
+  Only literal runs are used, anything the parser isn't sure about
+  (groups, classes, options, optional characters) just ends a run.
+  @param out the query, NULL if the pattern doesn't require any trigram
+  @param pattern the regex
+  @return non zero for error
+*/
+int f_trigram_query_init(f_trigram_query** out, const char* pattern);
+
+/**
+  Frees a trigram query
+  @param query the query to free
+*/
+void f_trigram_query_free(f_trigram_query** query);
+
+#endif
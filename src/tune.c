@@ -0,0 +1,364 @@
+#ifndef FLASHLIGHT_TUNE
+#define FLASHLIGHT_TUNE
+#include <string.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <sys/sysmacros.h>
+#endif
+#include "tune.h"
+
+#ifdef __linux__
+// filesystem magics, from linux/magic.h and the filesystems that don't export theirs.
+static const long f_tune_network_fs[] = {
+  0x6969, /* nfs */
+  0x517b, /* smb */
+  (long) 0xff534d42, /* cifs */
+  (long) 0xfe534d42, /* smb2 */
+  0x65735546, /* fuse */
+  0x00c36400, /* ceph */
+  0x01021997, /* 9p */
+  0x5346414f, /* afs */
+  0x0bd00bd0 /* lustre */
+};
+
+static const long f_tune_memory_fs[] = {
+  0x01021994, /* tmpfs */
+  (long) 0x858458f6 /* ramfs */
+};
+
+/*
+  reads a number from a sysfs attribute, -1 if it isn't there.
+*/
+static long f_tune_sysfs(const char* dir, const char* name)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+
+  long value;
+  if (fscanf(fp, "%ld", &value) != 1)
+  {
+    value = -1;
+  }
+  fclose(fp);
+  return value;
+}
+
+static bool f_tune_fs_is(long type, const long* types, size_t len)
+{
+  for (size_t i=0; i<len; i++)
+  {
+    if ((type & 0xffffffff) == (types[i] & 0xffffffff))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  finds the queue of the block device the target is on, partitions share their disk's queue.
+*/
+static void f_tune_probe_device(f_tune_probe* out, int fd, struct stat* st)
+{
+  struct statfs fs;
+  if (fstatfs(fd, &fs) == 0)
+  {
+    if (f_tune_fs_is((long) fs.f_type, f_tune_network_fs, sizeof(f_tune_network_fs) / sizeof(long)))
+    {
+      out->device = F_DEVICE_NETWORK;
+      return;
+    }
+
+    if (f_tune_fs_is((long) fs.f_type, f_tune_memory_fs, sizeof(f_tune_memory_fs) / sizeof(long)))
+    {
+      out->device = F_DEVICE_MEMORY;
+      return;
+    }
+  }
+
+  char dir[128];
+  snprintf(dir, sizeof(dir), "/sys/dev/block/%u:%u", major(st->st_dev), minor(st->st_dev));
+  if (f_tune_sysfs(dir, "partition") > 0)
+  {
+    strncat(dir, "/..", sizeof(dir) - strlen(dir) - 1);
+  }
+  strncat(dir, "/queue", sizeof(dir) - strlen(dir) - 1);
+
+  long rotational = f_tune_sysfs(dir, "rotational");
+  if (rotational == -1)
+  {
+    // overlay, btrfs subvolumes and other devices without a queue of their own.
+    return;
+  }
+
+  out->device = rotational == 1 ? F_DEVICE_ROTATIONAL : F_DEVICE_SOLID;
+
+  long block_size = f_tune_sysfs(dir, "logical_block_size");
+  long queue_depth = f_tune_sysfs(dir, "nr_requests");
+  long optimal_io = f_tune_sysfs(dir, "optimal_io_size");
+  out->block_size = block_size > 0 ? (size_t) block_size : out->block_size;
+  out->queue_depth = queue_depth > 0 ? (size_t) queue_depth : 0;
+  out->optimal_io = optimal_io > 0 ? (size_t) optimal_io : 0;
+}
+#endif
+
+/*
+  times reads spread over the target. the fastest one tells if the target is cached.
+*/
+static void f_tune_calibrate(f_tune_probe* out, int fd, size_t file_size)
+{
+  if (file_size < F_TUNE_CALIBRATE_SIZE)
+  {
+    return;
+  }
+
+  uint8_t* buffer = malloc(F_TUNE_CALIBRATE_SIZE);
+  if (buffer == NULL)
+  {
+    return;
+  }
+
+  uint64_t total_ns = 0;
+  size_t total_bytes = 0;
+  size_t step = (file_size - F_TUNE_CALIBRATE_SIZE) / F_TUNE_CALIBRATE_READS;
+  for (int i=0; i<F_TUNE_CALIBRATE_READS; i++)
+  {
+    uint64_t started = f_stats_now();
+    ssize_t n = pread(fd, buffer, F_TUNE_CALIBRATE_SIZE, (off_t) (step * i));
+    uint64_t elapsed = f_stats_now() - started;
+    if (n <= 0)
+    {
+      break;
+    }
+
+    out->read_ns = out->read_ns == 0 || elapsed < out->read_ns ? elapsed : out->read_ns;
+    total_ns += elapsed;
+    total_bytes += (size_t) n;
+  }
+
+  out->read_mb_per_sec = total_ns > 0 ? (double) total_bytes / (1024.0 * 1024.0) * 1e9 / (double) total_ns : 0.0;
+  free(buffer);
+}
+
+int f_tune_probe_fd(f_tune_probe* out, int fd, size_t file_size)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    f_log(F_LOG_ERROR, "cannot stat target to tune for");
+    return -1;
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  out->device = F_DEVICE_UNKNOWN;
+  out->cores = cores > 0 ? (int) cores : 1;
+  out->block_size = st.st_blksize > 0 ? (size_t) st.st_blksize : 4096;
+  out->queue_depth = 0;
+  out->optimal_io = 0;
+  out->read_ns = 0;
+  out->read_mb_per_sec = 0.0;
+  out->available_memory = 0;
+
+#ifdef _SC_AVPHYS_PAGES
+  long pages = sysconf(_SC_AVPHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (pages > 0 && page_size > 0)
+  {
+    out->available_memory = (size_t) pages * (size_t) page_size;
+  }
+#endif
+
+#ifdef __linux__
+  f_tune_probe_device(out, fd, &st);
+#endif
+
+  f_tune_calibrate(out, fd, file_size);
+
+  // a cached target is read at memory speed, whatever it is stored on.
+  if (out->read_ns > 0 && out->read_ns < F_TUNE_CACHED_NS && out->device != F_DEVICE_NETWORK)
+  {
+    out->device = F_DEVICE_MEMORY;
+  }
+
+  return 0;
+}
+
+static size_t f_tune_round(size_t size, size_t block_size)
+{
+  if (block_size > 1)
+  {
+    size = (size + block_size - 1) / block_size * block_size;
+  }
+  return size;
+}
+
+void f_tune_indexer(f_indexer* indexer, const f_tune_probe* probe, size_t file_size)
+{
+  int threads;
+  int concurrency;
+  size_t buffer_size;
+
+  switch (probe->device)
+  {
+    case F_DEVICE_ROTATIONAL:
+      // few large sequential reads, more readers only add seeks.
+      threads = probe->cores < 2 ? probe->cores : 2;
+      concurrency = 2;
+      buffer_size = 8u << 20;
+      break;
+    case F_DEVICE_NETWORK:
+      // large reads amortize the round trips, in flight on a few threads.
+      threads = probe->cores < 8 ? probe->cores : 8;
+      concurrency = 8;
+      buffer_size = 4u << 20;
+      break;
+    case F_DEVICE_MEMORY:
+      // bound by scanning, every core gets a share.
+      threads = probe->cores;
+      concurrency = 2;
+      buffer_size = 1u << 20;
+      break;
+    case F_DEVICE_SOLID:
+      // keep the device queue busy without going past it.
+      threads = probe->cores;
+      concurrency = 4;
+      if (probe->queue_depth > 0)
+      {
+        size_t per_thread = probe->queue_depth / (size_t) threads;
+        concurrency = per_thread < 2 ? 2 : per_thread > 16 ? 16 : (int) per_thread;
+      }
+      buffer_size = probe->optimal_io > (1u << 20) && probe->optimal_io <= (8u << 20) ? probe->optimal_io : 1u << 20;
+      break;
+    default:
+      threads = probe->cores;
+      concurrency = 4;
+      buffer_size = 1u << 20;
+      break;
+  }
+
+  if (probe->read_ns > F_TUNE_SLOW_NS && buffer_size < (4u << 20))
+  {
+    buffer_size = 4u << 20;
+  }
+
+  if (indexer->buffer_size == 0)
+  {
+    // small targets still get a buffer per thread.
+    size_t share = f_tune_round(file_size / (size_t) threads, probe->block_size);
+    indexer->buffer_size = f_tune_round(buffer_size, probe->block_size);
+    if (share < indexer->buffer_size)
+    {
+      indexer->buffer_size = share > F_TUNE_BUFFER_MIN ? share : F_TUNE_BUFFER_MIN;
+    }
+  }
+
+  if (indexer->threads <= 0)
+  {
+    size_t buffers = (file_size + indexer->buffer_size - 1) / indexer->buffer_size;
+    indexer->threads = buffers < (size_t) threads ? (buffers > 0 ? (int) buffers : 1) : threads;
+  }
+
+  if (indexer->concurrency <= 0)
+  {
+    indexer->concurrency = concurrency;
+  }
+
+  if (indexer->max_bytes_per_iteration == 0)
+  {
+    // the record ends of an iteration are held until the merge, bound what they take.
+    unsigned long long memory = F_TUNE_ITERATION_MAX / F_TUNE_LINE_BYTES * F_TUNE_OFFSET_BYTES;
+    if (probe->available_memory > 0 && probe->available_memory / F_TUNE_MEMORY_SHARE < memory)
+    {
+      memory = probe->available_memory / F_TUNE_MEMORY_SHARE;
+    }
+
+    unsigned long long bytes = memory / F_TUNE_OFFSET_BYTES * F_TUNE_LINE_BYTES;
+    bytes = bytes < F_TUNE_ITERATION_MIN ? F_TUNE_ITERATION_MIN : bytes > F_TUNE_ITERATION_MAX ? F_TUNE_ITERATION_MAX : bytes;
+
+    if (indexer->adaptive)
+    {
+      unsigned long long share = file_size / F_TUNE_ADAPT_ITERATIONS;
+      unsigned long long least = (unsigned long long) indexer->threads * indexer->buffer_size;
+      share = share < least ? least : share;
+      bytes = share < bytes ? share : bytes;
+    }
+    indexer->max_bytes_per_iteration = (size_t) bytes;
+  }
+
+  f_log(F_LOG_INFO, "tuned for device %d, %d cores: threads %d, concurrency %d, buffer size %zu, bytes per iteration %zu",
+    probe->device, probe->cores, indexer->threads, indexer->concurrency, indexer->buffer_size, indexer->max_bytes_per_iteration);
+}
+
+void f_tune_adapt_init(f_tune_adapt* adapt, size_t buffer_size, size_t block_size)
+{
+  adapt->buffer_size = buffer_size;
+  adapt->block_size = block_size;
+  adapt->best_size = buffer_size;
+  adapt->best_rate = 0.0;
+  adapt->direction = 1;
+  adapt->locked = false;
+  adapt->settled = false;
+}
+
+/*
+  the next size in the current direction, 0 if it's out of bounds.
+*/
+static size_t f_tune_adapt_step(f_tune_adapt* adapt, size_t from)
+{
+  size_t size = f_tune_round(adapt->direction > 0 ? from * 2 : from / 2, adapt->block_size);
+  return size < F_TUNE_BUFFER_MIN || size > F_TUNE_BUFFER_MAX || size == from ? 0 : size;
+}
+
+size_t f_tune_adapt_next(f_tune_adapt* adapt, size_t bytes, uint64_t elapsed_ns)
+{
+  if (adapt->settled || elapsed_ns == 0 || bytes == 0)
+  {
+    return adapt->buffer_size;
+  }
+
+  double rate = (double) bytes / (double) elapsed_ns;
+  if (adapt->best_rate == 0.0 || rate > adapt->best_rate * (1.0 + F_TUNE_ADAPT_NOISE))
+  {
+    // once a step helped, the sizes behind it are known to be worse.
+    adapt->locked = adapt->best_rate > 0.0;
+    adapt->best_size = adapt->buffer_size;
+    adapt->best_rate = rate;
+  }
+  else if (!adapt->locked)
+  {
+    // growing didn't help, try below the first size instead.
+    adapt->locked = true;
+    adapt->direction = -1;
+  }
+  else
+  {
+    adapt->settled = true;
+    adapt->buffer_size = adapt->best_size;
+    return adapt->buffer_size;
+  }
+
+  size_t next = f_tune_adapt_step(adapt, adapt->best_size);
+  if (next == 0 && !adapt->locked)
+  {
+    adapt->locked = true;
+    adapt->direction = -1;
+    next = f_tune_adapt_step(adapt, adapt->best_size);
+  }
+
+  if (next == 0)
+  {
+    adapt->settled = true;
+    next = adapt->best_size;
+  }
+
+  adapt->buffer_size = next;
+  return next;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef FLASHLIGHT_TUNE_H
+#define FLASHLIGHT_TUNE_H
+
+/** @file tune.h
+* @brief Picks indexing parameters for the device a target is on
+*
+* The device is probed once: the rotational flag, block size and queue depth from sysfs,
+* the filesystem type for network mounts, the number of cores, and a few timed reads of the target.
+* Only the parameters left at 0 in an `f_indexer` are picked.
+* With `adaptive`, the buffer size is also adjusted between iterations while throughput improves.
+*/
+
+// bytes of each calibration read.
+#define F_TUNE_CALIBRATE_SIZE (256u << 10)
+// calibration reads, spread over the target.
+#define F_TUNE_CALIBRATE_READS 4
+// a calibration read faster than this came from the page cache.
+#define F_TUNE_CACHED_NS 100000ull
+// a calibration read slower than this needs bigger buffers to amortize the latency.
+#define F_TUNE_SLOW_NS 2000000ull
+// bounds of the buffer size.
+#define F_TUNE_BUFFER_MIN (64u << 10)
+#define F_TUNE_BUFFER_MAX (64u << 20)
+// bounds of the bytes indexed per iteration.
+#define F_TUNE_ITERATION_MIN (16ull << 20)
+#define F_TUNE_ITERATION_MAX (128ull << 20)
+// the memory a record end takes until its iteration is merged.
+#define F_TUNE_OFFSET_BYTES 32
+// the short average line the record ends of an iteration are budgeted for.
+#define F_TUNE_LINE_BYTES 16
+// the record ends of an iteration take at most 1/n of the available memory.
+#define F_TUNE_MEMORY_SHARE 8
+// iterations an adaptive run is split into at least, so there are samples to adapt on.
+#define F_TUNE_ADAPT_ITERATIONS 8
+// throughput has to improve by this much for a buffer size to count as better.
+#define F_TUNE_ADAPT_NOISE 0.05
+
+/**
+* @brief the kind of storage a target is on
+*/
+enum F_DEVICE
+{
+  F_DEVICE_UNKNOWN = 0, /**< nothing could be probed */
+  F_DEVICE_ROTATIONAL, /**< a spinning disk, seeks are expensive */
+  F_DEVICE_SOLID, /**< an ssd or nvme drive */
+  F_DEVICE_MEMORY, /**< tmpfs, or a target that is in the page cache */
+  F_DEVICE_NETWORK /**< nfs, smb and other network or fuse mounts, reads have a high latency */
+};
+
+/** @struct FTuneProbe
+* @brief what was found out about the device and the host
+* @var FTuneProbe::device
+* the kind of storage
+* @var FTuneProbe::cores
+* the online cores
+* @var FTuneProbe::block_size
+* the logical block size of the device, or the preferred io size of the file
+* @var FTuneProbe::queue_depth
+* the requests the device queues (0 if unknown)
+* @var FTuneProbe::optimal_io
+* the optimal io size of the device (0 if unknown)
+* @var FTuneProbe::read_ns
+* the fastest calibration read (0 if the target was too small)
+* @var FTuneProbe::read_mb_per_sec
+* the throughput of the calibration reads
+* @var FTuneProbe::available_memory
+* the free physical memory of the host (0 if unknown)
+*/
+typedef struct FTuneProbe
+{
+  enum F_DEVICE device;
+  int cores;
+  size_t block_size;
+  size_t queue_depth;
+  size_t optimal_io;
+  uint64_t read_ns;
+  double read_mb_per_sec;
+  size_t available_memory;
+} f_tune_probe;
+
+/** @struct FTuneAdapt
+* @brief adjusts the buffer size between iterations, doubling it while throughput improves
+* @var FTuneAdapt::buffer_size
+* the buffer size of the next iteration
+* @var FTuneAdapt::block_size
+* buffer sizes are a multiple of it
+* @var FTuneAdapt::best_size
+* the buffer size with the best throughput so far
+* @var FTuneAdapt::best_rate
+* its throughput in bytes per nanosecond (0 before the first sample)
+* @var FTuneAdapt::direction
+* 1 while growing, -1 while shrinking
+* @var FTuneAdapt::locked
+* true once the direction is fixed, because a step helped or shrinking is tried
+* @var FTuneAdapt::settled
+* true once the best size was found, it isn't changed anymore
+*/
+typedef struct FTuneAdapt
+{
+  size_t buffer_size;
+  size_t block_size;
+  size_t best_size;
+  double best_rate;
+  int direction;
+  bool locked;
+  bool settled;
+} f_tune_adapt;
+
+/**
+  Probes the device and host a target is read from
+  @param out what was found out
+  @param fd the file descriptor of the target
+  @param file_size the size of the target, to spread the calibration reads (0 to skip them)
+  @return non zero for error
+*/
+int f_tune_probe_fd(f_tune_probe* out, int fd, size_t file_size);
+
+/**
+  Picks threads, concurrency, buffer_size and max_bytes_per_iteration where they are 0.
+  Every record end of an iteration is held in memory until the merge, so the bytes per iteration
+  are bounded by what the record ends of short lines would take, and by the available memory.
+  @param indexer the indexer config to fill in
+  @param probe the device and host
+  @param file_size the size of the target
+*/
+void f_tune_indexer(f_indexer* indexer, const f_tune_probe* probe, size_t file_size);
+
+/**
+  Starts adapting the buffer size
+  @param adapt the state to init
+  @param buffer_size the buffer size of the first iteration
+  @param block_size buffer sizes are a multiple of it (0 for none)
+*/
+void f_tune_adapt_init(f_tune_adapt* adapt, size_t buffer_size, size_t block_size);
+
+/**
+  Records the throughput of an iteration
+  @param adapt the state
+  @param bytes the bytes the iteration indexed
+  @param elapsed_ns how long it took
+  @return the buffer size of the next iteration
+*/
+size_t f_tune_adapt_next(f_tune_adapt* adapt, size_t bytes, uint64_t elapsed_ns);
+
+#endif
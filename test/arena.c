@@ -0,0 +1,60 @@
+TEST test_f_arena_alloc(void)
+{
+  f_arena* arena;
+  ASSERT_EQ(0, f_arena_init(&arena, 256));
+  ASSERT_EQ(NULL, arena->first);
+
+  // aligned for any type, and never overlapping.
+  uint8_t* a = f_arena_alloc(arena, 3);
+  uint8_t* b = f_arena_alloc(arena, sizeof(size_t));
+  if (a == NULL || b == NULL) FAIL();
+  ASSERT_EQ(0, (uintptr_t) a % _Alignof(max_align_t));
+  ASSERT_EQ(0, (uintptr_t) b % _Alignof(max_align_t));
+  ASSERT(b >= a + 3);
+  memset(a, 1, 3);
+  *(size_t*) b = 42;
+
+  // larger than a block gets a block of its own.
+  uint8_t* big = f_arena_alloc(arena, 1024);
+  if (big == NULL) FAIL();
+  memset(big, 2, 1024);
+  ASSERT_EQ_FMT(256ul + 1024ul, arena->allocated, "%zu");
+  ASSERT_EQ(1, a[2]);
+  ASSERT_EQ_FMT(42ul, *(size_t*) b, "%zu");
+
+  f_arena_free(&arena);
+  ASSERT_EQ(NULL, arena);
+  PASS();
+}
+
+TEST test_f_arena_reset(void)
+{
+  f_arena* arena;
+  ASSERT_EQ(0, f_arena_init(&arena, 1024));
+
+  for (int i=0; i<200; i++)
+  {
+    if (f_arena_alloc(arena, 32) == NULL) FAIL();
+  }
+  size_t allocated = arena->allocated;
+  ASSERT(allocated >= 200 * 32);
+
+  // the same round again reuses the blocks, from the start.
+  f_arena_reset(arena);
+  void* first = f_arena_alloc(arena, 32);
+  ASSERT_EQ((void*) arena->first->data, first);
+  for (int i=1; i<200; i++)
+  {
+    if (f_arena_alloc(arena, 32) == NULL) FAIL();
+  }
+  ASSERT_EQ_FMT(allocated, arena->allocated, "%zu");
+
+  f_arena_free(&arena);
+  PASS();
+}
+
+SUITE(f_arena_suite)
+{
+  RUN_TEST(test_f_arena_alloc);
+  RUN_TEST(test_f_arena_reset);
+}
@@ -0,0 +1,78 @@
+TEST test_f_bitmap_add(void)
+{
+  f_bitmap* bitmap;
+  if (f_bitmap_init(&bitmap) == -1) FAIL();
+
+  f_bitmap_add(bitmap, 3);
+  f_bitmap_add(bitmap, 70000);
+  f_bitmap_add(bitmap, 1);
+  f_bitmap_add(bitmap, 3);
+
+  ASSERT_EQ_FMT(3ul, bitmap->cardinality, "%zu");
+  ASSERT_EQ_FMT(2ul, bitmap->len, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 1));
+  ASSERT(f_bitmap_contains(bitmap, 3));
+  ASSERT(f_bitmap_contains(bitmap, 70000));
+  ASSERT_FALSE(f_bitmap_contains(bitmap, 2));
+  ASSERT_FALSE(f_bitmap_contains(bitmap, 65536 + 3));
+
+  f_bitmap_free(&bitmap);
+  PASS();
+}
+
+TEST test_f_bitmap_dense(void)
+{
+  f_bitmap* bitmap;
+  if (f_bitmap_init(&bitmap) == -1) FAIL();
+
+  // past F_BITMAP_ARRAY_MAX the container becomes a bitset.
+  for (size_t i=0; i<20000; i+=2)
+  {
+    f_bitmap_add(bitmap, i);
+  }
+
+  ASSERT(bitmap->containers[0].bits != NULL);
+  ASSERT_EQ_FMT(10000ul, bitmap->cardinality, "%zu");
+  ASSERT_EQ_FMT(50ul, f_bitmap_count_range(bitmap, 100, 200), "%zu");
+  ASSERT_EQ_FMT(10000ul, f_bitmap_count_range(bitmap, 0, 1000000), "%zu");
+
+  size_t next;
+  ASSERT(f_bitmap_next(bitmap, 301, &next));
+  ASSERT_EQ_FMT(302ul, next, "%zu");
+  ASSERT_FALSE(f_bitmap_next(bitmap, 19999, &next));
+
+  f_bitmap_free(&bitmap);
+  PASS();
+}
+
+TEST test_f_bitmap_merge(void)
+{
+  f_bitmap* a;
+  f_bitmap* b;
+  if (f_bitmap_init(&a) == -1) FAIL();
+  if (f_bitmap_init(&b) == -1) FAIL();
+
+  f_bitmap_add(a, 5);
+  f_bitmap_add(a, 10);
+  f_bitmap_add(b, 10);
+  f_bitmap_add(b, 200000);
+
+  if (f_bitmap_merge(a, b) == -1) FAIL();
+
+  ASSERT_EQ_FMT(3ul, a->cardinality, "%zu");
+
+  size_t next;
+  ASSERT(f_bitmap_next(a, 11, &next));
+  ASSERT_EQ_FMT(200000ul, next, "%zu");
+
+  f_bitmap_free(&a);
+  f_bitmap_free(&b);
+  PASS();
+}
+
+SUITE(f_bitmap_suite)
+{
+  RUN_TEST(test_f_bitmap_add);
+  RUN_TEST(test_f_bitmap_dense);
+  RUN_TEST(test_f_bitmap_merge);
+}
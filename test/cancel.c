@@ -0,0 +1,45 @@
+TEST test_f_cancel_state(void)
+{
+  f_cancel* cancel;
+  if (f_cancel_init(&cancel) == -1) FAIL();
+
+  f_cancel_state state;
+  f_cancel_state_init(&state, cancel, 0);
+  ASSERT_EQ_FMT(F_CANCEL_NONE, f_cancel_state_poll(&state), "%d");
+
+  f_cancel_request(cancel);
+  ASSERT(f_cancel_requested(cancel));
+  ASSERT_EQ_FMT(F_CANCEL_REQUESTED, f_cancel_state_poll(&state), "%d");
+
+  // the first reason sticks.
+  f_cancel_reset(cancel);
+  f_cancel_state_fail(&state);
+  ASSERT_EQ_FMT(F_CANCEL_REQUESTED, f_cancel_state_poll(&state), "%d");
+
+  errno = 0;
+  f_cancel_state_errno(&state);
+  ASSERT_EQ_FMT(ECANCELED, errno, "%d");
+
+  f_cancel_free(&cancel);
+  PASS();
+}
+
+TEST test_f_cancel_state_deadline(void)
+{
+  f_cancel_state state;
+  f_cancel_state_init(&state, NULL, 1);
+
+  usleep(2000);
+  ASSERT_EQ_FMT(F_CANCEL_DEADLINE, f_cancel_state_poll(&state), "%d");
+
+  errno = 0;
+  f_cancel_state_errno(&state);
+  ASSERT_EQ_FMT(ETIMEDOUT, errno, "%d");
+  PASS();
+}
+
+SUITE(f_cancel_suite)
+{
+  RUN_TEST(test_f_cancel_state);
+  RUN_TEST(test_f_cancel_state_deadline);
+}
@@ -0,0 +1,239 @@
+static const char* compress_words[] = { "error", "info", "warn", "debug" };
+
+// the lines both fixtures were compressed from.
+static size_t compress_line(char* out, size_t len, int i)
+{
+  return (size_t) snprintf(out, len, "%05d %s request %d took %dms\n", i, compress_words[i * 7 % 4], i * 31 % 977, i * 13 % 211);
+}
+
+static char* compress_text(size_t* len)
+{
+  char* text = malloc(sizeof(char) * 3000 * 64);
+  *len = 0;
+  for (int i=0; i<3000; i++)
+  {
+    *len += compress_line(text + *len, 64, i);
+  }
+  return text;
+}
+
+static int compress_count(void* payload, const uint8_t* data, size_t len, size_t offset, void* result)
+{
+  size_t* total = payload;
+  if (offset != *total)
+  {
+    return -1;
+  }
+
+  *total += len;
+  return 0;
+}
+
+f_index* get_compressed_index(char* filename, enum F_COMPRESSION compression)
+{
+  f_indexer config = {
+    .filename = filename,
+    .lookup_dir = ".flashlight",
+    .buffer_size = 1000,
+    .concurrency = 2,
+    .threads = 2,
+    .max_bytes_per_iteration = 10000,
+    .compression = compression,
+    .compression_span = 4096
+  };
+
+  return f_index_text_file(config);
+}
+
+static enum greatest_test_res compress_check_index(f_index* index)
+{
+  ASSERT_EQ_FMT(3000ul, f_index_line_count(index), "%zu");
+
+  // the lines around a member or frame boundary.
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 995, 1010));
+  ASSERT_EQ_FMT(1010ul, lines.count, "%zu");
+  for (size_t i=0; i<lines.count; i++)
+  {
+    char expected[64];
+    size_t expected_len = compress_line(expected, sizeof(expected), (int) (995 + i)) - 1;
+    char* line;
+    size_t line_len;
+    f_index_lines_get(&lines, i, &line, &line_len);
+    ASSERT_EQ_FMT(expected_len, line_len, "%zu");
+    ASSERT_STRN_EQ(expected, line, line_len);
+  }
+  f_index_lines_free(&lines);
+
+  char* data;
+  ASSERT_EQ(0, f_index_lookup(&data, index, 2999, 1));
+  ASSERT_STR_EQ("02999 info request 154 took 163ms\n", data);
+  free(data);
+
+  size_t count;
+  f_searcher searcher = {
+    .regex = "^\\d+ error request 5",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 100u
+  };
+  ASSERT_EQ(0, f_index_search_count(searcher, &count));
+  ASSERT_EQ_FMT(85ul, count, "%zu");
+  PASS();
+}
+
+TEST test_f_compress_gzip(void)
+{
+  f_index* index = get_compressed_index("test/zfixtures/lines.txt.gz", F_COMPRESSION_AUTO);
+  if (index == NULL) FAIL();
+  ASSERT(index->compressed != NULL);
+  ASSERT_EQ(F_COMPRESSION_GZIP, index->compressed->kind);
+
+  // two members and window points in between.
+  ASSERT(index->compressed->len > 2);
+  CHECK_CALL(compress_check_index(index));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_compress_zstd(void)
+{
+  f_index* index = get_compressed_index("test/zfixtures/lines.txt.zst", F_COMPRESSION_ZSTD);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(3ul, index->compressed->len, "%zu");
+  CHECK_CALL(compress_check_index(index));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_compress_bgzf(void)
+{
+  // every member starts a checkpoint, the last one is the empty end of file block.
+  f_index* index = get_compressed_index("test/zfixtures/lines.txt.bgz", F_COMPRESSION_AUTO);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(8ul, index->compressed->len, "%zu");
+  ASSERT_EQ_FMT(16000ul, index->compressed->points[1].out, "%zu");
+  CHECK_CALL(compress_check_index(index));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_compress_read(void)
+{
+  size_t text_len;
+  char* text = compress_text(&text_len);
+
+  int fd = open("test/zfixtures/lines.txt.gz", O_RDONLY);
+  ASSERT(fd != -1);
+  ASSERT_EQ(F_COMPRESSION_GZIP, f_compressed_detect(fd));
+
+  size_t seen = 0;
+  f_compressed* compressed;
+  ASSERT_EQ(0, f_compressed_build(&compressed, fd, F_COMPRESSION_GZIP, 4096, 1, NULL, compress_count, &seen));
+  ASSERT_EQ_FMT(text_len, seen, "%zu");
+  ASSERT_EQ_FMT(text_len, compressed->size, "%zu");
+
+  // backwards, forwards and across checkpoints, some from the cache.
+  char buffer[9000];
+  size_t offsets[] = { 90000, 0, 59990, 4000, 59990, 12345, 100000 };
+  for (size_t i=0; i<sizeof(offsets) / sizeof(offsets[0]); i++)
+  {
+    ssize_t n = f_compressed_read(compressed, buffer, sizeof(buffer), offsets[i]);
+    size_t expected = text_len - offsets[i] < sizeof(buffer) ? text_len - offsets[i] : sizeof(buffer);
+    ASSERT_EQ_FMT((ssize_t) expected, n, "%zd");
+    ASSERT_MEM_EQ(text + offsets[i], buffer, expected);
+  }
+  ASSERT_EQ(0, f_compressed_read(compressed, buffer, sizeof(buffer), text_len));
+
+  f_compressed_free(&compressed);
+  close(fd);
+
+  // frames decompressed on threads still come in order.
+  fd = open("test/zfixtures/lines.txt.zst", O_RDONLY);
+  seen = 0;
+  ASSERT_EQ(0, f_compressed_build(&compressed, fd, F_COMPRESSION_ZSTD, 0, 3, NULL, compress_count, &seen));
+  ASSERT_EQ_FMT(text_len, seen, "%zu");
+  ASSERT_EQ_FMT(3ul, compressed->len, "%zu");
+  ASSERT_EQ_FMT((ssize_t) sizeof(buffer), f_compressed_read(compressed, buffer, sizeof(buffer), 30000), "%zd");
+  ASSERT_MEM_EQ(text + 30000, buffer, sizeof(buffer));
+  f_compressed_free(&compressed);
+  close(fd);
+
+  fd = open("test/zfixtures/records.csv", O_RDONLY);
+  ASSERT_EQ(F_COMPRESSION_NONE, f_compressed_detect(fd));
+  close(fd);
+
+  free(text);
+  PASS();
+}
+
+TEST test_f_compress_prefix(char* filename, int threads)
+{
+  // every error or warn line starts a record of two lines, some end in the lookahead of a frame.
+  f_indexer config = {
+    .filename = filename,
+    .lookup_dir = ".flashlight",
+    .buffer_size = 1000,
+    .concurrency = 2,
+    .threads = threads,
+    .max_bytes_per_iteration = 10000,
+    .compression = F_COMPRESSION_AUTO,
+    .record = F_RECORD_PREFIX,
+    .record_prefix = "^\\d+ (error|warn) "
+  };
+  f_index* index = f_index_text_file(config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(1500u, index->flookup->len - 1, "%u");
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 0, 1500));
+  ASSERT_EQ_FMT(1500ul, lines.count, "%zu");
+  for (size_t i=0; i<lines.count; i++)
+  {
+    char expected[128];
+    size_t expected_len = compress_line(expected, sizeof(expected), (int) (2 * i));
+    expected_len += compress_line(expected + expected_len, sizeof(expected) - expected_len, (int) (2 * i + 1)) - 1;
+    char* line;
+    size_t line_len;
+    f_index_lines_get(&lines, i, &line, &line_len);
+    ASSERT_EQ_FMT(expected_len, line_len, "%zu");
+    ASSERT_STRN_EQ(expected, line, line_len);
+  }
+  f_index_lines_free(&lines);
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_compress_fixed(void)
+{
+  // formats that read the raw target can't index a compressed one.
+  f_indexer config = {
+    .filename = "test/zfixtures/lines.txt.zst",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 1000,
+    .concurrency = 2,
+    .threads = 2,
+    .max_bytes_per_iteration = 10000,
+    .format = &f_indexer_format_fixed,
+    .record_width = 8,
+    .compression = F_COMPRESSION_AUTO
+  };
+  ASSERT_EQ(NULL, f_index_text_file(config));
+  PASS();
+}
+
+SUITE(f_compress_suite)
+{
+  RUN_TEST(test_f_compress_gzip);
+  RUN_TEST(test_f_compress_zstd);
+  RUN_TEST(test_f_compress_bgzf);
+  RUN_TEST(test_f_compress_read);
+  RUN_TESTp(test_f_compress_prefix, "test/zfixtures/lines.txt.zst", 1);
+  RUN_TESTp(test_f_compress_prefix, "test/zfixtures/lines.txt.zst", 3);
+  RUN_TESTp(test_f_compress_prefix, "test/zfixtures/lines.txt.bgz", 3);
+  RUN_TEST(test_f_compress_fixed);
+}
@@ -0,0 +1,116 @@
+f_index* get_field_index(int threads, char field_delimiter)
+{
+  f_indexer config = {
+    .filename = "test/zfixtures/fields.csv",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 400000,
+    .concurrency = 50,
+    .threads = threads,
+    .max_bytes_per_iteration = 500000,
+    .field_delimiter = field_delimiter
+  };
+
+  return f_index_text_file(config);
+}
+
+TEST test_f_field_index(int threads)
+{
+  f_index* index = get_field_index(threads, ',');
+  if (index == NULL) FAIL();
+  ASSERT(index->fields != NULL);
+  ASSERT_EQ_FMT(3ul, index->fields->columns, "%zu");
+  ASSERT_EQ_FMT(7ul, index->fields->lines, "%zu");
+
+  // the quoted newline keeps "two\nlines" in one row.
+  ASSERT_EQ_FMT(6ul, index->fields->rows, "%zu");
+  ASSERT_EQ_FMT(4ul, (size_t) index->fields->row_lines[3], "%zu");
+
+  size_t offset, len;
+  ASSERT(f_field_index_span(index->fields, 4, 2, &offset, &len));
+  ASSERT_EQ_FMT(2ul, offset, "%zu");
+  ASSERT_EQ_FMT(11ul, len, "%zu");
+  // the rest of the quoted note is the only column on the line.
+  ASSERT(f_field_index_span(index->fields, 3, 3, &offset, &len));
+  ASSERT_EQ_FMT(0ul, offset, "%zu");
+  ASSERT(!f_field_index_span(index->fields, 3, 1, &offset, &len));
+  ASSERT(!f_field_index_span(index->fields, 5, 3, &offset, &len));
+
+  char* values;
+  ASSERT_EQ(0, f_index_lookup_column(&values, index, 1, 5, 2));
+  ASSERT_STR_EQ("alice\nbob\ncarol, jr\ndave\nerin", values);
+  free(values);
+
+  ASSERT_EQ(0, f_index_lookup_column(&values, index, 1, 10, 3));
+  ASSERT_STR_EQ("plain\ntwo\nlines\nsay \"hi\"\n\na,b", values);
+  free(values);
+
+  ASSERT_EQ(-1, f_index_lookup_column(&values, index, 0, 1, 4));
+
+  char* path = strdup(index->fields->path);
+  f_index_free(&index);
+  ASSERT_EQ(-1, access(path, F_OK));
+  free(path);
+  PASS();
+}
+
+TEST test_f_field_search_column(void)
+{
+  f_index* index = get_field_index(2, ',');
+  if (index == NULL) FAIL();
+
+  f_searcher searcher = {
+    .regex = "a",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u,
+    .column = 2
+  };
+
+  // "a,b" is in the third column.
+  f_bitmap* bitmap;
+  ASSERT_EQ(0, f_index_search_bitmap(searcher, &bitmap));
+  ASSERT_EQ_FMT(4ul, bitmap->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 1));
+  ASSERT(f_bitmap_contains(bitmap, 2));
+  ASSERT(f_bitmap_contains(bitmap, 5));
+  ASSERT(f_bitmap_contains(bitmap, 6));
+  f_bitmap_free(&bitmap);
+
+  searcher.column = 4;
+  ASSERT_EQ(-1, f_index_search_bitmap(searcher, &bitmap));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_field_none(void)
+{
+  f_index* index = get_field_index(2, '\0');
+  if (index == NULL) FAIL();
+  ASSERT_EQ(NULL, index->fields);
+
+  char* values;
+  ASSERT_EQ(-2, f_index_lookup_column(&values, index, 0, 1, 1));
+
+  f_searcher searcher = {
+    .regex = "a",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u,
+    .column = 1
+  };
+
+  size_t count;
+  ASSERT_EQ(-1, f_index_search_count(searcher, &count));
+
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_field_suite)
+{
+  RUN_TESTp(test_f_field_index, 1);
+  RUN_TESTp(test_f_field_index, 3);
+  RUN_TEST(test_f_field_search_column);
+  RUN_TEST(test_f_field_none);
+}
@@ -0,0 +1,58 @@
+#define FIXTURE_WORDS "test/zfixtures/words.txt"
+
+// set by fixture_words_init, from the file as written.
+static size_t fixture_words_lines = 0;
+static size_t fixture_words_car = 0;
+
+/*
+  writes test/zfixtures/words.txt, the same bytes on every run,
+  and counts its lines and the ones starting with "car".
+*/
+static int fixture_words_init(void)
+{
+  const char* words[] = { "car", "cars", "apple", "box", "tree", "house", "river", "stone", "cart", "scar" };
+  FILE* fp = fopen(FIXTURE_WORDS, "w");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+
+  // a fixed lcg, the suites reseed rand().
+  uint32_t seed = 1;
+  for (int l=0; l<20000; l++)
+  {
+    seed = seed * 1103515245u + 12345u;
+    int count = 1 + (seed >> 16) % 6;
+    for (int w=0; w<count; w++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      fprintf(fp, w == 0 ? "%s" : " %s", words[(seed >> 16) % 10]);
+    }
+    fputc('\n', fp);
+  }
+
+  if (fclose(fp) != 0)
+  {
+    return -1;
+  }
+
+  fp = fopen(FIXTURE_WORDS, "r");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+
+  char line[256];
+  fixture_words_lines = 0;
+  fixture_words_car = 0;
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    fixture_words_lines++;
+    if (strncmp(line, "car", 3) == 0)
+    {
+      fixture_words_car++;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
@@ -1,13 +1,28 @@
 #include "greatest.h"
 #include "../src/flashlight.c"
 #include "../vendor/btree.c"
+#include "fixtures.c"
 #include "node.c"
 #include "bytes.c"
 #include "chunk.c"
 #include "index.c"
 #include "indexer.c"
+#include "bitmap.c"
 #include "search.c"
+#include "trigram.c"
+#include "token.c"
+#include "timestamp.c"
+#include "field.c"
+#include "record.c"
+#include "format.c"
+#include "compress.c"
 #include "log.c"
+#include "cancel.c"
+#include "stats.c"
+#include "tune.c"
+#include "runtime.c"
+#include "numa.c"
+#include "arena.c"
 
 GREATEST_MAIN_DEFS();
 
@@ -19,13 +34,33 @@ int main(int argc, char** argv)
 
   GREATEST_MAIN_BEGIN();
 
+  if (fixture_words_init() == -1)
+  {
+    fprintf(stderr, "cannot write %s\n", FIXTURE_WORDS);
+    return 1;
+  }
+
   RUN_SUITE(f_node_suite);
   RUN_SUITE(f_bytes_suite);
   RUN_SUITE(f_chunk_suite);
   RUN_SUITE(f_index_suite);
   RUN_SUITE(f_indexer_suite);
+  RUN_SUITE(f_bitmap_suite);
   RUN_SUITE(f_search_suite);
+  RUN_SUITE(f_trigram_suite);
+  RUN_SUITE(f_token_suite);
+  RUN_SUITE(f_timestamp_suite);
+  RUN_SUITE(f_field_suite);
+  RUN_SUITE(f_record_suite);
+  RUN_SUITE(f_format_suite);
+  RUN_SUITE(f_compress_suite);
   RUN_SUITE(f_log_suite);
+  RUN_SUITE(f_cancel_suite);
+  RUN_SUITE(f_stats_suite);
+  RUN_SUITE(f_tune_suite);
+  RUN_SUITE(f_runtime_suite);
+  RUN_SUITE(f_numa_suite);
+  RUN_SUITE(f_arena_suite);
 
   GREATEST_MAIN_END();
 }
\ No newline at end of file
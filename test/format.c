@@ -0,0 +1,149 @@
+f_index* get_format_index(char* filename, f_indexer config)
+{
+  // tiny chunks so records span chunks, threads and iterations.
+  config.filename = filename;
+  config.lookup_dir = ".flashlight";
+  config.buffer_size = 3;
+  config.concurrency = 2;
+  config.threads = 3;
+  config.max_bytes_per_iteration = 10;
+
+  return f_index_text_file(config);
+}
+
+TEST test_f_format_delimited(void)
+{
+  f_indexer config = {
+    .format = &f_indexer_format_delimited,
+    .record_delimiter = '\0'
+  };
+
+  f_index* index = get_format_index("test/zfixtures/records.nul", config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(3u, index->flookup->len - 1, "%u");
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 0, 3));
+  char* line;
+  size_t line_len;
+  f_index_lines_get(&lines, 1, &line, &line_len);
+  ASSERT_EQ_FMT(8ul, line_len, "%zu");
+  ASSERT_STRN_EQ("beta one", line, line_len);
+  f_index_lines_free(&lines);
+
+  f_searcher searcher = {
+    .regex = "^(beta|gamma)",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u
+  };
+
+  f_bitmap* bitmap;
+  ASSERT_EQ(0, f_index_search_bitmap(searcher, &bitmap));
+  ASSERT_EQ_FMT(2ul, bitmap->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 2));
+  ASSERT(f_bitmap_contains(bitmap, 3));
+  f_bitmap_free(&bitmap);
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_format_fixed(void)
+{
+  f_indexer config = {
+    .format = &f_indexer_format_fixed,
+    .record_width = 8,
+    .record_start = 4,
+    .trigram_block = 2
+  };
+
+  // the header is skipped and the cut off record at the end isn't counted.
+  f_index* index = get_format_index("test/zfixtures/records.fixed", config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ(NULL, index->flookup);
+  ASSERT_EQ_FMT(4ul, f_index_line_count(index), "%zu");
+
+  char* data;
+  ASSERT_EQ(0, f_index_lookup(&data, index, 1, 10));
+  ASSERT_STR_EQ("beta    gamma   delta   ", data);
+  free(data);
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 2, 2));
+  char* line;
+  size_t line_len;
+  f_index_lines_get(&lines, 0, &line, &line_len);
+  ASSERT_STRN_EQ("gamma   ", line, line_len);
+  f_index_lines_get(&lines, 1, &line, &line_len);
+  ASSERT_STRN_EQ("delta   ", line, line_len);
+  ASSERT_EQ_FMT(8ul, line_len, "%zu");
+  f_index_lines_free(&lines);
+
+  f_searcher searcher = {
+    .regex = "ta ",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u
+  };
+
+  f_bitmap* bitmap;
+  ASSERT_EQ(0, f_index_search_bitmap(searcher, &bitmap));
+  ASSERT_EQ_FMT(2ul, bitmap->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 2));
+  ASSERT(f_bitmap_contains(bitmap, 4));
+  f_bitmap_free(&bitmap);
+
+  config.record_width = 0;
+  ASSERT_EQ(NULL, get_format_index("test/zfixtures/records.fixed", config));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_format_length(void)
+{
+  f_indexer config = {
+    .format = &f_indexer_format_length,
+    .record_length_bytes = 4
+  };
+
+  // the last record is cut off.
+  f_index* index = get_format_index("test/zfixtures/records.len", config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(3u, index->flookup->len - 1, "%u");
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 0, 3));
+  ASSERT_EQ_FMT(3ul, lines.count, "%zu");
+  char* line;
+  size_t line_len;
+  f_index_lines_get(&lines, 0, &line, &line_len);
+  ASSERT_STRN_EQ("alpha", line, line_len);
+  f_index_lines_get(&lines, 1, &line, &line_len);
+  ASSERT_EQ_FMT(8ul, line_len, "%zu");
+  ASSERT_STRN_EQ("beta one", line, line_len);
+  f_index_lines_get(&lines, 2, &line, &line_len);
+  ASSERT_STRN_EQ("gamma", line, line_len);
+  f_index_lines_free(&lines);
+
+  size_t count;
+  f_searcher searcher = {
+    .regex = "a$",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u
+  };
+  ASSERT_EQ(0, f_index_search_count(searcher, &count));
+  ASSERT_EQ_FMT(2ul, count, "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_format_suite)
+{
+  RUN_TEST(test_f_format_delimited);
+  RUN_TEST(test_f_format_fixed);
+  RUN_TEST(test_f_format_length);
+}
@@ -9,7 +9,7 @@ TEST test_indexer_threads(void)
   ASSERT_EQ_FMT(1000ul, indexer->threads[0].to, "%zu");
   ASSERT_EQ_FMT(1000ul, indexer->threads[0].buffer_size, "%zu");
 
-  ASSERT_EQ_FMT(1001ul, indexer->threads[1].from, "%zu");
+  ASSERT_EQ_FMT(1000ul, indexer->threads[1].from, "%zu");
   ASSERT_EQ_FMT(2000ul, indexer->threads[1].to, "%zu");
   ASSERT_EQ_FMT(1000ul, indexer->threads[1].buffer_size, "%zu");
 
@@ -28,7 +28,7 @@ TEST test_indexer_threads_remainder(void)
   ASSERT_EQ_FMT(900ul, indexer->threads[0].to, "%zu");
   ASSERT_EQ_FMT(1000ul, indexer->threads[0].buffer_size, "%zu");
 
-  ASSERT_EQ_FMT(901ul, indexer->threads[1].from, "%zu");
+  ASSERT_EQ_FMT(900ul, indexer->threads[1].from, "%zu");
   ASSERT_EQ_FMT(1800ul, indexer->threads[1].to, "%zu");
   ASSERT_EQ_FMT(1000ul, indexer->threads[1].buffer_size, "%zu");
 
@@ -67,7 +67,7 @@ TEST test_indexer_more_threads_than_index(void)
   ASSERT_EQ_FMT(1000ul, indexer->threads[0].to, "%zu");
   ASSERT_EQ_FMT(1500ul, indexer->threads[0].buffer_size, "%zu");
 
-  ASSERT_EQ_FMT(1001ul, indexer->threads[1].from, "%zu");
+  ASSERT_EQ_FMT(1000ul, indexer->threads[1].from, "%zu");
   ASSERT_EQ_FMT(2000ul, indexer->threads[1].to, "%zu");
   ASSERT_EQ_FMT(1500ul, indexer->threads[1].buffer_size, "%zu");
 
@@ -86,11 +86,11 @@ TEST test_indexer_more_chunks_than_threads(void)
   ASSERT_EQ_FMT(333ul, indexer->threads[0].to, "%zu");
   ASSERT_EQ_FMT(100ul, indexer->threads[0].buffer_size, "%zu");
 
-  ASSERT_EQ_FMT(334ul, indexer->threads[1].from, "%zu");
-  ASSERT_EQ_FMT(667ul, indexer->threads[1].to, "%zu");
+  ASSERT_EQ_FMT(333ul, indexer->threads[1].from, "%zu");
+  ASSERT_EQ_FMT(666ul, indexer->threads[1].to, "%zu");
   ASSERT_EQ_FMT(100ul, indexer->threads[1].buffer_size, "%zu");
 
-  ASSERT_EQ_FMT(668ul, indexer->threads[2].from, "%zu");
+  ASSERT_EQ_FMT(666ul, indexer->threads[2].from, "%zu");
   ASSERT_EQ_FMT(1000ul, indexer->threads[2].to, "%zu");
   ASSERT_EQ_FMT(100ul, indexer->threads[2].buffer_size, "%zu");
 
@@ -208,7 +208,7 @@ TEST test_text_indexer(void)
 
 TEST test_index_sequential(void)
 {
-  char* test = "test/zfixtures/words.txt";
+  char* test = FIXTURE_WORDS;
   f_indexer i = {
     .filename = test,
     .lookup_dir = ".flashlight",
@@ -252,6 +252,52 @@ TEST test_index_sequential(void)
   PASS();
 }
 
+TEST test_indexer_buffer_ring(void)
+{
+  char* test = FIXTURE_WORDS;
+  f_indexer ref = {
+    .filename = test,
+    .lookup_dir = ".flashlight",
+    .threads = 1,
+    .concurrency = 1,
+    .buffer_size = 1 << 20,
+    .max_bytes_per_iteration = 1 << 30
+  };
+
+  // read buffers are reused across chunks, and grow with the adapted buffer size.
+  f_indexer ring = {
+    .filename = test,
+    .lookup_dir = ".flashlight",
+    .threads = 2,
+    .concurrency = 3,
+    .buffer_size = 1000,
+    .max_bytes_per_iteration = 20000,
+    .adaptive = true
+  };
+
+  f_index* expected = f_index_text_file(ref);
+  f_index* index = f_index_text_file(ring);
+  if (expected == NULL || index == NULL) FAIL();
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(expected), "%zu");
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(index), "%zu");
+
+  size_t lines[] = { 0, fixture_words_lines / 3, fixture_words_lines / 2, fixture_words_lines - 1 };
+  for (int l=0; l<4; l++)
+  {
+    char* want;
+    char* got;
+    if (f_index_lookup(&want, expected, lines[l], 1) == -1) FAIL();
+    if (f_index_lookup(&got, index, lines[l], 1) == -1) FAIL();
+    ASSERT_STR_EQ(want, got);
+    free(want);
+    free(got);
+  }
+
+  f_index_free(&expected);
+  f_index_free(&index);
+  PASS();
+}
+
 TEST test_indexer_file_not_exists()
 {
     char* test = "test/zfixtures/notexist.txt";
@@ -270,6 +316,32 @@ TEST test_indexer_file_not_exists()
   PASS();
 }
 
+TEST test_indexer_cancelled(void)
+{
+  f_cancel* cancel;
+  if (f_cancel_init(&cancel) == -1) FAIL();
+  f_cancel_request(cancel);
+
+  f_indexer i = {
+    .filename = "test/zfixtures/search.txt",
+    .lookup_dir = ".flashlight",
+    .threads = 2,
+    .concurrency = 2,
+    .buffer_size = 3,
+    .max_bytes_per_iteration = 50000,
+    .on_progress = NULL,
+    .cancel = cancel
+  };
+
+  errno = 0;
+  f_index* index = f_index_text_file(i);
+  ASSERT_EQ_FMT(NULL, index, "%p");
+  ASSERT_EQ_FMT(ECANCELED, errno, "%d");
+
+  f_cancel_free(&cancel);
+  PASS();
+}
+
 SUITE(f_indexer_suite)
 {
   RUN_TEST(test_indexer_threads);
@@ -284,5 +356,7 @@ SUITE(f_indexer_suite)
 
   RUN_TEST(test_text_indexer);
   RUN_TEST(test_index_sequential);
+  RUN_TEST(test_indexer_buffer_ring);
   RUN_TEST(test_indexer_file_not_exists);
+  RUN_TEST(test_indexer_cancelled);
 }
\ No newline at end of file
@@ -1,42 +1,226 @@
 
+typedef struct TestLogState
+{
+  bool ok;
+  int calls;
+  size_t len;
+} test_log_state;
+
 void test_f_log_level_cb(f_log_message msg,  volatile void* payload)
 {
-  bool* ok = (bool*) payload;
+  test_log_state* state = (test_log_state*) payload;
+  state->calls++;
+  state->len = strlen(msg.message);
 
   if ((msg.level & (F_LOG_FINE | F_LOG_WARN)) && (strcmp(msg.message, "odoyle rules!") == 0) && msg.datetime != NULL)
   {
-    *ok = true;
+    state->ok = true;
   }
   else
   {
-    *ok = false;
+    state->ok = false;
   }
 }
 
+static int test_f_log_evaluated(int* count)
+{
+  (*count)++;
+  return *count;
+}
+
 TEST test_f_log_level()
 {
-  bool* ok = malloc(sizeof(bool));
-  *ok = false;
+  test_log_state* state = calloc(1, sizeof(test_log_state));
   f_logger_set_level(F_LOG_FINE | F_LOG_WARN);
-  f_logger_set_cb(test_f_log_level_cb, (void*) ok);
+  f_logger_set_cb(test_f_log_level_cb, (void*) state);
 
+  // filtered levels never reach the callback.
   f_log(F_LOG_ERROR, "discarded");
-  if (*ok) FAIL();
-  
+  ASSERT_EQ(0, state->calls);
+
   f_log(F_LOG_WARN, "%s rules!", "odoyle");
-  if (!*ok) FAIL();
+  if (!state->ok) FAIL();
 
+  // release builds compile fine messages out, whatever the level.
+  int calls = (F_LOG_COMPILED & F_LOG_FINE) ? 2 : 1;
   f_log(F_LOG_FINE, "odoyle rules!");
-  if (!*ok) FAIL();
+  if (!state->ok) FAIL();
+  ASSERT_EQ(calls, state->calls);
+  ASSERT_EQ((F_LOG_COMPILED & F_LOG_FINE) != 0, F_LOG_ENABLED(F_LOG_FINE));
 
   f_log(F_LOG_INFO, "more discarded");
-  if (*ok) FAIL();
+  ASSERT_EQ(calls, state->calls);
+
+  // later suites log too, don't leave them writing to `state`.
+  f_logger_set_cb(NULL, NULL);
+  free(state);
+  PASS();
+}
+
+TEST test_f_log_fast_path()
+{
+  test_log_state* state = calloc(1, sizeof(test_log_state));
+  f_logger_set_level(F_LOG_ERROR);
+  f_logger_set_cb(test_f_log_level_cb, (void*) state);
+
+  // the arguments of a filtered message aren't evaluated.
+  int evaluated = 0;
+  f_log(F_LOG_DEBUG, "%d", test_f_log_evaluated(&evaluated));
+  ASSERT_EQ(0, evaluated);
+  ASSERT_FALSE(F_LOG_ENABLED(F_LOG_DEBUG));
+  ASSERT(F_LOG_ENABLED(F_LOG_ERROR));
+
+  f_log(F_LOG_ERROR, "%d", test_f_log_evaluated(&evaluated));
+  ASSERT_EQ(1, evaluated);
+
+  // long messages are cut off instead of overflowing.
+  char* long_message = malloc(2000);
+  memset(long_message, 'x', 1999);
+  long_message[1999] = '\0';
+  f_log(F_LOG_ERROR, "%s", long_message);
+  ASSERT_EQ_FMT(499ul, state->len, "%zu");
+  free(long_message);
+
+  f_logger_set_cb(NULL, NULL);
+  free(state);
+  PASS();
+}
+
+typedef struct TestLogAsync
+{
+  atomic_int calls;
+  atomic_int on_caller;
+  pthread_t caller;
+} test_log_async;
+
+void test_f_log_async_cb(f_log_message msg,  volatile void* payload)
+{
+  test_log_async* state = (test_log_async*) payload;
+  if (strncmp(msg.message, "async ", 6) == 0)
+  {
+    atomic_fetch_add(&state->calls, 1);
+  }
+
+  if (pthread_equal(pthread_self(), state->caller))
+  {
+    atomic_fetch_add(&state->on_caller, 1);
+  }
+}
+
+static void* test_f_log_async_thread(void* payload)
+{
+  for (int i=0; i<500; i++)
+  {
+    f_log(F_LOG_WARN, "async %d", i);
+  }
+  return NULL;
+}
+
+TEST test_f_log_async()
+{
+  test_log_async* state = calloc(1, sizeof(test_log_async));
+  state->caller = pthread_self();
+  f_logger_set_level(F_LOG_WARN);
+  f_logger_set_cb(test_f_log_async_cb, (void*) state);
+
+  ASSERT_EQ(0, f_logger_async_start(4096));
+  ASSERT_EQ(-1, f_logger_async_start(1024));
+
+  pthread_t threads[4];
+  for (int i=0; i<4; i++)
+  {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, test_f_log_async_thread, NULL));
+  }
+  for (int i=0; i<4; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  // threads that exit hand their ring to the next one, 4096 records fit them all.
+  // stopping delivers what is still queued.
+  f_logger_async_stop();
+  ASSERT_EQ_FMT(2000, atomic_load(&state->calls) + (int) f_logger_async_dropped(), "%d");
+  ASSERT_EQ_FMT(0ul, f_logger_async_dropped(), "%zu");
+
+  // rings of exited threads are reused after a restart.
+  ASSERT_EQ(0, f_logger_async_start(0));
+  test_f_log_async_thread(NULL);
+  f_logger_async_stop();
+  ASSERT_EQ_FMT(2500, atomic_load(&state->calls), "%d");
 
-  free(ok);
+  // and logging is synchronous again.
+  atomic_store(&state->on_caller, 0);
+  f_log(F_LOG_WARN, "async %d", 0);
+  ASSERT_EQ(1, atomic_load(&state->on_caller));
+
+  f_logger_set_level(F_LOG_ERROR);
+  f_logger_set_cb(NULL, NULL);
+  free(state);
+  PASS();
+}
+
+typedef struct TestLogSlow
+{
+  atomic_bool delivering;
+  atomic_bool released;
+  atomic_bool timed_out;
+} test_log_slow;
+
+void test_f_log_slow_cb(f_log_message msg,  volatile void* payload)
+{
+  test_log_slow* state = (test_log_slow*) payload;
+  if (strcmp(msg.message, "slow") != 0)
+  {
+    return;
+  }
+
+  // wait for a thread that logs for the first time while this callback runs.
+  atomic_store(&state->delivering, true);
+  struct timespec nap = { .tv_sec = 0, .tv_nsec = 1000000 };
+  for (int i=0; i<2000 && !atomic_load(&state->released); i++)
+  {
+    nanosleep(&nap, NULL);
+  }
+  atomic_store(&state->timed_out, !atomic_load(&state->released));
+}
+
+static void* test_f_log_slow_thread(void* payload)
+{
+  test_log_slow* state = payload;
+  f_log(F_LOG_WARN, "new thread");
+  atomic_store(&state->released, true);
+  return NULL;
+}
+
+TEST test_f_log_async_slow_cb()
+{
+  test_log_slow* state = calloc(1, sizeof(test_log_slow));
+  f_logger_set_level(F_LOG_WARN);
+  f_logger_set_cb(test_f_log_slow_cb, (void*) state);
+  ASSERT_EQ(0, f_logger_async_start(0));
+
+  f_log(F_LOG_WARN, "slow");
+  while (!atomic_load(&state->delivering))
+  {
+    sched_yield();
+  }
+
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, test_f_log_slow_thread, state));
+  pthread_join(thread, NULL);
+  f_logger_async_stop();
+  ASSERT_FALSE(atomic_load(&state->timed_out));
+
+  f_logger_set_level(F_LOG_ERROR);
+  f_logger_set_cb(NULL, NULL);
+  free(state);
   PASS();
 }
 
 SUITE(f_log_suite)
 {
   RUN_TEST(test_f_log_level);
-}
\ No newline at end of file
+  RUN_TEST(test_f_log_fast_path);
+  RUN_TEST(test_f_log_async);
+  RUN_TEST(test_f_log_async_slow_cb);
+}
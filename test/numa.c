@@ -0,0 +1,101 @@
+static void* test_f_numa_bound(void* payload)
+{
+  f_numa* numa = payload;
+  intptr_t rc = f_numa_bind(numa, numa->len - 1);
+  return (void*) rc;
+}
+
+TEST test_f_numa_nodes(void)
+{
+  f_numa* numa;
+  ASSERT_EQ(0, f_numa_init(&numa));
+  ASSERT(numa->len > 0);
+
+  // node cpulists may name offline cpus, never unconfigured ones.
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  ASSERT(cpus > 0);
+  long total = 0;
+  for (int i=0; i<numa->len; i++)
+  {
+    ASSERT(numa->nodes[i].len > 0);
+    for (int c=0; c<numa->nodes[i].len; c++)
+    {
+      ASSERT(numa->nodes[i].cpus[c] >= 0 && numa->nodes[i].cpus[c] < cpus);
+      ASSERT(c == 0 || numa->nodes[i].cpus[c] > numa->nodes[i].cpus[c - 1]);
+    }
+    total += numa->nodes[i].len;
+  }
+  ASSERT(total <= cpus);
+
+  // blocks of neighbouring threads, every node used.
+  ASSERT_EQ(0, f_numa_node_of(numa, 0, 8));
+  ASSERT_EQ(numa->len - 1, f_numa_node_of(numa, 7, 8));
+  for (int i=1; i<8; i++)
+  {
+    ASSERT(f_numa_node_of(numa, i, 8) >= f_numa_node_of(numa, i - 1, 8));
+  }
+  ASSERT_EQ(-1, f_numa_bind(numa, numa->len));
+
+  // bound on a thread of its own, the test's thread stays where it is.
+  pthread_t thread;
+  void* rc;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, test_f_numa_bound, numa));
+  pthread_join(thread, &rc);
+  ASSERT_EQ(0, (intptr_t) rc);
+
+  f_numa_free(&numa);
+  ASSERT_EQ(NULL, numa);
+  PASS();
+}
+
+TEST test_f_numa_parse(void)
+{
+  int* values;
+  int len;
+  ASSERT_EQ(0, f_numa_parse("0-3,8,10-11\n", &values, &len));
+  ASSERT_EQ(7, len);
+  ASSERT_EQ(3, values[3]);
+  ASSERT_EQ(8, values[4]);
+  ASSERT_EQ(11, values[6]);
+  free(values);
+
+  ASSERT_EQ(-1, f_numa_parse("3-1", &values, &len));
+  PASS();
+}
+
+TEST test_f_numa_indexer(void)
+{
+  f_indexer config = {
+    .filename = FIXTURE_WORDS,
+    .lookup_dir = ".flashlight",
+    .buffer_size = 4096,
+    .concurrency = 4,
+    .threads = 4,
+    .max_bytes_per_iteration = 40000,
+    .numa = true
+  };
+  f_index* index = f_index_text_file(config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(index), "%zu");
+  f_index_free(&index);
+
+  // workers of a runtime are bound by its affinity.
+  f_runtime* runtime;
+  f_runtime_config runtime_config = { .threads = 3, .affinity = F_AFFINITY_NODES };
+  ASSERT_EQ(0, f_runtime_init(&runtime, runtime_config));
+  ASSERT(runtime->numa != NULL);
+  config.runtime = runtime;
+  index = f_index_text_file(config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(index), "%zu");
+  f_index_free(&index);
+  f_runtime_free(&runtime);
+  PASS();
+}
+
+SUITE(f_numa_suite)
+{
+  RUN_TEST(test_f_numa_nodes);
+  RUN_TEST(test_f_numa_parse);
+  RUN_TEST(test_f_numa_indexer);
+}
@@ -0,0 +1,105 @@
+f_index* get_record_index(char* filename, enum F_RECORD record, char* record_prefix, int threads)
+{
+  // tiny chunks so quotes and events span chunks, threads and iterations.
+  f_indexer config = {
+    .filename = filename,
+    .lookup_dir = ".flashlight",
+    .buffer_size = 5,
+    .concurrency = 2,
+    .threads = threads,
+    .max_bytes_per_iteration = 20,
+    .record = record,
+    .record_prefix = record_prefix
+  };
+
+  return f_index_text_file(config);
+}
+
+TEST test_f_record_quoted(int threads)
+{
+  f_index* index = get_record_index("test/zfixtures/records.csv", F_RECORD_QUOTED, NULL, threads);
+  if (index == NULL) FAIL();
+  ASSERT(index->records);
+  ASSERT_EQ_FMT(5u, index->flookup->len - 1, "%u");
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 1, 3));
+  ASSERT_EQ_FMT(3ul, lines.count, "%zu");
+
+  char* line;
+  size_t line_len;
+  f_index_lines_get(&lines, 0, &line, &line_len);
+  ASSERT_STRN_EQ("1,\"first\nline\"", line, line_len);
+  ASSERT_EQ_FMT(14ul, line_len, "%zu");
+  f_index_lines_get(&lines, 2, &line, &line_len);
+  ASSERT_STRN_EQ("3,\"a \"\"quoted\"\"\nmulti\nline\"", line, line_len);
+  ASSERT_EQ_FMT(27ul, line_len, "%zu");
+  f_index_lines_free(&lines);
+
+  f_searcher searcher = {
+    .regex = "multi|end",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u
+  };
+
+  f_bitmap* bitmap;
+  ASSERT_EQ(0, f_index_search_bitmap(searcher, &bitmap));
+  ASSERT_EQ_FMT(2ul, bitmap->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 4));
+  ASSERT(f_bitmap_contains(bitmap, 5));
+  f_bitmap_free(&bitmap);
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_record_prefix(int threads)
+{
+  f_index* index = get_record_index("test/zfixtures/events.log", F_RECORD_PREFIX, "\\d{4}-", threads);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(4u, index->flookup->len - 1, "%u");
+
+  f_index_lines lines;
+  ASSERT_EQ(0, f_index_lookup_lines(&lines, index, 1, 10));
+  ASSERT_EQ_FMT(3ul, lines.count, "%zu");
+
+  char* line;
+  size_t line_len;
+  f_index_lines_get(&lines, 0, &line, &line_len);
+  ASSERT_STRN_EQ("2024-03-01 10:00:01 error\n  at main.c:10\n  at lib.c:20", line, line_len);
+  ASSERT_EQ_FMT(54ul, line_len, "%zu");
+  f_index_lines_get(&lines, 2, &line, &line_len);
+  ASSERT_STRN_EQ("2024-03-01 10:00:03 error\n  at net.c:7", line, line_len);
+  f_index_lines_free(&lines);
+
+  f_searcher searcher = {
+    .regex = "c:\\d+",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 2u
+  };
+
+  size_t count;
+  ASSERT_EQ(0, f_index_search_count(searcher, &count));
+  ASSERT_EQ_FMT(2ul, count, "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_record_invalid_prefix(void)
+{
+  ASSERT_EQ(NULL, get_record_index("test/zfixtures/events.log", F_RECORD_PREFIX, NULL, 1));
+  ASSERT_EQ(NULL, get_record_index("test/zfixtures/events.log", F_RECORD_PREFIX, "(", 1));
+  PASS();
+}
+
+SUITE(f_record_suite)
+{
+  RUN_TESTp(test_f_record_quoted, 1);
+  RUN_TESTp(test_f_record_quoted, 3);
+  RUN_TESTp(test_f_record_prefix, 1);
+  RUN_TESTp(test_f_record_prefix, 3);
+  RUN_TEST(test_f_record_invalid_prefix);
+}
@@ -0,0 +1,155 @@
+typedef struct TestRuntimeState
+{
+  atomic_int active;
+  atomic_int most;
+  atomic_int runs;
+} test_runtime_state;
+
+static void* test_f_runtime_task(void* payload)
+{
+  test_runtime_state* state = payload;
+  int active = atomic_fetch_add(&state->active, 1) + 1;
+  int most = atomic_load(&state->most);
+  while (active > most && !atomic_compare_exchange_weak(&state->most, &most, active));
+
+  struct timespec nap = { .tv_sec = 0, .tv_nsec = 2000000 };
+  nanosleep(&nap, NULL);
+
+  atomic_fetch_sub(&state->active, 1);
+  return (void*) (intptr_t) (atomic_fetch_add(&state->runs, 1) + 1);
+}
+
+TEST test_f_runtime_cap(void)
+{
+  f_runtime* runtime;
+  f_runtime_config config = { .threads = 4, .concurrency = 2, .affinity = F_AFFINITY_CORES };
+  ASSERT_EQ(0, f_runtime_init(&runtime, config));
+
+  test_runtime_state state;
+  atomic_init(&state.active, 0);
+  atomic_init(&state.most, 0);
+  atomic_init(&state.runs, 0);
+
+  f_runtime_task* tasks[16];
+  for (int i=0; i<16; i++)
+  {
+    ASSERT_EQ(0, f_runtime_spawn(&tasks[i], runtime, test_f_runtime_task, &state));
+  }
+
+  intptr_t seen = 0;
+  for (int i=0; i<16; i++)
+  {
+    void* result;
+    ASSERT_EQ(0, f_runtime_join(tasks[i], &result));
+    seen += (intptr_t) result;
+  }
+
+  // every task ran once, never more than the cap at a time.
+  ASSERT_EQ(16, atomic_load(&state.runs));
+  ASSERT_EQ_FMT((intptr_t) (16 * 17 / 2), seen, "%ld");
+  ASSERT(atomic_load(&state.most) <= 2);
+
+  // a lower cap applies to the next tasks.
+  f_runtime_set_concurrency(runtime, 1);
+  atomic_store(&state.most, 0);
+  for (int i=0; i<4; i++)
+  {
+    ASSERT_EQ(0, f_runtime_spawn(&tasks[i], runtime, test_f_runtime_task, &state));
+  }
+  for (int i=0; i<4; i++)
+  {
+    ASSERT_EQ(0, f_runtime_join(tasks[i], NULL));
+  }
+  ASSERT_EQ(1, atomic_load(&state.most));
+
+  // tasks without a runtime get a thread of their own.
+  ASSERT_EQ(0, f_runtime_spawn(&tasks[0], NULL, test_f_runtime_task, &state));
+  ASSERT_EQ(0, f_runtime_join(tasks[0], NULL));
+  ASSERT_EQ(21, atomic_load(&state.runs));
+
+  f_runtime_free(&runtime);
+  ASSERT_EQ(NULL, runtime);
+  PASS();
+}
+
+TEST test_f_runtime_shared(void)
+{
+  // fewer workers than any operation asks threads for.
+  f_runtime* runtime;
+  f_runtime_config config = { .threads = 2 };
+  ASSERT_EQ(0, f_runtime_init(&runtime, config));
+
+  f_indexer indexer = {
+    .filename = FIXTURE_WORDS,
+    .lookup_dir = ".flashlight",
+    .buffer_size = 4096,
+    .concurrency = 4,
+    .threads = 6,
+    .max_bytes_per_iteration = 40000,
+    .runtime = runtime
+  };
+  f_index* index = f_index_text_file(indexer);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(index), "%zu");
+
+  f_searcher searcher = {
+    .regex = "^car",
+    .index = index,
+    .threads = 5,
+    .line_buffer = 300u
+  };
+
+  size_t expected;
+  ASSERT_EQ(0, f_index_search_count(searcher, &expected));
+  ASSERT_EQ_FMT(fixture_words_car, expected, "%zu");
+
+  searcher.runtime = runtime;
+  for (int i=0; i<20; i++)
+  {
+    size_t count;
+    searcher.ordered = i % 2 == 1;
+    ASSERT_EQ(0, f_index_search_count(searcher, &count));
+    ASSERT_EQ_FMT(expected, count, "%zu");
+  }
+
+  // searches running side by side share the workers.
+  searcher.ordered = false;
+  searcher.result_limit = 100000;
+  f_search_handle* handles[3];
+  for (int i=0; i<3; i++)
+  {
+    ASSERT_EQ(0, f_index_search_start(&handles[i], searcher));
+  }
+  for (int i=0; i<3; i++)
+  {
+    size_t count = 0;
+    f_search_batch* batch;
+    do
+    {
+      ASSERT_EQ(0, f_search_handle_next_batch(&batch, handles[i]));
+      if (batch != NULL)
+      {
+        count += batch->len;
+        f_search_batch_free(batch);
+      }
+    } while (batch != NULL || !f_search_handle_poll(handles[i], NULL));
+    ASSERT_EQ(0, f_search_handle_wait(handles[i]));
+    while (f_search_handle_next_batch(&batch, handles[i]) == 0 && batch != NULL)
+    {
+      count += batch->len;
+      f_search_batch_free(batch);
+    }
+    ASSERT_EQ_FMT(expected, count, "%zu");
+    f_search_handle_free(&handles[i]);
+  }
+
+  f_index_free(&index);
+  f_runtime_free(&runtime);
+  PASS();
+}
+
+SUITE(f_runtime_suite)
+{
+  RUN_TEST(test_f_runtime_cap);
+  RUN_TEST(test_f_runtime_shared);
+}
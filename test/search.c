@@ -62,6 +62,28 @@ TEST test_f_search_invalid_regex(void)
   PASS();
 }
 
+TEST test_f_search_invalid_line_buffer(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 0,
+    .ordered = true
+  };
+
+  // blocks of no lines would never end.
+  size_t count;
+  ASSERT_EQ(-1, f_index_search_count(searcher, &count));
+  searcher.ordered = false;
+  ASSERT_EQ(-1, f_index_search_count(searcher, &count));
+
+  f_index_free(&index);
+  PASS();
+}
+
 TEST test_f_search(void)
 {
   char* fixture = "test/zfixtures/search.txt";
@@ -147,8 +169,529 @@ TEST test_f_search(void)
   PASS();
 }
 
+TEST test_f_search_single_consumer(void)
+{
+  f_index* index = get_index();
+  struct btree* results = btree_new(sizeof(f_search_result), 0, test_search_result_compare, NULL);
+
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 400u,
+    .on_progress = NULL,
+    .progress_payload = NULL,
+    .on_result = test_f_search_result,
+    .result_payload = results,
+    .result_batch = 1,
+    .single_consumer = true
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(3ul, btree_count(results), "%zu");
+
+  const f_search_result* res = btree_min(results);
+  ASSERT_EQ_FMT(3ul, res->line_number, "%zu");
+  ASSERT_STR_EQ("the box ate cars", res->str);
+
+  btree_free(results);
+  f_index_free(&index);
+  PASS();
+}
+
+void* test_f_search_concurrent_thread(void* payload)
+{
+  f_searcher* searcher = payload;
+  if (f_index_search(*searcher) != 0)
+  {
+    return (void*) 1;
+  }
+  return NULL;
+}
+
+TEST test_f_search_concurrent(void)
+{
+  f_index* index = get_index();
+  struct btree* first = btree_new(sizeof(f_search_result), 0, test_search_result_compare, NULL);
+  struct btree* second = btree_new(sizeof(f_search_result), 0, test_search_result_compare, NULL);
+
+  f_searcher a = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 400u,
+    .on_result = test_f_search_result,
+    .result_payload = first
+  };
+
+  f_searcher b = a;
+  b.regex = "box";
+  b.result_payload = second;
+
+  pthread_t ta, tb;
+  void* rca;
+  void* rcb;
+  pthread_create(&ta, NULL, test_f_search_concurrent_thread, &a);
+  pthread_create(&tb, NULL, test_f_search_concurrent_thread, &b);
+  pthread_join(ta, &rca);
+  pthread_join(tb, &rcb);
+
+  ASSERT_EQ_FMT(NULL, rca, "%p");
+  ASSERT_EQ_FMT(NULL, rcb, "%p");
+  ASSERT_EQ_FMT(3ul, btree_count(first), "%zu");
+  ASSERT_EQ_FMT(2ul, btree_count(second), "%zu");
+
+  btree_free(first);
+  btree_free(second);
+  f_index_free(&index);
+  PASS();
+}
+
+typedef struct TestOrderedResults {
+  size_t lines[10];
+  int len;
+  bool ascending;
+} test_ordered_results;
+
+void test_f_search_ordered_result(f_search_result* res, void* payload)
+{
+  test_ordered_results* results = payload;
+  if (results->len > 0 && results->lines[results->len - 1] >= res->line_number)
+  {
+    results->ascending = false;
+  }
+
+  if (results->len < 10)
+  {
+    results->lines[results->len++] = res->line_number;
+  }
+  f_search_result_free(res);
+}
+
+TEST test_f_search_ordered(bool single_consumer)
+{
+  f_index* index = get_index();
+  test_ordered_results results = { .len = 0, .ascending = true };
+
+  f_searcher searcher = {
+    .regex = "cars|box|of",
+    .index = index,
+    .threads = 3,
+    .result_limit = 3,
+    .line_buffer = 2u,
+    .on_result = test_f_search_ordered_result,
+    .result_payload = &results,
+    .single_consumer = single_consumer,
+    .ordered = true,
+    .reorder_window = 1
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT(results.ascending);
+  ASSERT_EQ_FMT(3, results.len, "%d");
+  ASSERT_EQ_FMT(1ul, results.lines[0], "%zu");
+  ASSERT_EQ_FMT(3ul, results.lines[1], "%zu");
+  ASSERT_EQ_FMT(4ul, results.lines[2], "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_ordered_all(void)
+{
+  f_index* index = get_index();
+  test_ordered_results results = { .len = 0, .ascending = true };
+
+  f_searcher searcher = {
+    .regex = "cars|box|of",
+    .index = index,
+    .threads = 4,
+    .result_limit = 100,
+    .line_buffer = 1u,
+    .on_result = test_f_search_ordered_result,
+    .result_payload = &results,
+    .ordered = true
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT(results.ascending);
+  ASSERT_EQ_FMT(5, results.len, "%d");
+  ASSERT_EQ_FMT(7ul, results.lines[3], "%zu");
+  ASSERT_EQ_FMT(9ul, results.lines[4], "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_range(void)
+{
+  f_index* index = get_index();
+  test_ordered_results results = { .len = 0, .ascending = true };
+
+  // next match after line 4.
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .result_limit = 1,
+    .line_buffer = 2u,
+    .on_result = test_f_search_ordered_result,
+    .result_payload = &results,
+    .ordered = true,
+    .start_line = 5
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(1, results.len, "%d");
+  ASSERT_EQ_FMT(9ul, results.lines[0], "%zu");
+
+  size_t count;
+  searcher.start_line = 2;
+  searcher.end_line = 4;
+  ASSERT_EQ_FMT(0, f_index_search_count(searcher, &count), "%d");
+  ASSERT_EQ_FMT(2ul, count, "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_reverse(int result_limit)
+{
+  f_index* index = get_index();
+  test_ordered_results results = { .len = 0, .ascending = true };
+
+  // previous matches before line 9.
+  f_searcher searcher = {
+    .regex = "cars|box",
+    .index = index,
+    .threads = 3,
+    .result_limit = result_limit,
+    .line_buffer = 2u,
+    .on_result = test_f_search_ordered_result,
+    .result_payload = &results,
+    .reverse = true,
+    .reorder_window = 1,
+    .end_line = 8
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(result_limit < 3 ? result_limit : 3, results.len, "%d");
+  ASSERT_EQ_FMT(4ul, results.lines[0], "%zu");
+  if (result_limit > 1)
+  {
+    ASSERT_FALSE(results.ascending);
+    ASSERT_EQ_FMT(3ul, results.lines[1], "%zu");
+    ASSERT_EQ_FMT(1ul, results.lines[2], "%zu");
+  }
+
+  f_index_free(&index);
+  PASS();
+}
+
+typedef struct TestContextResults {
+  f_search_result* results[10];
+  int len;
+} test_context_results;
+
+void test_f_search_context_result(f_search_result* res, void* payload)
+{
+  test_context_results* results = payload;
+  if (results->len < 10)
+  {
+    results->results[results->len++] = res;
+    return;
+  }
+  f_search_result_free(res);
+}
+
+TEST test_f_search_context(bool reverse)
+{
+  f_index* index = get_index();
+  test_context_results results = { .len = 0 };
+
+  // 2 line buffers put most context across a buffer boundary.
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 3,
+    .result_limit = 100,
+    .line_buffer = 2u,
+    .on_result = test_f_search_context_result,
+    .result_payload = &results,
+    .ordered = true,
+    .reverse = reverse,
+    .context_before = 2,
+    .context_after = 1
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(3, results.len, "%d");
+
+  f_search_result* cars3 = results.results[reverse ? 2 : 0];
+  f_search_result* cars4 = results.results[1];
+  f_search_result* cars9 = results.results[reverse ? 0 : 2];
+
+  ASSERT_EQ_FMT(3ul, cars3->line_number, "%zu");
+  ASSERT_EQ_FMT(2u, cars3->before_len, "%u");
+  ASSERT_STR_EQ("a cat was in the box\n", cars3->before);
+  // line 4 is a match, not context.
+  ASSERT_EQ_FMT(0u, cars3->after_len, "%u");
+  ASSERT_EQ(NULL, cars3->after);
+
+  // line 3 isn't repeated as context.
+  ASSERT_EQ_FMT(0u, cars4->before_len, "%u");
+  ASSERT_EQ_FMT(1u, cars4->after_len, "%u");
+  ASSERT_STR_EQ("", cars4->after);
+
+  ASSERT_EQ_FMT(2u, cars9->before_len, "%u");
+  ASSERT_STR_EQ("of this\nprogram", cars9->before);
+  ASSERT_EQ_FMT(0u, cars9->after_len, "%u");
+
+  for (int i=0; i<results.len; i++)
+  {
+    f_search_result_free(results.results[i]);
+  }
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_count(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars|box",
+    .index = index,
+    .threads = 3,
+    .line_buffer = 2u
+  };
+
+  size_t count;
+  ASSERT_EQ_FMT(0, f_index_search_count(searcher, &count), "%d");
+  ASSERT_EQ_FMT(4ul, count, "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_bitmap(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .line_buffer = 400u
+  };
+
+  f_bitmap* bitmap;
+  ASSERT_EQ_FMT(0, f_index_search_bitmap(searcher, &bitmap), "%d");
+  ASSERT_EQ_FMT(3ul, bitmap->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(bitmap, 3));
+  ASSERT(f_bitmap_contains(bitmap, 4));
+  ASSERT(f_bitmap_contains(bitmap, 9));
+
+  f_bitmap_free(&bitmap);
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_cancelled(void)
+{
+  f_index* index = get_index();
+  struct btree* results = btree_new(sizeof(f_search_result), 0, test_search_result_compare, NULL);
+
+  f_cancel* cancel;
+  if (f_cancel_init(&cancel) == -1) FAIL();
+  f_cancel_request(cancel);
+
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 400u,
+    .on_result = test_f_search_result,
+    .result_payload = results,
+    .cancel = cancel
+  };
+
+  errno = 0;
+  ASSERT_EQ_FMT(F_CANCELLED, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(ECANCELED, errno, "%d");
+  ASSERT_EQ_FMT(0ul, btree_count(results), "%zu");
+
+  f_cancel_free(&cancel);
+  btree_free(results);
+  f_index_free(&index);
+  PASS();
+}
+
+typedef struct test_search_cancelling {
+  f_cancel* cancel;
+  int calls;
+} test_search_cancelling;
+
+void test_f_search_cancelling_result(f_search_result* res, void* payload)
+{
+  test_search_cancelling* state = payload;
+  state->calls++;
+  f_cancel_request(state->cancel);
+  f_search_result_free(res);
+}
+
+TEST test_f_search_cancelled_single_consumer(void)
+{
+  f_index* index = get_index();
+
+  test_search_cancelling state = { .calls = 0 };
+  if (f_cancel_init(&state.cancel) == -1) FAIL();
+
+  f_searcher searcher = {
+    .regex = "cars|box|of",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 1u,
+    .result_batch = 1,
+    .single_consumer = true,
+    .on_result = test_f_search_cancelling_result,
+    .result_payload = &state,
+    .cancel = state.cancel
+  };
+
+  // the batches queued behind the first result are never delivered.
+  errno = 0;
+  int rc = f_index_search(searcher);
+  ASSERT_EQ_FMT(F_CANCELLED, rc, "%d");
+  ASSERT_EQ_FMT(ECANCELED, errno, "%d");
+  ASSERT_EQ_FMT(1, state.calls, "%d");
+
+  f_cancel_free(&state.cancel);
+  f_index_free(&index);
+  PASS();
+}
+
+void test_f_search_slow_result(f_search_result* res, void* payload)
+{
+  usleep(5000);
+  f_search_result_free(res);
+}
+
+TEST test_f_search_deadline(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars|box|of",
+    .index = index,
+    .threads = 1,
+    .result_limit = 100,
+    .line_buffer = 1u,
+    .result_batch = 1,
+    .on_result = test_f_search_slow_result,
+    .timeout_ms = 1
+  };
+
+  errno = 0;
+  ASSERT_EQ_FMT(F_CANCELLED, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(ETIMEDOUT, errno, "%d");
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_handle(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars|box|of",
+    .index = index,
+    .threads = 3,
+    .result_limit = 100,
+    .line_buffer = 2u,
+    .ordered = true,
+    .reorder_window = 1
+  };
+
+  f_search_handle* handle;
+  ASSERT_EQ_FMT(0, f_index_search_start(&handle, searcher), "%d");
+  ASSERT_EQ_FMT(0, f_search_handle_wait(handle), "%d");
+
+  double progress;
+  ASSERT(f_search_handle_poll(handle, &progress));
+
+  size_t lines[5];
+  int len = 0;
+  f_search_batch* batch;
+  while (f_search_handle_next_batch(&batch, handle) == 0 && batch != NULL)
+  {
+    for (unsigned int i=0; i<batch->len && len<5; i++)
+    {
+      lines[len++] = batch->results[i]->line_number;
+    }
+    f_search_batch_free(batch);
+  }
+
+  ASSERT_EQ_FMT(5, len, "%d");
+  ASSERT_EQ_FMT(1ul, lines[0], "%zu");
+  ASSERT_EQ_FMT(3ul, lines[1], "%zu");
+  ASSERT_EQ_FMT(9ul, lines[4], "%zu");
+
+  f_search_handle_free(&handle);
+  ASSERT_EQ(NULL, handle);
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_search_handle_free_running(void)
+{
+  f_index* index = get_index();
+
+  f_searcher searcher = {
+    .regex = "cars",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 1u,
+    .ordered = true,
+    .reorder_window = 1
+  };
+
+  // nothing takes the batches, so the threads fill the window and wait.
+  f_search_handle* handle;
+  ASSERT_EQ_FMT(0, f_index_search_start(&handle, searcher), "%d");
+  f_search_handle_free(&handle);
+  ASSERT_EQ(NULL, handle);
+
+  f_index_free(&index);
+  PASS();
+}
+
 SUITE(f_search_suite)
 {
   RUN_TEST(test_f_search_invalid_regex);
+  RUN_TEST(test_f_search_invalid_line_buffer);
   RUN_TEST(test_f_search);
+  RUN_TEST(test_f_search_single_consumer);
+  RUN_TEST(test_f_search_concurrent);
+  RUN_TESTp(test_f_search_ordered, false);
+  RUN_TESTp(test_f_search_ordered, true);
+  RUN_TEST(test_f_search_ordered_all);
+  RUN_TEST(test_f_search_range);
+  RUN_TESTp(test_f_search_reverse, 1);
+  RUN_TESTp(test_f_search_reverse, 100);
+  RUN_TESTp(test_f_search_context, false);
+  RUN_TESTp(test_f_search_context, true);
+  RUN_TEST(test_f_search_count);
+  RUN_TEST(test_f_search_bitmap);
+  RUN_TEST(test_f_search_cancelled);
+  RUN_TEST(test_f_search_cancelled_single_consumer);
+  RUN_TEST(test_f_search_deadline);
+  RUN_TEST(test_f_search_handle);
+  RUN_TEST(test_f_search_handle_free_running);
 }
\ No newline at end of file
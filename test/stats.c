@@ -0,0 +1,111 @@
+static uint64_t stats_latency_reads(f_stats* stats)
+{
+  uint64_t reads = 0;
+  for (int i=0; i<F_STATS_BUCKETS; i++)
+  {
+    reads += atomic_load(&stats->read_latency[i]);
+  }
+  return reads;
+}
+
+static uint64_t stats_thread_ns(f_stats* stats)
+{
+  uint64_t total = 0;
+  for (int i=0; i<F_STATS_THREADS; i++)
+  {
+    total += atomic_load(&stats->busy_ns[i]) + atomic_load(&stats->idle_ns[i]);
+  }
+  return total;
+}
+
+TEST test_f_stats_indexer(void)
+{
+  f_stats stats;
+  f_stats_init(&stats);
+
+  f_indexer config = {
+    .filename = "test/zfixtures/search.txt",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 16,
+    .concurrency = 2,
+    .threads = 2,
+    .max_bytes_per_iteration = 48,
+    .stats = &stats
+  };
+
+  f_index* index = f_index_text_file(config);
+  if (index == NULL) FAIL();
+
+  // every byte of the target is read once, over several iterations.
+  ASSERT_EQ_FMT(94ull, atomic_load(&stats.bytes_read), "%llu");
+  ASSERT(atomic_load(&stats.reads) > 0);
+  ASSERT_EQ_FMT(atomic_load(&stats.reads), (unsigned long long) stats_latency_reads(&stats), "%llu");
+  ASSERT_EQ_FMT((unsigned long long) f_index_line_count(index), atomic_load(&stats.lines), "%llu");
+  ASSERT(atomic_load(&stats.scan_ns) > 0);
+  ASSERT(atomic_load(&stats.merge_ns) > 0);
+  ASSERT(stats_thread_ns(&stats) > 0);
+  ASSERT_EQ(2, stats.threads);
+  ASSERT(stats.elapsed_ns > 0);
+  ASSERT(stats.lines_per_sec > 0.0);
+  ASSERT(stats.peak_rss > 0);
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_stats_search(void)
+{
+  f_index* index = get_index();
+  if (index == NULL) FAIL();
+
+  f_stats stats;
+  f_stats_init(&stats);
+
+  f_searcher searcher = {
+    .regex = "cars|box",
+    .index = index,
+    .threads = 3,
+    .line_buffer = 2u,
+    .stats = &stats
+  };
+
+  size_t count;
+  ASSERT_EQ(0, f_index_search_count(searcher, &count));
+  ASSERT_EQ_FMT((unsigned long long) count, atomic_load(&stats.matches), "%llu");
+  ASSERT_EQ_FMT((unsigned long long) f_index_line_count(index), atomic_load(&stats.lines), "%llu");
+  ASSERT(atomic_load(&stats.reads) > 0);
+  ASSERT(atomic_load(&stats.bytes_read) > 0);
+  ASSERT(atomic_load(&stats.match_ns) > 0);
+  ASSERT_EQ(0u, atomic_load(&stats.scan_ns));
+  ASSERT(stats_thread_ns(&stats) > 0);
+  ASSERT_EQ(3, stats.threads);
+  ASSERT(stats.elapsed_ns > 0);
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_stats_unused(void)
+{
+  // nothing is measured without stats.
+  f_stats_read(NULL, 10, f_stats_now());
+  f_stats_add(NULL, F_STATS_LINES, 1);
+  ASSERT_EQ(0u, f_stats_since(NULL, F_STATS_SCAN, 0));
+  f_stats_thread(NULL, 0, 0, 0);
+  f_stats_finish(NULL, 0, 1);
+
+  f_stats stats;
+  f_stats_init(&stats);
+  f_stats_read(&stats, 10, f_stats_now());
+  f_stats_thread(&stats, F_STATS_THREADS + 3, f_stats_now(), 0);
+  ASSERT_EQ(10u, atomic_load(&stats.bytes_read));
+  ASSERT_EQ(1u, atomic_load(&stats.read_latency[0]) + atomic_load(&stats.read_latency[1]));
+  PASS();
+}
+
+SUITE(f_stats_suite)
+{
+  RUN_TEST(test_f_stats_indexer);
+  RUN_TEST(test_f_stats_search);
+  RUN_TEST(test_f_stats_unused);
+}
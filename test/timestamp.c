@@ -0,0 +1,108 @@
+#define F_TIMESTAMP_FORMAT "%Y-%m-%dT%H:%M:%S.%f%z"
+
+f_index* get_time_index(char* time_format, char* time_regex)
+{
+  f_indexer config = {
+    .filename = "test/zfixtures/times.txt",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 400000,
+    .concurrency = 50,
+    .threads = 3,
+    .max_bytes_per_iteration = 500000,
+    .time_format = time_format,
+    .time_regex = time_regex,
+    .time_every = 4
+  };
+
+  return f_index_text_file(config);
+}
+
+static int64_t get_time(const char* text)
+{
+  int64_t time = 0;
+  f_timestamp_parse(&time, text, strlen(text), F_TIMESTAMP_FORMAT);
+  return time;
+}
+
+TEST test_f_timestamp_parse(void)
+{
+  int64_t time;
+  const char* text = "2024-03-01T10:00:01.25Z boot";
+  ASSERT_EQ(0, f_timestamp_parse(&time, text, strlen(text), F_TIMESTAMP_FORMAT));
+  ASSERT_EQ_FMT(1709287201250l, (long) time, "%ld");
+
+  text = "2024-03-01 12:00:00 +02:00";
+  ASSERT_EQ(0, f_timestamp_parse(&time, text, strlen(text), "%Y-%m-%d %H:%M:%S %z"));
+  ASSERT_EQ_FMT(1709287200000l, (long) time, "%ld");
+
+  // syslog has no year and pads the day with a space.
+  text = "Mar  1 10:00:00 host app: boot";
+  ASSERT_EQ(0, f_timestamp_parse(&time, text, strlen(text), "%b %e %H:%M:%S"));
+  ASSERT_EQ_FMT((long) (59 * 86400 + 36000) * 1000, (long) time, "%ld");
+
+  text = "31/Dec/99:23:59:59";
+  ASSERT_EQ(0, f_timestamp_parse(&time, text, strlen(text), "%d/%b/%y:%H:%M:%S"));
+  ASSERT_EQ_FMT(946684799000l, (long) time, "%ld");
+
+  text = "1709287200.5";
+  ASSERT_EQ(0, f_timestamp_parse(&time, text, strlen(text), "%s.%f"));
+  ASSERT_EQ_FMT(1709287200500l, (long) time, "%ld");
+
+  text = "  from /etc/app.conf";
+  ASSERT_EQ(-1, f_timestamp_parse(&time, text, strlen(text), F_TIMESTAMP_FORMAT));
+  text = "2024-13-01T10:00:00.000Z";
+  ASSERT_EQ(-1, f_timestamp_parse(&time, text, strlen(text), F_TIMESTAMP_FORMAT));
+  text = "2024-03-01 12:00:00 +x";
+  ASSERT_EQ(-1, f_timestamp_parse(&time, text, strlen(text), "%Y-%m-%d %H:%M:%S %z"));
+  PASS();
+}
+
+TEST test_f_index_seek_time(char* time_regex)
+{
+  f_index* index = get_time_index(F_TIMESTAMP_FORMAT, time_regex);
+  if (index == NULL) FAIL();
+  ASSERT(index->times != NULL);
+  ASSERT_EQ_FMT(5ul, index->times->len, "%zu");
+  ASSERT_EQ_FMT(get_time("2024-03-01T10:01:00.000Z"), index->times->times[1], "%ld");
+
+  // lines 10 and 11, the block before is read for the lines ahead of the sample at 10:08.
+  size_t start_line, end_line;
+  ASSERT_EQ(0, f_index_seek_time(index, get_time("2024-03-01T10:04:30.000Z"), get_time("2024-03-01T10:06:00.000Z"), &start_line, &end_line));
+  ASSERT_EQ_FMT(5ul, start_line, "%zu");
+  ASSERT_EQ_FMT(16ul, end_line, "%zu");
+
+  // the out of order line 6 is in range.
+  ASSERT_EQ(0, f_index_seek_time(index, get_time("2024-03-01T10:00:59.000Z"), get_time("2024-03-01T10:00:59.900Z"), &start_line, &end_line));
+  ASSERT(start_line <= 6 && end_line >= 6);
+
+  // the last block can have lines after its sample.
+  ASSERT_EQ(0, f_index_seek_time(index, get_time("2024-03-01T11:00:00.000Z"), get_time("2024-03-01T12:00:00.000Z"), &start_line, &end_line));
+  ASSERT_EQ_FMT(17ul, end_line, "%zu");
+
+  ASSERT_EQ(1, f_index_seek_time(index, get_time("2024-03-01T09:00:00.000Z"), get_time("2024-03-01T09:30:00.000Z"), &start_line, &end_line));
+  ASSERT_EQ(-1, f_index_seek_time(index, 2, 1, &start_line, &end_line));
+
+  f_index_free(&index);
+  PASS();
+}
+
+TEST test_f_index_seek_time_none(void)
+{
+  f_index* index = get_time_index(NULL, NULL);
+  if (index == NULL) FAIL();
+  ASSERT_EQ(NULL, index->times);
+
+  size_t start_line, end_line;
+  ASSERT_EQ(-2, f_index_seek_time(index, 0, 1, &start_line, &end_line));
+
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_timestamp_suite)
+{
+  RUN_TEST(test_f_timestamp_parse);
+  RUN_TESTp(test_f_index_seek_time, NULL);
+  RUN_TESTp(test_f_index_seek_time, "^(\\S+) ");
+  RUN_TEST(test_f_index_seek_time_none);
+}
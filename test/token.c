@@ -0,0 +1,69 @@
+f_index* get_token_index(enum F_TOKENIZER tokenizer)
+{
+  f_indexer config = {
+    .filename = "test/zfixtures/search.txt",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 400000,
+    .concurrency = 50,
+    .threads = 3,
+    .max_bytes_per_iteration = 500000,
+    .tokenizer = tokenizer
+  };
+
+  return f_index_text_file(config);
+}
+
+TEST test_f_token_lookup(enum F_TOKENIZER tokenizer)
+{
+  f_index* index = get_token_index(tokenizer);
+  if (index == NULL) FAIL();
+  ASSERT(index->tokens != NULL);
+
+  f_bitmap* lines;
+  ASSERT_EQ(0, f_index_token_lookup(&lines, index, "cars"));
+
+  // whitespace keeps "cars?" as its own token.
+  bool punctuation = tokenizer == F_TOKENIZER_PUNCTUATION;
+  ASSERT_EQ_FMT(punctuation ? 3ul : 2ul, lines->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(lines, 3));
+  ASSERT_EQ(punctuation, f_bitmap_contains(lines, 4));
+  ASSERT(f_bitmap_contains(lines, 9));
+  f_bitmap_free(&lines);
+
+  // every token of the term.
+  ASSERT_EQ(0, f_index_token_lookup(&lines, index, "the box"));
+  ASSERT_EQ_FMT(2ul, lines->cardinality, "%zu");
+  ASSERT(f_bitmap_contains(lines, 1));
+  ASSERT(f_bitmap_contains(lines, 3));
+  f_bitmap_free(&lines);
+
+  ASSERT_EQ(0, f_index_token_lookup(&lines, index, "trucks"));
+  ASSERT_EQ_FMT(0ul, lines->cardinality, "%zu");
+  f_bitmap_free(&lines);
+
+  char* path = strdup(index->tokens->path);
+  f_index_free(&index);
+  ASSERT_EQ(-1, access(path, F_OK));
+  free(path);
+  PASS();
+}
+
+TEST test_f_token_none(void)
+{
+  f_index* index = get_token_index(F_TOKENIZER_NONE);
+  if (index == NULL) FAIL();
+  ASSERT_EQ(NULL, index->tokens);
+
+  f_bitmap* lines;
+  ASSERT_EQ(-2, f_index_token_lookup(&lines, index, "cars"));
+
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_token_suite)
+{
+  RUN_TESTp(test_f_token_lookup, F_TOKENIZER_WHITESPACE);
+  RUN_TESTp(test_f_token_lookup, F_TOKENIZER_PUNCTUATION);
+  RUN_TEST(test_f_token_none);
+}
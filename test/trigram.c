@@ -0,0 +1,122 @@
+f_index* get_trigram_index(void)
+{
+  f_indexer config = {
+    .filename = "test/zfixtures/search.txt",
+    .lookup_dir = ".flashlight",
+    .buffer_size = 400000,
+    .concurrency = 50,
+    .threads = 3,
+    .max_bytes_per_iteration = 500000,
+    .trigram_block = 2
+  };
+
+  return f_index_text_file(config);
+}
+
+TEST test_f_trigram_query(void)
+{
+  f_trigram_query* query;
+
+  if (f_trigram_query_init(&query, "cars") == -1) FAIL();
+  ASSERT_EQ_FMT(1ul, query->branches, "%zu");
+  ASSERT_EQ_FMT(2ul, query->branch_len[0], "%zu");
+  f_trigram_query_free(&query);
+
+  if (f_trigram_query_init(&query, "cars|box") == -1) FAIL();
+  ASSERT_EQ_FMT(2ul, query->branches, "%zu");
+  ASSERT_EQ_FMT(1ul, query->branch_len[1], "%zu");
+  f_trigram_query_free(&query);
+
+  // "foo" and "bar.abc", the class and repeat split them and "d" is optional.
+  if (f_trigram_query_init(&query, "foo[0-9]+bar\\.abcd?") == -1) FAIL();
+  ASSERT_EQ_FMT(1ul, query->branches, "%zu");
+  ASSERT_EQ_FMT(6ul, query->branch_len[0], "%zu");
+  f_trigram_query_free(&query);
+
+  // nothing every match has to contain.
+  char* patterns[] = { "ca.s", "(?i)cars", "cars|b", "x+yz", "(cars)" };
+  for (int i=0; i<5; i++)
+  {
+    if (f_trigram_query_init(&query, patterns[i]) == -1) FAIL();
+    ASSERT_EQm(patterns[i], NULL, query);
+  }
+
+  PASS();
+}
+
+TEST test_f_trigram_index(void)
+{
+  f_index* index = get_trigram_index();
+  if (index == NULL) FAIL();
+  ASSERT(index->trigrams != NULL);
+  ASSERT_EQ_FMT(5ul, index->trigrams->block_count, "%zu");
+
+  char* path = strdup(index->trigrams->path);
+  ASSERT_EQ(0, access(path, F_OK));
+
+  f_trigram_query* query;
+  if (f_trigram_query_init(&query, "cars") == -1) FAIL();
+
+  // "cars" is on lines 3, 4 and 9.
+  ASSERT_FALSE(f_trigram_index_maybe(index->trigrams, query, 0));
+  ASSERT(f_trigram_index_maybe(index->trigrams, query, 1));
+  ASSERT_FALSE(f_trigram_index_maybe(index->trigrams, query, 2));
+  ASSERT_FALSE(f_trigram_index_maybe(index->trigrams, query, 3));
+  ASSERT(f_trigram_index_maybe(index->trigrams, query, 4));
+
+  f_trigram_query_free(&query);
+
+  // blocks need lines, and building needs a thread.
+  f_trigram_index* invalid;
+  ASSERT_EQ(-1, f_trigram_index_build(&invalid, index, strdup(".flashlight/invalid.tri"), 0, 0, 1, NULL));
+  ASSERT_EQ(-1, f_trigram_index_build(&invalid, index, strdup(".flashlight/invalid.tri"), 2, 0, 0, NULL));
+  ASSERT_EQ(-1, access(".flashlight/invalid.tri", F_OK));
+  f_index_free(&index);
+
+  // the trigram index goes with the lookup.
+  ASSERT_EQ(-1, access(path, F_OK));
+  free(path);
+  PASS();
+}
+
+TEST test_f_trigram_search(bool reverse)
+{
+  f_index* index = get_trigram_index();
+  if (index == NULL) FAIL();
+  test_ordered_results results = { .len = 0, .ascending = true };
+
+  f_searcher searcher = {
+    .regex = "cars|developer",
+    .index = index,
+    .threads = 2,
+    .result_limit = 100,
+    .line_buffer = 3u,
+    .on_result = test_f_search_ordered_result,
+    .result_payload = &results,
+    .ordered = true,
+    .reverse = reverse
+  };
+
+  ASSERT_EQ_FMT(0, f_index_search(searcher), "%d");
+  ASSERT_EQ_FMT(4, results.len, "%d");
+  ASSERT_EQ_FMT(reverse ? 9ul : 3ul, results.lines[0], "%zu");
+  ASSERT_EQ_FMT(reverse ? 6ul : 4ul, results.lines[1], "%zu");
+  ASSERT_EQ_FMT(reverse ? 4ul : 6ul, results.lines[2], "%zu");
+  ASSERT_EQ_FMT(reverse ? 3ul : 9ul, results.lines[3], "%zu");
+
+  size_t count;
+  searcher.regex = "cars";
+  ASSERT_EQ_FMT(0, f_index_search_count(searcher, &count), "%d");
+  ASSERT_EQ_FMT(3ul, count, "%zu");
+
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_trigram_suite)
+{
+  RUN_TEST(test_f_trigram_query);
+  RUN_TEST(test_f_trigram_index);
+  RUN_TESTp(test_f_trigram_search, false);
+  RUN_TESTp(test_f_trigram_search, true);
+}
@@ -0,0 +1,129 @@
+static f_tune_probe tune_probe(enum F_DEVICE device, int cores)
+{
+  f_tune_probe probe = {
+    .device = device,
+    .cores = cores,
+    .block_size = 4096,
+    .queue_depth = 0,
+    .optimal_io = 0,
+    .read_ns = 0,
+    .read_mb_per_sec = 0.0,
+    .available_memory = 0
+  };
+  return probe;
+}
+
+TEST test_f_tune_indexer(void)
+{
+  size_t gb = 1ul << 30;
+
+  // spinning disks get few readers and big buffers.
+  f_indexer config = { .filename = "target" };
+  f_tune_probe probe = tune_probe(F_DEVICE_ROTATIONAL, 16);
+  f_tune_indexer(&config, &probe, 10 * gb);
+  ASSERT_EQ(2, config.threads);
+  ASSERT_EQ(2, config.concurrency);
+  ASSERT_EQ_FMT((size_t) 8u << 20, config.buffer_size, "%zu");
+  ASSERT_EQ_FMT((size_t) F_TUNE_ITERATION_MAX, config.max_bytes_per_iteration, "%zu");
+
+  // the record ends of an iteration fit in a share of the free memory.
+  f_indexer tight = { .filename = "target" };
+  probe.available_memory = 256ul << 20;
+  f_tune_indexer(&tight, &probe, 10 * gb);
+  ASSERT_EQ_FMT((size_t) 16u << 20, tight.max_bytes_per_iteration, "%zu");
+
+  // solid state drives spread their queue over every core.
+  f_indexer solid = { .filename = "target" };
+  probe = tune_probe(F_DEVICE_SOLID, 8);
+  probe.queue_depth = 64;
+  f_tune_indexer(&solid, &probe, 10 * gb);
+  ASSERT_EQ(8, solid.threads);
+  ASSERT_EQ(8, solid.concurrency);
+  ASSERT_EQ_FMT((size_t) 1u << 20, solid.buffer_size, "%zu");
+
+  // slow reads get bigger buffers, given values are kept.
+  f_indexer network = { .filename = "target", .threads = 3 };
+  probe = tune_probe(F_DEVICE_NETWORK, 16);
+  probe.read_ns = F_TUNE_SLOW_NS * 2;
+  f_tune_indexer(&network, &probe, 10 * gb);
+  ASSERT_EQ(3, network.threads);
+  ASSERT_EQ(8, network.concurrency);
+  ASSERT_EQ_FMT((size_t) 4u << 20, network.buffer_size, "%zu");
+
+  // small targets aren't split in more buffers than there are bytes.
+  f_indexer small = { .filename = "target" };
+  probe = tune_probe(F_DEVICE_MEMORY, 16);
+  f_tune_indexer(&small, &probe, 100000);
+  ASSERT_EQ_FMT((size_t) F_TUNE_BUFFER_MIN, small.buffer_size, "%zu");
+  ASSERT_EQ(2, small.threads);
+
+  // adaptive runs are split so there is something to adapt on.
+  f_indexer adaptive = { .filename = "target", .adaptive = true };
+  f_tune_indexer(&adaptive, &probe, gb);
+  ASSERT_EQ_FMT((size_t) gb / F_TUNE_ADAPT_ITERATIONS, adaptive.max_bytes_per_iteration, "%zu");
+  PASS();
+}
+
+TEST test_f_tune_adapt(void)
+{
+  f_tune_adapt adapt;
+  size_t mb = 1u << 20;
+  size_t next;
+
+  // doubling while it helps, then back to the best size.
+  f_tune_adapt_init(&adapt, mb, 4096);
+  next = f_tune_adapt_next(&adapt, 100 * mb, 1000);
+  ASSERT_EQ_FMT(2 * mb, next, "%zu");
+  next = f_tune_adapt_next(&adapt, 100 * mb, 500);
+  ASSERT_EQ_FMT(4 * mb, next, "%zu");
+  // within the noise isn't better.
+  next = f_tune_adapt_next(&adapt, 100 * mb, 490);
+  ASSERT_EQ_FMT(2 * mb, next, "%zu");
+  ASSERT(adapt.settled);
+  next = f_tune_adapt_next(&adapt, 100 * mb, 1);
+  ASSERT_EQ_FMT(2 * mb, next, "%zu");
+
+  // growing is worse, shrinking is tried instead.
+  f_tune_adapt_init(&adapt, mb, 4096);
+  next = f_tune_adapt_next(&adapt, 100 * mb, 1000);
+  ASSERT_EQ_FMT(2 * mb, next, "%zu");
+  next = f_tune_adapt_next(&adapt, 100 * mb, 2000);
+  ASSERT_EQ_FMT(mb / 2, next, "%zu");
+  next = f_tune_adapt_next(&adapt, 100 * mb, 500);
+  ASSERT_EQ_FMT(mb / 4, next, "%zu");
+  next = f_tune_adapt_next(&adapt, 100 * mb, 600);
+  ASSERT_EQ_FMT(mb / 2, next, "%zu");
+  ASSERT(adapt.settled);
+  PASS();
+}
+
+TEST test_f_tune_auto(void)
+{
+  int fd = open(FIXTURE_WORDS, O_RDONLY);
+  ASSERT(fd != -1);
+  f_tune_probe probe;
+  ASSERT_EQ(0, f_tune_probe_fd(&probe, fd, 0));
+  ASSERT(probe.cores > 0);
+  ASSERT(probe.block_size > 0);
+  close(fd);
+
+  // nothing given, everything picked.
+  f_indexer config = {
+    .filename = FIXTURE_WORDS,
+    .lookup_dir = ".flashlight",
+    .adaptive = true
+  };
+
+  f_index* index = f_index_text_file(config);
+  if (index == NULL) FAIL();
+  ASSERT_EQ_FMT(fixture_words_lines, f_index_line_count(index), "%zu");
+  f_index_free(&index);
+  PASS();
+}
+
+SUITE(f_tune_suite)
+{
+  RUN_TEST(test_f_tune_indexer);
+  RUN_TEST(test_f_tune_adapt);
+  RUN_TEST(test_f_tune_auto);
+}
@@ -1,5 +1,13 @@
 add_rules("mode.debug", "mode.release", "mode.valgrind")
 
+-- cpu sets for the runtime's affinity.
+add_defines("_GNU_SOURCE")
+
+-- release builds compile out debug and fine log messages.
+if is_mode("release") then
+  add_defines("NDEBUG")
+end
+
 package("libdill")
   add_deps("make")
   add_urls("https://github.com/sustrik/libdill.git")
@@ -15,7 +23,7 @@ package_end()
 target("test")
   set_kind("binary")
   add_files("test/flashlight.c")
-  add_packages("libdill", "pthread", "pcre2")
+  add_packages("libdill", "pthread", "pcre2", "zlib", "zstd")
   add_cflags("-Wall -Werror")
   after_build(function (target)
     os.exec("./%s", target:targetfile())
@@ -26,18 +34,29 @@ target("leaks")
   set_kind("binary")
   add_cflags("-g", "-O2", "-DDEBUG")
   add_files("test/bin.c")
-  add_packages("libdill", "pthread",  "pcre2", "valgrind")
+  add_packages("libdill", "pthread",  "pcre2", "zlib", "zstd", "valgrind")
   after_build(function (target)
     os.exec("valgrind --show-leak-kinds=all --track-origins=yes --leak-check=full %s", target:targetfile())
   end)
 target_end()
 
-add_requires("pthread", "pcre2", "libdill")
+-- xmake run bench -- --help
+target("bench")
+  set_kind("binary")
+  set_default(false)
+  set_optimize("fastest")
+  add_defines("NDEBUG")
+  add_files("bench/bench.c")
+  add_packages("libdill", "pthread", "pcre2", "zlib", "zstd")
+  add_cflags("-Wall -Werror")
+target_end()
+
+add_requires("pthread", "pcre2", "libdill", "zlib", "zstd")
 
 target("flashlight")
   set_kind("$(kind)")
   add_ldflags("-ldill")
   add_files("src/flashlight.c")
   add_headerfiles("src/flashlight.h")
-  add_packages("pthread",  "pcre2", "libdill")
+  add_packages("pthread",  "pcre2", "libdill", "zlib", "zstd")
 target_end()